@@ -0,0 +1,161 @@
+"""
+Roofline plots of benchmark results.
+
+Reads a dataset written by `bench --roofline PATH`, with ceilings from the
+machine profile given by `--profile`, and plots each result's FLOP rate
+against its arithmetic intensity, under the machine's bandwidth and FLOP rate
+ceilings.
+
+    python -m perf.roofline roofline.json --output roofline.png
+"""
+
+#-------------------------------------------------------------------------------
+
+import argparse
+import json
+
+#-------------------------------------------------------------------------------
+
+def load(path):
+    with open(path) as file:
+        return json.load(file)
+
+
+def ceilings(data, threads):
+    """
+    Returns bandwidth and FLOP rate ceilings for `threads`.
+
+    Returns `(bandwidths, flop_rate)`, where `bandwidths` is a list of
+    `(size, bytes/s)` for the best kernel at each profiled working set size,
+    and `flop_rate` is FLOP/s or None.  Uses the most profiled threads up to
+    `threads`.
+    """
+    def choose(points):
+        counts = sorted({ p["threads"] for p in points })
+        below = [ t for t in counts if t <= threads ]
+        return below[-1] if below else counts[0] if counts else None
+
+    bandwidth = data.get("bandwidth", [])
+    t = choose(bandwidth)
+    bandwidths = sorted(
+        (p["size"], p["value"]) for p in bandwidth if p["threads"] == t)
+
+    flop_rate = data.get("flop_rate", [])
+    t = choose(flop_rate)
+    flop_rate = max(
+        (p["value"] for p in flop_rate if p["threads"] == t), default=None)
+
+    return bandwidths, flop_rate
+
+
+def roof(intensity, bandwidth, flop_rate):
+    """
+    Returns the attainable FLOP rate at `intensity`.
+    """
+    attainable = intensity * bandwidth
+    return attainable if flop_rate is None else min(attainable, flop_rate)
+
+
+def label(point):
+    params = " ".join( "{}={}".format(k, v) for k, v in point["params"].items() )
+    return "{} {}".format(point["name"], params).strip()
+
+
+def summarize(data):
+    """
+    Prints each point, and its FLOP rate as a fraction of its roof.
+    """
+    for point in data["points"]:
+        bandwidths, flop_rate = ceilings(data, point["threads"])
+        bandwidth = point.get("peak_bandwidth")
+        fraction = (
+            "" if bandwidth is None
+            else "{:4.0f}% of roof".format(
+                100 * point["flop_rate"]
+                / roof(point["intensity"], bandwidth, flop_rate)))
+        print("{:48s} AI {:8.3f}  {:8.2f} GFLOP/s  {:8.2f} GB/s  {}".format(
+            label(point), point["intensity"], point["flop_rate"] * 1e-9,
+            point["bandwidth"] * 1e-9, fraction))
+
+
+def plot(data, threads=1, ax=None):
+    """
+    Plots a roofline for `threads`, and the points with that many threads.
+    """
+    import matplotlib.pyplot as plt
+    if ax is None:
+        _, ax = plt.subplots(figsize=(10, 7))
+
+    points = [ p for p in data["points"] if p["threads"] == threads ]
+    bandwidths, flop_rate = ceilings(data, threads)
+    intensities = [ p["intensity"] for p in points ]
+    lo = min(intensities + [1 / 64]) / 2
+    hi = max(intensities + [64]) * 2
+    xs = [ lo * (hi / lo) ** (i / 99) for i in range(100) ]
+
+    # The fastest (innermost cache) and slowest (main memory) bandwidths.
+    if bandwidths:
+        for (size, bandwidth), style in (
+                (max(bandwidths, key=lambda b: b[1]), "-"),
+                (bandwidths[-1], "--")):
+            ax.plot(
+                xs, [ roof(x, bandwidth, flop_rate) * 1e-9 for x in xs ],
+                "k" + style, linewidth=1,
+                label="{:.1f} GB/s ({} B working set)".format(
+                    bandwidth * 1e-9, size))
+    if flop_rate is not None:
+        ax.axhline(
+            flop_rate * 1e-9, color="k", linestyle=":", linewidth=1,
+            label="{:.1f} GFLOP/s".format(flop_rate * 1e-9))
+
+    for point in points:
+        ax.plot(point["intensity"], point["flop_rate"] * 1e-9, "o")
+        ax.annotate(
+            label(point), (point["intensity"], point["flop_rate"] * 1e-9),
+            fontsize=7, xytext=(4, 2), textcoords="offset points")
+
+    ax.set_xscale("log")
+    ax.set_yscale("log")
+    ax.set_xlabel("arithmetic intensity (FLOP/byte)")
+    ax.set_ylabel("GFLOP/s")
+    ax.set_title("{} threads={}".format(data.get("cpu", ""), threads).strip())
+    ax.legend(loc="lower right", fontsize=8)
+    return ax
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Plots a roofline dataset.")
+    parser.add_argument(
+        "path", metavar="PATH",
+        help="dataset from bench --roofline")
+    parser.add_argument(
+        "--threads", metavar="NUM", type=int, default=1,
+        help="plot points with NUM threads [1]")
+    parser.add_argument(
+        "--output", metavar="FILE", default=None,
+        help="save plot to FILE, instead of showing it")
+    parser.add_argument(
+        "--text", action="store_true", default=False,
+        help="print points instead of plotting")
+    args = parser.parse_args()
+
+    data = load(args.path)
+    if args.text:
+        summarize(data)
+        return
+
+    import matplotlib
+    if args.output is not None:
+        matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+    plot(data, args.threads)
+    if args.output is None:
+        plt.show()
+    else:
+        plt.savefig(args.output, dpi=150, bbox_inches="tight")
+
+
+if __name__ == "__main__":
+    main()
+
+
@@ -0,0 +1,114 @@
+"""
+Thread scaling plots of benchmark results.
+
+Reads results of `bench --scaling THREADS --format json`, and plots speedup
+and efficiency against threads for each kernel, with a curve per placement.
+
+    python -m perf.scaling scaling.json --output scaling.png
+"""
+
+#-------------------------------------------------------------------------------
+
+import argparse
+import collections
+import json
+
+#-------------------------------------------------------------------------------
+
+def load(path):
+    with open(path) as file:
+        return json.load(file)
+
+
+def curves(results):
+    """
+    Groups results into curves.
+
+    Returns a mapping from kernel label to a mapping from placement to a list
+    of `(threads, speedup, efficiency)`, in thread order.
+    """
+    groups = collections.defaultdict(lambda: collections.defaultdict(list))
+    for result in results:
+        params = " ".join(
+            "{}={}".format(k, v) for k, v in result["params"].items()
+            if k != "threads")
+        label = "{} {}".format(result["name"], params).strip()
+        groups[label][result["placement"]].append(
+            (result["threads"], result["speedup"], result["efficiency"]))
+    return {
+        label: { p: sorted(c) for p, c in placements.items() }
+        for label, placements in groups.items()
+    }
+
+
+def summarize(results):
+    for label, placements in curves(results).items():
+        print(label)
+        for placement, curve in placements.items():
+            print("  {:8s} ".format(placement) + "  ".join(
+                "{}:{:.2f}x/{:.0f}%".format(t, s or 0, 100 * (e or 0))
+                for t, s, e in curve))
+
+
+def plot(results):
+    """
+    Plots speedup and efficiency for each kernel, one row per kernel.
+    """
+    import matplotlib.pyplot as plt
+    groups = curves(results)
+    fig, axes = plt.subplots(
+        len(groups), 2, figsize=(10, 3.5 * len(groups)), squeeze=False)
+    for (label, placements), (ax0, ax1) in zip(groups.items(), axes):
+        max_threads = 1
+        for placement, curve in placements.items():
+            threads, speedups, efficiencies = zip(*curve)
+            max_threads = max(max_threads, max(threads))
+            ax0.plot(threads, speedups, "o-", label=placement)
+            ax1.plot(
+                threads, [ 100 * (e or 0) for e in efficiencies ], "o-",
+                label=placement)
+        ax0.plot([1, max_threads], [1, max_threads], "k:", linewidth=1)
+        ax0.set_title(label, fontsize=9)
+        ax0.set_xlabel("threads")
+        ax0.set_ylabel("speedup")
+        ax0.legend(fontsize=8)
+        ax1.set_xlabel("threads")
+        ax1.set_ylabel("efficiency (%)")
+        ax1.set_ylim(0, 110)
+    fig.tight_layout()
+    return fig
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Plots thread scaling.")
+    parser.add_argument(
+        "path", metavar="PATH",
+        help="results from bench --scaling --format json")
+    parser.add_argument(
+        "--output", metavar="FILE", default=None,
+        help="save plot to FILE, instead of showing it")
+    parser.add_argument(
+        "--text", action="store_true", default=False,
+        help="print curves instead of plotting")
+    args = parser.parse_args()
+
+    results = load(args.path)
+    if args.text:
+        summarize(results)
+        return
+
+    import matplotlib
+    if args.output is not None:
+        matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+    plot(results)
+    if args.output is None:
+        plt.show()
+    else:
+        plt.savefig(args.output, dpi=150, bbox_inches="tight")
+
+
+if __name__ == "__main__":
+    main()
+
+
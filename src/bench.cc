@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "bench.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+std::vector<Benchmark>&
+benchmarks()
+{
+  // Constructed on first use, as registration happens during static init.
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+
+size_t
+register_benchmark(
+  std::string const& name,
+  std::vector<Axis> axes,
+  SetupFn setup,
+  std::vector<CacheState> caches)
+{
+  auto& all = benchmarks();
+  all.push_back({name, std::move(axes), std::move(setup), std::move(caches)});
+  return all.size() - 1;
+}
+
+
+std::vector<long>
+pow2_range(
+  int const lo,
+  int const hi,
+  int const step)
+{
+  std::vector<long> values;
+  for (int i = lo; i <= hi; i += step)
+    values.push_back(1l << i);
+  return values;
+}
+
+
+std::vector<long>
+parse_axis_values(
+  std::string const& str)
+{
+  std::vector<long> values;
+  size_t start = 0;
+  while (start <= str.size()) {
+    auto end = str.find(',', start);
+    if (end == std::string::npos)
+      end = str.size();
+    auto const item = str.substr(start, end - start);
+    auto const dots = item.find("..");
+    if (dots == std::string::npos)
+      values.push_back(parse_size(item));
+    else {
+      auto const lo = parse_size(item.substr(0, dots));
+      auto const hi = parse_size(item.substr(dots + 2));
+      if (lo < 1)
+        throw std::invalid_argument("bad range: "s + item);
+      for (long v = lo; v <= hi; v *= 2)
+        values.push_back(v);
+    }
+    start = end + 1;
+  }
+  return values;
+}
+
+
+std::vector<Params>
+expand(
+  std::vector<Axis> const& axes)
+{
+  std::vector<Params> all{{}};
+  for (auto const& axis : axes) {
+    std::vector<Params> next;
+    for (auto const& params : all)
+      for (auto const val : axis.values) {
+        next.push_back(params);
+        next.back()[axis.name] = val;
+      }
+    all = std::move(next);
+  }
+  return all;
+}
+
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+long
+get_threads(
+  Params const& params)
+{
+  auto const t = params.find("threads");
+  return t == params.end() ? 1 : t->second;
+}
+
+
+Roofline
+roofline(
+  Case const& c,
+  Params const& params,
+  Elapsed const elapsed,
+  MachineProfile const* const profile)
+{
+  double const bytes = c.bytes > 0 ? c.bytes : NAN;
+  double const flops = c.flops > 0 ? c.flops : NAN;
+  // Take the working set to be the bytes accessed per run.
+  double const working_set = bytes * c.num_elements;
+  auto const threads = get_threads(params);
+  return {
+    bytes,
+    flops,
+    working_set / elapsed,
+    flops * c.num_elements / elapsed,
+    flops / bytes,
+    profile == nullptr || std::isnan(bytes) ? NAN
+      : profile->peak_bandwidth(working_set, threads),
+    profile == nullptr || std::isnan(flops) ? NAN
+      : profile->peak_flop_rate(threads),
+  };
+}
+
+
+/*
+ * Returns `val` as JSON, or null if NaN.
+ */
+Json
+number_or_null(
+  double const val)
+{
+  return std::isnan(val) ? Json() : Json(val);
+}
+
+
+}  // anonymous namespace
+
+BenchResult
+run_benchmark(
+  Benchmark const& benchmark,
+  Params const& params,
+  CacheState const cache,
+  RunOptions const& options)
+{
+  auto const c = benchmark.setup(params);
+
+  Timer::SetupFn prepare = nullptr;
+  if (cache != CacheState::WARM) {
+    auto const& operands = c.operands;
+    prepare = [cache, &operands]() { prepare_cache(cache, operands); };
+  }
+  PerfCounters counters;
+  for (auto const event : options.counters)
+    counters.add(event);
+
+  Timer timer{options.budget, options.discard_fraction, prepare};
+  timer.keep_samples(options.keep_samples);
+  if (counters.size() > 0)
+    timer.counters(&counters);
+  auto const& run = c.run;
+  auto const stats = timer([&run]() { run(); return 0; });
+
+  BenchResult result{
+    benchmark.name, params, cache, c.num_elements, timer.batch(), stats,
+    timer.histogram(), c.metrics, {}, {}, timer.samples(), {}};
+  result.roofline = roofline(c, params, stats.mean, options.profile);
+  for (size_t i = 0; i < counters.size(); ++i) {
+    auto const name = perf_event_name(counters.event(i));
+    result.counters[name] = timer.counter_means()[i];
+    if (options.keep_samples) {
+      auto& samples = result.counter_samples[name];
+      for (auto const& counts : timer.counter_samples())
+        samples.push_back(counts[i]);
+    }
+  }
+  return result;
+}
+
+
+void
+add_to_profile(
+  MachineProfile& profile,
+  BenchResult const& result)
+{
+  auto const slash = result.name.find('/');
+  if (slash == std::string::npos)
+    return;
+  auto const suite = result.name.substr(0, slash);
+  auto const size = result.params.find("size");
+  MachineProfile::Point point{
+    result.name.substr(slash + 1),
+    size == result.params.end() ? 0 : size->second,
+    get_threads(result.params),
+    0};
+  if (suite == "stream") {
+    point.value = result.roofline.bandwidth;
+    profile.bandwidth.push_back(point);
+  }
+  else if (suite == "latency") {
+    point.value = result.stats.mean / result.num_elements;
+    profile.latency.push_back(point);
+  }
+  else if (suite == "flops") {
+    point.value = result.roofline.flop_rate;
+    profile.flop_rate.push_back(point);
+  }
+}
+
+
+Json
+roofline_dataset(
+  MachineProfile const* const profile,
+  std::vector<BenchResult> const& results)
+{
+  auto json = Json::new_obj();
+
+  if (profile != nullptr) {
+    json["cpu"] = Json(profile->cpu);
+    // The best kernel at each working set size and thread count.
+    std::map<std::pair<long, long>, double> peaks;
+    for (auto const& point : profile->bandwidth) {
+      auto& peak = peaks[{point.threads, point.size}];
+      peak = std::max(peak, point.value);
+    }
+    auto bandwidth = Json::new_arr();
+    for (auto const& peak : peaks) {
+      auto ceiling = Json::new_obj();
+      ceiling["threads"] = Json((double) peak.first.first);
+      ceiling["size"] = Json((double) peak.first.second);
+      ceiling["value"] = peak.second;
+      bandwidth[bandwidth.size()] = std::move(ceiling);
+    }
+    json["bandwidth"] = std::move(bandwidth);
+
+    std::map<long, double> flop_peaks;
+    for (auto const& point : profile->flop_rate)
+      flop_peaks[point.threads] = std::max(flop_peaks[point.threads], point.value);
+    auto flop_rate = Json::new_arr();
+    for (auto const& peak : flop_peaks) {
+      auto ceiling = Json::new_obj();
+      ceiling["threads"] = Json((double) peak.first);
+      ceiling["value"] = peak.second;
+      flop_rate[flop_rate.size()] = std::move(ceiling);
+    }
+    json["flop_rate"] = std::move(flop_rate);
+  }
+
+  auto points = Json::new_arr();
+  for (auto const& result : results) {
+    auto const& roofline = result.roofline;
+    if (std::isnan(roofline.intensity))
+      continue;
+    auto point = Json::new_obj();
+    point["name"] = Json(result.name);
+    auto params = Json::new_obj();
+    for (auto const& p : result.params)
+      params[p.first] = Json((double) p.second);
+    point["params"] = std::move(params);
+    point["cache"] = cache_state_name(result.cache);
+    point["threads"] = Json((double) get_threads(result.params));
+    point["working_set"] = roofline.bytes * result.num_elements;
+    point["intensity"] = roofline.intensity;
+    point["bandwidth"] = roofline.bandwidth;
+    point["flop_rate"] = roofline.flop_rate;
+    point["peak_bandwidth"] = number_or_null(roofline.peak_bandwidth);
+    point["peak_flop_rate"] = number_or_null(roofline.peak_flop_rate);
+    points[points.size()] = std::move(point);
+  }
+  json["points"] = std::move(points);
+  return json;
+}
+
+
+Json
+to_json(
+  BenchResult const& result)
+{
+  auto json = Json::new_obj();
+  json["name"] = Json(result.name);
+  auto params = Json::new_obj();
+  for (auto const& p : result.params)
+    params[p.first] = Json((double) p.second);
+  json["params"] = std::move(params);
+  json["cache"] = cache_state_name(result.cache);
+  json["num_elements"] = Json((double) result.num_elements);
+  json["batch"] = Json((double) result.batch);
+  json["stats"] = to_json(result.stats);
+  json["histogram"] = to_json(result.histogram);
+  if (!result.metrics.empty()) {
+    auto metrics = Json::new_obj();
+    for (auto const& m : result.metrics)
+      metrics[m.first] = m.second;
+    json["metrics"] = std::move(metrics);
+  }
+  auto const& roofline = result.roofline;
+  if (!(std::isnan(roofline.bytes) && std::isnan(roofline.flops))) {
+    auto json_roofline = Json::new_obj();
+    json_roofline["bytes"] = number_or_null(roofline.bytes);
+    json_roofline["flops"] = number_or_null(roofline.flops);
+    json_roofline["bandwidth"] = number_or_null(roofline.bandwidth);
+    json_roofline["flop_rate"] = number_or_null(roofline.flop_rate);
+    json_roofline["intensity"] = number_or_null(roofline.intensity);
+    json_roofline["peak_bandwidth"] = number_or_null(roofline.peak_bandwidth);
+    json_roofline["peak_flop_rate"] = number_or_null(roofline.peak_flop_rate);
+    json["roofline"] = std::move(json_roofline);
+  }
+  if (!result.counters.empty()) {
+    auto counters = Json::new_obj();
+    for (auto const& c : result.counters)
+      counters[c.first] = number_or_null(c.second);
+    json["counters"] = std::move(counters);
+  }
+  if (!result.samples.empty()) {
+    auto samples = Json::new_arr();
+    for (auto const s : result.samples)
+      samples[samples.size()] = s;
+    json["samples"] = std::move(samples);
+  }
+  if (!result.counter_samples.empty()) {
+    auto counter_samples = Json::new_obj();
+    for (auto const& c : result.counter_samples) {
+      auto samples = Json::new_arr();
+      for (auto const s : c.second)
+        samples[samples.size()] = number_or_null(s);
+      counter_samples[c.first] = std::move(samples);
+    }
+    json["counter_samples"] = std::move(counter_samples);
+  }
+  return json;
+}
+
+
+namespace {
+
+std::string
+format_params(
+  Params const& params,
+  char const* const sep)
+{
+  std::string str;
+  for (auto const& p : params) {
+    if (!str.empty())
+      str += sep;
+    str += p.first + "=" + std::to_string(p.second);
+  }
+  return str;
+}
+
+
+}  // anonymous namespace
+
+void
+print_text(
+  std::ostream& os,
+  BenchResult const& result)
+{
+  os << std::left << std::setw(20) << result.name << " "
+     << std::setw(28) << format_params(result.params, " ") << " "
+     << std::setw(4) << cache_state_name(result.cache) << std::right << " "
+     << result.stats << " || " << result.stats / result.num_elements
+     << std::setprecision(2) << std::fixed
+     << " p50 " << result.histogram.percentile(50) * 1e9
+     << " p99 " << result.histogram.percentile(99) * 1e9
+     << " p99.9 " << result.histogram.percentile(99.9) * 1e9
+     << std::defaultfloat;
+  auto const& roofline = result.roofline;
+  auto const print_rate = [&os](
+    double const rate, double const peak, char const* const unit) {
+    os << "  " << std::setprecision(2) << std::fixed << rate * 1e-9 << unit;
+    if (!std::isnan(peak))
+      os << " (" << std::setprecision(0) << rate / peak * 100 << "% peak)";
+    os << std::defaultfloat;
+  };
+  if (!std::isnan(roofline.bytes))
+    print_rate(roofline.bandwidth, roofline.peak_bandwidth, " GB/s");
+  if (!std::isnan(roofline.flops))
+    print_rate(roofline.flop_rate, roofline.peak_flop_rate, " GFLOP/s");
+  if (!std::isnan(roofline.intensity))
+    os << "  AI " << std::setprecision(3) << roofline.intensity;
+  for (auto const& m : result.metrics)
+    os << "  " << m.first << " " << std::setprecision(3) << std::scientific
+       << m.second << std::defaultfloat;
+  for (auto const& c : result.counters)
+    os << "  " << c.first << "/call " << std::setprecision(4) << c.second;
+  os << std::endl;
+}
+
+
+void
+print_csv_header(
+  std::ostream& os)
+{
+  os << "name,params,cache,num_elements,num_samples,min,max,mean,"
+     << "standard_deviation,p50,p90,p99,p99.9,bandwidth,flop_rate,intensity,"
+     << "metrics,counters\n";
+}
+
+
+void
+print_csv(
+  std::ostream& os,
+  BenchResult const& result)
+{
+  auto const& stats = result.stats;
+  auto const format = [](std::map<std::string, double> const& vals) {
+    std::ostringstream ss;
+    ss << std::setprecision(17);
+    for (auto const& v : vals)
+      ss << (&v == &*vals.begin() ? "" : ";") << v.first << "=" << v.second;
+    return ss.str();
+  };
+
+  os << result.name << ","
+     << format_params(result.params, ";") << ","
+     << cache_state_name(result.cache) << ","
+     << result.num_elements << ","
+     << stats.num_samples << ","
+     << std::setprecision(17)
+     << stats.min << "," << stats.max << "," << stats.mean << ","
+     << stats.standard_deviation << ",";
+  for (auto const p : {50.0, 90.0, 99.0, 99.9})
+    os << result.histogram.percentile(p) << ",";
+  // Leave undeclared roofline quantities empty.
+  for (auto const v : {
+         result.roofline.bandwidth, result.roofline.flop_rate,
+         result.roofline.intensity})
+    if (std::isnan(v))
+      os << ",";
+    else
+      os << v << ",";
+  os << format(result.metrics) << "," << format(result.counters)
+     << std::defaultfloat << "\n";
+}
+
+
+//------------------------------------------------------------------------------
+
+double
+throughput(
+  ScalingResult const& result)
+{
+  return result.cpus.size() * result.num_elements / result.stats.mean;
+}
+
+
+ScalingResult
+run_scaling(
+  Benchmark const& benchmark,
+  Params const& params,
+  Placement const placement,
+  unsigned const threads,
+  RunOptions const& options)
+{
+  auto const cpus = place_threads(placement, threads);
+  ParallelTimer timer{options.budget, options.discard_fraction, cpus};
+
+  // Set up each thread's case on that thread, so its data is local.
+  std::vector<Case> cases(threads);
+  timer.pool().run([&](size_t const i) { cases[i] = benchmark.setup(params); });
+  auto const stats = timer([&cases](size_t const i) {
+    cases[i].run();
+    return 0;
+  });
+
+  return {
+    benchmark.name, params, placement, cpus, cases[0].num_elements,
+    timer.batch(), stats, timer.thread_means()};
+}
+
+
+void
+set_speedup(
+  ScalingResult& result,
+  double const base_throughput)
+{
+  result.speedup = throughput(result) / base_throughput;
+  result.efficiency = result.speedup / result.cpus.size();
+}
+
+
+Json
+to_json(
+  ScalingResult const& result)
+{
+  auto json = Json::new_obj();
+  json["name"] = Json(result.name);
+  auto params = Json::new_obj();
+  for (auto const& p : result.params)
+    params[p.first] = Json((double) p.second);
+  json["params"] = std::move(params);
+  json["placement"] = placement_name(result.placement);
+  json["threads"] = Json((double) result.cpus.size());
+  auto cpus = Json::new_arr();
+  for (auto const cpu : result.cpus)
+    cpus[cpus.size()] = cpu;
+  json["cpus"] = std::move(cpus);
+  json["num_elements"] = Json((double) result.num_elements);
+  json["batch"] = Json((double) result.batch);
+  json["stats"] = to_json(result.stats);
+  json["throughput"] = throughput(result);
+  auto thread_throughputs = Json::new_arr();
+  for (auto const mean : result.thread_means)
+    thread_throughputs[thread_throughputs.size()] = result.num_elements / mean;
+  json["thread_throughputs"] = std::move(thread_throughputs);
+  json["speedup"] = number_or_null(result.speedup);
+  json["efficiency"] = number_or_null(result.efficiency);
+  return json;
+}
+
+
+void
+print_text(
+  std::ostream& os,
+  ScalingResult const& result)
+{
+  auto const& means = result.thread_means;
+  auto const minmax = std::minmax_element(means.begin(), means.end());
+  os << std::left << std::setw(20) << result.name << " "
+     << std::setw(28) << format_params(result.params, " ") << " "
+     << std::setw(7) << placement_name(result.placement) << std::right
+     << " threads=" << std::setw(3) << result.cpus.size() << " "
+     << result.stats
+     << std::setprecision(3) << std::fixed
+     << "  " << throughput(result) * 1e-6 << " M/s"
+     // Per-thread throughput, slowest and fastest.
+     << "  thread " << result.num_elements / *minmax.second * 1e-6
+     << ".." << result.num_elements / *minmax.first * 1e-6 << " M/s"
+     << std::setprecision(2)
+     << "  speedup " << result.speedup
+     << "  efficiency " << result.efficiency * 100 << "%"
+     << std::defaultfloat << std::endl;
+}
+
+
+void
+print_scaling_csv_header(
+  std::ostream& os)
+{
+  os << "name,params,placement,threads,cpus,num_elements,num_samples,mean,"
+     << "standard_deviation,throughput,speedup,efficiency,thread_throughputs\n";
+}
+
+
+void
+print_csv(
+  std::ostream& os,
+  ScalingResult const& result)
+{
+  auto const& stats = result.stats;
+  os << result.name << ","
+     << format_params(result.params, ";") << ","
+     << placement_name(result.placement) << ","
+     << result.cpus.size() << ",";
+  for (size_t i = 0; i < result.cpus.size(); ++i)
+    os << (i > 0 ? ";" : "") << result.cpus[i];
+  os << ","
+     << result.num_elements << ","
+     << stats.num_samples << ","
+     << std::setprecision(17)
+     << stats.mean << "," << stats.standard_deviation << ","
+     << throughput(result) << ","
+     << result.speedup << "," << result.efficiency << ",";
+  for (size_t i = 0; i < result.thread_means.size(); ++i)
+    os << (i > 0 ? ";" : "") << result.num_elements / result.thread_means[i];
+  os << std::defaultfloat << "\n";
+}
+
+
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cache.hh"
+#include "json.hh"
+#include "machine.hh"
+#include "timing.hh"
+#include "topology.hh"
+
+//------------------------------------------------------------------------------
+// Benchmark registry.
+//
+// A benchmark is registered with a name, parameter axes, and a setup function.
+// For each combination of parameter values, the runner calls the setup
+// function, which allocates and fills inputs and returns a `Case` whose `run`
+// is timed.  Register at namespace scope, in any file linked into `bench`:
+//
+//   static auto const reg = register_benchmark(
+//     "dot", {{"len", pow2_range(10, 24)}},
+//     [](Params const& params) {
+//       auto const len = params.at("len");
+//       auto const arr = std::make_shared<std::vector<double>>(len, 1.0);
+//       return Case{[=]() { dot<double>(len, arr->data(), arr->data()); }, len};
+//     });
+//
+// Data captured by `run` is freed when the case is done.
+//------------------------------------------------------------------------------
+
+/*
+ * Parameter values, by axis name.
+ */
+using Params = std::map<std::string, long>;
+
+struct Axis
+{
+  std::string name;
+  std::vector<long> values;
+};
+
+
+struct Case
+{
+  // The operation to time.
+  std::function<void()> run;
+  // Number of elements processed by each run, for per-element times.
+  long num_elements = 1;
+  // Additional measurements to report, e.g. the result's error.
+  std::map<std::string, double> metrics = {};
+  // Bytes of memory read and written per element, for bandwidth; 0 if not
+  // meaningful.
+  double bytes = 0;
+  // Floating point operations per element, for FLOP rate; 0 if not meaningful.
+  double flops = 0;
+  // Memory that each run reads or writes, to flush for cold cache states.  If
+  // empty, whole cache levels are evicted instead.
+  std::vector<MemoryRange> operands = {};
+};
+
+
+using SetupFn = std::function<Case(Params const&)>;
+
+struct Benchmark
+{
+  std::string name;
+  std::vector<Axis> axes;
+  SetupFn setup;
+  // Cache states in which to run the benchmark, if requested.
+  std::vector<CacheState> caches;
+};
+
+
+/*
+ * Returns all registered benchmarks, in registration order.
+ */
+extern std::vector<Benchmark>& benchmarks();
+
+/*
+ * Registers a benchmark.  Returns its index, so that registration can
+ * initialize a static.
+ *
+ * A benchmark that controls its own working set, e.g. to measure a particular
+ * cache level, should restrict `caches` to warm.
+ */
+extern size_t register_benchmark(
+  std::string const& name, std::vector<Axis> axes, SetupFn setup,
+  std::vector<CacheState> caches={
+    CacheState::WARM, CacheState::L2, CacheState::COLD, CacheState::TLB});
+
+/*
+ * Returns 2^lo, 2^(lo + step), ..., up to 2^hi.
+ */
+extern std::vector<long> pow2_range(int lo, int hi, int step=1);
+
+/*
+ * Parses axis values: a comma-separated list of sizes (see `parse_size()`),
+ * each of which may be a range LO..HI of powers of 2.
+ */
+extern std::vector<long> parse_axis_values(std::string const& str);
+
+/*
+ * Returns all combinations of axis values, with the first axis varying
+ * slowest.
+ */
+extern std::vector<Params> expand(std::vector<Axis> const& axes);
+
+//------------------------------------------------------------------------------
+// Running
+//------------------------------------------------------------------------------
+
+struct RunOptions
+{
+  Elapsed budget = 0.5;
+  double discard_fraction = 0.1;
+  // If true, keep raw sample times in results.
+  bool keep_samples = false;
+  // Perf events to count.
+  std::vector<PerfEvent> counters;
+  // If not null, report bandwidth and FLOP rate against this machine's peaks.
+  MachineProfile const* profile = nullptr;
+};
+
+
+/*
+ * A result's position relative to the roofline.  Quantities that a case
+ * doesn't declare, or that the machine profile doesn't provide, are NaN.
+ */
+struct Roofline
+{
+  // Per element, as declared by the case.
+  double bytes;
+  double flops;
+  // Achieved bytes/s and FLOP/s.
+  double bandwidth;
+  double flop_rate;
+  // Flops per byte.
+  double intensity;
+  // Peak bytes/s for the working set and thread count, and peak FLOP/s for
+  // the thread count.
+  double peak_bandwidth;
+  double peak_flop_rate;
+};
+
+
+struct BenchResult
+{
+  std::string name;
+  Params params;
+  CacheState cache;
+  long num_elements;
+  // Calls per timed sample.
+  size_t batch;
+  SummaryStats<Elapsed> stats;
+  Histogram histogram;
+  std::map<std::string, double> metrics;
+  Roofline roofline;
+  // Mean counts per call of perf events, by name; NaN if unavailable.
+  std::map<std::string, double> counters;
+  std::vector<Elapsed> samples;
+  // Per-call counts of each perf event in each sample, if samples are kept.
+  std::map<std::string, std::vector<double>> counter_samples;
+};
+
+
+/*
+ * Sets up and times one case of a benchmark.
+ */
+extern BenchResult run_benchmark(
+  Benchmark const& benchmark, Params const& params, CacheState cache,
+  RunOptions const& options);
+
+/*
+ * If `result` is from a `stream/`, `latency/`, or `flops/` benchmark, adds its
+ * bandwidth, latency, or FLOP rate to `profile`.
+ */
+extern void add_to_profile(MachineProfile& profile, BenchResult const& result);
+
+/*
+ * Returns a roofline dataset: bandwidth and FLOP rate ceilings from `profile`,
+ * if not null, and a point for each result that declares bytes and flops.
+ */
+extern Json roofline_dataset(
+  MachineProfile const* profile, std::vector<BenchResult> const& results);
+
+extern Json to_json(BenchResult const& result);
+
+extern void print_text(std::ostream& os, BenchResult const& result);
+extern void print_csv_header(std::ostream& os);
+extern void print_csv(std::ostream& os, BenchResult const& result);
+
+//------------------------------------------------------------------------------
+// Thread scaling
+//
+// Runs a case concurrently on a number of threads, each pinned to a CPU by a
+// placement policy and with its own copy of the case, set up on that thread so
+// that its data is local.  Throughput relative to one thread gives speedup and
+// efficiency: weak scaling, as each thread processes its own elements.
+//------------------------------------------------------------------------------
+
+struct ScalingResult
+{
+  std::string name;
+  Params params;
+  Placement placement;
+  std::vector<int> cpus;
+  // Elements per call per thread.
+  long num_elements;
+  // Calls per timed sample.
+  size_t batch;
+  // Parallel region time per call.
+  SummaryStats<Elapsed> stats;
+  // Each thread's mean time per call.
+  std::vector<Elapsed> thread_means;
+  // Relative to one thread with the same placement; NaN if not measured.
+  double speedup = NAN;
+  double efficiency = NAN;
+};
+
+
+/*
+ * Returns aggregate elements per second.
+ */
+extern double throughput(ScalingResult const& result);
+
+/*
+ * Sets up and times one case of a benchmark on `threads` threads.
+ */
+extern ScalingResult run_scaling(
+  Benchmark const& benchmark, Params const& params, Placement placement,
+  unsigned threads, RunOptions const& options);
+
+/*
+ * Sets speedup and efficiency of `result` relative to `base_throughput`, that
+ * of one thread.
+ */
+extern void set_speedup(ScalingResult& result, double base_throughput);
+
+extern Json to_json(ScalingResult const& result);
+
+extern void print_text(std::ostream& os, ScalingResult const& result);
+extern void print_scaling_csv_header(std::ostream& os);
+extern void print_csv(std::ostream& os, ScalingResult const& result);
+
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+
+#include "bench.hh"
+#include "compare.hh"
+#include "json_stream.hh"
+#include "tuning.hh"
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Exit status if any result is a regression from the baseline.
+int constexpr EXIT_REGRESSION = 2;
+
+void
+usage(
+  char const* const argv0)
+{
+  std::cerr
+    << "usage: " << argv0 << " [OPTIONS] [REGEX]\n"
+    << "\n"
+    << "Runs registered benchmarks whose names match REGEX.\n"
+    << "\n"
+    << "  --list               list benchmarks and axes, and exit\n"
+    << "  --set AXIS=VALUES    sweep AXIS over comma-separated VALUES;\n"
+    << "                       LO..HI for powers of 2 in a range\n"
+    << "  --cache STATES       comma-separated cache states [warm]:\n"
+    << "                         warm: as left by the previous run\n"
+    << "                         l2: operands in L2, not L1 or a victim LLC\n"
+    << "                         cold: operands flushed from all caches\n"
+    << "                         tlb: TLBs evicted, caches as left\n"
+    << "                       each benchmark runs in those it supports\n"
+    << "  --cache-info         print the detected cache hierarchy, and exit\n"
+    << "  --scaling THREADS    run each case on each of comma-separated\n"
+    << "                       THREADS threads (LO..HI for powers of 2), and\n"
+    << "                       report speedup and efficiency; warm only\n"
+    << "  --placement POLICIES comma-separated compact, scatter, numa, for\n"
+    << "                       --scaling [compact]\n"
+    << "  --budget SECONDS     time budget per case [0.5]\n"
+    << "  --samples            include raw sample times (json)\n"
+    << "  --counters EVENTS    count comma-separated perf events:\n"
+    << "                       cycles, instructions, branch-misses,\n"
+    << "                       l1d-misses, llc-references, llc-misses,\n"
+    << "                       dtlb-misses, task-clock, page-faults,\n"
+    << "                       context-switches\n"
+    << "  --profile PATH       report bandwidth and FLOP rate as fractions of\n"
+    << "                       the peaks in machine profile PATH\n"
+    << "  --save-profile PATH  save stream/, latency/, and flops/ results as a\n"
+    << "                       machine profile to PATH\n"
+    << "  --roofline PATH      save a roofline dataset to PATH\n"
+    << "  --save PATH          save results, with samples, as json to PATH\n"
+    << "  --baseline PATH      compare results to those saved in PATH, and\n"
+    << "                       exit with status 2 if any is slower\n"
+    << "  --threshold FRACTION smallest relative slowdown that counts as a\n"
+    << "                       regression [0.05]\n"
+    << "  --alpha P            significance level of comparisons [0.01]\n"
+    << "  --tune               tune parameters whose names match REGEX, save\n"
+    << "                       them to the tuning file, and exit\n"
+    << "  --no-tune            use defaults for untuned parameters, instead of\n"
+    << "                       tuning them on first use\n"
+    << "  --tuning PATH        tuning file [$ASLIB_TUNING or\n"
+    << "                       ~/.aslib_tuning.json]\n"
+    << "  --format FORMAT      text, csv, or json [text]\n"
+    << "  --output PATH        write results to PATH\n";
+}
+
+
+std::vector<std::string>
+split(
+  std::string const& str,
+  char const sep)
+{
+  std::vector<std::string> parts;
+  size_t start = 0;
+  for (size_t end; (end = str.find(sep, start)) != std::string::npos;
+       start = end + 1)
+    parts.push_back(str.substr(start, end - start));
+  parts.push_back(str.substr(start));
+  return parts;
+}
+
+
+}  // anonymous namespace
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  bool list = false;
+  bool cache_info = false;
+  bool tune_params = false;
+  std::map<std::string, std::vector<long>> overrides;
+  std::vector<CacheState> caches{CacheState::WARM};
+  std::vector<long> scaling;
+  std::vector<Placement> placements{Placement::COMPACT};
+  RunOptions options;
+  std::string format = "text";
+  std::string output;
+  std::string save_profile;
+  std::string roofline;
+  std::string save;
+  std::string baseline_path;
+  CompareOptions compare_options;
+  std::string pattern = "";
+  MachineProfile profile;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string const arg = argv[i];
+      bool const has_val = i + 1 < argc;
+      if (arg == "--list")
+        list = true;
+      else if (arg == "--set" && has_val) {
+        std::string const spec = argv[++i];
+        auto const eq = spec.find('=');
+        if (eq == std::string::npos) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        overrides[spec.substr(0, eq)] = parse_axis_values(spec.substr(eq + 1));
+      }
+      else if (arg == "--cache" && has_val) {
+        caches.clear();
+        for (auto const& name : split(argv[++i], ','))
+          caches.push_back(parse_cache_state(name));
+      }
+      else if (arg == "--cache-info")
+        cache_info = true;
+      else if (arg == "--scaling" && has_val)
+        scaling = parse_axis_values(argv[++i]);
+      else if (arg == "--placement" && has_val) {
+        placements.clear();
+        for (auto const& name : split(argv[++i], ','))
+          placements.push_back(parse_placement(name));
+      }
+      else if (arg == "--budget" && has_val)
+        options.budget = std::stod(argv[++i]);
+      else if (arg == "--samples")
+        options.keep_samples = true;
+      else if (arg == "--counters" && has_val)
+        for (auto const& name : split(argv[++i], ','))
+          options.counters.push_back(parse_perf_event(name));
+      else if (arg == "--profile" && has_val) {
+        profile = load_machine_profile(argv[++i]);
+        options.profile = &profile;
+      }
+      else if (arg == "--save-profile" && has_val)
+        save_profile = argv[++i];
+      else if (arg == "--roofline" && has_val)
+        roofline = argv[++i];
+      else if (arg == "--save" && has_val)
+        save = argv[++i];
+      else if (arg == "--baseline" && has_val)
+        baseline_path = argv[++i];
+      else if (arg == "--threshold" && has_val)
+        compare_options.threshold = std::stod(argv[++i]);
+      else if (arg == "--alpha" && has_val)
+        compare_options.alpha = std::stod(argv[++i]);
+      else if (arg == "--tune")
+        tune_params = true;
+      else if (arg == "--no-tune")
+        set_auto_tune(false);
+      else if (arg == "--tuning" && has_val)
+        set_tuning_path(argv[++i]);
+      else if (arg == "--format" && has_val)
+        format = argv[++i];
+      else if (arg == "--output" && has_val)
+        output = argv[++i];
+      else if (arg[0] == '-' || !pattern.empty()) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      else
+        pattern = arg;
+    }
+    if (!(format == "text" || format == "csv" || format == "json")) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    std::regex const regex(pattern);
+    // Comparisons test sample distributions.
+    if (!save.empty() || !baseline_path.empty())
+      options.keep_samples = true;
+
+    if (cache_info) {
+      for (auto const& level : cache_hierarchy())
+        std::cout << "L" << level.level << " " << level.type
+                  << " size=" << level.size << " line=" << level.line_size
+                  << " ways=" << level.ways << "\n";
+      return EXIT_SUCCESS;
+    }
+
+    if (tune_params) {
+      std::vector<TuneResult> tuned;
+      for (auto const& tunable : tunables())
+        if (std::regex_search(tunable.name, regex)) {
+          tuned.push_back(tune(tunable, options.budget));
+          auto const& result = tuned.back();
+          std::cout << result.name << " = " << result.value
+                    << " (default " << tunable.default_value << ")\n";
+          for (auto const& trial : result.trials)
+            std::cout << "  " << std::setw(8) << trial.first << " "
+                      << format_ns(trial.second) << "/element\n";
+        }
+      save_tuned(tuned);
+      std::cout << "saved to " << tuning_path() << "\n";
+      return EXIT_SUCCESS;
+    }
+
+    if (list) {
+      for (auto const& benchmark : benchmarks())
+        if (std::regex_search(benchmark.name, regex)) {
+          std::cout << benchmark.name;
+          for (auto const& axis : benchmark.axes) {
+            std::cout << " " << axis.name << "=";
+            for (size_t v = 0; v < axis.values.size(); ++v)
+              std::cout << (v > 0 ? "," : "") << axis.values[v];
+          }
+          std::cout << " cache=";
+          for (size_t c = 0; c < benchmark.caches.size(); ++c)
+            std::cout << (c > 0 ? "," : "")
+                      << cache_state_name(benchmark.caches[c]);
+          std::cout << "\n";
+        }
+      return EXIT_SUCCESS;
+    }
+
+    std::ofstream file;
+    if (!output.empty()) {
+      file.open(output);
+      if (!file) {
+        std::cerr << "can't write " << output << "\n";
+        return EXIT_FAILURE;
+      }
+    }
+    std::ostream& os = output.empty() ? std::cout : file;
+
+    if (format == "csv") {
+      if (scaling.empty())
+        print_csv_header(os);
+      else
+        print_scaling_csv_header(os);
+    }
+    // Write json results as they complete, rather than holding them all.
+    aslib::json::Writer writer(os);
+    if (format == "json")
+      writer.start_array();
+    auto const emit = [&](auto const& result) {
+      if (format == "text")
+        print_text(os, result);
+      else if (format == "csv")
+        print_csv(os, result);
+      else {
+        to_json(result).emit(writer);
+        writer.flush();
+        os.flush();
+        // Show progress when writing json to a file.
+        if (!output.empty())
+          print_text(std::cerr, result);
+      }
+    };
+
+    std::unique_ptr<Baseline> baseline;
+    if (!baseline_path.empty())
+      baseline.reset(new Baseline(baseline_path));
+    std::vector<Comparison> comparisons;
+    // Results with no baseline.
+    std::vector<BenchResult> added;
+    auto saved = Json::new_arr();
+
+    MachineProfile measured{cpu_model()};
+    std::vector<BenchResult> roofline_results;
+    for (auto const& benchmark : benchmarks()) {
+      if (!std::regex_search(benchmark.name, regex))
+        continue;
+
+      auto axes = benchmark.axes;
+      for (auto& axis : axes) {
+        auto const o = overrides.find(axis.name);
+        if (o != overrides.end())
+          axis.values = o->second;
+        // When scaling, the harness provides the threads.
+        if (!scaling.empty() && axis.name == "threads")
+          axis.values = {1};
+      }
+
+      for (auto const& params : expand(axes)) {
+        if (!scaling.empty()) {
+          for (auto const placement : placements) {
+            double base = NAN;
+            for (auto const threads : scaling) {
+              auto result
+                = run_scaling(benchmark, params, placement, threads, options);
+              if (threads == 1)
+                base = throughput(result);
+              set_speedup(result, base);
+              emit(result);
+            }
+          }
+          continue;
+        }
+
+        for (auto const cache : caches) {
+          auto const& supported = benchmark.caches;
+          if (std::find(supported.begin(), supported.end(), cache)
+              == supported.end())
+            continue;
+          auto const result = run_benchmark(benchmark, params, cache, options);
+          if (!save_profile.empty() && cache == CacheState::WARM)
+            add_to_profile(measured, result);
+          if (!roofline.empty())
+            roofline_results.push_back(result);
+          if (!save.empty())
+            saved[saved.size()] = to_json(result);
+          if (baseline != nullptr) {
+            auto const base = baseline->find(result);
+            if (base != nullptr)
+              comparisons.push_back(compare(*base, result, compare_options));
+            else
+              added.push_back(result);
+          }
+          emit(result);
+        }
+      }
+    }
+    if (format == "json") {
+      writer.end_array();
+      os << std::endl;
+    }
+    if (!save_profile.empty())
+      save_machine_profile(measured, save_profile);
+    if (!roofline.empty()) {
+      std::ofstream file(roofline);
+      if (!file) {
+        std::cerr << "can't write " << roofline << "\n";
+        return EXIT_FAILURE;
+      }
+      file << roofline_dataset(options.profile, roofline_results) << std::endl;
+    }
+    if (!save.empty())
+      save_results(saved, save);
+
+    if (baseline != nullptr) {
+      // On stderr, so as not to mix with csv or json results.
+      size_t regressions = 0;
+      for (auto const& comparison : comparisons) {
+        print_text(std::cerr, comparison);
+        if (comparison.verdict == Verdict::SLOWER)
+          ++regressions;
+      }
+      for (auto const& result : added)
+        print_unmatched(std::cerr, result, "added");
+      // Only those the regex selects are expected to have been run.
+      size_t num_missing = 0;
+      for (auto const result : baseline->missing(comparisons))
+        if (std::regex_search(result->name, regex)) {
+          print_unmatched(std::cerr, *result, "missing");
+          ++num_missing;
+        }
+      std::cerr << regressions << " regressions in " << comparisons.size()
+                << " comparisons, " << added.size() << " added, "
+                << num_missing << " missing\n";
+      if (regressions > 0)
+        return EXIT_REGRESSION;
+    }
+  }
+  catch (std::exception const& exc) {
+    std::cerr << "error: " << exc.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,282 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_CLFLUSH 1
+#endif
+
+#include "cache.hh"
+#include "util.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+size_t constexpr PAGE_SIZE = 4096;
+// Pages touched to evict the TLBs; several times the entries of a typical
+// second-level TLB.
+size_t constexpr TLB_PAGES = 8192;
+
+bool
+read_line(
+  std::string const& path,
+  std::string& line)
+{
+  std::ifstream file(path);
+  return bool(std::getline(file, line));
+}
+
+
+std::vector<CacheLevel>
+read_sysfs()
+{
+  std::vector<CacheLevel> levels;
+  for (int i = 0; ; ++i) {
+    auto const dir
+      = "/sys/devices/system/cpu/cpu0/cache/index"s + std::to_string(i) + "/";
+    std::string level, type, size, line_size, ways;
+    if (!read_line(dir + "level", level))
+      break;
+    if (!(read_line(dir + "type", type)
+          && read_line(dir + "size", size)
+          && read_line(dir + "coherency_line_size", line_size)
+          && read_line(dir + "ways_of_associativity", ways)))
+      continue;
+    if (type == "Instruction")
+      continue;
+    levels.push_back({
+      std::stoi(level), type, (size_t) parse_size(size),
+      (size_t) std::stoul(line_size), (unsigned) std::stoul(ways)});
+  }
+  return levels;
+}
+
+
+std::vector<CacheLevel>
+read_sysconf()
+{
+  long const line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+  long const sizes[] = {
+    sysconf(_SC_LEVEL1_DCACHE_SIZE),
+    sysconf(_SC_LEVEL2_CACHE_SIZE),
+    sysconf(_SC_LEVEL3_CACHE_SIZE),
+  };
+  std::vector<CacheLevel> levels;
+  for (int i = 0; i < 3; ++i)
+    if (sizes[i] > 0)
+      levels.push_back({
+        i + 1, i == 0 ? "Data" : "Unified", (size_t) sizes[i],
+        line > 0 ? (size_t) line : 64, 0});
+  return levels;
+}
+
+
+/*
+ * Returns a buffer of `size` bytes, allocated on first use.
+ */
+char*
+get_buffer(
+  size_t const size)
+{
+  static std::map<size_t, std::vector<char>> buffers;
+  auto& buf = buffers[size];
+  if (buf.empty())
+    buf.resize(size, 1);
+  return buf.data();
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+std::vector<CacheLevel> const&
+cache_hierarchy()
+{
+  static std::vector<CacheLevel> const levels = []() {
+    auto levels = read_sysfs();
+    if (levels.empty())
+      levels = read_sysconf();
+    if (levels.empty())
+      levels = {
+        {1, "Data", 32 << 10, 64, 8},
+        {2, "Unified", 1 << 20, 64, 16},
+        {3, "Unified", 32 << 20, 64, 16},
+      };
+    return levels;
+  }();
+  return levels;
+}
+
+
+size_t
+cache_size(
+  int const level)
+{
+  auto const& levels = cache_hierarchy();
+  for (auto const& l : levels)
+    if (l.level == level)
+      return l.size;
+  return levels.back().size;
+}
+
+
+size_t
+cache_line_size()
+{
+  return cache_hierarchy().front().line_size;
+}
+
+
+//------------------------------------------------------------------------------
+
+char const*
+cache_state_name(
+  CacheState const cache)
+{
+  switch (cache) {
+  case CacheState::WARM: return "warm";
+  case CacheState::L2: return "l2";
+  case CacheState::COLD: return "cold";
+  case CacheState::TLB: return "tlb";
+  }
+  return nullptr;
+}
+
+
+CacheState
+parse_cache_state(
+  std::string const& name)
+{
+  if (name == "warm")
+    return CacheState::WARM;
+  else if (name == "l2")
+    return CacheState::L2;
+  else if (name == "cold")
+    return CacheState::COLD;
+  else if (name == "tlb")
+    return CacheState::TLB;
+  else
+    throw std::invalid_argument("unknown cache state: "s + name);
+}
+
+
+void
+flush_ranges(
+  std::vector<MemoryRange> const& ranges)
+{
+#if HAVE_CLFLUSH
+  size_t const line = cache_line_size();
+  for (auto const& range : ranges) {
+    auto p = (uintptr_t) range.data & ~(line - 1);
+    auto const end = (uintptr_t) range.data + range.size;
+    for (; p < end; p += line)
+# ifdef __CLFLUSHOPT__
+      _mm_clflushopt((void*) p);
+# else
+      _mm_clflush((void const*) p);
+# endif
+  }
+  _mm_mfence();
+#else
+  (void) ranges;
+  evict_caches(cache_hierarchy().back().level);
+#endif
+}
+
+
+void
+load_ranges(
+  std::vector<MemoryRange> const& ranges)
+{
+  size_t const line = cache_line_size();
+  unsigned char sum = 0;
+  for (auto const& range : ranges) {
+    auto const p = (unsigned char const*) range.data;
+    for (size_t i = 0; i < range.size; i += line)
+      sum += p[i];
+  }
+  do_not_optimize(sum);
+}
+
+
+void
+evict_caches(
+  int const level)
+{
+  size_t const size = 2 * cache_size(level);
+  size_t const line = cache_line_size();
+  char* const buf = get_buffer(size);
+  // Write each line, to evict modified lines too.
+  for (size_t i = 0; i < size; i += line)
+    buf[i] += 1;
+  do_not_optimize(buf[0]);
+}
+
+
+void
+evict_tlb()
+{
+  static char* const buf = []() {
+    size_t const size = TLB_PAGES * PAGE_SIZE;
+    auto const buf = (char*) mmap(
+      nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+      -1, 0);
+    if (buf == MAP_FAILED)
+      throw std::bad_alloc();
+    // Huge pages would cover the buffer with too few TLB entries.
+    madvise(buf, size, MADV_NOHUGEPAGE);
+    for (size_t p = 0; p < TLB_PAGES; ++p)
+      buf[p * PAGE_SIZE] = 1;
+    return buf;
+  }();
+
+  // The first line of each page, so all map to the few cache sets whose
+  // index bits above the page offset vary.
+  char sum = 0;
+  for (size_t p = 0; p < TLB_PAGES; ++p)
+    sum += ((char volatile*) buf)[p * PAGE_SIZE];
+  do_not_optimize(sum);
+}
+
+
+void
+prepare_cache(
+  CacheState const state,
+  std::vector<MemoryRange> const& operands)
+{
+  switch (state) {
+  case CacheState::WARM:
+    break;
+
+  case CacheState::L2:
+    // Reading from memory fills L2 and L1 but, if the LLC is a victim cache,
+    // not the LLC; then evict L1.
+    if (!operands.empty()) {
+      flush_ranges(operands);
+      load_ranges(operands);
+    }
+    evict_caches(1);
+    break;
+
+  case CacheState::COLD:
+    if (operands.empty())
+      evict_caches(cache_hierarchy().back().level);
+    else
+      flush_ranges(operands);
+    break;
+
+  case CacheState::TLB:
+    evict_tlb();
+    break;
+  }
+}
+
+
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Cache hierarchy detection and cache state control.
+//
+// Benchmarks run each sample with operands in a chosen cache state, to
+// reproduce e.g. a query over a column that hasn't been touched recently.
+// States that target operands flush exactly their memory ranges with
+// `clflush`, rather than thrashing a buffer, so they don't depend on a guessed
+// cache size and cost time proportional to the operands.
+//------------------------------------------------------------------------------
+
+struct CacheLevel
+{
+  int level;
+  // "Data" or "Unified"; instruction caches are omitted.
+  std::string type;
+  size_t size;
+  size_t line_size;
+  unsigned ways;
+};
+
+
+/*
+ * Returns data and unified caches of the first CPU, from sysfs, in level
+ * order.  If sysfs is unavailable, uses sysconf, or guesses typical sizes.
+ */
+extern std::vector<CacheLevel> const& cache_hierarchy();
+
+/*
+ * Returns the size of the given level, or of the last level if there aren't
+ * that many.
+ */
+extern size_t cache_size(int level);
+
+extern size_t cache_line_size();
+
+//------------------------------------------------------------------------------
+
+/*
+ * A contiguous range of memory.
+ */
+struct MemoryRange
+{
+  void const* data;
+  size_t size;
+};
+
+
+enum class CacheState
+{
+  WARM,   // as left by the previous run
+  L2,     // in L2, not L1; with a victim LLC, not in LLC
+  COLD,   // in no cache
+  TLB,    // in cache as left, but no page translations in TLBs
+};
+
+
+extern char const* cache_state_name(CacheState);
+extern CacheState parse_cache_state(std::string const&);
+
+/*
+ * Evicts `ranges` from all cache levels, to memory.
+ */
+extern void flush_ranges(std::vector<MemoryRange> const& ranges);
+
+/*
+ * Reads every cache line of `ranges`.
+ */
+extern void load_ranges(std::vector<MemoryRange> const& ranges);
+
+/*
+ * Evicts everything from caches up to and including `level`, by reading and
+ * writing a buffer twice that level's size.
+ */
+extern void evict_caches(int level);
+
+/*
+ * Evicts page translations from the TLBs, by touching one line in each of many
+ * 4 KiB pages.  The lines map to few cache sets, to disturb caches little.
+ */
+extern void evict_tlb();
+
+/*
+ * Puts `operands` into `state`.
+ *
+ * If `operands` is empty, cold states evict whole cache levels instead: COLD
+ * evicts the LLC, L2 evicts L1.
+ */
+extern void prepare_cache(
+  CacheState state, std::vector<MemoryRange> const& operands);
+
@@ -0,0 +1,600 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "colfile.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+char const MAGIC[8] = {'D', 'A', 'T', 'U', 'L', 'A', 'C', '1'};
+
+// Size of the trailer: the footer offset, then the magic number.
+size_t constexpr TRAILER_SIZE = 8 + sizeof(MAGIC);
+
+inline size_t
+value_size(
+  DType const dtype)
+{
+  return dtype == DType::ID ? sizeof(uint32_t) : 8;
+}
+
+
+inline size_t
+num_words(
+  size_t const num_rows)
+{
+  return (num_rows + 63) / 64;
+}
+
+
+/*
+ * Returns the bytes that a column's data occupies in a group.
+ */
+inline size_t
+column_bytes(
+  DType const dtype,
+  size_t const num_rows,
+  bool const validity)
+{
+  return (validity ? num_words(num_rows) * 8 : 0)
+    + (num_rows * value_size(dtype) + 7) / 8 * 8;
+}
+
+
+/*
+ * Fills in the column offsets of a group, from its offset, number of rows,
+ * and validity flags.  Returns the offset of the group's end.
+ */
+size_t
+locate_columns(
+  ColFileGroup& group,
+  std::vector<DType> const& dtypes)
+{
+  size_t offset = group.offset;
+  group.offsets.resize(dtypes.size());
+  for (size_t c = 0; c < dtypes.size(); ++c) {
+    group.offsets[c] = offset;
+    offset += column_bytes(dtypes[c], group.num_rows, group.validity[c]);
+  }
+  return offset;
+}
+
+
+void
+put_u64(
+  std::string& buf,
+  uint64_t const val)
+{
+  buf.append((char const*) &val, sizeof(val));
+}
+
+
+void
+put_str(
+  std::string& buf,
+  std::string const& str)
+{
+  put_u64(buf, str.size());
+  buf.append(str);
+}
+
+
+/*
+ * Decodes the footer, checking that it's not truncated.
+ */
+class FooterReader
+{
+public:
+
+  FooterReader(
+    std::string const& path,
+    std::string const& buf)
+  : path_(path),
+    p_(buf.data()),
+    end_(buf.data() + buf.size())
+  {
+  }
+
+  uint64_t
+  u64()
+  {
+    uint64_t val;
+    need(sizeof(val));
+    memcpy(&val, p_, sizeof(val));
+    p_ += sizeof(val);
+    return val;
+  }
+
+  std::string
+  str()
+  {
+    size_t const size = u64();
+    need(size);
+    p_ += size;
+    return std::string(p_ - size, size);
+  }
+
+private:
+
+  void
+  need(
+    size_t const size)
+  {
+    if ((size_t) (end_ - p_) < size)
+      throw ColFileError("corrupt footer in "s + path_);
+  }
+
+  std::string const& path_;
+  char const* p_;
+  char const* const end_;
+
+};
+
+
+void
+pread_all(
+  int const fd,
+  void* const data,
+  size_t const size,
+  size_t const offset,
+  std::string const& path)
+{
+  for (size_t done = 0; done < size; ) {
+    auto const n = pread(fd, (char*) data + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw ColFileError(
+        "can't read "s + path + ": "
+        + (n == 0 ? "unexpected end of file" : strerror(errno)));
+    done += n;
+  }
+}
+
+
+inline bool
+get_bit(
+  uint64_t const* const words,
+  size_t const i)
+{
+  return (words[i / 64] >> (i % 64)) & 1;
+}
+
+
+inline void
+clear_bit(
+  uint64_t* const words,
+  size_t const i)
+{
+  words[i / 64] &= ~(uint64_t(1) << (i % 64));
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+bool
+is_colfile_path(
+  std::string const& path)
+{
+  return path.size() >= 4 && path.compare(path.size() - 4, 4, ".col") == 0;
+}
+
+
+//------------------------------------------------------------------------------
+
+ColFileWriter::ColFileWriter(
+  std::string const& path,
+  std::vector<std::string> names,
+  std::vector<DType> dtypes)
+: path_(path),
+  names_(std::move(names)),
+  dtypes_(std::move(dtypes)),
+  dictionaries_(names_.size()),
+  codes_(names_.size())
+{
+  assert(names_.size() == dtypes_.size());
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0)
+    throw ColFileError("can't create "s + path + ": " + strerror(errno));
+  offset_ = 0;
+  write_bytes(MAGIC, sizeof(MAGIC));
+}
+
+
+ColFileWriter::~ColFileWriter()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+
+void
+ColFileWriter::set_dictionary(
+  size_t const c,
+  std::vector<std::string> dictionary)
+{
+  assert(groups_.empty());
+  codes_[c].clear();
+  for (size_t i = 0; i < dictionary.size(); ++i)
+    codes_[c].emplace(dictionary[i], i);
+  dictionaries_[c] = std::move(dictionary);
+}
+
+
+void
+ColFileWriter::write(
+  Table const& table,
+  size_t const begin,
+  size_t end)
+{
+  if (table.num_columns() != names_.size())
+    throw ColFileError("wrong number of columns for "s + path_);
+  end = std::min(end, table.num_rows());
+  assert(begin <= end);
+  size_t const num_rows = end - begin;
+
+  ColFileGroup group;
+  group.offset = offset_;
+  group.num_rows = num_rows;
+  std::vector<uint64_t> validity;
+  std::vector<uint32_t> codes;
+  for (size_t c = 0; c < names_.size(); ++c) {
+    auto const& col = table.column(c);
+    if (col.dtype() != dtypes_[c])
+      throw ColFileError(
+        "wrong type for column "s + names_[c] + " of " + path_);
+
+    // Write validity bits, only if some rows are null.
+    bool has_null = false;
+    if (col.has_validity()) {
+      validity.assign(num_words(num_rows), ~uint64_t(0));
+      for (size_t i = 0; i < num_rows; ++i)
+        if (!col.is_valid(begin + i)) {
+          clear_bit(validity.data(), i);
+          has_null = true;
+        }
+    }
+    group.validity.push_back(has_null);
+    if (has_null)
+      write_bytes(validity.data(), validity.size() * 8);
+
+    size_t size = num_rows * value_size(dtypes_[c]);
+    if (dtypes_[c] != DType::ID)
+      write_bytes(
+        dtypes_[c] == DType::F64
+          ? (void const*) (column_cast<double>(col).data() + begin)
+          : (void const*) (column_cast<int64_t>(col).data() + begin),
+        size);
+    else {
+      auto const& id = column_cast<uint32_t>(col);
+      auto const& dictionary = id.dictionary();
+      if (dictionary.empty())
+        write_bytes(id.data() + begin, size);
+      else {
+        // Remap the codes that occur into the file's dictionary.
+        uint32_t constexpr NONE = -1;
+        std::vector<uint32_t> remap(dictionary.size(), NONE);
+        codes.resize(num_rows);
+        for (size_t i = 0; i < num_rows; ++i) {
+          auto const code = id[begin + i];
+          if (remap[code] == NONE) {
+            auto const& str = dictionary[code];
+            auto const j = codes_[c].find(str);
+            if (j == codes_[c].end()) {
+              remap[code] = dictionaries_[c].size();
+              codes_[c].emplace(str, remap[code]);
+              dictionaries_[c].push_back(str);
+            }
+            else
+              remap[code] = j->second;
+          }
+          codes[i] = remap[code];
+        }
+        write_bytes(codes.data(), size);
+      }
+      // Pad to 8 bytes.
+      if (size % 8 != 0) {
+        uint32_t const pad = 0;
+        write_bytes(&pad, sizeof(pad));
+      }
+    }
+  }
+  groups_.push_back(std::move(group));
+}
+
+
+size_t
+ColFileWriter::close()
+{
+  std::string footer;
+  put_u64(footer, names_.size());
+  for (size_t c = 0; c < names_.size(); ++c) {
+    put_str(footer, names_[c]);
+    put_u64(footer, (uint64_t) dtypes_[c]);
+    put_u64(footer, dictionaries_[c].size());
+    for (auto const& str : dictionaries_[c])
+      put_str(footer, str);
+  }
+  put_u64(footer, groups_.size());
+  for (auto const& group : groups_) {
+    put_u64(footer, group.offset);
+    put_u64(footer, group.num_rows);
+    for (size_t c0 = 0; c0 < names_.size(); c0 += 64) {
+      uint64_t bits = 0;
+      for (size_t c = c0; c < std::min(c0 + 64, names_.size()); ++c)
+        bits |= uint64_t(group.validity[c]) << (c - c0);
+      put_u64(footer, bits);
+    }
+  }
+  put_u64(footer, offset_);
+  footer.append(MAGIC, sizeof(MAGIC));
+  write_bytes(footer.data(), footer.size());
+
+  if (::close(fd_) != 0) {
+    fd_ = -1;
+    throw ColFileError("can't write "s + path_ + ": " + strerror(errno));
+  }
+  fd_ = -1;
+  return offset_;
+}
+
+
+void
+ColFileWriter::write_bytes(
+  void const* const data,
+  size_t const size)
+{
+  for (size_t done = 0; done < size; ) {
+    auto const n = ::write(fd_, (char const*) data + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw ColFileError("can't write "s + path_ + ": " + strerror(errno));
+    done += n;
+  }
+  offset_ += size;
+}
+
+
+//------------------------------------------------------------------------------
+
+ColFileReader::ColFileReader(
+  std::string const& path)
+: path_(path)
+{
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0)
+    throw ColFileError("can't open "s + path + ": " + strerror(errno));
+
+  try {
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+      throw ColFileError("can't stat "s + path + ": " + strerror(errno));
+    file_size_ = st.st_size;
+
+    char magic[sizeof(MAGIC)];
+    char trailer[TRAILER_SIZE];
+    if (file_size_ < sizeof(MAGIC) + TRAILER_SIZE)
+      throw ColFileError("not a column file: "s + path);
+    pread_all(fd_, magic, sizeof(magic), 0, path);
+    pread_all(fd_, trailer, TRAILER_SIZE, file_size_ - TRAILER_SIZE, path);
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || memcmp(trailer + 8, MAGIC, sizeof(MAGIC)) != 0)
+      throw ColFileError("not a column file: "s + path);
+    memcpy(&footer_offset_, trailer, 8);
+    if (footer_offset_ < sizeof(MAGIC)
+        || footer_offset_ > file_size_ - TRAILER_SIZE)
+      throw ColFileError("corrupt footer in "s + path);
+
+    std::string buf(file_size_ - TRAILER_SIZE - footer_offset_, 0);
+    pread_all(fd_, &buf[0], buf.size(), footer_offset_, path);
+    FooterReader footer(path, buf);
+
+    size_t const num_columns = footer.u64();
+    for (size_t c = 0; c < num_columns; ++c) {
+      names_.push_back(footer.str());
+      auto const dtype = footer.u64();
+      if (dtype > (uint64_t) DType::ID)
+        throw ColFileError("corrupt footer in "s + path);
+      dtypes_.push_back((DType) dtype);
+      dictionaries_.emplace_back(footer.u64());
+      for (auto& str : dictionaries_.back())
+        str = footer.str();
+    }
+
+    size_t const num_groups = footer.u64();
+    size_t end = sizeof(MAGIC);
+    for (size_t g = 0; g < num_groups; ++g) {
+      ColFileGroup group;
+      group.offset = footer.u64();
+      group.num_rows = footer.u64();
+      for (size_t c0 = 0; c0 < num_columns; c0 += 64) {
+        auto const bits = footer.u64();
+        for (size_t c = c0; c < std::min(c0 + 64, num_columns); ++c)
+          group.validity.push_back((bits >> (c - c0)) & 1);
+      }
+      if (group.offset != end)
+        throw ColFileError("corrupt footer in "s + path);
+      end = locate_columns(group, dtypes_);
+      if (end > footer_offset_)
+        throw ColFileError("corrupt footer in "s + path);
+      num_rows_ += group.num_rows;
+      groups_.push_back(std::move(group));
+    }
+  }
+  catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+
+ColFileReader::~ColFileReader()
+{
+  ::close(fd_);
+}
+
+
+size_t
+ColFileReader::group_bytes(
+  size_t const begin,
+  size_t const end)
+  const
+{
+  assert(begin <= end && end <= groups_.size());
+  if (begin == end)
+    return 0;
+  return (end < groups_.size() ? groups_[end].offset : footer_offset_)
+    - groups_[begin].offset;
+}
+
+
+Table
+ColFileReader::read(
+  size_t const begin,
+  size_t const end)
+  const
+{
+  return read(begin, end, false);
+}
+
+
+Table
+ColFileReader::read()
+  const
+{
+  return read(0, groups_.size(), true);
+}
+
+
+namespace {
+
+/*
+ * Reads values of column `c` from groups [begin, end) into one column.
+ */
+template<typename T>
+std::unique_ptr<ColumnBase>
+read_column(
+  int const fd,
+  std::string const& path,
+  std::vector<ColFileGroup> const& groups,
+  size_t const begin,
+  size_t const end,
+  size_t const c,
+  DType const dtype,
+  std::vector<std::string> dictionary)
+{
+  size_t num_rows = 0;
+  bool has_null = false;
+  for (size_t g = begin; g < end; ++g) {
+    num_rows += groups[g].num_rows;
+    has_null |= groups[g].validity[c];
+  }
+
+  std::vector<T> values(num_rows);
+  std::vector<uint64_t> validity;
+  if (has_null)
+    validity.assign(num_words(num_rows), ~uint64_t(0));
+  std::vector<uint64_t> bits;
+  size_t row = 0;
+  for (size_t g = begin; g < end; ++g) {
+    auto const& group = groups[g];
+    size_t offset = group.offsets[c];
+    if (group.validity[c]) {
+      // Copy null bits, shifted to this group's rows.
+      bits.resize(num_words(group.num_rows));
+      pread_all(fd, bits.data(), bits.size() * 8, offset, path);
+      offset += bits.size() * 8;
+      for (size_t i = 0; i < group.num_rows; ++i)
+        if (!get_bit(bits.data(), i))
+          clear_bit(validity.data(), row + i);
+    }
+    pread_all(
+      fd, values.data() + row, group.num_rows * sizeof(T), offset, path);
+    row += group.num_rows;
+  }
+
+  return std::unique_ptr<ColumnBase>(new Column<T>(
+    dtype, std::move(values), std::move(validity), std::move(dictionary)));
+}
+
+
+}  // anonymous namespace
+
+Table
+ColFileReader::read(
+  size_t const begin,
+  size_t const end,
+  bool const dictionaries)
+  const
+{
+  assert(begin <= end && end <= groups_.size());
+  Table table;
+  for (size_t c = 0; c < names_.size(); ++c) {
+    auto const dtype = dtypes_[c];
+    table.add(
+      names_[c],
+      dtype == DType::F64
+        ? read_column<double>(fd_, path_, groups_, begin, end, c, dtype, {})
+      : dtype == DType::ID
+        ? read_column<uint32_t>(
+            fd_, path_, groups_, begin, end, c, dtype,
+            dictionaries ? dictionaries_[c] : std::vector<std::string>{})
+      : read_column<int64_t>(fd_, path_, groups_, begin, end, c, dtype, {}));
+  }
+  return table;
+}
+
+
+//------------------------------------------------------------------------------
+
+void
+write_colfile(
+  std::string const& path,
+  Table const& table,
+  size_t const group_rows)
+{
+  std::vector<std::string> names;
+  std::vector<DType> dtypes;
+  for (size_t c = 0; c < table.num_columns(); ++c) {
+    names.push_back(table.name(c));
+    dtypes.push_back(table.column(c).dtype());
+  }
+
+  ColFileWriter writer(path, std::move(names), std::move(dtypes));
+  for (size_t i = 0; i < table.num_rows(); i += group_rows)
+    writer.write(table, i, i + group_rows);
+  writer.close();
+}
+
+
+Table
+load_colfile(
+  std::string const& path)
+{
+  return ColFileReader(path).read();
+}
+
+
+void
+evict_file(
+  std::string const& path)
+{
+  int const fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "column.hh"
+
+//------------------------------------------------------------------------------
+// Column files: tables stored on disk as blocks of contiguous column arrays.
+//
+// A file is a magic number, a sequence of row groups, a footer, and a trailer
+// with the footer's offset.  A group stores, for each column in order, the
+// column's validity bits if any of its values in the group are null, then its
+// values, padded to 8 bytes.  The footer holds the schema, dictionaries of ID
+// columns, and the location and number of rows of each group.  Everything is in
+// native byte order.
+//
+// Since groups are contiguous and located by the footer, a reader can read any
+// range of groups with one sequential read per column, and needn't hold more
+// than that in memory.
+//------------------------------------------------------------------------------
+
+class ColFileError
+  : public std::runtime_error
+{
+public:
+
+  using std::runtime_error::runtime_error;
+
+};
+
+
+/*
+ * Returns true if `path` has the column file extension, ".col".
+ */
+extern bool is_colfile_path(std::string const& path);
+
+/*
+ * Location of a row group.
+ */
+struct ColFileGroup
+{
+  size_t offset;
+  size_t num_rows;
+  // Offset in the file of each column's data.
+  std::vector<size_t> offsets;
+  // Whether each column has validity bits.
+  std::vector<bool> validity;
+};
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes a column file, one row group per call to `write()`.
+ */
+class ColFileWriter
+{
+public:
+
+  /*
+   * Creates or truncates the file at `path`, for columns with `names` and
+   * `dtypes`.
+   */
+  ColFileWriter(
+    std::string const& path,
+    std::vector<std::string> names,
+    std::vector<DType> dtypes);
+
+  ColFileWriter(ColFileWriter const&) = delete;
+  ~ColFileWriter();
+
+  /*
+   * Sets the dictionary of ID column `c`, before any groups are written.
+   */
+  void set_dictionary(size_t c, std::vector<std::string> dictionary);
+
+  /*
+   * Writes rows [begin, end) of `table`, whose columns must match the file's,
+   * as a row group.
+   *
+   * Codes of ID columns with a dictionary are remapped into the file's
+   * dictionary, which grows as needed.  Codes of ID columns without one are
+   * written as they are, as codes into the file's dictionary.
+   */
+  void write(Table const& table, size_t begin=0, size_t end=(size_t) -1);
+
+  /*
+   * Writes the footer and closes the file.  Returns the file size.
+   */
+  size_t close();
+
+private:
+
+  void write_bytes(void const* data, size_t size);
+
+  std::string const path_;
+  std::vector<std::string> const names_;
+  std::vector<DType> const dtypes_;
+  int fd_;
+  size_t offset_;
+
+  std::vector<std::vector<std::string>> dictionaries_;
+  std::vector<std::unordered_map<std::string, uint32_t>> codes_;
+
+  std::vector<ColFileGroup> groups_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Reads a column file.
+ *
+ * The file stays open, and groups are read with `pread()`, so reads may be made
+ * from several threads at once.
+ */
+class ColFileReader
+{
+public:
+
+  explicit ColFileReader(std::string const& path);
+  ColFileReader(ColFileReader const&) = delete;
+  ~ColFileReader();
+
+  size_t file_size() const              { return file_size_; }
+  size_t num_columns() const            { return names_.size(); }
+  std::string const& name(size_t c) const { return names_[c]; }
+  DType dtype(size_t c) const           { return dtypes_[c]; }
+  std::vector<std::string> const& names() const { return names_; }
+  std::vector<DType> const& dtypes() const { return dtypes_; }
+
+  // For ID columns, the strings that codes index.
+  std::vector<std::string> const&
+  dictionary(size_t c) const            { return dictionaries_[c]; }
+
+  size_t num_groups() const             { return groups_.size(); }
+  size_t num_rows() const               { return num_rows_; }
+  size_t group_rows(size_t g) const     { return groups_[g].num_rows; }
+  ColFileGroup const& group(size_t g) const { return groups_[g]; }
+
+  // Bytes that groups [begin, end) occupy in the file.
+  size_t group_bytes(size_t begin, size_t end) const;
+
+  /*
+   * Reads groups [begin, end) into one table.  ID columns are left without
+   * dictionaries; their codes index `dictionary()`.
+   */
+  Table read(size_t begin, size_t end) const;
+
+  /*
+   * Reads the whole file, with dictionaries.
+   */
+  Table read() const;
+
+private:
+
+  Table read(size_t begin, size_t end, bool dictionaries) const;
+
+  std::string const path_;
+  int fd_;
+  size_t file_size_;
+  std::vector<std::string> names_;
+  std::vector<DType> dtypes_;
+  std::vector<std::vector<std::string>> dictionaries_;
+
+  std::vector<ColFileGroup> groups_;
+  size_t num_rows_ = 0;
+  // Offset of the footer, where groups end.
+  size_t footer_offset_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes `table` as a column file, in groups of `group_rows`.
+ */
+extern void write_colfile(
+  std::string const& path, Table const& table, size_t group_rows=1 << 20);
+
+/*
+ * Reads a whole column file.
+ */
+extern Table load_colfile(std::string const& path);
+
+/*
+ * Flushes a file to disk and evicts it from the page cache, so that it's next
+ * read from disk.
+ */
+extern void evict_file(std::string const& path);
+
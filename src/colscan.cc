@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <system_error>
+#include <unistd.h>
+
+#include "colfile.hh"
+#include "colscan.hh"
+#include "timing.hh"
+#include "uring.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+char const*
+io_engine_name(
+  IoEngine const engine)
+{
+  switch (engine) {
+  case IoEngine::SYNC:  return "sync";
+  case IoEngine::URING: return "uring";
+  }
+  return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Alignment of buffers, and of offsets and sizes for O_DIRECT.
+size_t constexpr ALIGN = 4096;
+
+inline size_t
+align_down(
+  size_t const n)
+{
+  return n & ~(ALIGN - 1);
+}
+
+
+inline size_t
+align_up(
+  size_t const n)
+{
+  return align_down(n + ALIGN - 1);
+}
+
+
+struct Free
+{
+  void operator()(void* const ptr) const { free(ptr); }
+};
+
+
+using AlignedBuffer = std::unique_ptr<char, Free>;
+
+AlignedBuffer
+alloc_aligned(
+  size_t const size)
+{
+  void* ptr;
+  if (posix_memalign(&ptr, ALIGN, size) != 0)
+    throw std::bad_alloc();
+  return AlignedBuffer((char*) ptr);
+}
+
+
+/*
+ * A read of part of the file into a buffer.
+ */
+struct Read
+{
+  char* buf;
+  uint64_t offset;
+  size_t size;
+  // Bytes that must be read to cover the data wanted, which may be fewer than
+  // `size` at the end of the file.
+  size_t needed;
+};
+
+
+/*
+ * Completes a read that returned `done` bytes, with blocking reads.
+ */
+void
+finish_read(
+  int const fd,
+  Read const& read,
+  size_t done,
+  std::string const& path)
+{
+  while (done < read.needed) {
+    auto const n = pread(
+      fd, read.buf + done, read.size - done, read.offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw ColFileError(
+        "can't read "s + path + ": "
+        + (n == 0 ? "unexpected end of file" : strerror(errno)));
+    done += n;
+  }
+}
+
+
+/*
+ * A chunk's location in the file.
+ */
+struct ChunkPos
+{
+  size_t group;
+  // First row in the group, and in the file.
+  size_t group_row;
+  size_t row;
+  size_t num_rows;
+};
+
+
+/*
+ * Buffers for one chunk, and the reads that fill them.
+ */
+class Slot
+{
+public:
+
+  Slot(
+    size_t const num_columns,
+    size_t const chunk_rows)
+  {
+    for (size_t c = 0; c < num_columns; ++c) {
+      values_.push_back(alloc_aligned(chunk_rows * 8 + 2 * ALIGN));
+      validity_.push_back(alloc_aligned(chunk_rows / 8 + 2 * ALIGN));
+    }
+    chunk.values.resize(num_columns);
+    chunk.validity.resize(num_columns);
+  }
+
+  /*
+   * Sets up reads of chunk `pos` of `columns`.
+   */
+  void
+  prepare(
+    ColFileReader const& file,
+    std::vector<size_t> const& columns,
+    ChunkPos const& pos,
+    bool const direct)
+  {
+    auto const& group = file.group(pos.group);
+    reads.clear();
+    chunk.row = pos.row;
+    chunk.num_rows = pos.num_rows;
+    bytes = 0;
+
+    // Adds a read of `size` bytes at `offset`, and returns where they'll be.
+    auto const add = [&](char* const buf, size_t offset, size_t const size) {
+      bytes += size;
+      if (!direct) {
+        reads.push_back({buf, offset, size, size});
+        return buf;
+      }
+      size_t const start = align_down(offset);
+      size_t const end = align_up(offset + size);
+      reads.push_back({buf, start, end - start, offset + size - start});
+      return buf + (offset - start);
+    };
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+      size_t const c = columns[i];
+      size_t offset = group.offsets[c];
+      chunk.validity[i] = nullptr;
+      if (group.validity[c]) {
+        // Chunks start at multiples of 64 rows, so at a word of bits.
+        chunk.validity[i] = (uint64_t const*) add(
+          validity_[i].get(), offset + pos.group_row / 8,
+          (pos.num_rows + 63) / 64 * 8);
+        offset += (group.num_rows + 63) / 64 * 8;
+      }
+      size_t const width = file.dtype(c) == DType::ID ? 4 : 8;
+      chunk.values[i] = add(
+        values_[i].get(), offset + pos.group_row * width,
+        pos.num_rows * width);
+    }
+    pending = reads.size();
+  }
+
+  ScanChunk chunk;
+  std::vector<Read> reads;
+  // Number of reads not yet complete.
+  size_t pending = 0;
+  // Bytes of column data in the chunk.
+  size_t bytes = 0;
+
+private:
+
+  std::vector<AlignedBuffer> values_;
+  std::vector<AlignedBuffer> validity_;
+
+};
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+ScanStats
+scan_colfile(
+  std::string const& path,
+  std::vector<std::string> const& columns,
+  std::function<void(ScanChunk const&)> const& fn,
+  ScanOptions const& options)
+{
+  auto const start = Clock::now();
+  ColFileReader const file(path);
+  std::vector<size_t> cols;
+  for (auto const& name : columns) {
+    size_t c = 0;
+    while (c < file.num_columns() && file.name(c) != name)
+      ++c;
+    if (c == file.num_columns())
+      throw ColFileError("no column "s + name + " in " + path);
+    cols.push_back(c);
+  }
+
+  // Divide groups into chunks.
+  size_t const chunk_rows = std::max<size_t>(
+    64, (options.chunk_rows + 63) / 64 * 64);
+  std::vector<ChunkPos> chunks;
+  for (size_t g = 0, row = 0; g < file.num_groups(); ++g) {
+    size_t const num_rows = file.group_rows(g);
+    for (size_t r = 0; r < num_rows; r += chunk_rows)
+      chunks.push_back(
+        {g, r, row + r, std::min(chunk_rows, num_rows - r)});
+    row += num_rows;
+  }
+
+  ScanStats stats;
+  stats.engine = options.engine;
+  stats.direct = options.direct;
+  int fd = -1;
+  if (options.direct) {
+    fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0 && errno == EINVAL)
+      stats.direct = false;
+  }
+  if (fd < 0 && !stats.direct)
+    fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw ColFileError("can't open "s + path + ": " + strerror(errno));
+
+  // Each column may need a read of values and one of validity bits.
+  size_t const reads_per_chunk = 2 * cols.size();
+  size_t const num_slots = std::max(
+    1u, stats.engine == IoEngine::SYNC ? 1u : options.num_buffers);
+  std::unique_ptr<IoUring> ring;
+  if (stats.engine == IoEngine::URING)
+    try {
+      ring.reset(new IoUring(num_slots * reads_per_chunk));
+    }
+    catch (std::system_error const&) {
+      stats.engine = IoEngine::SYNC;
+    }
+
+  // Buffers outlive the ring, so that reads in flight complete first.
+  std::vector<Slot> slots;
+  try {
+    for (size_t s = 0; s < (ring ? num_slots : 1); ++s)
+      slots.emplace_back(cols.size(), chunk_rows);
+
+    // Handles completions.
+    auto const drain = [&]() {
+      uint64_t tag;
+      int result;
+      while (ring->pop(tag, result)) {
+        auto& slot = slots[tag / reads_per_chunk];
+        --slot.pending;
+        if (result == -EINVAL) {
+          // The kernel lacks IORING_OP_READ.  Read this with blocking reads,
+          // and queue no more.
+          stats.engine = IoEngine::SYNC;
+          result = 0;
+        }
+        else if (result < 0)
+          throw ColFileError(
+            "can't read "s + path + ": " + strerror(-result));
+        finish_read(fd, slot.reads[tag % reads_per_chunk], result, path);
+      }
+    };
+
+    // Prepares and, with io_uring, queues the reads of a chunk.
+    auto const queue = [&](size_t const i) {
+      auto& slot = slots[i % slots.size()];
+      slot.prepare(file, cols, chunks[i], stats.direct);
+      if (stats.engine == IoEngine::URING)
+        for (size_t r = 0; r < slot.reads.size(); ++r) {
+          auto const& read = slot.reads[r];
+          bool const queued = ring->prepare_read(
+            fd, read.buf, read.size, read.offset,
+            (i % slots.size()) * reads_per_chunk + r);
+          assert(queued);
+          (void) queued;
+        }
+    };
+
+    size_t next = 0;
+    if (ring) {
+      for (; next < std::min(slots.size(), chunks.size()); ++next)
+        queue(next);
+      ring->submit();
+    }
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      auto& slot = slots[i % slots.size()];
+      auto const wait_start = Clock::now();
+      if (i < next)
+        // Queued with io_uring.
+        while (slot.pending > 0) {
+          ring->submit(true);
+          drain();
+        }
+      else {
+        queue(i);
+        for (auto const& read : slot.reads)
+          finish_read(fd, read, 0, path);
+      }
+      stats.wait_time += time_since(wait_start);
+
+      auto const compute_start = Clock::now();
+      fn(slot.chunk);
+      stats.compute_time += time_since(compute_start);
+      ++stats.num_chunks;
+      stats.bytes += slot.bytes;
+
+      // Reuse the buffers for the next chunk not yet queued.
+      if (stats.engine == IoEngine::URING && next < chunks.size()) {
+        queue(next++);
+        ring->submit();
+      }
+    }
+  }
+  catch (...) {
+    // Wait for reads in flight before their buffers are freed.
+    if (ring)
+      try {
+        for (auto& slot : slots)
+          while (slot.pending > 0) {
+            ring->submit(true);
+            uint64_t tag;
+            int result;
+            while (ring->pop(tag, result))
+              --slots[tag / reads_per_chunk].pending;
+          }
+      }
+      catch (...) {
+      }
+    ring.reset();
+    close(fd);
+    throw;
+  }
+
+  ring.reset();
+  close(fd);
+  stats.elapsed = time_since(start);
+  return stats;
+}
+
+
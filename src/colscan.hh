@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Scans of column files that overlap reading with processing.
+//
+// Columns are read in chunks of rows into a pool of page-aligned buffers.
+// While the caller processes one chunk, reads of the next are in flight, so a
+// scan of data not in memory takes about the longer of the I/O and compute
+// times, rather than their sum.
+//------------------------------------------------------------------------------
+
+enum class IoEngine
+{
+  // Blocking `pread()` of each chunk before it's processed; no overlap.
+  SYNC,
+  // Reads queued ahead with io_uring.
+  URING,
+};
+
+
+extern char const* io_engine_name(IoEngine);
+
+struct ScanOptions
+{
+  IoEngine engine = IoEngine::URING;
+  // Rows per chunk, rounded up to a multiple of 64.  Chunks don't span groups.
+  size_t chunk_rows = 1 << 17;
+  // Number of chunk buffers, i.e. one being processed and the rest being read.
+  unsigned num_buffers = 4;
+  // If true, read with O_DIRECT, bypassing the page cache.
+  bool direct = false;
+};
+
+
+/*
+ * Rows of the scanned columns, valid during the call that receives them.
+ */
+struct ScanChunk
+{
+  // Index of the first row in the file.
+  size_t row;
+  size_t num_rows;
+  // Each column's values, in its column type, and validity bits, or null if
+  // all are valid.
+  std::vector<void const*> values;
+  std::vector<uint64_t const*> validity;
+};
+
+
+struct ScanStats
+{
+  // The engine and mode actually used, after any fallback.
+  IoEngine engine;
+  bool direct;
+  size_t num_chunks = 0;
+  // Bytes of column data delivered.
+  size_t bytes = 0;
+  // Total seconds, seconds blocked waiting for reads, and seconds processing.
+  double elapsed = 0;
+  double wait_time = 0;
+  double compute_time = 0;
+};
+
+
+/*
+ * Reads `columns` of the column file at `path`, and calls `fn(chunk)` for each
+ * chunk of rows in order, as soon as its reads complete.
+ *
+ * With `IoEngine::URING`, reads for the following chunks are queued while a
+ * chunk is processed.  If io_uring is unavailable, or the kernel predates its
+ * read operation, falls back to `SYNC`.  If the file system doesn't support
+ * O_DIRECT, falls back to buffered reads.
+ */
+extern ScanStats scan_colfile(
+  std::string const& path, std::vector<std::string> const& columns,
+  std::function<void(ScanChunk const&)> const& fn,
+  ScanOptions const& options=ScanOptions());
+
@@ -0,0 +1,66 @@
+#include <stdexcept>
+#include <string>
+
+#include "column.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+char const*
+dtype_name(
+  DType const dtype)
+{
+  switch (dtype) {
+  case DType::F64:  return "f64";
+  case DType::I64:  return "i64";
+  case DType::TIME: return "time";
+  case DType::ID:   return "id";
+  }
+  return nullptr;
+}
+
+
+DType
+parse_dtype(
+  std::string const& name)
+{
+  if (name == "f64")
+    return DType::F64;
+  else if (name == "i64")
+    return DType::I64;
+  else if (name == "time")
+    return DType::TIME;
+  else if (name == "id")
+    return DType::ID;
+  else
+    throw std::invalid_argument("unknown dtype: "s + name);
+}
+
+
+//------------------------------------------------------------------------------
+
+bool
+Table::has(
+  std::string const& name)
+  const
+{
+  for (auto const& n : names_)
+    if (n == name)
+      return true;
+  return false;
+}
+
+
+ColumnBase const&
+Table::operator[](
+  std::string const& name)
+  const
+{
+  for (size_t i = 0; i < names_.size(); ++i)
+    if (names_[i] == name)
+      return *columns_[i];
+  throw std::out_of_range("no column: "s + name);
+}
+
+
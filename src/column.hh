@@ -0,0 +1,380 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+/*
+ * A timestamp, as nanoseconds since 1970-01-01T00:00:00Z.
+ */
+using TimeNs = int64_t;
+
+/*
+ * Element type of a column.
+ */
+enum class DType
+{
+  F64,
+  I64,
+  TIME,
+  ID,     // dictionary-encoded string
+};
+
+
+extern char const* dtype_name(DType);
+extern DType parse_dtype(std::string const&);
+
+//------------------------------------------------------------------------------
+
+/*
+ * Type-erased base of all columns.
+ *
+ * A column holds a contiguous array of values and, optionally, validity bits.
+ * If there are no validity bits, all values are valid.
+ */
+class ColumnBase
+{
+public:
+
+  virtual ~ColumnBase() {}
+
+  virtual DType dtype() const = 0;
+  virtual size_t size() const = 0;
+
+  bool has_validity() const             { return !validity_.empty(); }
+
+  bool
+  is_valid(
+    size_t const i)
+    const
+  {
+    return validity_.empty() || (validity_[i / 64] >> (i % 64)) & 1;
+  }
+
+  std::vector<uint64_t> const& validity() const { return validity_; }
+
+protected:
+
+  std::vector<uint64_t> validity_;
+
+  template<typename T> friend class ColumnBuilder;
+
+};
+
+
+template<typename T>
+class Column
+  : public ColumnBase
+{
+public:
+
+  Column(DType const dtype) : Column(dtype, {}) {}
+
+  /*
+   * Takes values and, if any are null, validity bits.
+   */
+  Column(
+    DType const dtype,
+    std::vector<T> values,
+    std::vector<uint64_t> validity={},
+    std::vector<std::string> dictionary={})
+  : Column(
+      dtype, std::move(values), std::move(validity),
+      std::make_shared<std::vector<std::string> const>(std::move(dictionary)))
+  {
+  }
+
+  /*
+   * As above, but shares a dictionary with other columns.  The dictionary may
+   * grow, but existing codes must not change.
+   */
+  Column(
+    DType const dtype,
+    std::vector<T> values,
+    std::vector<uint64_t> validity,
+    std::shared_ptr<std::vector<std::string> const> dictionary)
+  : dtype_(dtype),
+    values_(std::move(values)),
+    dictionary_(std::move(dictionary))
+  {
+    assert(validity.empty() || validity.size() == (values_.size() + 63) / 64);
+    assert(dictionary_ != nullptr);
+    validity_ = std::move(validity);
+  }
+
+  DType dtype() const override          { return dtype_; }
+  size_t size() const override          { return values_.size(); }
+
+  T const* data() const                 { return values_.data(); }
+  T operator[](size_t i) const          { return values_[i]; }
+  std::vector<T> const& values() const  { return values_; }
+
+  // For ID columns only.
+  std::vector<std::string> const& dictionary() const { return *dictionary_; }
+  std::shared_ptr<std::vector<std::string> const> const&
+  shared_dictionary() const             { return dictionary_; }
+
+private:
+
+  DType const dtype_;
+  std::vector<T> values_;
+  std::shared_ptr<std::vector<std::string> const> dictionary_;
+
+  template<typename U> friend class ColumnBuilder;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Accumulates values for a column.
+ *
+ * Builders for disjoint row ranges can be built independently, e.g. in
+ * different threads, and then concatenated in order with `append()`.
+ */
+template<typename T>
+class ColumnBuilder
+{
+public:
+
+  ColumnBuilder(DType const dtype) : col_(new Column<T>(dtype)) {}
+
+  DType dtype() const                   { return col_->dtype_; }
+  size_t size() const                   { return col_->values_.size(); }
+  void reserve(size_t const num)        { col_->values_.reserve(num); }
+
+  void
+  append(
+    T const val)
+  {
+    if (has_nulls_ && size() % 64 == 0)
+      col_->validity_.push_back(0);
+    col_->values_.push_back(val);
+    if (has_nulls_)
+      set_valid(size() - 1);
+  }
+
+  void
+  append_null()
+  {
+    if (!has_nulls_)
+      start_validity();
+    if (size() % 64 == 0)
+      col_->validity_.push_back(0);
+    col_->values_.push_back(T{});
+  }
+
+  /*
+   * Appends the contents of another builder, which is left empty.
+   */
+  void append(ColumnBuilder&& other);
+
+  /*
+   * For ID columns, encodes `str` and appends its code.
+   */
+  void
+  append_str(
+    std::string const& str)
+  {
+    auto const i = codes_.find(str);
+    if (i == codes_.end()) {
+      T const code = dictionary_.size();
+      codes_.emplace(str, code);
+      dictionary_.push_back(str);
+      append(code);
+    }
+    else
+      append(i->second);
+  }
+
+  std::unique_ptr<Column<T>>
+  finish()
+  {
+    auto col = std::move(col_);
+    col_.reset(new Column<T>(col->dtype_));
+    col->dictionary_ = std::make_shared<std::vector<std::string> const>(
+      std::move(dictionary_));
+    has_nulls_ = false;
+    dictionary_.clear();
+    codes_.clear();
+    return col;
+  }
+
+private:
+
+  void
+  set_valid(
+    size_t const i)
+  {
+    col_->validity_[i / 64] |= uint64_t(1) << (i % 64);
+  }
+
+  void
+  start_validity()
+  {
+    // Mark all values so far as valid.
+    auto const num = size();
+    col_->validity_.assign((num + 63) / 64, 0);
+    for (size_t i = 0; i < num; ++i)
+      set_valid(i);
+    has_nulls_ = true;
+  }
+
+  std::unique_ptr<Column<T>> col_;
+  bool has_nulls_ = false;
+  // For ID columns, the dictionary and its codes.
+  std::vector<std::string> dictionary_;
+  std::unordered_map<std::string, T> codes_;
+
+};
+
+
+template<typename T>
+void
+ColumnBuilder<T>::append(
+  ColumnBuilder&& other)
+{
+  auto& src = *other.col_;
+  if (other.has_nulls_ && !has_nulls_)
+    start_validity();
+
+  // Remap dictionary codes, if any, into this builder's dictionary.
+  std::vector<T> remap;
+  for (auto const& str : other.dictionary_) {
+    auto const i = codes_.find(str);
+    if (i == codes_.end()) {
+      T const code = dictionary_.size();
+      codes_.emplace(str, code);
+      dictionary_.push_back(str);
+      remap.push_back(code);
+    }
+    else
+      remap.push_back(i->second);
+  }
+
+  auto& dst = col_->values_;
+  auto const base = dst.size();
+  if (remap.empty())
+    dst.insert(dst.end(), src.values_.begin(), src.values_.end());
+  else
+    for (auto const val : src.values_)
+      dst.push_back(remap[val]);
+
+  if (has_nulls_) {
+    col_->validity_.resize((dst.size() + 63) / 64, 0);
+    for (size_t i = 0; i < src.values_.size(); ++i)
+      if (src.is_valid(i))
+        set_valid(base + i);
+  }
+
+  other.finish();
+}
+
+
+/*
+ * Builder for a column of whichever type `dtype` requires: doubles for F64,
+ * int64s for I64 and TIME, or dictionary codes for ID.
+ */
+struct AnyColumnBuilder
+{
+  AnyColumnBuilder(
+    DType const dtype)
+  : dtype(dtype), f64(dtype), i64(dtype), id(dtype)
+  {
+  }
+
+  DType dtype;
+  ColumnBuilder<double> f64;
+  ColumnBuilder<int64_t> i64;
+  ColumnBuilder<uint32_t> id;
+
+  void
+  append_null()
+  {
+    switch (dtype) {
+    case DType::F64:  f64.append_null(); break;
+    case DType::I64:
+    case DType::TIME: i64.append_null(); break;
+    case DType::ID:   id.append_null(); break;
+    }
+  }
+
+  void
+  append(
+    AnyColumnBuilder&& other)
+  {
+    f64.append(std::move(other.f64));
+    i64.append(std::move(other.i64));
+    id.append(std::move(other.id));
+  }
+
+  std::unique_ptr<ColumnBase>
+  finish()
+  {
+    switch (dtype) {
+    case DType::F64:  return f64.finish();
+    case DType::I64:
+    case DType::TIME: return i64.finish();
+    case DType::ID:   return id.finish();
+    }
+    return nullptr;
+  }
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * An ordered collection of named columns of equal length.
+ */
+class Table
+{
+public:
+
+  size_t num_columns() const            { return columns_.size(); }
+  size_t num_rows() const { return columns_.empty() ? 0 : columns_[0]->size(); }
+
+  std::string const& name(size_t i) const { return names_[i]; }
+  ColumnBase const& column(size_t i) const { return *columns_[i]; }
+
+  bool has(std::string const& name) const;
+  ColumnBase const& operator[](std::string const& name) const;
+
+  void
+  add(
+    std::string const& name,
+    std::unique_ptr<ColumnBase> col)
+  {
+    assert(columns_.empty() || col->size() == num_rows());
+    names_.push_back(name);
+    columns_.push_back(std::move(col));
+  }
+
+private:
+
+  std::vector<std::string> names_;
+  std::vector<std::unique_ptr<ColumnBase>> columns_;
+
+};
+
+
+/*
+ * Returns `col` downcast to its concrete type.
+ */
+template<typename T>
+inline Column<T> const&
+column_cast(
+  ColumnBase const& col)
+{
+  return dynamic_cast<Column<T> const&>(col);
+}
+
+
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+
+#include "compare.hh"
+#include "json_stream.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Fewest samples on each side for the Mann-Whitney test's normal
+// approximation.
+size_t constexpr MIN_SAMPLES = 8;
+
+std::string
+key(
+  std::string const& name,
+  Params const& params,
+  CacheState const cache)
+{
+  std::string key = name;
+  for (auto const& p : params)
+    key += " "s + p.first + "=" + std::to_string(p.second);
+  return key + " " + cache_state_name(cache);
+}
+
+
+/*
+ * Prints the name, parameters, and cache state, in columns.
+ */
+void
+print_case(
+  std::ostream& os,
+  std::string const& name,
+  Params const& params,
+  CacheState const cache)
+{
+  std::string text;
+  for (auto const& p : params)
+    text += (text.empty() ? "" : " ") + p.first + "="
+      + std::to_string(p.second);
+  os << std::left << std::setw(20) << name << " "
+     << std::setw(28) << text << " "
+     << std::setw(4) << cache_state_name(cache) << std::right;
+}
+
+
+double
+median(
+  std::vector<double> vals)
+{
+  assert(!vals.empty());
+  auto const mid = vals.begin() + vals.size() / 2;
+  std::nth_element(vals.begin(), mid, vals.end());
+  if (vals.size() % 2 == 1)
+    return *mid;
+  return (*mid + *std::max_element(vals.begin(), mid)) / 2;
+}
+
+
+/*
+ * Returns the two-sided p-value of standard normal statistic `z`.
+ */
+double
+normal_p_value(
+  double const z)
+{
+  return std::erfc(std::abs(z) / std::sqrt(2.0));
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+char const*
+verdict_name(
+  Verdict const verdict)
+{
+  switch (verdict) {
+  case Verdict::SAME: return "same";
+  case Verdict::FASTER: return "faster";
+  case Verdict::SLOWER: return "slower";
+  }
+  return nullptr;
+}
+
+
+BenchResult
+result_from_json(
+  Json const& json)
+{
+  BenchResult result{};
+  result.name = json["name"].get_str();
+  for (auto const& p : json["params"].get_obj())
+    result.params[p.first] = (long) p.second.get_num();
+  result.cache = parse_cache_state(json["cache"].get_str());
+  result.num_elements = (long) json["num_elements"].get_num();
+  result.batch = (size_t) json["batch"].get_num();
+
+  auto const& stats = json["stats"];
+  result.stats = {
+    (size_t) stats["num_samples"].get_num(),
+    stats["min"].get_num(),
+    stats["max"].get_num(),
+    stats["mean"].get_num(),
+    stats["standard_deviation"].get_num(),
+  };
+  if (json.has("metrics"))
+    for (auto const& m : json["metrics"].get_obj())
+      result.metrics[m.first] = m.second.get_num();
+  if (json.has("samples"))
+    for (auto const& s : json["samples"].get_arr())
+      result.samples.push_back(s.get_num());
+  return result;
+}
+
+
+void
+save_results(
+  Json const& results,
+  std::string const& path)
+{
+  std::ofstream file(path);
+  if (!file)
+    throw std::runtime_error("can't write results: "s + path);
+  file << results << std::endl;
+}
+
+
+Baseline::Baseline(
+  std::string const& path)
+{
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("can't read baseline: "s + path);
+  auto const json = aslib::json::parse(file);
+  for (auto const& r : json.get_arr()) {
+    auto result = result_from_json(r);
+    auto k = key(result.name, result.params, result.cache);
+    results_.emplace(std::move(k), std::move(result));
+  }
+}
+
+
+BenchResult const*
+Baseline::find(
+  BenchResult const& result)
+  const
+{
+  auto const r = results_.find(key(result.name, result.params, result.cache));
+  return r == results_.end() ? nullptr : &r->second;
+}
+
+
+std::vector<BenchResult const*>
+Baseline::missing(
+  std::vector<Comparison> const& comparisons)
+  const
+{
+  std::set<std::string> compared;
+  for (auto const& c : comparisons)
+    compared.insert(key(c.name, c.params, c.cache));
+  std::vector<BenchResult const*> missing;
+  for (auto const& r : results_)
+    if (compared.count(r.first) == 0)
+      missing.push_back(&r.second);
+  return missing;
+}
+
+
+double
+mann_whitney(
+  std::vector<double> const& a,
+  std::vector<double> const& b)
+{
+  size_t const n1 = a.size();
+  size_t const n2 = b.size();
+  size_t const n = n1 + n2;
+
+  // Rank the pooled samples, remembering which are from `a`.
+  std::vector<std::pair<double, bool>> pooled;
+  pooled.reserve(n);
+  for (auto const x : a)
+    pooled.emplace_back(x, true);
+  for (auto const x : b)
+    pooled.emplace_back(x, false);
+  std::sort(pooled.begin(), pooled.end());
+
+  // Sum ranks of `a`, giving ties their mean rank.
+  double rank_sum = 0;
+  double ties = 0;
+  for (size_t i = 0; i < n; ) {
+    size_t j = i + 1;
+    while (j < n && pooled[j].first == pooled[i].first)
+      ++j;
+    double const rank = (i + j + 1) / 2.0;
+    for (size_t k = i; k < j; ++k)
+      if (pooled[k].second)
+        rank_sum += rank;
+    double const t = j - i;
+    ties += t * t * t - t;
+    i = j;
+  }
+
+  double const u = rank_sum - n1 * (n1 + 1) / 2.0;
+  double const mu = n1 * n2 / 2.0;
+  double const var = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1.0)));
+  if (!(var > 0))
+    return 1;
+  double const diff = std::abs(u - mu);
+  return normal_p_value(std::max(0.0, diff - 0.5) / std::sqrt(var));
+}
+
+
+double
+welch(
+  SummaryStats<Elapsed> const& a,
+  SummaryStats<Elapsed> const& b)
+{
+  double const var
+    = a.standard_deviation * a.standard_deviation / a.num_samples
+    + b.standard_deviation * b.standard_deviation / b.num_samples;
+  if (!(var > 0))
+    return a.mean == b.mean ? 1 : 0;
+  return normal_p_value((a.mean - b.mean) / std::sqrt(var));
+}
+
+
+Comparison
+compare(
+  BenchResult const& baseline,
+  BenchResult const& current,
+  CompareOptions const& options)
+{
+  Comparison comparison{
+    current.name, current.params, current.cache, nullptr, 0, 0, 0, 1,
+    Verdict::SAME};
+  if (baseline.samples.size() >= MIN_SAMPLES
+      && current.samples.size() >= MIN_SAMPLES) {
+    comparison.test = "mann-whitney";
+    comparison.baseline = median(baseline.samples);
+    comparison.current = median(current.samples);
+    comparison.p_value = mann_whitney(baseline.samples, current.samples);
+  }
+  else {
+    comparison.test = "welch";
+    comparison.baseline = baseline.stats.mean;
+    comparison.current = current.stats.mean;
+    comparison.p_value = welch(baseline.stats, current.stats);
+  }
+  comparison.change = comparison.current / comparison.baseline - 1;
+
+  if (comparison.p_value < options.alpha) {
+    if (comparison.change > options.threshold)
+      comparison.verdict = Verdict::SLOWER;
+    else if (comparison.change < -options.threshold)
+      comparison.verdict = Verdict::FASTER;
+  }
+  return comparison;
+}
+
+
+void
+print_text(
+  std::ostream& os,
+  Comparison const& comparison)
+{
+  print_case(os, comparison.name, comparison.params, comparison.cache);
+  os << std::setprecision(2) << std::fixed
+     << " " << format_ns(comparison.baseline)
+     << " -> " << format_ns(comparison.current)
+     << " " << std::showpos << std::setw(7) << comparison.change * 100
+     << std::noshowpos << "%"
+     << std::setprecision(4) << std::scientific
+     << "  p=" << comparison.p_value << std::defaultfloat
+     << " " << comparison.test
+     << "  " << verdict_name(comparison.verdict) << std::endl;
+}
+
+
+void
+print_unmatched(
+  std::ostream& os,
+  BenchResult const& result,
+  char const* const what)
+{
+  print_case(os, result.name, result.params, result.cache);
+  os << " " << what << std::endl;
+}
+
+
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench.hh"
+
+//------------------------------------------------------------------------------
+// Comparison of benchmark results against a saved baseline.
+//
+// `bench --save PATH` saves results, with raw samples, as JSON; `bench
+// --baseline PATH` loads them and tests each new result against the baseline
+// result with the same name, parameters, and cache state.  A result is a
+// regression if its time per call is significantly greater, by a two-sided
+// test at level `alpha`, and its median is slower by more than `threshold`.
+//
+// With raw samples on both sides, the test is Mann-Whitney U, which makes no
+// assumption about the shape of the distributions and is insensitive to the
+// outliers that interrupts and frequency changes produce.  Otherwise, e.g. for
+// a baseline saved by `--format json` without `--samples`, it is Welch's t
+// test on the summary statistics, and the change is that of the mean.
+//
+// Results with no baseline counterpart, and baseline results not run, are
+// reported as added and missing, but aren't regressions.
+//------------------------------------------------------------------------------
+
+struct CompareOptions
+{
+  // Significance level.
+  double alpha = 0.01;
+  // Smallest relative change in time that counts as a regression.
+  double threshold = 0.05;
+};
+
+
+enum class Verdict
+{
+  SAME,         // not significant, or smaller than the threshold
+  FASTER,
+  SLOWER,       // a regression
+};
+
+
+extern char const* verdict_name(Verdict);
+
+struct Comparison
+{
+  std::string name;
+  Params params;
+  CacheState cache;
+  // "mann-whitney" or "welch".
+  char const* test;
+  // Median time per call, or mean for Welch's test.
+  Elapsed baseline;
+  Elapsed current;
+  // Relative change in time: current / baseline - 1.
+  double change;
+  double p_value;
+  Verdict verdict;
+};
+
+
+/*
+ * Results loaded from a JSON array written by `bench --format json` or
+ * `bench --save`, by name, parameters, and cache state.
+ */
+class Baseline
+{
+public:
+
+  explicit Baseline(std::string const& path);
+
+  /*
+   * Returns the baseline result corresponding to `result`, or null.
+   */
+  BenchResult const* find(BenchResult const& result) const;
+
+  /*
+   * Returns baseline results that none of `comparisons` compares, in order of
+   * name, parameters, and cache state.
+   */
+  std::vector<BenchResult const*> missing(
+    std::vector<Comparison> const& comparisons) const;
+
+  size_t size() const                   { return results_.size(); }
+
+private:
+
+  std::map<std::string, BenchResult> results_;
+
+};
+
+
+/*
+ * Returns a result from its JSON representation, as by `to_json()`.  The
+ * histogram, roofline, and counters are not restored.
+ */
+extern BenchResult result_from_json(Json const& json);
+
+/*
+ * Saves `results`, a JSON array, to `path`.
+ */
+extern void save_results(Json const& results, std::string const& path);
+
+/*
+ * Compares `current` to `baseline`, which must be the same case.
+ */
+extern Comparison compare(
+  BenchResult const& baseline, BenchResult const& current,
+  CompareOptions const& options);
+
+/*
+ * Returns the two-sided p-value of the Mann-Whitney U test that samples `a`
+ * and `b` are from the same distribution, by the normal approximation with
+ * tie and continuity corrections.
+ */
+extern double mann_whitney(
+  std::vector<double> const& a, std::vector<double> const& b);
+
+/*
+ * Returns the two-sided p-value of Welch's t test that `a` and `b` have the
+ * same mean, by the normal approximation; samples are assumed numerous.
+ */
+extern double welch(
+  SummaryStats<Elapsed> const& a, SummaryStats<Elapsed> const& b);
+
+extern void print_text(std::ostream& os, Comparison const& comparison);
+
+/*
+ * Prints a result without a counterpart: "added" if only in the current
+ * results, or "missing" if only in the baseline.
+ */
+extern void print_unmatched(
+  std::ostream& os, BenchResult const& result, char const* what);
+
@@ -0,0 +1,503 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "csv.hh"
+#include "parallel.hh"
+#include "parse.hh"
+#include "text_bits.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+CsvSchema
+parse_csv_schema(
+  std::string const& types)
+{
+  CsvSchema schema;
+  std::istringstream ss(types);
+  std::string type;
+  while (std::getline(ss, type, ','))
+    if (type == "-")
+      schema.push_back({true, DType::F64});
+    else
+      schema.push_back({false, parse_dtype(type)});
+  return schema;
+}
+
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+size_t constexpr BLOCK_SIZE = 64;
+
+// Rows are split among threads only if each gets at least this much text.
+size_t constexpr MIN_CHUNK_SIZE = 1 << 20;
+
+/*
+ * Bitmasks of structural characters in a 64-byte block.
+ */
+struct Block
+{
+  uint64_t quote;
+  uint64_t delim;
+  uint64_t newline;
+};
+
+
+#ifdef __AVX2__
+
+inline uint64_t
+mask_eq(
+  __m256i const lo,
+  __m256i const hi,
+  char const c)
+{
+  __m256i const cv = _mm256_set1_epi8(c);
+  uint64_t const m0 = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, cv));
+  uint64_t const m1 = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, cv));
+  return m0 | m1 << 32;
+}
+
+
+inline Block
+scan_block(
+  char const* const p,
+  char const delimiter)
+{
+  __m256i const lo = _mm256_loadu_si256((__m256i const*) p);
+  __m256i const hi = _mm256_loadu_si256((__m256i const*) (p + 32));
+  return {mask_eq(lo, hi, '"'), mask_eq(lo, hi, delimiter), mask_eq(lo, hi, '\n')};
+}
+
+#else
+
+inline uint64_t
+mask_eq(
+  __m128i const (&v)[4],
+  char const c)
+{
+  __m128i const cv = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i)
+    mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[i], cv))
+            << (16 * i);
+  return mask;
+}
+
+
+inline Block
+scan_block(
+  char const* const p,
+  char const delimiter)
+{
+  __m128i const v[4] = {
+    _mm_loadu_si128((__m128i const*) p),
+    _mm_loadu_si128((__m128i const*) (p + 16)),
+    _mm_loadu_si128((__m128i const*) (p + 32)),
+    _mm_loadu_si128((__m128i const*) (p + 48)),
+  };
+  return {mask_eq(v, '"'), mask_eq(v, delimiter), mask_eq(v, '\n')};
+}
+
+#endif
+
+
+/*
+ * Calls `fn(block_start, block)` for each 64-byte block in [begin, end),
+ * padding the last block and masking out bits beyond `end`.
+ */
+template<typename FN>
+inline void
+for_each_block(
+  char const* const begin,
+  char const* const end,
+  char const delimiter,
+  FN&& fn)
+{
+  char const* p = begin;
+  for (; p + BLOCK_SIZE <= end; p += BLOCK_SIZE)
+    fn(p, scan_block(p, delimiter));
+
+  if (p < end) {
+    size_t const len = end - p;
+    char buf[BLOCK_SIZE] = {};
+    memcpy(buf, p, len);
+    auto block = scan_block(buf, delimiter);
+    uint64_t const valid = (uint64_t(1) << len) - 1;
+    block.quote &= valid;
+    block.delim &= valid;
+    block.newline &= valid;
+    fn(p, block);
+  }
+}
+
+
+/*
+ * Returns the number of quotes in [begin, end).
+ */
+size_t
+count_quotes(
+  char const* const begin,
+  char const* const end)
+{
+  size_t count = 0;
+  for_each_block(begin, end, '"', [&](char const*, Block const& block) {
+    count += __builtin_popcountll(block.quote);
+  });
+  return count;
+}
+
+
+/*
+ * Returns the start of the first row at or after `p`, given whether `p` is
+ * inside a quoted field.
+ */
+char const*
+find_row_start(
+  char const* p,
+  char const* const end,
+  bool in_quote)
+{
+  for (; p < end; ++p)
+    if (*p == '"')
+      in_quote = !in_quote;
+    else if (*p == '\n' && !in_quote)
+      return p + 1;
+  return end;
+}
+
+
+/*
+ * Removes surrounding double quotes from a field, if present.
+ */
+inline bool
+unquote(
+  char const*& b,
+  char const*& e)
+{
+  if (e - b >= 2 && *b == '"' && e[-1] == '"') {
+    ++b;
+    --e;
+    return true;
+  }
+  else
+    return false;
+}
+
+
+/*
+ * Returns the contents of a quoted field, with escaped quotes collapsed.
+ */
+std::string
+collapse_quotes(
+  char const* const b,
+  char const* const e)
+{
+  std::string str;
+  for (auto c = b; c < e; ++c) {
+    str.push_back(*c);
+    if (*c == '"' && c + 1 < e && c[1] == '"')
+      ++c;
+  }
+  return str;
+}
+
+
+/*
+ * Parses rows from a chunk of text into field builders.
+ */
+class ChunkParser
+{
+public:
+
+  ChunkParser(
+    CsvSchema const& schema,
+    char const delimiter,
+    char const* const text)
+  : schema_(schema),
+    delimiter_(delimiter),
+    text_(text)
+  {
+    for (auto const& field : schema)
+      builders_.emplace_back(field.dtype);
+  }
+
+  std::vector<AnyColumnBuilder>& builders() { return builders_; }
+
+  void
+  parse(
+    char const* const begin,
+    char const* const end)
+  {
+    uint64_t in_quote = 0;
+    char const* field = begin;
+
+    for_each_block(begin, end, delimiter_, [&](char const* p, Block const& block) {
+      // Mask of bytes inside quotes, including opening but not closing quotes.
+      uint64_t const quoted = prefix_xor(block.quote) ^ in_quote;
+      in_quote = (uint64_t) ((int64_t) quoted >> 63);
+
+      uint64_t structural = (block.delim | block.newline) & ~quoted;
+      while (structural != 0) {
+        int const i = __builtin_ctzll(structural);
+        end_field(field, p + i, (block.newline >> i) & 1);
+        field = p + i + 1;
+        structural &= structural - 1;
+      }
+    });
+
+    // Chunks end outside quotes, unless a quote is never closed.
+    if (in_quote)
+      error("unterminated quoted field", field);
+
+    // The last row may be missing its newline.
+    if (field < end || col_ > 0)
+      end_field(field, end, true);
+  }
+
+private:
+
+  [[noreturn]] void
+  error(
+    std::string const& msg,
+    char const* const pos)
+  {
+    std::ostringstream ss;
+    ss << msg << " at offset " << (pos - text_);
+    throw CsvError(ss.str());
+  }
+
+  void
+  end_field(
+    char const* b,
+    char const* e,
+    bool const eol)
+  {
+    if (eol && e > b && e[-1] == '\r')
+      --e;
+    if (eol && col_ == 0 && b == e)
+      // Skip a blank line.
+      return;
+    if (col_ >= schema_.size())
+      error("too many fields", b);
+
+    if (!schema_[col_].skip)
+      parse_field(builders_[col_], b, e);
+
+    if (eol) {
+      if (col_ + 1 != schema_.size())
+        error("too few fields", b);
+      col_ = 0;
+    }
+    else
+      ++col_;
+  }
+
+  void
+  parse_field(
+    AnyColumnBuilder& builder,
+    char const* b,
+    char const* e)
+  {
+    if (b == e) {
+      builder.append_null();
+      return;
+    }
+
+    bool const quoted = unquote(b, e);
+    switch (builder.dtype) {
+    case DType::F64: {
+      double val;
+      if (!parse_double(b, e, val))
+        error("invalid f64", b);
+      builder.f64.append(val);
+      } break;
+
+    case DType::I64: {
+      int64_t val;
+      if (!parse_int64(b, e, val))
+        error("invalid i64", b);
+      builder.i64.append(val);
+      } break;
+
+    case DType::TIME: {
+      TimeNs val;
+      if (!parse_time(b, e, val))
+        error("invalid time", b);
+      builder.i64.append(val);
+      } break;
+
+    case DType::ID:
+      if (quoted && std::find(b, e, '"') != e)
+        builder.id.append_str(collapse_quotes(b, e));
+      else
+        builder.id.append_str(std::string(b, e));
+      break;
+    }
+  }
+
+  CsvSchema const& schema_;
+  char const delimiter_;
+  char const* const text_;
+  std::vector<AnyColumnBuilder> builders_;
+  size_t col_ = 0;
+
+};
+
+
+/*
+ * Parses the header line, and returns the position after it.
+ */
+char const*
+parse_header(
+  char const* const text,
+  char const* const end,
+  char const delimiter,
+  std::vector<std::string>& names)
+{
+  char const* const eol = find_row_start(text, end, false);
+  char const* line_end = eol;
+  if (line_end > text && line_end[-1] == '\n')
+    --line_end;
+  if (line_end > text && line_end[-1] == '\r')
+    --line_end;
+
+  // Split at delimiters outside quotes, as rows are.
+  char const* b = text;
+  bool in_quote = false;
+  for (char const* p = text; ; ++p)
+    if (p < line_end && *p == '"')
+      in_quote = !in_quote;
+    else if (p == line_end || (*p == delimiter && !in_quote)) {
+      char const* nb = b;
+      char const* ne = p;
+      bool const quoted = unquote(nb, ne);
+      names.push_back(quoted ? collapse_quotes(nb, ne) : std::string(nb, ne));
+      if (p == line_end)
+        break;
+      b = p + 1;
+    }
+  if (in_quote)
+    throw CsvError("unterminated quoted field in header");
+  return eol;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+Table
+parse_csv(
+  char const* const text,
+  size_t const size,
+  CsvSchema const& schema,
+  CsvOptions const& options)
+{
+  char const* const end = text + size;
+  char const* start = text;
+
+  std::vector<std::string> names;
+  if (options.header) {
+    start = parse_header(text, end, options.delimiter, names);
+    if (names.size() != schema.size())
+      throw CsvError(
+        "header has "s + std::to_string(names.size()) + " fields; expected "
+        + std::to_string(schema.size()));
+  }
+  else
+    for (size_t i = 0; i < schema.size(); ++i)
+      names.push_back("c"s + std::to_string(i));
+
+  // Split the text into nominal chunks.
+  size_t const num_chunks = std::max<size_t>(
+    1, std::min<size_t>(
+      num_threads(options.num_threads), (end - start) / MIN_CHUNK_SIZE));
+  std::vector<char const*> bounds(num_chunks + 1);
+  for (size_t i = 0; i <= num_chunks; ++i)
+    bounds[i] = start + (end - start) * i / num_chunks;
+
+  if (num_chunks > 1) {
+    // Count quotes in each chunk, to determine whether each nominal chunk
+    // boundary is inside a quoted field.
+    std::vector<size_t> quotes(num_chunks);
+    run_parallel(num_chunks, [&](size_t const i) {
+      quotes[i] = count_quotes(bounds[i], bounds[i + 1]);
+    });
+
+    // Move each boundary forward to the start of the next row.
+    size_t parity = 0;
+    for (size_t i = 1; i < num_chunks; ++i) {
+      parity ^= quotes[i - 1] & 1;
+      bounds[i] = std::max(
+        bounds[i - 1], find_row_start(bounds[i], end, parity));
+    }
+  }
+
+  // Parse chunks in parallel.
+  std::vector<std::unique_ptr<ChunkParser>> parsers(num_chunks);
+  run_parallel(num_chunks, [&](size_t const i) {
+    parsers[i].reset(new ChunkParser(schema, options.delimiter, text));
+    parsers[i]->parse(bounds[i], bounds[i + 1]);
+  });
+
+  // Concatenate chunks.
+  Table table;
+  auto& builders = parsers[0]->builders();
+  for (size_t f = 0; f < schema.size(); ++f) {
+    if (schema[f].skip)
+      continue;
+    for (size_t i = 1; i < num_chunks; ++i)
+      builders[f].append(std::move(parsers[i]->builders()[f]));
+    table.add(names[f], builders[f].finish());
+  }
+  return table;
+}
+
+
+Table
+load_csv(
+  std::string const& path,
+  CsvSchema const& schema,
+  CsvOptions const& options)
+{
+  int const fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw CsvError("can't open "s + path + ": " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw CsvError("can't stat "s + path + ": " + strerror(errno));
+  }
+  size_t const size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return parse_csv(nullptr, 0, schema, options);
+  }
+
+  void* const addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw CsvError("can't map "s + path + ": " + strerror(errno));
+  madvise(addr, size, MADV_WILLNEED);
+
+  try {
+    auto table = parse_csv((char const*) addr, size, schema, options);
+    munmap(addr, size);
+    return table;
+  }
+  catch (...) {
+    munmap(addr, size);
+    throw;
+  }
+}
+
+
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "column.hh"
+
+//------------------------------------------------------------------------------
+
+class CsvError
+  : public std::runtime_error
+{
+public:
+
+  using std::runtime_error::runtime_error;
+
+};
+
+
+/*
+ * Type of one CSV field, or skip to ignore the field.
+ */
+struct CsvField
+{
+  bool skip;
+  DType dtype;
+};
+
+using CsvSchema = std::vector<CsvField>;
+
+/*
+ * Parses a schema of comma-separated field types, e.g. "time,id,f64,-,i64".
+ * A "-" skips the field.
+ */
+extern CsvSchema parse_csv_schema(std::string const& types);
+
+struct CsvOptions
+{
+  char delimiter = ',';
+  // If true, the first line contains field names.
+  bool header = true;
+  // Number of parser threads; 0 for one per hardware thread.
+  unsigned num_threads = 0;
+};
+
+
+/*
+ * Parses CSV text into a table.
+ *
+ * Each row must have exactly the fields in `schema`.  An empty field is
+ * stored as null.  Fields may be double-quoted, with "" for a literal quote.
+ *
+ * The text is split into chunks at row boundaries, which are parsed in
+ * parallel.  Delimiters, newlines, and quotes are located 64 bytes at a time
+ * with SIMD compares.
+ */
+extern Table parse_csv(
+  char const* text, size_t size,
+  CsvSchema const& schema, CsvOptions const& options=CsvOptions());
+
+/*
+ * Memory-maps and parses a CSV file.
+ */
+extern Table load_csv(
+  std::string const& path,
+  CsvSchema const& schema, CsvOptions const& options=CsvOptions());
+
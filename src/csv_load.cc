@@ -0,0 +1,117 @@
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <random>
+
+#include "csv.hh"
+#include "ndjson.hh"
+#include "timing.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes synthetic tick data with fields time,symbol,price,size: as CSV, or as
+ * NDJSON if `path` has its extension.
+ */
+void
+generate(
+  std::string const& path,
+  long const num_rows)
+{
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> sym(0, 499);
+  std::uniform_int_distribution<int> dt(1, 2000000);
+  std::uniform_int_distribution<int> size(1, 5000);
+  std::normal_distribution<double> ret(0, 1e-4);
+
+  FILE* const file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    perror(path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  bool const ndjson = is_ndjson_path(path);
+  if (!ndjson)
+    fprintf(file, "time,symbol,price,size\n");
+  // Start at 09:30:00.
+  long sec = 34200;
+  long nsec = 0;
+  double price = 100;
+  for (long i = 0; i < num_rows; ++i) {
+    nsec += dt(rng);
+    sec += nsec / 1000000000;
+    nsec %= 1000000000;
+    price *= 1 + ret(rng);
+    fprintf(
+      file,
+      ndjson
+        ? "{\"time\":\"2017-07-14T%02ld:%02ld:%02ld.%09ld\",\"symbol\":"
+          "\"SYM%03d\",\"price\":%.4f,\"size\":%d}\n"
+        : "2017-07-14T%02ld:%02ld:%02ld.%09ld,SYM%03d,%.4f,%d\n",
+      sec / 3600 % 24, sec / 60 % 60, sec % 60, nsec,
+      sym(rng), price, size(rng));
+  }
+  fclose(file);
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc == 4 && std::string(argv[1]) == "--generate") {
+    generate(argv[2], parse_size(argv[3]));
+    return EXIT_SUCCESS;
+  }
+  if (argc < 3 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " PATH TYPES [THREADS]\n"
+              << "       " << argv[0] << " --generate PATH ROWS\n"
+              << "For .ndjson or .jsonl, TYPES are FIELD:TYPE,...\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    std::string const path = argv[1];
+    unsigned const threads = argc == 4 ? atoi(argv[3]) : 0;
+    std::function<Table()> load;
+    if (is_ndjson_path(path)) {
+      auto const schema = parse_ndjson_schema(argv[2]);
+      NdjsonOptions options;
+      options.num_threads = threads;
+      load = [=]() { return load_ndjson(path, schema, options); };
+    }
+    else {
+      auto const schema = parse_csv_schema(argv[2]);
+      CsvOptions options;
+      options.num_threads = threads;
+      load = [=]() { return load_csv(path, schema, options); };
+    }
+
+    // Load once to warm the page cache.
+    load();
+
+    std::ifstream file(argv[1], std::ios::ate | std::ios::binary);
+    size_t const size = file.tellg();
+
+    for (int i = 0; i < 5; ++i) {
+      auto const start = Clock::now();
+      auto const table = load();
+      auto const elapsed = time_since(start);
+      std::cout << std::setw(12) << table.num_rows() << " rows "
+                << std::setw(8) << std::setprecision(3) << std::fixed
+                << elapsed << " s "
+                << std::setw(8) << size / elapsed * 1e-9 << " GB/s"
+                << std::endl;
+    }
+  }
+  catch (std::exception const& exc) {
+    std::cerr << "error: " << exc.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,65 @@
+#include <string>
+
+#include "csv.hh"
+#include "test.hh"
+
+//------------------------------------------------------------------------------
+// Tests of CSV parsing.
+//------------------------------------------------------------------------------
+
+namespace {
+
+Table
+parse(
+  std::string const& text,
+  std::string const& types)
+{
+  return parse_csv(text.data(), text.size(), parse_csv_schema(types));
+}
+
+
+void
+test_quoted_header()
+{
+  auto const table = parse(
+    "\"a,b\",c,\"say \"\"hi\"\"\"\n"
+    "\"x,y\",1,2.5\n"
+    "z,2,3\n",
+    "id,i64,f64");
+  CHECK(table.num_columns() == 3);
+  CHECK(table.num_rows() == 2);
+  CHECK(table.has("a,b") && table.has("c") && table.has("say \"hi\""));
+  auto const& id = column_cast<uint32_t>(table["a,b"]);
+  CHECK(id.dictionary()[id[0]] == "x,y");
+  CHECK(column_cast<int64_t>(table["c"])[1] == 2);
+}
+
+
+void
+test_unterminated_header()
+{
+  bool threw = false;
+  try {
+    parse("\"a,b\nx\n", "id");
+  }
+  catch (CsvError const&) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+int
+main()
+{
+  test_quoted_header();
+  test_unterminated_header();
+
+  return test_result("csv_test");
+}
+
+
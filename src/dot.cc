@@ -1,64 +1,29 @@
 #include <cstddef>
-#include <iomanip>
-#include <unistd.h>
+#include <memory>
+#include <vector>
 
-#include "timing.hh"
+#include "bench.hh"
+#include "kernels.hh"
 
 //------------------------------------------------------------------------------
 
-__attribute((noinline)) 
-double
-dot(
-  size_t const num,
-  double const* const arg0,
-  double const* const arg1)
-{
-  double result = 0;
-  for (size_t i = 0; i < num; ++i)
-    result += arg0[i] * arg1[i];
-  return result;
-}
-
-
-int
-main(
-  int const argc,
-  char const* const* const argv)
-{
-  size_t const num = 1 << 25;
-  double* const arr0 = new double[num];
-  double* const arr1 = new double[num];
-  for (size_t i = 0; i < num; ++i) {
-    arr0[i] = i + 1;
-    arr1[i] = 1.0 / (i + 1);
-  }  
-
-  {
-    std::cout << "without cache flush:" << std::endl;
-    Timer timer{1.0, 0.1, nullptr};
-    for (size_t s = 0; s < 26; ++s) {
-      auto const n = 1 << s;
-      auto const stats = timer(dot, n, arr0, arr1);
-      std::cout << std::setw(10) << n << ": " 
-                << stats << " || " << stats / n
-                << std::endl;
-      // std::cout << to_json(stats) << std::endl;
+static auto const reg = register_benchmark(
+  "dot", {{"len", pow2_range(0, 25)}},
+  [](Params const& params) {
+    size_t const len = params.at("len");
+    auto const arr0 = std::make_shared<std::vector<double>>(len);
+    auto const arr1 = std::make_shared<std::vector<double>>(len);
+    for (size_t i = 0; i < len; ++i) {
+      (*arr0)[i] = i + 1;
+      (*arr1)[i] = 1.0 / (i + 1);
     }
-  }
-    
-  {
-    std::cout << "with cache flush:" << std::endl;
-    Timer timer{1.0, 0.1, []() { thrash_cache(6 * 1024 * 1024); }};
-    for (size_t s = 0; s < 26; ++s) {
-      auto const n = 1 << s;
-      auto const stats = timer(dot, n, arr0, arr1);
-      std::cout << std::setw(10) << n << ": " 
-                << stats << " || " << stats / n
-                << std::endl;
-    }
-  }
-    
-  return EXIT_SUCCESS;
-}
-
+    return Case{
+      [=]() { do_not_optimize(dot<double>(len, arr0->data(), arr1->data())); },
+      (long) len,
+      {},
+      2 * sizeof(double),
+      2,
+      {{arr0->data(), len * sizeof(double)},
+       {arr1->data(), len * sizeof(double)}}};
+  });
 
@@ -0,0 +1,215 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+#include "colfile.hh"
+#include "sort.hh"
+#include "timing.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes synthetic tick data with fields time,symbol,price,size as a column
+ * file, a group at a time, so that it may be larger than memory.
+ */
+void
+generate(
+  std::string const& path,
+  long const num_rows)
+{
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> sym(0, 499);
+  std::uniform_int_distribution<int> dt(1, 2000000);
+  std::uniform_int_distribution<int> size(1, 5000);
+  std::normal_distribution<double> ret(0, 1e-4);
+
+  ColFileWriter writer(
+    path, {"time", "symbol", "price", "size"},
+    {DType::TIME, DType::ID, DType::F64, DType::I64});
+  long const group_rows = 1 << 20;
+  // Start at 2017-07-14T09:30:00.
+  TimeNs time = 1500024600000000000;
+  double price = 100;
+  char name[8];
+  for (long i = 0; i < num_rows; i += group_rows) {
+    ColumnBuilder<int64_t> times(DType::TIME);
+    ColumnBuilder<uint32_t> syms(DType::ID);
+    ColumnBuilder<double> prices(DType::F64);
+    ColumnBuilder<int64_t> sizes(DType::I64);
+    for (long j = i; j < std::min(i + group_rows, num_rows); ++j) {
+      time += dt(rng);
+      price *= 1 + ret(rng);
+      snprintf(name, sizeof(name), "SYM%03d", sym(rng));
+      times.append(time);
+      syms.append_str(name);
+      prices.append(price);
+      sizes.append(size(rng));
+    }
+    Table group;
+    group.add("time", times.finish());
+    group.add("symbol", syms.finish());
+    group.add("price", prices.finish());
+    group.add("size", sizes.finish());
+    writer.write(group);
+  }
+  writer.close();
+}
+
+
+/*
+ * Measures sequential write and read bandwidth, in bytes/s, of a file of
+ * `size` bytes in `dir`.  The file is synced before the write is timed as
+ * complete, and evicted from the page cache before it's read.
+ */
+std::pair<double, double>
+probe_disk(
+  std::string const& dir,
+  size_t const size)
+{
+  std::string path = dir + "/datula-probe-XXXXXX";
+  int const fd = mkstemp(&path[0]);
+  if (fd < 0)
+    throw ColFileError("can't create file in " + dir + ": " + strerror(errno));
+  unlink(path.c_str());
+
+  std::vector<char> buf(16 << 20, 'x');
+  auto start = Clock::now();
+  for (size_t done = 0; done < size; ) {
+    auto const n = write(fd, buf.data(), std::min(buf.size(), size - done));
+    if (n <= 0) {
+      close(fd);
+      throw ColFileError("can't write probe file: "s + strerror(errno));
+    }
+    done += n;
+  }
+  fdatasync(fd);
+  double const write_bw = size / time_since(start);
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  start = Clock::now();
+  for (size_t done = 0; done < size; ) {
+    auto const n = pread(fd, buf.data(), buf.size(), done);
+    if (n <= 0) {
+      close(fd);
+      throw ColFileError("can't read probe file: "s + strerror(errno));
+    }
+    done += n;
+  }
+  double const read_bw = size / time_since(start);
+  close(fd);
+  return {write_bw, read_bw};
+}
+
+
+std::vector<std::string>
+split(
+  std::string const& str)
+{
+  std::vector<std::string> parts;
+  std::istringstream ss(str);
+  std::string part;
+  while (std::getline(ss, part, ','))
+    parts.push_back(part);
+  return parts;
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  auto const usage = [&]() {
+    std::cerr << "usage: " << argv[0]
+              << " [--memory SIZE] [--tmp DIR] [--group ROWS]"
+              << " [--no-read-ahead] [--drop-cache] [--probe SIZE]"
+              << " IN OUT KEY,...\n"
+              << "       " << argv[0] << " --generate PATH ROWS\n"
+              << "IN and OUT are column files.\n";
+    return EXIT_FAILURE;
+  };
+
+  if (argc == 4 && std::string(argv[1]) == "--generate") {
+    generate(argv[2], parse_size(argv[3]));
+    return EXIT_SUCCESS;
+  }
+
+  ExternalSortOptions options;
+  size_t probe_size = 256 << 20;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    std::string const arg = argv[i];
+    if (arg == "--memory" && i + 1 < argc)
+      options.memory = parse_size(argv[++i]);
+    else if (arg == "--tmp" && i + 1 < argc)
+      options.tmp_dir = argv[++i];
+    else if (arg == "--group" && i + 1 < argc)
+      options.group_rows = std::max(1l, parse_size(argv[++i]));
+    else if (arg == "--no-read-ahead")
+      options.read_ahead = false;
+    else if (arg == "--drop-cache")
+      options.drop_cache = true;
+    else if (arg == "--probe" && i + 1 < argc)
+      probe_size = parse_size(argv[++i]);
+    else
+      return usage();
+  }
+  if (argc - i != 3)
+    return usage();
+
+  try {
+    double write_bw = 0;
+    double read_bw = 0;
+    if (probe_size > 0)
+      std::tie(write_bw, read_bw) = probe_disk(options.tmp_dir, probe_size);
+
+    auto const start = Clock::now();
+    auto const stats = external_sort(
+      argv[i], argv[i + 1], split(argv[i + 2]), options);
+    auto const elapsed = time_since(start);
+    size_t const size = ColFileReader(argv[i]).file_size();
+
+    auto const gbps = [](double const bytes, double const secs) {
+      std::ostringstream ss;
+      ss << std::setprecision(3) << std::fixed << bytes / secs * 1e-9
+         << " GB/s";
+      return ss.str();
+    };
+    std::cout << std::setprecision(3) << std::fixed
+              << "sorted " << stats.num_rows << " rows, "
+              << size * 1e-9 << " GB, in " << elapsed << " s: "
+              << gbps(size, elapsed) << "\n"
+              << "runs:  " << stats.num_runs << " in "
+              << stats.run_time << " s\n"
+              << "merge: " << stats.num_passes << " passes in "
+              << stats.merge_time << " s\n"
+              << "I/O:   " << stats.bytes_read * 1e-9 << " GB read, "
+              << stats.bytes_written * 1e-9 << " GB written: "
+              << gbps(stats.bytes_read + stats.bytes_written, elapsed) << "\n";
+    if (probe_size > 0) {
+      // Time for the I/O alone, at the probed bandwidth.
+      double const io_time
+        = stats.bytes_read / read_bw + stats.bytes_written / write_bw;
+      std::cout << "disk:  " << gbps(write_bw, 1) << " write, "
+                << gbps(read_bw, 1) << " read: sort at "
+                << std::setprecision(0) << io_time / elapsed * 100
+                << "% of disk bandwidth\n";
+    }
+  }
+  catch (std::exception const& exc) {
+    std::cerr << "error: " << exc.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <memory>
+#include <numeric>
+
+#include "bench.hh"
+#include "parallel.hh"
+
+//------------------------------------------------------------------------------
+// Peak floating point rate.
+//
+// Runs many independent chains of double multiply-adds, enough to cover the
+// latency of every FMA unit, which the compiler vectorizes as it does other
+// kernels; the peak is thus for this build's vector width.
+// `bench --save-profile` records the result as the machine's peak FLOP rate,
+// for roofline reporting.
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Independent accumulators; eight vectors of AVX-512.
+size_t constexpr CHAINS = 64;
+// Multiply-adds per chain per run.
+size_t constexpr ITERATIONS = 1 << 12;
+
+__attribute((noinline)) double
+fma_chains(
+  size_t const num)
+{
+  // Converges to 1, so values stay normal.
+  double constexpr MUL = 0.999;
+  double constexpr ADD = 0.001;
+
+  double acc[CHAINS];
+  for (size_t j = 0; j < CHAINS; ++j)
+    acc[j] = j;
+  for (size_t i = 0; i < num; ++i)
+    for (size_t j = 0; j < CHAINS; ++j)
+      acc[j] = acc[j] * MUL + ADD;
+  return std::accumulate(acc, acc + CHAINS, 0.0);
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+static auto const reg_fma = register_benchmark(
+  "flops/fma", {{"threads", thread_counts()}},
+  [](Params const& params) {
+    unsigned const threads = params.at("threads");
+    auto const pool = std::make_shared<WorkerPool>(threads);
+    return Case{
+      [pool]() {
+        pool->run([](size_t) { do_not_optimize(fma_chains(ITERATIONS)); });
+      },
+      // Elements are iterations of all chains, in all threads.
+      (long) (ITERATIONS * threads),
+      {},
+      0,
+      2 * CHAINS};
+  },
+  {CacheState::WARM});
+
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//------------------------------------------------------------------------------
+// Fast formatting of numbers into character buffers.
+//
+// Each function writes to `buf`, which must have room for the longest result,
+// and returns the end of what it wrote.  Nothing is terminated.
+//------------------------------------------------------------------------------
+
+// Longest output of any of the functions below.
+size_t constexpr FORMAT_NUMBER_SIZE = 32;
+
+/*
+ * Formats an unsigned integer in decimal.
+ */
+extern char* format_uint64(uint64_t val, char* buf);
+
+/*
+ * Formats a signed integer in decimal.
+ */
+inline char*
+format_int64(
+  int64_t const val,
+  char* buf)
+{
+  if (val < 0) {
+    *buf++ = '-';
+    return format_uint64(-(uint64_t) val, buf);
+  }
+  else
+    return format_uint64(val, buf);
+}
+
+
+/*
+ * Formats a double as the shortest decimal that reads back as the same value,
+ * choosing the closest such decimal if there are several.
+ *
+ * The layout is as printf's "%.17g", but without trailing zeros: e.g. "0.1",
+ * "1234.5", "1e+20", "2.5e-07".  Integers below 2^53 are exact, and nonfinite
+ * values are "nan", "inf", or "-inf".  The digits are computed with the
+ * Schubfach algorithm, described in Giulietti, "The Schubfach way to render
+ * doubles", without multi-precision arithmetic or iteration.
+ */
+extern char* format_double(double val, char* buf);
+
+/*
+ * Appends the formatted double to `str`.
+ */
+inline void
+append_double(
+  std::string& str,
+  double const val)
+{
+  char buf[FORMAT_NUMBER_SIZE];
+  str.append(buf, format_double(val, buf));
+}
+
+
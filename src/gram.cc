@@ -0,0 +1,155 @@
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "bench.hh"
+#include "gram.hh"
+#include "kernels.hh"
+#include "tuning.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Computes the Gram matrix with one `dot()` call per pair of columns.
+ */
+double
+gram_pairwise(
+  size_t const num,
+  size_t const len,
+  double const* const* const cols,
+  double* const result,
+  unsigned)
+{
+  for (size_t i = 0; i < num; ++i)
+    for (size_t j = i; j < num; ++j)
+      result[i * num + j] = result[j * num + i] = dot<double>(len, cols[i], cols[j]);
+  return result[num * num - 1];
+}
+
+
+double
+gram_blocked(
+  size_t const num,
+  size_t const len,
+  double const* const* const cols,
+  double* const result,
+  unsigned const threads)
+{
+  static size_t const block = tuned("gram/block");
+  return gram<double, double>(
+    num, len, cols, result, nullptr, threads, block);
+}
+
+
+using GramFn = double (*)(
+  size_t, size_t, double const* const*, double*, unsigned);
+
+/*
+ * Returns `num` columns of returns of length `len`, driven by a common factor,
+ * and pointers to them.
+ */
+std::pair<
+  std::shared_ptr<std::vector<std::vector<double>>>,
+  std::shared_ptr<std::vector<double const*>>>
+make_returns(
+  size_t const num,
+  size_t const len)
+{
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0, 1);
+  std::vector<double> factor(len);
+  for (auto& f : factor)
+    f = normal(rng);
+  auto const data
+    = std::make_shared<std::vector<std::vector<double>>>(num);
+  auto const cols = std::make_shared<std::vector<double const*>>(num);
+  for (size_t c = 0; c < num; ++c) {
+    auto& col = (*data)[c];
+    double const beta = normal(rng);
+    col.resize(len);
+    for (size_t i = 0; i < len; ++i)
+      col[i] = 1e-3 + 1e-2 * (beta * factor[i] + normal(rng));
+    (*cols)[c] = col.data();
+  }
+  return {data, cols};
+}
+
+
+/*
+ * Registers a Gram matrix computation over correlated columns, reporting the
+ * maximum relative difference from pairwise dot products.  If `one_pass`, the
+ * computation reads each column from memory once, else once per pair.
+ */
+size_t
+register_gram(
+  char const* const name,
+  GramFn const fn,
+  std::vector<long> const& threads,
+  bool const one_pass)
+{
+  return register_benchmark(
+    name,
+    {{"columns", {64, 256, 500}}, {"len", {1 << 16}}, {"threads", threads}},
+    [fn, one_pass](Params const& params) {
+      size_t const num = params.at("columns");
+      size_t const len = params.at("len");
+      unsigned const threads = params.at("threads");
+
+      auto const made = make_returns(num, len);
+      auto const data = made.first;
+      auto const cols = made.second;
+
+      auto const result = std::make_shared<std::vector<double>>(num * num);
+      std::vector<double> ref(num * num);
+      gram_pairwise(num, len, cols->data(), ref.data(), 1);
+      fn(num, len, cols->data(), result->data(), threads);
+      double err = 0;
+      for (size_t i = 0; i < num * num; ++i)
+        err = std::max(err, std::abs(((*result)[i] - ref[i]) / ref[i]));
+
+      std::vector<MemoryRange> operands;
+      for (auto const col : *cols)
+        operands.push_back({col, len * sizeof(double)});
+
+      // Capture `data` too, which `cols` points into.
+      return Case{
+        [fn, num, len, data, cols, result, threads]() {
+          do_not_optimize(fn(num, len, cols->data(), result->data(), threads));
+        },
+        // Column pairs times length.
+        (long) (num * (num + 1) / 2 * len),
+        {{"max_rel_diff", err}},
+        one_pass ? 2.0 * sizeof(double) / (num + 1) : 2.0 * sizeof(double),
+        2,
+        operands};
+    });
+}
+
+
+// Enough columns that blocks matter, and few rows, as only the panels'
+// cache footprint depends on the block size.
+static auto const reg_block = register_tunable(
+  "gram/block", GRAM_BLOCK, {16, 32, 64, 128, 256, 512},
+  [](Params const& params) {
+    size_t const block = params.at("gram/block");
+    size_t const num = 512;
+    size_t const len = 2048;
+    auto const cols = make_returns(num, len);
+    auto const result = std::make_shared<std::vector<double>>(num * num);
+    return Case{
+      [num, len, block, cols, result]() {
+        do_not_optimize(gram<double, double>(
+          num, len, cols.second->data(), result->data(), nullptr, 1, block));
+      },
+      (long) (num * (num + 1) / 2 * len)};
+  });
+
+
+static auto const reg_pairwise
+  = register_gram("gram/pairwise", gram_pairwise, {1}, false);
+static auto const reg_blocked
+  = register_gram("gram/blocked", gram_blocked, {1, 2, 4}, true);
+
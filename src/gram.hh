@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "kernels.hh"
+#include "parallel.hh"
+#include "util.hh"
+
+//------------------------------------------------------------------------------
+// Gram, covariance, and correlation matrices of many columns.
+//
+// Computing `dot()` for each pair of N columns makes N (N + 1) / 2 passes over
+// memory, each performing one multiply-add per two values loaded.  Instead,
+// like a GEMM, `gram()` processes rows in panels of `GRAM_PANEL`.  Each panel
+// is packed, converted to the accumulator type, into a contiguous buffer that
+// stays in cache, and the products of all column pairs over the panel are
+// computed in `GRAM_TILE` x `GRAM_TILE` tiles, which perform 16 multiply-adds
+// per 8 values loaded.  Columns are read from memory only once (twice with
+// demeaning, to compute the means).
+//
+// Threads process disjoint row ranges into private matrices, which are summed
+// at the end in a fixed order, so results are reproducible for a given
+// thread count.
+//------------------------------------------------------------------------------
+
+// Rows per panel.
+size_t constexpr GRAM_PANEL = 256;
+// Columns per tile.
+size_t constexpr GRAM_TILE = 4;
+// Default columns per block of tiles whose panels are kept in cache together.
+size_t constexpr GRAM_BLOCK = 128;
+// Partial sums per tile entry.  With 4 x 4 tiles, 4 lanes of f64 fill 16
+// vector registers; more causes spills.
+size_t constexpr GRAM_LANES = 4;
+
+/*
+ * Adds the products of `GRAM_TILE` columns of panel `a` with `GRAM_TILE`
+ * columns of panel `b` to a tile of `g`, whose rows are `stride` apart.
+ */
+template<typename ACC>
+inline void
+gram_tile(
+  ACC const* const a,
+  ACC const* const b,
+  ACC* const g,
+  size_t const stride)
+{
+  ACC acc[GRAM_TILE][GRAM_TILE][GRAM_LANES] = {};
+  for (size_t k = 0; k < GRAM_PANEL; k += GRAM_LANES)
+    for (size_t i = 0; i < GRAM_TILE; ++i)
+      for (size_t j = 0; j < GRAM_TILE; ++j)
+        for (size_t l = 0; l < GRAM_LANES; ++l)
+          acc[i][j][l] += a[i * GRAM_PANEL + k + l] * b[j * GRAM_PANEL + k + l];
+
+  for (size_t i = 0; i < GRAM_TILE; ++i)
+    for (size_t j = 0; j < GRAM_TILE; ++j) {
+      ACC sum = 0;
+      for (size_t l = 0; l < GRAM_LANES; ++l)
+        sum += acc[i][j][l];
+      g[i * stride + j] += sum;
+    }
+}
+
+
+/*
+ * Computes the Gram matrix of `num` columns of length `len`: the dot products
+ * of all pairs of columns.  If `means` is not null, each column's mean is
+ * subtracted first.  `result` is a full, symmetric `num` x `num` matrix in
+ * row-major order.  `block` is the number of columns whose panels are kept in
+ * cache together, rounded up to whole tiles.  Returns the last result value.
+ */
+template<typename T, typename ACC=moment_t<T>>
+__attribute((noinline))
+ACC
+gram(
+  size_t const num,
+  size_t const len,
+  T const* const* const cols,
+  ACC* const result,
+  ACC const* const means=nullptr,
+  unsigned const threads=1,
+  size_t const block=GRAM_BLOCK)
+{
+  if (num == 0)
+    return 0;
+
+  // Pad columns, and blocks, to a whole number of tiles.
+  size_t const width = (num + GRAM_TILE - 1) / GRAM_TILE * GRAM_TILE;
+  size_t const block_width
+    = std::max<size_t>(1, (block + GRAM_TILE - 1) / GRAM_TILE) * GRAM_TILE;
+  size_t const parts
+    = std::max<size_t>(1, std::min<size_t>(threads, len / GRAM_PANEL));
+  std::vector<std::vector<ACC>> partial(parts);
+
+  run_parallel(parts, [&](size_t const part) {
+    auto& g = partial[part];
+    g.assign(width * width, 0);
+    std::vector<ACC> pack(width * GRAM_PANEL, 0);
+
+    size_t const end = len * (part + 1) / parts;
+    for (size_t k0 = len * part / parts; k0 < end; k0 += GRAM_PANEL) {
+      size_t const n = std::min(GRAM_PANEL, end - k0);
+
+      // Pack the panel, zero-padding the last rows.
+      for (size_t c = 0; c < num; ++c) {
+        ACC* const p = &pack[c * GRAM_PANEL];
+        T const* const col = cols[c] + k0;
+        ACC const mean = means == nullptr ? 0 : means[c];
+        for (size_t k = 0; k < n; ++k)
+          p[k] = ACC(col[k]) - mean;
+        std::fill(p + n, p + GRAM_PANEL, 0);
+      }
+
+      // Upper triangle of tiles, a block of columns at a time.
+      for (size_t j0 = 0; j0 < width; j0 += block_width) {
+        size_t const j1 = std::min(width, j0 + block_width);
+        for (size_t i = 0; i < j1; i += GRAM_TILE)
+          for (size_t j = std::max(i, j0); j < j1; j += GRAM_TILE)
+            gram_tile(
+              &pack[i * GRAM_PANEL], &pack[j * GRAM_PANEL],
+              &g[i * width + j], width);
+      }
+    }
+  });
+
+  for (size_t i = 0; i < num; ++i)
+    for (size_t j = i; j < num; ++j) {
+      ACC sum = 0;
+      for (auto const& g : partial)
+        sum += g[i * width + j];
+      result[i * num + j] = result[j * num + i] = sum;
+    }
+  return result[num * num - 1];
+}
+
+
+/*
+ * Computes the sample covariance matrix of `num` columns of length `len`.
+ */
+template<typename T, typename ACC=moment_t<T>>
+ACC
+covariance(
+  size_t const num,
+  size_t const len,
+  T const* const* const cols,
+  ACC* const result,
+  unsigned const threads=1)
+{
+  std::vector<ACC> means(num);
+  for (size_t c = 0; c < num; ++c)
+    means[c] = sum<T, ACC>(len, cols[c]) / ACC(len);
+
+  gram(num, len, cols, result, means.data(), threads);
+  ACC const scale = ACC(1) / ACC(len - 1);
+  for (size_t i = 0; i < num * num; ++i)
+    result[i] *= scale;
+  return num > 0 ? result[num * num - 1] : 0;
+}
+
+
+/*
+ * Computes the correlation matrix of `num` columns of length `len`.
+ */
+template<typename T, typename ACC=moment_t<T>>
+ACC
+correlation(
+  size_t const num,
+  size_t const len,
+  T const* const* const cols,
+  ACC* const result,
+  unsigned const threads=1)
+{
+  covariance(num, len, cols, result, threads);
+  std::vector<ACC> scale(num);
+  for (size_t i = 0; i < num; ++i)
+    scale[i] = ACC(1) / std::sqrt(result[i * num + i]);
+  for (size_t i = 0; i < num; ++i)
+    for (size_t j = 0; j < num; ++j)
+      result[i * num + j] = i == j ? 1 : result[i * num + j] * scale[i] * scale[j];
+  return num > 0 ? result[num * num - 1] : 0;
+}
+
+
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "histogram.hh"
+
+using aslib::json::Json;
+
+//------------------------------------------------------------------------------
+
+void
+Histogram::merge(
+  Histogram const& other)
+{
+  assert(unit_ == other.unit_ && sub_bits_ == other.sub_bits_);
+  for (size_t i = 0; i < counts_.size(); ++i)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+  sum2_ += other.sum2_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+
+double
+Histogram::percentile(
+  double const p)
+  const
+{
+  if (count_ == 0)
+    return NAN;
+  if (p <= 0)
+    return min_;
+  if (p >= 100)
+    return max_;
+
+  auto const rank = std::max<uint64_t>(1, std::ceil(p / 100 * count_));
+  uint64_t total = 0;
+  for (size_t i = 0; i < counts_.size(); ++i)
+    if ((total += counts_[i]) >= rank)
+      // Midpoint of the bucket, within the exact range.
+      return std::min(
+        max_, std::max(min_, (bucket_lo(i) + bucket_hi(i)) / 2));
+  return max_;
+}
+
+
+std::pair<double, double>
+Histogram::trimmed_moments(
+  double const discard_fraction)
+  const
+{
+  uint64_t const lo = count_ * discard_fraction / 2;
+  uint64_t const hi = count_ - lo;
+  if (lo == 0)
+    return {mean(), standard_deviation()};
+
+  // Count the values of ranks [lo, hi) in each bucket, at its midpoint.
+  uint64_t total = 0;
+  double m0 = 0, m1 = 0, m2 = 0;
+  for (size_t i = 0; i < counts_.size() && total < hi; ++i) {
+    auto const start = total;
+    total += counts_[i];
+    auto const n = std::min(total, hi) - std::max(start, std::min(total, lo));
+    if (n > 0) {
+      double const x = std::min(
+        max_, std::max(min_, (bucket_lo(i) + bucket_hi(i)) / 2));
+      m0 += n;
+      m1 += n * x;
+      m2 += n * x * x;
+    }
+  }
+  double const mean = m1 / m0;
+  return {
+    mean,
+    m0 > 1 ? std::sqrt(std::max(0.0, (m2 - m1 * mean) / (m0 - 1))) : 0};
+}
+
+
+Json
+to_json(
+  Histogram const& histogram)
+{
+  auto json = Json::new_obj();
+  json["count"] = Json((double) histogram.count());
+  if (histogram.count() > 0) {
+    json["min"] = histogram.min();
+    json["max"] = histogram.max();
+    json["mean"] = histogram.mean();
+    json["standard_deviation"] = histogram.standard_deviation();
+  }
+
+  auto percentiles = Json::new_obj();
+  for (auto const p : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+    std::ostringstream ss;
+    ss << p;
+    percentiles[ss.str()] = histogram.percentile(p);
+  }
+  json["percentiles"] = std::move(percentiles);
+
+  auto buckets = Json::new_arr();
+  for (size_t i = 0; i < histogram.num_buckets(); ++i)
+    if (histogram.bucket_count(i) > 0) {
+      auto bucket = Json::new_arr();
+      bucket[0] = histogram.bucket_lo(i);
+      bucket[1] = histogram.bucket_hi(i);
+      bucket[2] = Json((double) histogram.bucket_count(i));
+      buckets[buckets.size()] = std::move(bucket);
+    }
+  json["buckets"] = std::move(buckets);
+  return json;
+}
+
+
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "json.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Log-bucketed histogram of nonnegative values, in the style of HdrHistogram.
+ *
+ * Values are rounded to integer multiples of `unit`.  Integers below
+ * 2^`sub_bits` have their own buckets; above, each power of 2 is divided into
+ * 2^(`sub_bits` - 1) buckets, so a bucket's width is at most 2^(1 - `sub_bits`)
+ * of its values.  Memory is constant, about 2^`sub_bits` * (65 - `sub_bits`) / 2
+ * counts, and recording is O(1).
+ *
+ * Count, min, max, and moments are tracked exactly; percentiles are accurate to
+ * bucket width.  Histograms with the same unit and sub-bits can be merged, e.g.
+ * across runs or threads.
+ */
+class Histogram
+{
+public:
+
+  Histogram(
+    double const unit=1e-12,
+    int const sub_bits=8)
+  : unit_(unit),
+    sub_bits_(sub_bits),
+    counts_(index(std::numeric_limits<uint64_t>::max()) + 1, 0)
+  {
+    assert(unit > 0);
+    assert(1 < sub_bits && sub_bits < 32);
+  }
+
+  double unit() const                   { return unit_; }
+  uint64_t count() const                { return count_; }
+  double min() const                    { return count_ > 0 ? min_ : NAN; }
+  double max() const                    { return count_ > 0 ? max_ : NAN; }
+  double mean() const                   { return sum_ / count_; }
+
+  double
+  standard_deviation()
+    const
+  {
+    return count_ > 1
+      ? std::sqrt(std::max(0.0, (sum2_ - sum_ * sum_ / count_) / (count_ - 1)))
+      : 0;
+  }
+
+  void
+  record(
+    double const val)
+  {
+    double const v = std::max(0.0, val / unit_ + 0.5);
+    ++counts_[index(
+      v < 0x1p64 ? (uint64_t) v : std::numeric_limits<uint64_t>::max())];
+    ++count_;
+    sum_ += val;
+    sum2_ += val * val;
+    min_ = std::min(min_, val);
+    max_ = std::max(max_, val);
+  }
+
+  void merge(Histogram const& other);
+
+  /*
+   * Returns the value at percentile `p`, in [0, 100].
+   */
+  double percentile(double p) const;
+
+  /*
+   * Returns the mean and standard deviation, excluding `discard_fraction` of
+   * values, half from each end.  These are approximated from buckets.
+   */
+  std::pair<double, double> trimmed_moments(double discard_fraction) const;
+
+  size_t num_buckets() const            { return counts_.size(); }
+  uint64_t bucket_count(size_t i) const { return counts_[i]; }
+  double bucket_lo(size_t i) const      { return lower(i) * unit_; }
+  double bucket_hi(size_t i) const { return (double(lower(i)) + width(i)) * unit_; }
+
+private:
+
+  size_t
+  index(
+    uint64_t const v)
+    const
+  {
+    int const bits = v == 0 ? 0 : 64 - __builtin_clzll(v);
+    if (bits <= sub_bits_)
+      return v;
+    int const shift = bits - sub_bits_;
+    return ((size_t) shift << (sub_bits_ - 1)) + (v >> shift);
+  }
+
+  uint64_t
+  lower(
+    size_t const i)
+    const
+  {
+    if (i < ((size_t) 1 << sub_bits_))
+      return i;
+    size_t const shift = (i >> (sub_bits_ - 1)) - 1;
+    return (i - (shift << (sub_bits_ - 1))) << shift;
+  }
+
+  uint64_t
+  width(
+    size_t const i)
+    const
+  {
+    return i < ((size_t) 1 << sub_bits_)
+      ? 1 : (uint64_t) 1 << ((i >> (sub_bits_ - 1)) - 1);
+  }
+
+  double unit_;
+  int sub_bits_;
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  double sum_ = 0;
+  double sum2_ = 0;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = -std::numeric_limits<double>::infinity();
+
+};
+
+
+/*
+ * Returns count, min, max, mean, standard deviation, selected percentiles,
+ * and the nonempty buckets as [lo, hi, count].
+ */
+extern aslib::json::Json to_json(Histogram const& histogram);
+
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+#include "bench.hh"
+#include "colfile.hh"
+#include "colscan.hh"
+#include "kernels.hh"
+#include "util.hh"
+
+//------------------------------------------------------------------------------
+// Scans of a column file from disk, overlapping reads with computation.
+//
+// The file has two f64 columns, x and y, of `NUM_ROWS` rows, and is written
+// once to $TMPDIR, or /tmp, and shared by all cases.  Each run evicts it from
+// the page cache, then scans both columns in chunks and computes `work` dot
+// products of x and y per chunk.  Reads are blocking (`engine` 0) or queued
+// ahead with io_uring (1), buffered or with O_DIRECT (`direct` 1).  Bytes per
+// element are those read from disk.
+//
+// Setup measures the scan's I/O time alone, with no work, and then a scan with
+// work, whose own compute time it records.  The `overlap` metric is the
+// fraction of the shorter of the I/O and compute times that this scan hid: 1
+// if it took the longer of them, 0 if it took their sum.  As the I/O time is
+// from a separate scan, noise can put the estimate outside that range, so it
+// is clamped to it.  `wait` is the fraction of the scan spent blocked on
+// reads.  `direct` and `uring` show what was actually used, after any
+// fallback.
+//------------------------------------------------------------------------------
+
+namespace {
+
+size_t constexpr NUM_ROWS = size_t(1) << 24;
+size_t constexpr GROUP_ROWS = size_t(1) << 20;
+int constexpr NUM_CALIBRATIONS = 2;
+
+/*
+ * The scanned file, written on first use and removed at exit.
+ */
+class ScanFile
+{
+public:
+
+  ScanFile()
+  {
+    char const* const dir = getenv("TMPDIR");
+    path_ = std::string(dir == nullptr || *dir == '\0' ? "/tmp" : dir)
+      + "/bench-io-" + std::to_string(getpid()) + ".col";
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> val(-1, 1);
+    ColFileWriter writer(path_, {"x", "y"}, {DType::F64, DType::F64});
+    for (size_t i = 0; i < NUM_ROWS; i += GROUP_ROWS) {
+      ColumnBuilder<double> xs(DType::F64);
+      ColumnBuilder<double> ys(DType::F64);
+      for (size_t j = i; j < std::min(i + GROUP_ROWS, NUM_ROWS); ++j) {
+        xs.append(val(rng));
+        ys.append(val(rng));
+      }
+      Table group;
+      group.add("x", xs.finish());
+      group.add("y", ys.finish());
+      writer.write(group);
+    }
+    writer.close();
+  }
+
+  ScanFile(ScanFile const&) = delete;
+  ~ScanFile() { unlink(path_.c_str()); }
+
+  std::string const& path() const { return path_; }
+
+private:
+
+  std::string path_;
+
+};
+
+
+std::string const&
+scan_path()
+{
+  static ScanFile const file;
+  return file.path();
+}
+
+
+/*
+ * Scans the file, evicting it first if `cold`, and computes `work` dot
+ * products per chunk.
+ */
+ScanStats
+scan(
+  ScanOptions const& options,
+  long const work,
+  bool const cold)
+{
+  auto const& path = scan_path();
+  if (cold)
+    evict_file(path);
+  double sum = 0;
+  auto const stats = scan_colfile(
+    path, {"x", "y"},
+    [work, &sum](ScanChunk const& chunk) {
+      auto const x = (double const*) chunk.values[0];
+      auto const y = (double const*) chunk.values[1];
+      for (long w = 0; w < work; ++w)
+        sum += dot<double>(chunk.num_rows, x, y);
+    },
+    options);
+  do_not_optimize(sum);
+  return stats;
+}
+
+
+}  // anonymous namespace
+
+static auto const reg_scan = register_benchmark(
+  "io/scan",
+  {{"engine", {0, 1}}, {"direct", {0, 1}}, {"work", {0, 1, 4, 16}}},
+  [](Params const& params) {
+    ScanOptions options;
+    options.engine = params.at("engine") ? IoEngine::URING : IoEngine::SYNC;
+    options.direct = params.at("direct");
+    long const work = params.at("work");
+
+    // Take the best of a few scans for each, as a single one is noisy.
+    double io = HUGE_VAL;
+    ScanStats stats;
+    for (int i = 0; i < NUM_CALIBRATIONS; ++i) {
+      io = std::min(io, scan(options, 0, true).elapsed);
+      auto const s = scan(options, work, true);
+      if (i == 0 || s.elapsed < stats.elapsed)
+        stats = s;
+    }
+
+    double const compute = stats.compute_time;
+    std::map<std::string, double> metrics = {
+      {"io_time", io},
+      {"compute_time", compute},
+      {"wait", stats.wait_time / stats.elapsed},
+      {"direct", stats.direct},
+      {"uring", stats.engine == IoEngine::URING},
+    };
+    if (work > 0)
+      metrics["overlap"] = std::max(0.0, std::min(
+        1.0, (io + compute - stats.elapsed) / std::min(io, compute)));
+
+    return Case{
+      [options, work]() { scan(options, work, true); },
+      (long) NUM_ROWS, metrics, 2 * sizeof(double)};
+  },
+  {CacheState::WARM});
+
@@ -1,17 +1,20 @@
 //------------------------------------------------------------------------------
 // TO DO:
-// - Use better data structure for arr.
-// - Use better data structure for obj.
 // - Use wchar_t instead of char* to support Unicode strings.
 //------------------------------------------------------------------------------
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <new>
+#include <numeric>
 #include <string>
+#include <vector>
 
 #include "json.hh"
+#include "json_stream.hh"
 
 using std::string;
 
@@ -25,327 +28,533 @@ int const FORMAT_ONE_LINE = -1;
 
 namespace {
 
-inline void sep(std::ostream& os, int indent, size_t level)
+// Sizes of the first and largest chunks of an arena.  Larger allocations get
+// chunks of their own.
+size_t constexpr MIN_CHUNK = 256;
+size_t constexpr MAX_CHUNK = 1 << 20;
+
+/*
+ * Compares names as `std::string` does.
+ */
+inline int
+compare(
+  Json::Str const a,
+  Json::Str const b)
 {
-  if (indent == FORMAT_MIN)
-    ;
-  else if (indent == FORMAT_ONE_LINE) 
-    os << ' ';
+  // Empty names may have null data, which memcmp doesn't allow.
+  auto const n = std::min(a.size(), b.size());
+  int const cmp = n == 0 ? 0 : std::memcmp(a.data(), b.data(), n);
+  return cmp != 0 ? cmp : a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+Arena::~Arena()
+{
+  for (auto chunk = chunks_; chunk != nullptr; ) {
+    auto const next = chunk->next;
+    std::free(chunk);
+    chunk = next;
+  }
+  for (auto arena = adopted_; arena != nullptr; ) {
+    auto const next = arena->next_;
+    delete arena;
+    arena = next;
+  }
+}
+
+
+void*
+Arena::grow(
+  void* const ptr,
+  size_t old_size,
+  size_t new_size)
+{
+  old_size = round(old_size);
+  new_size = round(new_size);
+  assert(old_size <= new_size);
+  if (ptr != nullptr
+      && (char*) ptr + old_size == cur_
+      && new_size - old_size <= size_t(end_ - cur_)) {
+    cur_ += new_size - old_size;
+    used_ += new_size - old_size;
+    return ptr;
+  }
+  void* const new_ptr = alloc(new_size);
+  if (old_size > 0)
+    std::memcpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+
+void
+Arena::adopt(
+  Arena* const other)
+{
+  assert(other != this && other->next_ == nullptr);
+  other->next_ = adopted_;
+  adopted_ = other;
+}
+
+
+void
+Arena::new_chunk(
+  size_t const min_size)
+{
+  size_t size = chunks_ == nullptr ? MIN_CHUNK
+    : std::min(2 * chunks_->size, MAX_CHUNK);
+  size = std::max(size, min_size);
+  auto const chunk = (Chunk*) std::malloc(sizeof(Chunk) + size);
+  if (chunk == nullptr)
+    throw std::bad_alloc();
+  // A chunk for a large allocation doesn't set the size of the next.
+  chunk->size = std::min(size, MAX_CHUNK);
+  chunk->next = chunks_;
+  chunks_ = chunk;
+  cur_ = (char*) (chunk + 1);
+  end_ = cur_ + size;
+}
+
+
+//------------------------------------------------------------------------------
+
+void
+Json::set(
+  char const* const data,
+  size_t const size)
+{
+  type_ = STR;
+  if (size <= SHORT_LEN) {
+    short_len_ = size;
+    std::memcpy(short_, data, size);
+  }
   else {
-    os << '\n';
-    for (size_t i = 0; i < indent * level; ++i)
-      os << ' ';
+    auto const str = (char*) arena().alloc(size);
+    std::memcpy(str, data, size);
+    short_len_ = LONG_STR;
+    str_ = {str, size};
   }
 }
 
 
-}  // anonymous namespace
+void
+Json::copy_payload(
+  Json const& json)
+{
+  type_ = json.type_;
+  short_len_ = json.short_len_;
+  std::memcpy(short_, json.short_, sizeof(short_));
+}
+
 
+void
+Json::copy_from(
+  Json const& json,
+  Arena& arena)
+{
+  switch (json.type_) {
+  case STR:
+    if (json.short_len_ == LONG_STR) {
+      auto const str = (char*) arena.alloc(json.str_.size);
+      std::memcpy(str, json.str_.data, json.str_.size);
+      type_ = STR;
+      short_len_ = LONG_STR;
+      str_ = {str, json.str_.size};
+      return;
+    }
+    break;
+
+  case ARR: {
+    uint32_t const size = json.seq_.size;
+    set(ARR);
+    if (size == 0)
+      return;
+    auto const elements = (Json*) arena.alloc(size * sizeof(Json));
+    for (uint32_t i = 0; i < size; ++i) {
+      auto const element = new (&elements[i]) Json;
+      element->arena_ = &arena;
+      element->copy_from(json.elements()[i], arena);
+    }
+    seq_ = {elements, size, size};
+    return;
+  }
+
+  case OBJ: {
+    uint32_t const size = json.seq_.size;
+    set(OBJ);
+    if (size == 0)
+      return;
+    auto const members = (Member*) arena.alloc(size * sizeof(Member));
+    for (uint32_t i = 0; i < size; ++i) {
+      auto const& from = json.members()[i];
+      auto const name = (char*) arena.alloc(from.first.size());
+      std::memcpy(name, from.first.data(), from.first.size());
+      auto const member
+        = new (&members[i]) Member{Str(name, from.first.size()), Json()};
+      member->second.arena_ = &arena;
+      member->second.copy_from(from.second, arena);
+    }
+    seq_ = {members, size, size};
+    return;
+  }
+
+  default:
+    break;
+  }
+  copy_payload(json);
+}
+
+
+void
+Json::assign(
+  Json& json)
+{
+  // Whether this value is nested in a document, which holds its contents.
+  bool const nested = arena_ != nullptr && !owns_;
+  // The new contents, and the arena for this value to own, if any.
+  Json payload;
+  Arena* owned = nullptr;
+
+  if (!json.has_storage())
+    payload.copy_payload(json);
+  else if (json.owns_ && !nested) {
+    // Take the root's arena.
+    payload.copy_payload(json);
+    owned = json.arena_;
+    json.arena_ = nullptr;
+    json.owns_ = false;
+  }
+  else if (json.owns_ && json.arena_->used() > SMALL_DOC) {
+    // Keep the root's arena with this document's.
+    arena_->adopt(json.arena_);
+    payload.copy_payload(json);
+    json.arena_ = nullptr;
+    json.owns_ = false;
+  }
+  else if (nested && json.arena_ == arena_)
+    // Nested in the same document.
+    payload.copy_payload(json);
+  else if (nested)
+    payload.copy_from(json, *arena_);
+  else {
+    owned = new Arena;
+    payload.copy_from(json, *owned);
+  }
+
+  // Reset `json` before releasing this value's arena, which may hold it.
+  json.release();
+  json.type_ = NUL;
+  json.short_len_ = 0;
+
+  if (!nested) {
+    release();
+    if (owned != nullptr) {
+      arena_ = owned;
+      owns_ = true;
+    }
+  }
+  copy_payload(payload);
+}
+
+
+Json
+Json::copy()
+  const
+{
+  Json json;
+  if (has_storage())
+    json.copy_from(*this, json.arena());
+  else
+    json.copy_payload(*this);
+  return json;
+}
 
-void 
+
+void
+Json::reserve_one(
+  size_t const size)
+{
+  if (seq_.size == seq_.cap) {
+    if (seq_.cap > UINT32_MAX / 2)
+      throw std::bad_alloc();
+    uint32_t const cap = seq_.cap == 0 ? 4 : 2 * seq_.cap;
+    seq_.data = arena().grow(seq_.data, seq_.cap * size, cap * size);
+    seq_.cap = cap;
+  }
+}
+
+
+Json&
+Json::append()
+{
+  reserve_one(sizeof(Json));
+  auto const element = new (&elements()[seq_.size++]) Json;
+  element->arena_ = arena_;
+  return *element;
+}
+
+
+Json&
+Json::insert(
+  size_t const index,
+  char const* const name,
+  size_t const size)
+{
+  reserve_one(sizeof(Member));
+  auto const key = (char*) arena_->alloc(size);
+  if (size > 0)
+    std::memcpy(key, name, size);
+
+  Member* const members = this->members();
+  std::memmove(
+    (void*) (members + index + 1), (void const*) (members + index),
+    (seq_.size - index) * sizeof(Member));
+  ++seq_.size;
+  auto const member = new (&members[index]) Member{Str(key, size), Json()};
+  member->second.arena_ = arena_;
+  return member->second;
+}
+
+
+void
 Json::print(
-  std::ostream& os, 
-  int indent, 
+  std::ostream& os,
+  int indent,
   size_t level) const
+{
+  Writer writer(os, indent, level);
+  emit(writer);
+}
+
+
+void
+Json::emit(
+  Handler& handler)
+  const
 {
   switch (type_) {
   case NUL:
-    os << "null";
+    handler.null();
     break;
 
   case FAL:
-    os << "false";
-    break;
-
   case TRU:
-    os << "true";
+    handler.boolean(type_ == TRU);
     break;
 
   case NUM:
-    os << std::defaultfloat << get_num();  // FIXME: Right format?  No scientific notation...
-    break;
-
-  case STR:
-    os << '"';
-    for (char const c : get_str())
-      switch (c) {
-      case '"':  os << '\\' << '"'; break;
-      case '\\': os << '\\' << '\\'; break;
-      case '\b': os << '\\' << 'b'; break;
-      case '\f': os << '\\' << 'f'; break;
-      case '\n': os << '\\' << 'n'; break;
-      case '\r': os << '\\' << 'r'; break;
-      case '\t': os << '\\' << 't'; break;
-
-      default:
-        assert(isprint(c));
-        os << c;
-        break;
-      }
-    os << '"';
+    handler.number(num_);
     break;
 
-  case ARR: {
-    os << '[';
-    bool first = true;
-    for (auto const& ent : get_arr()) {
-      if (first)
-        first = false;
-      else
-        os << ',';
-      sep(os, indent, level + 1);
-      ent.print(os, indent, level + 1);
-    }
-    sep(os, indent, level);
-    os << ']';
+  case STR: {
+    auto const str = get_chars();
+    handler.string(str.data(), str.size());
     } break;
 
-  case OBJ: {
-    os << '{';
-    bool first = true;
+  case ARR:
+    handler.start_array();
+    for (auto const& ent : get_arr())
+      ent.emit(handler);
+    handler.end_array();
+    break;
+
+  case OBJ:
+    handler.start_object();
     for (auto const& ent : get_obj()) {
-      if (first)
-        first = false;
-      else
-        os << ',';
-      sep(os, indent, level + 1);
-      // Use the STR type's print method for the name.
-      Json(ent.first).print(os, indent);
-      os << ':';
-      if (indent != FORMAT_MIN)
-        os << ' ';
-      ent.second.print(os, indent, level + 1);
-    }    
-    sep(os, indent, level);
-    os << '}';
-    } break;
+      handler.key(ent.first.data(), ent.first.size());
+      ent.second.emit(handler);
+    }
+    handler.end_object();
+    break;
   }
 }
 
 
 //------------------------------------------------------------------------------
 
-namespace {
+Json&
+Builder::next()
+{
+  if (member_ != nullptr) {
+    auto const member = member_;
+    member_ = nullptr;
+    return *member;
+  }
+  else if (stack_.empty()) {
+    assert(!done_);
+    return root_;
+  }
+  else {
+    assert(stack_.back()->type_ == Json::ARR);
+    return stack_.back()->append();
+  }
+}
 
-// Forward declaration.
-Json _parse_val(char const** json);
 
-inline bool _eat(char const** json, char c)
+void
+Builder::null()
 {
-  if (**json == c) {
-    ++*json;
-    return true;
-  }
-  else
-    return false;
+  next();
+  end_value();
 }
 
 
-inline void _skip_space(char const** json)
+void
+Builder::boolean(
+  bool const val)
 {
-  while (isspace(**json))
-    ++*json;
+  next().set(val ? Json::TRU : Json::FAL);
+  end_value();
 }
 
 
-string _parse_str(char const** json)
+void
+Builder::number(
+  double const val)
 {
-  // Start with a double quote.
-  if (! _eat(json, '"'))
-    throw ParseError();
-
-  // Count the length of the string.
-  size_t length = 0;
-  for (const char* c = *json; *c != '"'; ++c) {
-    if (*c == '\0') 
-      // Hit the end of string inside a quoted string.  
-      throw ParseError();
-    // Don't count an escape character.
-    _eat(&c, '\\');
-    ++length;
-  }
+  next().set(val);
+  end_value();
+}
 
-  // Now go back and build the string.
-  char str[length];
-  char* d = str;
-  while (true) {
-    if (_eat(json, '"'))
-      break;
-    // Skip over the escape character, but treat the next character specially.
-    else if (_eat(json, '\\')) 
-      switch (**json) {
-      case '"':
-      case '\\':
-      case '/':
-        *d = **json;
-        break;
-
-      case 'b':
-        *d = '\b';
-        break;
-        
-      case 'f':
-        *d = '\f';
-        break;
-
-      case 'n':
-        *d = '\n';
-        break;
-
-      case 'r':
-        *d = '\r';
-        break;
-
-      case 't':
-        *d = '\t';
-        break;
-
-      default:
-        // Unknown escape sequence.
-        throw ParseError();
-      }
-    else 
-      // Normal character; copy it.
-      *d = **json;
-    ++*json;
-    ++d;
-  }
-  assert(d - str == (int) length);
-  return string(str, length);
+
+void
+Builder::string(
+  char const* const data,
+  size_t const size)
+{
+  next().set(data, size);
+  end_value();
 }
 
 
-Json 
-_parse_obj(
-  char const** json)
+void
+Builder::start_array()
 {
-  // Start with a left curly.
-  if (! _eat(json, '{'))
-    throw ParseError();
-  _skip_space(json);
-  Json obj = Json::OBJ;
-
-  if (_eat(json, '}'))
-    return obj;
-  
-  while (true) {
-    // Parse the next '"name": value' element.
-    _skip_space(json);
-    string const name = _parse_str(json);
-    _skip_space(json);
-    if (! _eat(json, ':')) 
-      throw ParseError();
-    _skip_space(json);
-    // FIXME: Detect duplicates.
-    obj[name] = _parse_val(json);
-
-    _skip_space(json);
-    if (_eat(json, ','))
-      // Comma means on to the next element.
-      continue;
-    else if (_eat(json, '}'))
-      // Closing brace means done.
-      break;
-    else 
-      throw ParseError();
-  }
+  auto& json = next();
+  json.set(Json::ARR);
+  stack_.push_back(&json);
+}
 
-  return obj;
+
+void
+Builder::end_array()
+{
+  stack_.pop_back();
+  end_value();
 }
 
 
-Json _parse_arr(char const** json)
+void
+Builder::start_object()
 {
-  // Start with a left bracket;
-  if (! _eat(json, '['))
-    throw ParseError();
-
-  Json arr = Json::ARR;
-
-  _skip_space(json);
-  if (_eat(json, ']'))
-    // Empty array.
-    return arr;
-  
-  while (true) {
-    // Parse the next element.
-    _skip_space(json);
-    arr[arr.size()] = _parse_val(json);
-
-    _skip_space(json);
-    if (_eat(json, ','))
-      // Comma means on to the next element.
-      continue;
-    else if (_eat(json, ']'))
-      // Closing bracket means done.
-      break;
-    else 
-      throw ParseError();
-  }
+  auto& json = next();
+  json.set(Json::OBJ);
+  stack_.push_back(&json);
+  sorted_.push_back(true);
+}
+
 
-  return arr;
+void
+Builder::key(
+  char const* const data,
+  size_t const size)
+{
+  assert(member_ == nullptr);
+  Json& obj = *stack_.back();
+  assert(obj.type_ == Json::OBJ);
+  Arena& arena = obj.arena();
+  auto const name = (char*) arena.alloc(size);
+  if (size > 0)
+    std::memcpy(name, data, size);
+
+  // Append members as parsed, and sort at the end if necessary.
+  obj.reserve_one(sizeof(Json::Member));
+  auto const members = obj.members();
+  auto const num = obj.seq_.size;
+  if (num > 0 && compare(members[num - 1].first, {name, size}) >= 0)
+    sorted_.back() = false;
+  auto const member
+    = new (&members[num]) Json::Member{Json::Str(name, size), Json()};
+  member->second.arena_ = &arena;
+  ++obj.seq_.size;
+  // The members don't move until the next key.
+  member_ = &member->second;
 }
 
 
-Json _parse_num(char const** json)
+void
+Builder::end_object()
 {
-  double num;
-  int chars;
-  if (sscanf(*json, "%lg%n", &num, &chars) == 1) {
-    *json += chars;
-    return Json(num);
-  }
-  else
-    throw ParseError();
+  if (!sorted_.back())
+    sort_members(*stack_.back());
+  sorted_.pop_back();
+  stack_.pop_back();
+  end_value();
 }
 
 
-Json _parse_val(char const** json)
+Json
+Builder::take()
 {
-  _skip_space(json);
-  if (**json == '"') 
-    return Json(_parse_str(json));
-  else if (**json == '{')
-    return _parse_obj(json);
-  else if (**json == '[')
-    return _parse_arr(json);
-  else if (**json == '-' || isdigit(**json))
-    return _parse_num(json);
-  else if (strncmp(*json, "true", 4) == 0) {
-    *json += 4;
-    return Json::TRU;
-  }
-  else if (strncmp(*json, "false", 5) == 0) {
-    *json += 5;
-    return Json::FAL;
-  }
-  else if (strncmp(*json, "null", 4) == 0) {
-    *json += 4;
-    return Json::NUL;
+  assert(done_);
+  done_ = false;
+  return std::move(root_);
+}
+
+
+void
+Builder::sort_members(
+  Json& obj)
+{
+  uint32_t const size = obj.seq_.size;
+  Json::Member const* const members = obj.members();
+  std::vector<uint32_t> order(size);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(
+    order.begin(), order.end(),
+    [members](uint32_t const a, uint32_t const b) {
+      return compare(members[a].first, members[b].first) < 0;
+    });
+
+  auto const sorted
+    = (Json::Member*) obj.arena_->alloc(size * sizeof(Json::Member));
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    // Of members with the same name, keep the last, as assigning them in
+    // order would.
+    if (i + 1 < size
+        && compare(members[order[i]].first, members[order[i + 1]].first) == 0)
+      continue;
+    std::memcpy(
+      (void*) &sorted[num++], (void const*) &members[order[i]],
+      sizeof(Json::Member));
   }
-  else 
-    throw ParseError();
+  obj.seq_ = {sorted, num, size};
 }
 
 
-}  // anonymous namespace
+//------------------------------------------------------------------------------
 
-Json 
+Json
 parse(
-  string const& json, 
+  string const& json,
   string::size_type& end)
 {
-  char const* j = json.c_str();
-  Json val = _parse_val(&j);
-  end = j - json.c_str();
-  return val;
+  Builder builder;
+  Reader reader(builder);
+  end = reader.feed(json.data(), json.size());
+  reader.finish();
+  return builder.take();
 }
 
 
 Json parse(string const& json)
 {
-  char const* j = json.c_str();
-  return _parse_val(&j);
+  string::size_type end;
+  return parse(json, end);
 }
 
 
@@ -1,11 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <map>
-#include <memory>
 #include <sstream>
-#include <vector>
+#include <string>
 
 using namespace std::string_literals;
 
@@ -20,7 +21,7 @@ extern int const FORMAT_ONE_LINE;
 //------------------------------------------------------------------------------
 
 class Error
-  : std::exception
+  : public std::exception
 {
 public:
 
@@ -36,7 +37,7 @@ private:
 
 
 class TypeError
-  : Error
+  : public Error
 {
 public:
 
@@ -48,7 +49,7 @@ public:
 
 // FIXME: Provide more information.
 class ParseError
-  : Error
+  : public Error
 {
 public:
 
@@ -59,7 +60,7 @@ public:
 
 
 class NameError
-  : Error
+  : public Error
 {
 public:
 
@@ -70,7 +71,7 @@ public:
 
 
 class IndexError
-  : Error
+  : public Error
 {
 public:
 
@@ -100,11 +101,103 @@ private:
 
 //------------------------------------------------------------------------------
 
+/*
+ * Bump allocator for the contents of a JSON document.
+ *
+ * Allocations come from chunks of increasing size, and are freed all at once
+ * when the arena is destroyed.  An arena may adopt another, which it then
+ * destroys along with itself.
+ */
+class Arena
+{
+public:
+
+  Arena()                               = default;
+  Arena(Arena const&)                   = delete;
+  Arena& operator=(Arena const&)        = delete;
+  ~Arena();
+
+  /*
+   * Returns `size` bytes, 8-byte aligned.
+   */
+  void*
+  alloc(
+    size_t size)
+  {
+    size = round(size);
+    if (size > size_t(end_ - cur_))
+      new_chunk(size);
+    void* const ptr = cur_;
+    cur_ += size;
+    used_ += size;
+    return ptr;
+  }
+
+  /*
+   * Resizes `ptr`, an allocation of `old_size` bytes, to `new_size` bytes.
+   * Extends it in place if it is the last allocation and the chunk has room,
+   * else allocates and copies.
+   */
+  void* grow(void* ptr, size_t old_size, size_t new_size);
+
+  /*
+   * Takes ownership of `other`, which must have been allocated with `new`.
+   */
+  void adopt(Arena* other);
+
+  // Bytes allocated, excluding adopted arenas.
+  size_t used() const                   { return used_; }
+
+private:
+
+  struct Chunk
+  {
+    Chunk* next;
+    size_t size;
+  };
+
+  static size_t round(size_t size)      { return (size + 7) & ~size_t(7); }
+
+  void new_chunk(size_t min_size);
+
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+  Chunk* chunks_ = nullptr;
+  size_t used_ = 0;
+  // Adopted arenas, linked through `next_`.
+  Arena* adopted_ = nullptr;
+  Arena* next_ = nullptr;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+class Handler;
+
+/*
+ * A JSON value.
+ *
+ * A value is 32 bytes: a type tag, and inline storage for a number, a string
+ * of up to 15 bytes, or a pointer to a longer string or to array elements or
+ * object members.  Object members are kept sorted by name, so lookup is a
+ * binary search and printing is in name order.
+ *
+ * A value that isn't an element or member of another, e.g. one returned by
+ * `parse()`, is a document root: it owns an arena, created on first need, from
+ * which the contents of it and of all values nested in it are allocated, and
+ * which is freed in one shot with the root.  Nested values own nothing.
+ * Moving a root into a document gives its arena to the document's, or copies
+ * it if small; moving a nested value out of its document copies it.
+ *
+ * Like `std::vector`, adding an element or member may move the others, so
+ * references to them are invalidated.
+ */
 class Json
 {
 public:
 
-  enum Type
+  enum Type : uint8_t
   {
     NUL,
     FAL,
@@ -115,17 +208,73 @@ public:
     OBJ,
   };
 
-  typedef std::vector<Json> ArrVal;
-  typedef std::map<std::string, Json> ObjVal;
+  /*
+   * Characters of a string in a document, not null-terminated.
+   */
+  class Str
+  {
+  public:
+
+    Str(char const* data, size_t size) : data_(data), size_(size) {}
+
+    char const* data() const            { return data_; }
+    size_t size() const                 { return size_; }
+    std::string str() const             { return std::string(data_, size_); }
+    operator std::string() const        { return str(); }
+
+    bool
+    operator==(
+      std::string const& other)
+      const
+    {
+      return size_ == other.size()
+        && (size_ == 0 || std::memcmp(data_, other.data(), size_) == 0);
+    }
+
+    bool operator!=(std::string const& other) const { return !(*this == other); }
+
+  private:
+
+    char const* data_;
+    size_t size_;
+
+  };
+
+  struct Member;
+
+  /*
+   * A contiguous range of array elements or object members.
+   */
+  template<typename T>
+  class Range
+  {
+  public:
+
+    Range(T* const begin, size_t const size) : begin_(begin), size_(size) {}
+
+    T* begin() const                    { return begin_; }
+    T* end() const                      { return begin_ + size_; }
+    size_t size() const                 { return size_; }
+    bool empty() const                  { return size_ == 0; }
+    T& operator[](size_t i) const       { return begin_[i]; }
+
+  private:
+
+    T* begin_;
+    size_t size_;
+
+  };
+
+  typedef Range<Json const> ArrVal;
+  typedef Range<Member const> ObjVal;
 
   // Ctors.
   Json()                                { set(NUL); }
   Json(Type type)                       { set(type); }
   Json(double val)                      { set(val); }
-  Json(std::string const& val)          { set(val); }
+  Json(std::string const& val)          { set(val.data(), val.size()); }
   Json(Json const& json)                = delete;
-  Json(Json&& json)                     { move(json); }
-  // FIXME: Add deep copy ctor?
+  Json(Json&& json)                     { set(NUL); assign(json); }
 
   static Json new_arr()                 { return Json(ARR); }
   static Json new_obj()                 { return Json(OBJ); }
@@ -133,12 +282,25 @@ public:
   // Convenience ctors.
   Json(bool val)                        { set(val ? TRU : FAL); }
   Json(int val)                         { set((double) val); }
-  Json(char const* val)                 { set(std::string(val)); }
+  Json(char const* val)                 { set(val, std::strlen(val)); }
 
-  virtual ~Json()                       { clear(); }
+  ~Json()                               { release(); }
 
   Json& operator=(Json const& json)     = delete;
-  Json& operator=(Json&& json)          { clear(); move(json); return *this; }
+
+  Json&
+  operator=(
+    Json&& json)
+  {
+    if (&json != this)
+      assign(json);
+    return *this;
+  }
+
+  /*
+   * Returns a deep copy, as a new document root.
+   */
+  Json copy() const;
 
   Type get_type() const                 { return type_; }
 
@@ -148,43 +310,125 @@ public:
   // Accessors for NUM.
   double get_num() const;
 
-  // Accessors for STR;
-  std::string const& get_str() const;
+  // Accessors for STR.
+  std::string get_str() const           { return get_chars().str(); }
+  // Returns the characters, without copying them.
+  Str get_chars() const;
 
-  // Accessors for ARR;
+  // Accessors for ARR.
   size_t size() const                   { return get_arr().size(); }
   Json const& operator[](size_t index) const;
   Json& operator[](size_t index);
-  ArrVal const& get_arr() const;
+  ArrVal get_arr() const;
 
   // Accessors for OBJ.
   bool has(std::string const& name) const;
   Json const& operator[](std::string const& name) const;
   Json& operator[](std::string const& name);
-  ObjVal const& get_obj() const;
+  ObjVal get_obj() const;
 
   // Convenience accessors.
   int get_int() const;
 
-  virtual void print(std::ostream& os, int indent, size_t level=0) const;
+  void print(std::ostream& os, int indent, size_t level=0) const;
+
+  /*
+   * Passes this value to `handler` as events.
+   */
+  void emit(Handler& handler) const;
 
 private:
 
+  friend class Builder;
+
+  // Longest string stored inline.
+  static size_t constexpr SHORT_LEN = 15;
+  // `short_len_` of a string stored in the arena.
+  static uint8_t constexpr LONG_STR = 0xff;
+  // Size of a small document that is copied, rather than adopted, when moved
+  // into another.
+  static size_t constexpr SMALL_DOC = 512;
+
   void set(Type type);
   void set(double val);
-  void set(std::string const& val);
-  void move(Json& json);
+  void set(char const* data, size_t size);
+
+  /*
+   * Returns true if this value's contents are in an arena.
+   */
+  bool
+  has_storage()
+    const
+  {
+    return (type_ == STR && short_len_ == LONG_STR)
+      || ((type_ == ARR || type_ == OBJ) && seq_.cap > 0);
+  }
 
-  double& get_num();
-  std::string& get_str();
-  ArrVal& get_arr();
-  ObjVal& get_obj();
+  /*
+   * Returns the arena for this value's contents, creating and owning one if
+   * this is a root without one.
+   */
+  Arena&
+  arena()
+  {
+    if (arena_ == nullptr) {
+      arena_ = new Arena;
+      owns_ = true;
+    }
+    return *arena_;
+  }
 
-  void clear();
+  // Frees this value's arena, if it owns one.
+  void release();
+  // Moves `json` into this value, leaving `json` null.
+  void assign(Json& json);
+  // Sets this value to a copy of `json`, allocating from `arena`.
+  void copy_from(Json const& json, Arena& arena);
+  // Copies the type and contents of `json`, but not its arena.
+  void copy_payload(Json const& json);
+
+  Json* elements() const                { return (Json*) seq_.data; }
+  Member* members() const               { return (Member*) seq_.data; }
+  // Makes room for one more element of `size` bytes.
+  void reserve_one(size_t size);
+  // Appends a null element, and returns it.
+  Json& append();
+  // Returns the index of the first member whose name is not less than `name`.
+  size_t lower_bound(char const* name, size_t size) const;
+  // Inserts a member named `name` with a null value at `index`.
+  Json& insert(size_t index, char const* name, size_t size);
 
   Type type_;
-  void* val_;  // FIXME: Use a better representation.
+  // If true, this value is a root that owns `arena_`; else `arena_` is its
+  // document's, or null if this is a root without one.
+  bool owns_ = false;
+  // Length of an inline string, or `LONG_STR`.
+  uint8_t short_len_ = 0;
+  Arena* arena_ = nullptr;
+  union
+  {
+    double num_;
+    char short_[SHORT_LEN + 1];
+    struct
+    {
+      char const* data;
+      size_t size;
+    } str_;
+    struct
+    {
+      void* data;
+      uint32_t size;
+      uint32_t cap;
+    } seq_;
+  };
+
+};
 
+
+struct Json::Member
+{
+  Str first;
+  Json second;
 };
 
 
@@ -202,25 +446,49 @@ Json::get_bool()
 }
 
 
-inline double 
+inline double
 Json::get_num()
   const
 {
   if (type_ == NUM)
-    return *reinterpret_cast<double const*>(val_);
+    return num_;
   else
     throw TypeError("not a NUM");
 }
 
 
-inline std::string const&
-Json::get_str()
+inline Json::Str
+Json::get_chars()
   const
 {
-  if (type_ == STR) 
-    return *reinterpret_cast<std::string const*>(val_);
-  else
+  if (type_ != STR)
     throw TypeError("not a STR");
+  else if (short_len_ == LONG_STR)
+    return {str_.data, str_.size};
+  else
+    return {short_, short_len_};
+}
+
+
+inline Json::ArrVal
+Json::get_arr()
+  const
+{
+  if (type_ == ARR)
+    return {elements(), seq_.size};
+  else
+    throw TypeError("not a ARR");
+}
+
+
+inline Json::ObjVal
+Json::get_obj()
+  const
+{
+  if (type_ == OBJ)
+    return {members(), seq_.size};
+  else
+    throw TypeError("not a OBJ");
 }
 
 
@@ -229,7 +497,7 @@ Json::operator[](
   size_t index)
   const
 {
-  ArrVal const& arr = get_arr();
+  auto const arr = get_arr();
   if (index < arr.size())
     return arr[index];
   else
@@ -241,17 +509,40 @@ inline Json&
 Json::operator[](
   size_t index)
 {
-  ArrVal& arr = get_arr();
-  if (index < arr.size())
-    return arr[index];
-  else if (index == arr.size()) {
-    // Append a new NUL.
-    arr.emplace_back();
-    // Return a reference to it.
-    return arr[index];
-  }
+  auto const size = get_arr().size();
+  if (index < size)
+    return elements()[index];
+  else if (index == size)
+    // Append a new NUL, and return a reference to it.
+    return append();
   else
-    throw IndexError(index, arr.size());
+    throw IndexError(index, size);
+}
+
+
+inline size_t
+Json::lower_bound(
+  char const* const name,
+  size_t const size)
+  const
+{
+  // Binary search, comparing as std::string does.
+  size_t lo = 0;
+  size_t hi = seq_.size;
+  while (lo < hi) {
+    size_t const mid = (lo + hi) / 2;
+    auto const& key = members()[mid].first;
+    // Empty names may have null data, which memcmp doesn't allow.
+    auto const n = std::min(key.size(), size);
+    int cmp = n == 0 ? 0 : std::memcmp(key.data(), name, n);
+    if (cmp == 0)
+      cmp = key.size() < size ? -1 : key.size() > size ? 1 : 0;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
 }
 
 
@@ -260,9 +551,9 @@ Json::has(
   std::string const& name)
   const
 {
-  ObjVal const& obj = get_obj();
-  auto find = obj.find(name);
-  return find != end(obj);
+  auto const obj = get_obj();
+  auto const i = lower_bound(name.data(), name.size());
+  return i < obj.size() && obj[i].first == name;
 }
 
 
@@ -271,12 +562,12 @@ Json::operator[](
   std::string const& name)
   const
 {
-  ObjVal const& obj = get_obj();
-  auto find = obj.find(name);
-  if (find == obj.end())
-    throw NameError(name);
+  auto const obj = get_obj();
+  auto const i = lower_bound(name.data(), name.size());
+  if (i < obj.size() && obj[i].first == name)
+    return obj[i].second;
   else
-    return find->second;
+    throw NameError(name);
 }
 
 
@@ -284,13 +575,13 @@ inline Json&
 Json::operator[](
   std::string const& name)
 {
-  ObjVal& obj = get_obj();
-  auto find = obj.find(name);
-  if (find == obj.end()) 
-    // Name not found.  Set it to a new NUL, and return a reference to it.
-    return obj[name];
+  auto const obj = get_obj();
+  auto const i = lower_bound(name.data(), name.size());
+  if (i < obj.size() && obj[i].first == name)
+    return members()[i].second;
   else
-    return find->second;
+    // Name not found.  Set it to a new NUL, and return a reference to it.
+    return insert(i, name.data(), name.size());
 }
 
 
@@ -314,11 +605,11 @@ inline void
 Json::set(
   Type type)
 {
+  type_ = type;
   switch (type) {
   case NUL:
   case TRU:
   case FAL:
-    type_ = type;
     break;
 
   case NUM:
@@ -326,13 +617,8 @@ Json::set(
     assert(false);
 
   case ARR:
-    type_ = ARR;
-    val_ = new ArrVal;
-    break;
-
   case OBJ:
-    type_ = OBJ;
-    val_ = new ObjVal;
+    seq_ = {nullptr, 0, 0};
     break;
   }
 }
@@ -343,116 +629,18 @@ Json::set(
   double val)
 {
   type_ = NUM;
-  val_ = new double(val);
-}
-
-
-inline void
-Json::set(
-  std::string const& val)
-{
-  type_ = STR;
-  val_ = new std::string(val);
-}
-
-
-inline void
-Json::move(
-  Json& json)
-{
-  type_ = json.type_;
-  val_ = json.val_;
-  json.type_ = NUL;
-}
-
-
-inline Json::ArrVal const&
-Json::get_arr()
-  const
-{
-  if (type_ == ARR)
-    return *reinterpret_cast<ArrVal const*>(val_);
-  else
-    throw TypeError("not a ARR");
-}
-
-
-inline Json::ObjVal const&
-Json::get_obj()
-  const
-{
-  if (type_ == OBJ)
-    return *reinterpret_cast<ObjVal const*>(val_);
-  else
-    throw TypeError("not a OBJ");
-}
-
-
-inline double&
-Json::get_num()
-{
-  if (type_ == NUM)
-    return *reinterpret_cast<double*>(val_);
-  else
-    throw TypeError("not a NUM");
-}
-
-
-inline std::string&
-Json::get_str()
-{
-  if (type_ == STR)
-    return *reinterpret_cast<std::string*>(val_);
-  else
-    throw TypeError("not a STR");
-}
-
-
-inline Json::ArrVal&
-Json::get_arr()
-{
-  if (type_ == ARR)
-    return *reinterpret_cast<ArrVal*>(val_);
-  else
-    throw TypeError("not a ARR");
-}
-
-
-inline Json::ObjVal&
-Json::get_obj()
-{
-  assert(type_ == OBJ);
-  return *reinterpret_cast<ObjVal*>(val_);
+  num_ = val;
 }
 
 
 inline void
-Json::clear()
+Json::release()
 {
-  switch (type_) {
-  case NUL:
-  case FAL:
-  case TRU:
-    break;
-
-  case NUM:
-    delete & get_num();
-    break;
-
-  case STR:
-    delete & get_str();
-    break;
-
-  case ARR:
-    delete & get_arr();
-    break;
-    
-  case OBJ:
-    delete & get_obj();
-    break;
+  if (owns_) {
+    delete arena_;
+    arena_ = nullptr;
+    owns_ = false;
   }
-
-  type_ = NUL;
 }
 
 
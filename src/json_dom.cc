@@ -0,0 +1,751 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.hh"
+#include "format.hh"
+#include "json.hh"
+#include "json_lazy.hh"
+#include "json_legacy.hh"
+#include "json_stream.hh"
+#include "json_tape.hh"
+#include "parse.hh"
+
+//------------------------------------------------------------------------------
+// Parsing and traversal of JSON documents, with the arena-backed `Json` and
+// with the previous representation in json_legacy.hh.
+//
+// Documents are of two kinds, each with `size` records:
+// - results: an array of benchmark results, as `bench --format json` writes,
+//   each with summary stats, a histogram, and raw samples
+// - plan: a query plan, a balanced tree of joins whose leaves filter and
+//   project scans with nested expressions
+//
+// Parse times are per byte of text, so bandwidth is the parse rate.  Stream
+// parsing reads the text in chunks and passes events to a handler, without
+// building a document.  Tape parsing indexes structural characters with SIMD,
+// then builds a flat tape; index times the first stage alone.  Traversal
+// visits every value, and times are per value.  Print times are per byte of
+// text written.
+//
+// Lazy reading navigates the text on demand with `Cursor`, skipping values
+// not read: one value from the first result, the mean of every result, or the
+// root op of a plan, whose name sorts after its large inputs.  Times are per
+// byte of the whole document, for comparison with parsing it.
+//
+// Number benchmarks format and parse `size` doubles like benchmark samples,
+// with full precision over several orders of magnitude, and times are per
+// number.  Formatting is with the shortest round-trip digits, or with printf
+// as `Json` did before; parsing with `parse_double()` or `strtod()`.
+//------------------------------------------------------------------------------
+
+namespace {
+
+using aslib::json::Cursor;
+using aslib::json::Json;
+namespace legacy = aslib::json::legacy;
+
+size_t constexpr NUM_SAMPLES = 64;
+size_t constexpr NUM_BUCKETS = 24;
+
+std::vector<long> const SIZES = {1, 16, 256, 4096};
+// The legacy parser is superlinear in document size.
+std::vector<long> const LEGACY_SIZES = {1, 16, 256};
+
+/*
+ * Valid and invalid text, on which tape parsing must agree with `parse()`.
+ */
+char const* const CONFORMANCE[] = {
+  "", "1", "-0", "01", "1.", "1e5", "1E+5", "-1.5e-3", "-", "+1", "0x10",
+  "true", "false", "null", "nul", "truex", "[tru]", "[-]", "[1.5e]",
+  "[]", "{}", "[1,2]", "[1,]", "[,1]", "]", "}", "[[[[[]]]]]", "[[[[]]]",
+  "{\"a\":1}", "{\"a\" 1}", "{\"a\":1,}", "{1:2}", "{\"a\":1:2}",
+  "{\"k\":1,\"k\":2}", "[1 2]", "[1$]", "[1\"a\"]", "[1:2]", "[\"a\":1]",
+  "\"abc\"", "\"abc", "\"ab\\\"c\"", "\"\\\\\"", "\"\\\\\\\"\"",
+  "[\"a\\\\\",\"b\"]", "\"a\\u00e9\"", "\"\\ud83d\\ude00\"", "\"\\ud83d\"",
+  "\"\\q\"", "12$", "12 x", "[1] tail", "\"a\"$", "[\f1]", "\v1",
+  "{\"a\":{\"b\":[1,{\"c\":null}]},\"d\":[\"x\",true,-2.5e-3]}",
+};
+
+Json
+result_doc(
+  size_t const size)
+{
+  std::mt19937_64 rng(42);
+  std::lognormal_distribution<double> time(-14, 0.3);
+
+  auto results = Json::new_arr();
+  for (size_t r = 0; r < size; ++r) {
+    auto result = Json::new_obj();
+    result["name"] = Json("dot/f64/f64");
+    auto params = Json::new_obj();
+    params["len"] = Json((double) (1024 << (r % 12)));
+    params["threads"] = Json((double) (1 + r % 4));
+    result["params"] = std::move(params);
+    result["cache"] = "warm";
+    result["num_elements"] = Json((double) (1024 << (r % 12)));
+    result["batch"] = Json(1 + (int) (r % 16));
+
+    auto stats = Json::new_obj();
+    stats["num_samples"] = Json((int) NUM_SAMPLES);
+    stats["min"] = time(rng);
+    stats["max"] = time(rng);
+    stats["mean"] = time(rng);
+    stats["standard_deviation"] = time(rng) * 0.1;
+    result["stats"] = std::move(stats);
+
+    auto histogram = Json::new_obj();
+    histogram["count"] = Json((int) NUM_SAMPLES);
+    auto buckets = Json::new_arr();
+    for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+      auto bucket = Json::new_arr();
+      bucket[0] = time(rng);
+      bucket[1] = time(rng);
+      bucket[2] = Json((int) (1 + b % 5));
+      buckets[b] = std::move(bucket);
+    }
+    histogram["buckets"] = std::move(buckets);
+    result["histogram"] = std::move(histogram);
+
+    auto samples = Json::new_arr();
+    for (size_t s = 0; s < NUM_SAMPLES; ++s)
+      samples[s] = time(rng);
+    result["samples"] = std::move(samples);
+
+    results[r] = std::move(result);
+  }
+  return results;
+}
+
+
+/*
+ * Returns an expression tree of `depth` over columns of table `t`.
+ */
+Json
+expr_doc(
+  size_t const t,
+  size_t const depth)
+{
+  if (depth == 0)
+    return Json("price_" + std::to_string(t));
+  auto expr = Json::new_arr();
+  expr[0] = depth % 2 == 0 ? "+" : "*";
+  expr[1] = expr_doc(t, depth - 1);
+  expr[2] = Json(0.5 * depth);
+  return expr;
+}
+
+
+/*
+ * Returns a plan joining tables `lo` through `hi` - 1.
+ */
+Json
+plan_doc(
+  size_t const lo,
+  size_t const hi)
+{
+  auto node = Json::new_obj();
+  if (hi - lo == 1) {
+    auto scan = Json::new_obj();
+    scan["op"] = "scan";
+    scan["table"] = Json("trades_" + std::to_string(lo));
+
+    auto filter = Json::new_obj();
+    filter["op"] = "filter";
+    auto pred = Json::new_arr();
+    pred[0] = ">";
+    pred[1] = expr_doc(lo, 4);
+    pred[2] = Json(100.0);
+    filter["pred"] = std::move(pred);
+    filter["input"] = std::move(scan);
+
+    node["op"] = "project";
+    auto columns = Json::new_obj();
+    columns["key"] = "key";
+    columns["value_" + std::to_string(lo)] = expr_doc(lo, 6);
+    node["columns"] = std::move(columns);
+    node["input"] = std::move(filter);
+  }
+  else {
+    size_t const mid = lo + (hi - lo) / 2;
+    node["op"] = "join";
+    auto on = Json::new_arr();
+    on[0] = "key";
+    on[1] = "key";
+    node["on"] = std::move(on);
+    node["left"] = plan_doc(lo, mid);
+    node["right"] = plan_doc(mid, hi);
+  }
+  return node;
+}
+
+
+std::string
+doc_text(
+  bool const plan,
+  size_t const size)
+{
+  std::ostringstream ss;
+  ss << (plan ? plan_doc(0, size) : result_doc(size));
+  return ss.str();
+}
+
+
+size_t
+str_size(
+  Json const& json)
+{
+  return json.get_chars().size();
+}
+
+
+size_t
+str_size(
+  legacy::Json const& json)
+{
+  return json.get_str().size();
+}
+
+
+/*
+ * Visits every value under `json`.  Returns the number of values, and adds
+ * numbers and string lengths to `sum`.
+ */
+template<typename J>
+size_t
+traverse(
+  J const& json,
+  double& sum)
+{
+  switch (json.get_type()) {
+  case J::NUM:
+    sum += json.get_num();
+    return 1;
+
+  case J::STR:
+    sum += str_size(json);
+    return 1;
+
+  case J::ARR: {
+    size_t num = 1;
+    for (auto const& element : json.get_arr())
+      num += traverse(element, sum);
+    return num;
+  }
+
+  case J::OBJ: {
+    size_t num = 1;
+    for (auto const& member : json.get_obj()) {
+      sum += member.first.size();
+      num += traverse(member.second, sum);
+    }
+    return num;
+  }
+
+  default:
+    return 1;
+  }
+}
+
+
+template<typename J>
+size_t
+register_parse(
+  std::string const& name,
+  bool const plan,
+  J (*parse)(std::string const&),
+  std::vector<long> const& sizes)
+{
+  return register_benchmark(
+    name, {{"size", sizes}},
+    [plan, parse](Params const& params) {
+      auto const text = std::make_shared<std::string>(
+        doc_text(plan, params.at("size")));
+      return Case{
+        [text, parse]() {
+          auto const json = parse(*text);
+          do_not_optimize(&json);
+        },
+        (long) text->size(),
+        {},
+        1,
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+/*
+ * Sums numbers and string lengths from events.
+ */
+class SumHandler
+  : public aslib::json::Handler
+{
+public:
+
+  double sum = 0;
+
+  void null() override                  {}
+  void boolean(bool) override           {}
+  void number(double val) override      { sum += val; }
+  void string(char const*, size_t size) override { sum += size; }
+  void start_array() override           {}
+  void end_array() override             {}
+  void start_object() override          {}
+  void key(char const*, size_t size) override { sum += size; }
+  void end_object() override            {}
+
+};
+
+
+size_t
+register_stream(
+  std::string const& name,
+  bool const plan)
+{
+  return register_benchmark(
+    name, {{"size", SIZES}, {"chunk", {4096, 1 << 16}}},
+    [plan](Params const& params) {
+      auto const text = std::make_shared<std::string>(
+        doc_text(plan, params.at("size")));
+      size_t const chunk = params.at("chunk");
+      return Case{
+        [text, chunk]() {
+          SumHandler handler;
+          aslib::json::Reader reader(handler);
+          for (size_t i = 0; i < text->size(); i += chunk)
+            reader.feed(
+              text->data() + i, std::min(chunk, text->size() - i));
+          reader.finish();
+          do_not_optimize(handler.sum);
+        },
+        (long) text->size(),
+        {},
+        1,
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+size_t
+register_index(
+  std::string const& name,
+  bool const plan)
+{
+  return register_benchmark(
+    name, {{"size", SIZES}},
+    [plan](Params const& params) {
+      auto const text = std::make_shared<std::string>(
+        doc_text(plan, params.at("size")));
+      return Case{
+        [text]() {
+          aslib::json::Indexer indexer(text->data(), text->size());
+          size_t num = 0;
+          while (indexer.next() != nullptr)
+            ++num;
+          do_not_optimize(num);
+        },
+        (long) text->size(),
+        {},
+        1,
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+/*
+ * Returns `parse()` or `parse_tape()` of `text`, printed, or "error".
+ */
+std::string
+parse_result(
+  std::string const& text,
+  bool const tape)
+{
+  try {
+    std::ostringstream ss;
+    if (tape)
+      aslib::json::parse_tape(text).to_json().print(ss, aslib::json::FORMAT_MIN);
+    else
+      aslib::json::parse(text).print(ss, aslib::json::FORMAT_MIN);
+    return ss.str();
+  }
+  catch (aslib::json::ParseError const&) {
+    return "error";
+  }
+}
+
+
+/*
+ * Reports the number of texts, from the document and from `CONFORMANCE` at
+ * each alignment in a block, on which tape parsing disagrees with `parse()`.
+ */
+size_t
+register_tape(
+  std::string const& name,
+  bool const plan)
+{
+  return register_benchmark(
+    name, {{"size", SIZES}},
+    [plan](Params const& params) {
+      auto const text = std::make_shared<std::string>(
+        doc_text(plan, params.at("size")));
+
+      size_t mismatches
+        = parse_result(*text, false) != parse_result(*text, true);
+      for (auto const conformance : CONFORMANCE)
+        for (size_t pad = 0; pad < 64; ++pad) {
+          auto const padded = std::string(pad, ' ') + conformance;
+          if (parse_result(padded, false) != parse_result(padded, true))
+            ++mismatches;
+        }
+
+      return Case{
+        [text]() {
+          auto const tape = aslib::json::parse_tape(*text);
+          do_not_optimize(&tape);
+        },
+        (long) text->size(),
+        {{"mismatches", (double) mismatches}},
+        1,
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+template<typename J>
+size_t
+register_traverse(
+  std::string const& name,
+  bool const plan,
+  J (*parse)(std::string const&),
+  std::vector<long> const& sizes)
+{
+  return register_benchmark(
+    name, {{"size", sizes}},
+    [plan, parse](Params const& params) {
+      auto const json = std::make_shared<J>(
+        parse(doc_text(plan, params.at("size"))));
+      double sum = 0;
+      long const num = traverse(*json, sum);
+      return Case{
+        [json]() {
+          double sum = 0;
+          do_not_optimize(traverse(*json, sum));
+          do_not_optimize(sum);
+        },
+        num};
+    });
+}
+
+
+template<typename J>
+size_t
+register_print(
+  std::string const& name,
+  bool const plan,
+  J (*parse)(std::string const&),
+  std::vector<long> const& sizes)
+{
+  return register_benchmark(
+    name, {{"size", sizes}},
+    [plan, parse](Params const& params) {
+      auto const json = std::make_shared<J>(
+        parse(doc_text(plan, params.at("size"))));
+      std::ostringstream ss;
+      json->print(ss, 2);
+      long const size = ss.str().size();
+      return Case{
+        [json]() {
+          std::ostringstream ss;
+          json->print(ss, 2);
+          do_not_optimize(&ss);
+        },
+        size,
+        {},
+        1};
+    });
+}
+
+
+/*
+ * Returns `num` doubles like timing samples, from 1 ns to 1 s.
+ */
+std::vector<double>
+sample_values(
+  size_t const num)
+{
+  std::mt19937_64 rng(44);
+  std::uniform_real_distribution<double> log10_val(-9, 0);
+  std::vector<double> vals(num);
+  for (auto& val : vals)
+    val = std::pow(10, log10_val(rng));
+  return vals;
+}
+
+
+// Number sizes.
+std::vector<long> const NUM_SIZES = {1 << 10, 1 << 20};
+
+using FormatFn = char* (*)(double, char*);
+using ParseFn = bool (*)(char const*, char const*, double&);
+
+/*
+ * Formats as `Json` did before shortest round-trip formatting: the fewer of 15
+ * or 17 significant digits that reads back exactly.
+ */
+char*
+format_printf(
+  double const val,
+  char* const buf)
+{
+  int len = snprintf(buf, FORMAT_NUMBER_SIZE, "%.15g", val);
+  if (strtod(buf, nullptr) != val)
+    len = snprintf(buf, FORMAT_NUMBER_SIZE, "%.17g", val);
+  return buf + len;
+}
+
+
+bool
+parse_strtod(
+  char const* const p,
+  char const* const end,
+  double& val)
+{
+  // The number is followed by a delimiter, so strtod() stops there.
+  char* e;
+  val = strtod(p, &e);
+  return e == end;
+}
+
+
+/*
+ * Reports the number of values that don't read back exactly.
+ */
+size_t
+register_format(
+  std::string const& name,
+  FormatFn const format)
+{
+  return register_benchmark(
+    name, {{"size", NUM_SIZES}},
+    [format](Params const& params) {
+      auto const vals = std::make_shared<std::vector<double>>(
+        sample_values(params.at("size")));
+      auto const out = std::make_shared<std::string>(
+        vals->size() * FORMAT_NUMBER_SIZE, '\0');
+
+      size_t mismatches = 0;
+      char* p = &(*out)[0];
+      for (auto const val : *vals) {
+        char* const end = format(val, p);
+        *end = '\n';
+        if (strtod(p, nullptr) != val)
+          ++mismatches;
+        p = end + 1;
+      }
+      double const chars = (p - out->data()) / (double) vals->size();
+
+      return Case{
+        [vals, out, format]() {
+          char* p = &(*out)[0];
+          for (auto const val : *vals) {
+            p = format(val, p);
+            *p++ = '\n';
+          }
+          do_not_optimize(p);
+        },
+        (long) vals->size(),
+        {{"mismatches", (double) mismatches}, {"chars", chars}},
+        sizeof(double) + chars,
+        0,
+        {{vals->data(), vals->size() * sizeof(double)},
+         {out->data(), out->size()}}};
+    });
+}
+
+
+/*
+ * Reports the number of values that differ from `strtod()`'s.
+ */
+size_t
+register_parse_numbers(
+  std::string const& name,
+  ParseFn const parse)
+{
+  return register_benchmark(
+    name, {{"size", NUM_SIZES}},
+    [parse](Params const& params) {
+      auto const vals = sample_values(params.at("size"));
+      auto const text = std::make_shared<std::string>();
+      for (auto const val : vals) {
+        append_double(*text, val);
+        *text += '\n';
+      }
+
+      size_t mismatches = 0;
+      for (char const* p = text->c_str(); *p != '\0';) {
+        char const* const end = strchr(p, '\n');
+        double val;
+        if (!parse(p, end, val) || val != strtod(p, nullptr))
+          ++mismatches;
+        p = end + 1;
+      }
+
+      return Case{
+        [text, parse]() {
+          double sum = 0;
+          for (char const* p = text->c_str(); *p != '\0';) {
+            char const* const end = strchr(p, '\n');
+            double val;
+            parse(p, end, val);
+            sum += val;
+            p = end + 1;
+          }
+          do_not_optimize(sum);
+        },
+        (long) vals.size(),
+        {{"mismatches", (double) mismatches}},
+        text->size() / (double) vals.size(),
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+// Reads from a results document.
+template<typename J>
+double
+read_first(
+  J const& doc)
+{
+  return doc[0]["stats"]["mean"].get_num();
+}
+
+
+template<typename J>
+double
+read_means(
+  J const& doc)
+{
+  double sum = 0;
+  for (auto const& result : doc.get_arr())
+    sum += result["stats"]["mean"].get_num();
+  return sum;
+}
+
+
+// Reads from a plan document.
+template<typename J>
+double
+read_op(
+  J const& doc)
+{
+  return doc["op"].get_str() == "join";
+}
+
+
+/*
+ * Reports the number of documents, of one, on which lazy reading differs from
+ * reading the parsed document.
+ */
+size_t
+register_lazy(
+  std::string const& name,
+  bool const plan,
+  double (*read_json)(Json const&),
+  double (*read_lazy)(Cursor const&))
+{
+  return register_benchmark(
+    name, {{"size", SIZES}},
+    [plan, read_json, read_lazy](Params const& params) {
+      auto const text = std::make_shared<std::string>(
+        doc_text(plan, params.at("size")));
+      aslib::json::Document const doc(text->data(), text->size());
+      size_t const mismatches
+        = read_json(aslib::json::parse(*text)) != read_lazy(doc.root());
+
+      return Case{
+        [text, read_lazy]() {
+          aslib::json::Document const doc(text->data(), text->size());
+          do_not_optimize(read_lazy(doc.root()));
+        },
+        (long) text->size(),
+        {{"mismatches", (double) mismatches}},
+        1,
+        0,
+        {{text->data(), text->size()}}};
+    });
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+static auto const reg_parse_results_legacy = register_parse<legacy::Json>(
+  "json/parse/results/legacy", false, legacy::parse, LEGACY_SIZES);
+static auto const reg_parse_results = register_parse<Json>(
+  "json/parse/results/arena", false, aslib::json::parse, SIZES);
+static auto const reg_parse_plan_legacy = register_parse<legacy::Json>(
+  "json/parse/plan/legacy", true, legacy::parse, LEGACY_SIZES);
+static auto const reg_parse_plan = register_parse<Json>(
+  "json/parse/plan/arena", true, aslib::json::parse, SIZES);
+
+static auto const reg_stream_results
+  = register_stream("json/stream/results", false);
+static auto const reg_stream_plan
+  = register_stream("json/stream/plan", true);
+
+static auto const reg_index_results
+  = register_index("json/index/results", false);
+static auto const reg_index_plan
+  = register_index("json/index/plan", true);
+static auto const reg_tape_results
+  = register_tape("json/tape/results", false);
+static auto const reg_tape_plan
+  = register_tape("json/tape/plan", true);
+
+static auto const reg_lazy_results_first = register_lazy(
+  "json/lazy/results/first", false, read_first<Json>, read_first<Cursor>);
+static auto const reg_lazy_results_means = register_lazy(
+  "json/lazy/results/means", false, read_means<Json>, read_means<Cursor>);
+static auto const reg_lazy_plan_op = register_lazy(
+  "json/lazy/plan/op", true, read_op<Json>, read_op<Cursor>);
+
+static auto const reg_traverse_results_legacy = register_traverse<legacy::Json>(
+  "json/traverse/results/legacy", false, legacy::parse, LEGACY_SIZES);
+static auto const reg_traverse_results = register_traverse<Json>(
+  "json/traverse/results/arena", false, aslib::json::parse, SIZES);
+static auto const reg_traverse_plan_legacy = register_traverse<legacy::Json>(
+  "json/traverse/plan/legacy", true, legacy::parse, LEGACY_SIZES);
+static auto const reg_traverse_plan = register_traverse<Json>(
+  "json/traverse/plan/arena", true, aslib::json::parse, SIZES);
+
+static auto const reg_print_results_legacy = register_print<legacy::Json>(
+  "json/print/results/legacy", false, legacy::parse, LEGACY_SIZES);
+static auto const reg_print_results = register_print<Json>(
+  "json/print/results/arena", false, aslib::json::parse, SIZES);
+static auto const reg_print_plan_legacy = register_print<legacy::Json>(
+  "json/print/plan/legacy", true, legacy::parse, LEGACY_SIZES);
+static auto const reg_print_plan = register_print<Json>(
+  "json/print/plan/arena", true, aslib::json::parse, SIZES);
+
+static auto const reg_format_shortest
+  = register_format("json/number/format/shortest", format_double);
+static auto const reg_format_printf
+  = register_format("json/number/format/printf", format_printf);
+static auto const reg_parse_fast
+  = register_parse_numbers("json/number/parse/fast", parse_double);
+static auto const reg_parse_strtod
+  = register_parse_numbers("json/number/parse/strtod", parse_strtod);
+
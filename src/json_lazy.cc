@@ -0,0 +1,620 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_lazy.hh"
+#include "json_stream.hh"
+#include "parse.hh"
+#include "text_bits.hh"
+
+//------------------------------------------------------------------------------
+
+namespace aslib {
+namespace json {
+
+namespace {
+
+size_t constexpr BLOCK_SIZE = 64;
+
+/*
+ * Bitmasks of the characters that matter for skipping, in a 64-byte block.
+ */
+struct Block
+{
+  uint64_t quote;
+  uint64_t backslash;
+  // Opening and closing brackets and braces.
+  uint64_t open;
+  uint64_t close;
+};
+
+
+// '[' and '{', and ']' and '}', differ only in bit 5.
+char constexpr OPEN = '{';
+char constexpr CLOSE = '}';
+static_assert(('[' | 0x20) == OPEN && (']' | 0x20) == CLOSE, "bracket bits");
+
+#ifdef __AVX2__
+
+inline uint64_t
+mask_eq(
+  __m256i const lo,
+  __m256i const hi,
+  char const c)
+{
+  __m256i const cv = _mm256_set1_epi8(c);
+  uint64_t const m0 = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, cv));
+  uint64_t const m1 = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, cv));
+  return m0 | m1 << 32;
+}
+
+
+inline Block
+scan_block(
+  char const* const p)
+{
+  __m256i const lo = _mm256_loadu_si256((__m256i const*) p);
+  __m256i const hi = _mm256_loadu_si256((__m256i const*) (p + 32));
+  __m256i const bit5 = _mm256_set1_epi8(0x20);
+  __m256i const lo_folded = _mm256_or_si256(lo, bit5);
+  __m256i const hi_folded = _mm256_or_si256(hi, bit5);
+  return {
+    mask_eq(lo, hi, '"'),
+    mask_eq(lo, hi, '\\'),
+    mask_eq(lo_folded, hi_folded, OPEN),
+    mask_eq(lo_folded, hi_folded, CLOSE),
+  };
+}
+
+#else
+
+inline uint64_t
+mask_eq(
+  __m128i const (&v)[4],
+  char const c)
+{
+  __m128i const cv = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i)
+    mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[i], cv))
+            << (16 * i);
+  return mask;
+}
+
+
+inline Block
+scan_block(
+  char const* const p)
+{
+  __m128i const v[4] = {
+    _mm_loadu_si128((__m128i const*) p),
+    _mm_loadu_si128((__m128i const*) (p + 16)),
+    _mm_loadu_si128((__m128i const*) (p + 32)),
+    _mm_loadu_si128((__m128i const*) (p + 48)),
+  };
+  __m128i const bit5 = _mm_set1_epi8(0x20);
+  __m128i const folded[4] = {
+    _mm_or_si128(v[0], bit5),
+    _mm_or_si128(v[1], bit5),
+    _mm_or_si128(v[2], bit5),
+    _mm_or_si128(v[3], bit5),
+  };
+  return {
+    mask_eq(v, '"'),
+    mask_eq(v, '\\'),
+    mask_eq(folded, OPEN),
+    mask_eq(folded, CLOSE),
+  };
+}
+
+#endif
+
+inline bool
+is_space(
+  char const c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+
+inline char const*
+skip_space(
+  char const* p,
+  char const* const end)
+{
+  while (p < end && is_space(*p))
+    ++p;
+  return p;
+}
+
+
+/*
+ * Returns the end of the string whose opening quote is at `p`.
+ */
+char const*
+skip_string(
+  char const* const p,
+  char const* const end)
+{
+  char const* q = p + 1;
+  while (true) {
+    q = (char const*) std::memchr(q, '"', end - q);
+    if (q == nullptr)
+      throw ParseError();
+    // The quote is escaped if preceded by an odd number of backslashes.
+    char const* s = q;
+    while (s > p + 1 && s[-1] == '\\')
+      --s;
+    ++q;
+    if ((q - 1 - s) % 2 == 0)
+      return q;
+  }
+}
+
+
+/*
+ * Returns the end of the number or literal at `p`.
+ */
+inline char const*
+skip_scalar(
+  char const* p,
+  char const* const end)
+{
+  while (p < end
+         && (('0' <= *p && *p <= '9') || ('a' <= *p && *p <= 'z')
+             || *p == '-' || *p == '+' || *p == '.' || *p == 'E'))
+    ++p;
+  return p;
+}
+
+
+/*
+ * Returns the end of the array or object whose opening bracket is at `p`.
+ *
+ * Counts brackets outside strings a block at a time.  Depth can only return to
+ * zero in a block with at least as many closing brackets as the depth before
+ * it, so other blocks need only population counts.
+ */
+char const*
+skip_container(
+  char const* const start,
+  char const* const end)
+{
+  uint64_t escaped = 0;
+  uint64_t in_string = 0;
+  uint64_t depth = 0;
+  for (char const* p = start; p < end; p += BLOCK_SIZE) {
+    Block block;
+    uint64_t valid = ~uint64_t(0);
+    if (end - p >= (ptrdiff_t) BLOCK_SIZE)
+      block = scan_block(p);
+    else {
+      // Pad the last block, and mask out bits beyond the end.
+      size_t const len = end - p;
+      char buf[BLOCK_SIZE] = {};
+      std::memcpy(buf, p, len);
+      block = scan_block(buf);
+      valid = (uint64_t(1) << len) - 1;
+    }
+
+    uint64_t const quote
+      = block.quote & ~escaped_mask(block.backslash, escaped);
+    uint64_t const str = prefix_xor(quote) ^ in_string;
+    in_string = uint64_t(int64_t(str) >> 63);
+    uint64_t const open = block.open & ~str & valid;
+    uint64_t const close = block.close & ~str & valid;
+
+    uint64_t const num_close = __builtin_popcountll(close);
+    if (num_close < depth) {
+      depth += __builtin_popcountll(open) - num_close;
+      continue;
+    }
+    for (uint64_t bits = open | close; bits != 0; bits &= bits - 1) {
+      int const i = __builtin_ctzll(bits);
+      if ((open >> i) & 1)
+        ++depth;
+      else if (--depth == 0)
+        return p + i + 1;
+    }
+  }
+  throw ParseError();
+}
+
+
+/*
+ * Returns the end of the value at `p`.
+ */
+char const*
+skip_value(
+  char const* const p,
+  char const* const end)
+{
+  if (p == end)
+    throw ParseError();
+  switch (*p) {
+  case '"':
+    return skip_string(p, end);
+
+  case '[':
+  case '{':
+    return skip_container(p, end);
+
+  default:
+    char const* const e = skip_scalar(p, end);
+    if (e == p)
+      throw ParseError();
+    return e;
+  }
+}
+
+
+/*
+ * Given the first character of a container, returns its first element or
+ * member, or null if it is empty.
+ */
+char const*
+first(
+  char const* const p,
+  char const* const end,
+  char const close)
+{
+  char const* const q = skip_space(p + 1, end);
+  if (q == end)
+    throw ParseError();
+  return *q == close ? nullptr : q;
+}
+
+
+/*
+ * Given the end of an element or member value, returns the start of the next,
+ * or null at the container's close.
+ */
+char const*
+next(
+  char const* p,
+  char const* const end,
+  char const close)
+{
+  p = skip_space(p, end);
+  if (p == end)
+    throw ParseError();
+  else if (*p == close)
+    return nullptr;
+  else if (*p != ',')
+    throw ParseError();
+  p = skip_space(p + 1, end);
+  if (p == end || *p == close)
+    throw ParseError();
+  return p;
+}
+
+
+/*
+ * Given the start of a member, returns the body of its name, and the start of
+ * its value.
+ */
+char const*
+member(
+  char const* const p,
+  char const* const end,
+  char const*& name,
+  size_t& size)
+{
+  if (*p != '"')
+    throw ParseError();
+  char const* const e = skip_string(p, end);
+  name = p + 1;
+  size = e - 1 - name;
+  char const* const colon = skip_space(e, end);
+  if (colon == end || *colon != ':')
+    throw ParseError();
+  char const* const val = skip_space(colon + 1, end);
+  if (val == end)
+    throw ParseError();
+  return val;
+}
+
+
+inline std::string
+decode(
+  char const* const data,
+  size_t const size)
+{
+  if (std::memchr(data, '\\', size) == nullptr)
+    return std::string(data, size);
+  std::string str;
+  decode_string(data, data + size, str);
+  return str;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+Json::Type
+Cursor::get_type()
+  const
+{
+  if (p_ == nullptr || p_ == end_)
+    throw ParseError();
+  auto const literal = [this](char const* const lit, size_t const len) {
+    if (!(end_ - p_ >= (ptrdiff_t) len && std::memcmp(p_, lit, len) == 0
+          && skip_scalar(p_, end_) == p_ + len))
+      throw ParseError();
+  };
+
+  switch (*p_) {
+  case 'n': literal("null", 4); return Json::NUL;
+  case 't': literal("true", 4); return Json::TRU;
+  case 'f': literal("false", 5); return Json::FAL;
+  case '"': return Json::STR;
+  case '[': return Json::ARR;
+  case '{': return Json::OBJ;
+
+  default:
+    if (*p_ == '-' || ('0' <= *p_ && *p_ <= '9'))
+      return Json::NUM;
+    throw ParseError();
+  }
+}
+
+
+bool
+Cursor::get_bool()
+  const
+{
+  switch (get_type()) {
+  case Json::FAL: return false;
+  case Json::TRU: return true;
+
+  default:
+    throw TypeError("not a TRU or FAL");
+  }
+}
+
+
+double
+Cursor::get_num()
+  const
+{
+  if (get_type() != Json::NUM)
+    throw TypeError("not a NUM");
+  char const* const e = skip_scalar(p_, end_);
+  double val;
+  if (!is_number(p_, e) || !parse_double(p_, e, val))
+    throw ParseError();
+  return val;
+}
+
+
+int
+Cursor::get_int()
+  const
+{
+  double const num = get_num();
+  int const val = int(num);
+  if (val == num)
+    return val;
+  else {
+    std::stringstream ss;
+    ss << "not an int: " << val;
+    throw TypeError(ss.str());
+  }
+}
+
+
+std::string
+Cursor::get_str()
+  const
+{
+  if (get_type() != Json::STR)
+    throw TypeError("not a STR");
+  char const* const e = skip_string(p_, end_);
+  return decode(p_ + 1, e - 1 - (p_ + 1));
+}
+
+
+size_t
+Cursor::size()
+  const
+{
+  if (get_type() != Json::ARR)
+    throw TypeError("not a ARR");
+  size_t num = 0;
+  for (auto p = first(p_, end_, ']'); p != nullptr;
+       p = next(skip_value(p, end_), end_, ']'))
+    ++num;
+  return num;
+}
+
+
+Cursor
+Cursor::operator[](
+  size_t const index)
+  const
+{
+  if (get_type() != Json::ARR)
+    throw TypeError("not a ARR");
+  size_t i = 0;
+  for (auto p = first(p_, end_, ']'); p != nullptr;
+       p = next(skip_value(p, end_), end_, ']'), ++i)
+    if (i == index)
+      return {p, end_};
+  throw IndexError(index, i);
+}
+
+
+Cursor::ArrVal
+Cursor::get_arr()
+  const
+{
+  if (get_type() != Json::ARR)
+    throw TypeError("not a ARR");
+  return Cursor(first(p_, end_, ']'), end_);
+}
+
+
+bool
+Cursor::has(
+  std::string const& name)
+  const
+{
+  for (auto const& member : get_obj())
+    if (member.first == name)
+      return true;
+  return false;
+}
+
+
+Cursor
+Cursor::operator[](
+  std::string const& name)
+  const
+{
+  if (get_type() != Json::OBJ)
+    throw TypeError("not a OBJ");
+  for (auto p = first(p_, end_, '}'); p != nullptr; ) {
+    char const* key;
+    size_t size;
+    char const* const val = member(p, end_, key, size);
+    // Compare undecoded names first; most have no escapes.
+    if ((size == name.size() && std::memcmp(key, name.data(), size) == 0)
+        || (std::memchr(key, '\\', size) != nullptr
+            && decode(key, size) == name))
+      return {val, end_};
+    p = next(skip_value(val, end_), end_, '}');
+  }
+  throw NameError(name);
+}
+
+
+Cursor::ObjVal
+Cursor::get_obj()
+  const
+{
+  if (get_type() != Json::OBJ)
+    throw TypeError("not a OBJ");
+  return {first(p_, end_, '}'), end_};
+}
+
+
+Json
+Cursor::to_json()
+  const
+{
+  return parse(std::string(p_, skip_value(p_, end_)));
+}
+
+
+//------------------------------------------------------------------------------
+
+Cursor::ArrVal::iterator&
+Cursor::ArrVal::iterator::operator++()
+{
+  cur_.p_ = next(skip_value(cur_.p_, cur_.end_), cur_.end_, ']');
+  return *this;
+}
+
+
+Cursor::ObjVal::iterator::iterator(
+  char const* const p,
+  char const* const end)
+: p_(p),
+  end_(end),
+  member_{std::string(), Cursor(nullptr, end)}
+{
+  load();
+}
+
+
+void
+Cursor::ObjVal::iterator::load()
+{
+  if (p_ == nullptr)
+    return;
+  char const* name;
+  size_t size;
+  char const* const val = member(p_, end_, name, size);
+  member_.first = decode(name, size);
+  member_.second = Cursor(val, end_);
+}
+
+
+Cursor::ObjVal::iterator&
+Cursor::ObjVal::iterator::operator++()
+{
+  p_ = next(skip_value(member_.second.p_, end_), end_, '}');
+  load();
+  return *this;
+}
+
+
+//------------------------------------------------------------------------------
+
+Document::Document(
+  std::string const& path)
+: text_(nullptr),
+  size_(0),
+  mapped_(false)
+{
+  int const fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw Error("can't open "s + path + ": " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw Error("can't stat "s + path + ": " + strerror(errno));
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* const addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw Error("can't map "s + path + ": " + strerror(errno));
+    }
+    text_ = (char const*) addr;
+    mapped_ = true;
+  }
+  close(fd);
+}
+
+
+Document::Document(
+  char const* const text,
+  size_t const size)
+: text_(text),
+  size_(size),
+  mapped_(false)
+{
+}
+
+
+Document::~Document()
+{
+  if (mapped_)
+    munmap((void*) text_, size_);
+}
+
+
+Cursor
+Document::root()
+  const
+{
+  char const* const end = text_ + size_;
+  char const* const p = skip_space(text_, end);
+  if (p == end)
+    throw ParseError();
+  return {p, end};
+}
+
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "json.hh"
+
+namespace aslib {
+namespace json {
+
+//------------------------------------------------------------------------------
+
+/*
+ * A position in JSON text, from which a value is read on demand.
+ *
+ * Navigation is as for `Json`, e.g. `doc["runs"][i]["mean"].get_num()`, but
+ * each step scans the text: looking up a member or element skips the values
+ * before it, without parsing them, by tracking bracket depth 64 bytes at a
+ * time.  Only the values that are read are parsed, so cost grows with the text
+ * up to the values read, not with the size of the document.
+ *
+ * Text that is skipped is checked only for balanced brackets and terminated
+ * strings; errors in it may go undetected.  If an object has duplicate names,
+ * lookup finds the first.
+ */
+class Cursor
+{
+public:
+
+  class ArrVal;
+  class ObjVal;
+
+  Cursor(char const* const p, char const* const end) : p_(p), end_(end) {}
+
+  Json::Type get_type() const;
+
+  bool get_bool() const;
+  double get_num() const;
+  int get_int() const;
+  std::string get_str() const;
+
+  // Number of elements, counted by skipping each.
+  size_t size() const;
+  Cursor operator[](size_t index) const;
+  ArrVal get_arr() const;
+
+  bool has(std::string const& name) const;
+  Cursor operator[](std::string const& name) const;
+  ObjVal get_obj() const;
+
+  /*
+   * Parses the value in full.
+   */
+  Json to_json() const;
+
+private:
+
+  // First character of the value, or null past the end of a container.
+  char const* p_;
+  // End of the text.
+  char const* end_;
+
+};
+
+
+/*
+ * Forward iteration over the elements of an array.
+ */
+class Cursor::ArrVal
+{
+public:
+
+  class iterator
+  {
+  public:
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Cursor;
+    using difference_type = ptrdiff_t;
+    using pointer = Cursor const*;
+    using reference = Cursor const&;
+
+    iterator(Cursor const& cur) : cur_(cur) {}
+
+    Cursor const& operator*() const     { return cur_; }
+    Cursor const* operator->() const    { return &cur_; }
+    iterator& operator++();
+
+    bool
+    operator==(
+      iterator const& other)
+      const
+    {
+      return cur_.p_ == other.cur_.p_;
+    }
+
+    bool operator!=(iterator const& other) const { return !(*this == other); }
+
+  private:
+
+    Cursor cur_;
+
+  };
+
+  ArrVal(Cursor const& first) : first_(first) {}
+
+  iterator begin() const                { return first_; }
+  iterator end() const                  { return Cursor(nullptr, first_.end_); }
+
+private:
+
+  Cursor const first_;
+
+};
+
+
+/*
+ * Forward iteration over the members of an object, as pairs of name and value.
+ */
+class Cursor::ObjVal
+{
+public:
+
+  class iterator
+  {
+  public:
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<std::string, Cursor>;
+    using difference_type = ptrdiff_t;
+    using pointer = value_type const*;
+    using reference = value_type const&;
+
+    // `p` is the start of a member's name, or null at the end.
+    iterator(char const* p, char const* end);
+
+    value_type const& operator*() const { return member_; }
+    value_type const* operator->() const { return &member_; }
+    iterator& operator++();
+    bool operator==(iterator const& other) const { return p_ == other.p_; }
+    bool operator!=(iterator const& other) const { return p_ != other.p_; }
+
+  private:
+
+    // Reads the name and finds the value of the member at `p_`.
+    void load();
+
+    char const* p_;
+    char const* const end_;
+    value_type member_;
+
+  };
+
+  ObjVal(
+    char const* const first,
+    char const* const end)
+  : first_(first),
+    end_(end)
+  {
+  }
+
+  iterator begin() const                { return {first_, end_}; }
+  iterator end() const                  { return {nullptr, end_}; }
+
+private:
+
+  char const* const first_;
+  char const* const end_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * JSON text for on-demand reading with `Cursor`, memory-mapped from a file or
+ * borrowed from memory.
+ */
+class Document
+{
+public:
+
+  /*
+   * Maps the file at `path`.  Pages are read as they are touched.
+   */
+  explicit Document(std::string const& path);
+
+  /*
+   * Uses `size` bytes of `text`, which must outlive the document.
+   */
+  Document(char const* text, size_t size);
+
+  Document(Document const&)             = delete;
+  Document& operator=(Document const&)  = delete;
+  ~Document();
+
+  size_t size() const                   { return size_; }
+
+  // The top-level value.
+  Cursor root() const;
+
+  // Convenience.
+  Cursor operator[](size_t index) const { return root()[index]; }
+  Cursor operator[](std::string const& name) const { return root()[name]; }
+
+private:
+
+  char const* text_;
+  size_t size_;
+  bool mapped_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,722 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "format.hh"
+#include "json_stream.hh"
+#include "parse.hh"
+
+//------------------------------------------------------------------------------
+
+namespace aslib {
+namespace json {
+
+namespace {
+
+// Size of chunks read from a stream.
+size_t constexpr CHUNK_SIZE = 64 << 10;
+
+inline bool
+is_space(
+  char const c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+
+/*
+ * Returns true if `c` may be part of a number or literal.
+ */
+inline bool
+is_word(
+  char const c)
+{
+  return ('0' <= c && c <= '9')
+    || ('a' <= (c | 0x20) && (c | 0x20) <= 'z')
+    || c == '+' || c == '-' || c == '.';
+}
+
+
+inline char const*
+word_end(
+  char const* p,
+  char const* const end)
+{
+  while (p < end && is_word(*p))
+    ++p;
+  return p;
+}
+
+
+/*
+ * Returns the closing quote of a string whose body continues at `p`, or `end`
+ * if it isn't in [p, end).  `escaped` carries an escape split across calls.
+ */
+inline char const*
+string_end(
+  char const* p,
+  char const* const end,
+  bool& escaped)
+{
+  if (escaped && p < end) {
+    ++p;
+    escaped = false;
+  }
+  while (p < end) {
+    char const c = *p;
+    if (c == '"')
+      return p;
+    else if (c != '\\')
+      ++p;
+    else if (p + 1 == end) {
+      escaped = true;
+      return end;
+    }
+    else
+      p += 2;
+  }
+  return end;
+}
+
+
+unsigned
+hex4(
+  char const*& p,
+  char const* const end)
+{
+  if (end - p < 4)
+    throw ParseError();
+  unsigned val = 0;
+  for (int i = 0; i < 4; ++i, ++p) {
+    char const c = *p;
+    val <<= 4;
+    if ('0' <= c && c <= '9')
+      val |= c - '0';
+    else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f')
+      val |= (c | 0x20) - 'a' + 10;
+    else
+      throw ParseError();
+  }
+  return val;
+}
+
+
+/*
+ * Decodes a \u escape, after the 'u', as UTF-8 into `d`.  Returns the end.
+ */
+char*
+unicode(
+  char const*& p,
+  char const* const end,
+  char* d)
+{
+  unsigned code = hex4(p, end);
+  if (0xdc00 <= code && code < 0xe000)
+    throw ParseError();
+  if (0xd800 <= code && code < 0xdc00) {
+    // A surrogate pair.
+    if (!(end - p >= 2 && p[0] == '\\' && p[1] == 'u'))
+      throw ParseError();
+    p += 2;
+    unsigned const low = hex4(p, end);
+    if (!(0xdc00 <= low && low < 0xe000))
+      throw ParseError();
+    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+  }
+  if (code < 0x80)
+    *d++ = code;
+  else if (code < 0x800) {
+    *d++ = 0xc0 | (code >> 6);
+    *d++ = 0x80 | (code & 0x3f);
+  }
+  else if (code < 0x10000) {
+    *d++ = 0xe0 | (code >> 12);
+    *d++ = 0x80 | ((code >> 6) & 0x3f);
+    *d++ = 0x80 | (code & 0x3f);
+  }
+  else {
+    *d++ = 0xf0 | (code >> 18);
+    *d++ = 0x80 | ((code >> 12) & 0x3f);
+    *d++ = 0x80 | ((code >> 6) & 0x3f);
+    *d++ = 0x80 | (code & 0x3f);
+  }
+  return d;
+}
+
+
+inline void
+sep(
+  std::string& out,
+  int const indent,
+  size_t const level)
+{
+  if (indent == FORMAT_MIN)
+    ;
+  else if (indent == FORMAT_ONE_LINE)
+    out += ' ';
+  else {
+    out += '\n';
+    out.append(indent * level, ' ');
+  }
+}
+
+
+void
+print_str(
+  std::string& out,
+  char const* const data,
+  size_t const size)
+{
+  out += '"';
+  // Characters that need no escape are appended in runs.
+  char const* run = data;
+  for (size_t i = 0; i < size; ++i) {
+    char const c = data[i];
+    char esc;
+    switch (c) {
+    case '"':  esc = '"'; break;
+    case '\\': esc = '\\'; break;
+    case '\b': esc = 'b'; break;
+    case '\f': esc = 'f'; break;
+    case '\n': esc = 'n'; break;
+    case '\r': esc = 'r'; break;
+    case '\t': esc = 't'; break;
+
+    default:
+      if ((unsigned char) c >= 0x20)
+        // Including bytes of UTF-8 sequences.
+        continue;
+      esc = 0;
+      break;
+    }
+
+    out.append(run, data + i);
+    run = data + i + 1;
+    if (esc != 0) {
+      out += '\\';
+      out += esc;
+    }
+    else {
+      char buf[8];
+      int const len = snprintf(buf, sizeof(buf), "\\u%04x", (unsigned) c);
+      out.append(buf, len);
+    }
+  }
+  out.append(run, data + size);
+  out += '"';
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+bool
+is_number(
+  char const* p,
+  char const* const end)
+{
+  auto const digits = [&p, end]() {
+    char const* const start = p;
+    while (p < end && '0' <= *p && *p <= '9')
+      ++p;
+    return p > start;
+  };
+
+  if (p < end && *p == '-')
+    ++p;
+  if (p < end && *p == '0')
+    ++p;
+  else if (!digits())
+    return false;
+  if (p < end && *p == '.') {
+    ++p;
+    if (!digits())
+      return false;
+  }
+  if (p < end && (*p | 0x20) == 'e') {
+    ++p;
+    if (p < end && (*p == '+' || *p == '-'))
+      ++p;
+    if (!digits())
+      return false;
+  }
+  return p == end;
+}
+
+
+void
+decode_string(
+  char const* p,
+  char const* const end,
+  std::string& out)
+{
+  // Decoding never lengthens the text.
+  size_t const size = out.size();
+  out.resize(size + (end - p));
+  char* const start = &out[0];
+  char* d = start + size;
+  while (p < end) {
+    if (*p != '\\') {
+      *d++ = *p++;
+      continue;
+    }
+    // Skip over the escape character, but treat the next one specially.
+    if (++p == end)
+      throw ParseError();
+    switch (*p++) {
+    case '"':  *d++ = '"'; break;
+    case '\\': *d++ = '\\'; break;
+    case '/':  *d++ = '/'; break;
+    case 'b':  *d++ = '\b'; break;
+    case 'f':  *d++ = '\f'; break;
+    case 'n':  *d++ = '\n'; break;
+    case 'r':  *d++ = '\r'; break;
+    case 't':  *d++ = '\t'; break;
+    case 'u':  d = unicode(p, end, d); break;
+
+    default:
+      // Unknown escape sequence.
+      throw ParseError();
+    }
+  }
+  out.resize(d - start);
+}
+
+
+//------------------------------------------------------------------------------
+
+Reader::Reader(
+  Handler& handler,
+  bool const multiple)
+: handler_(handler),
+  multiple_(multiple)
+{
+}
+
+
+size_t
+Reader::feed(
+  char const* const data,
+  size_t const size)
+{
+  char const* p = data;
+  char const* const end = data + size;
+  if (!carry_.empty())
+    p = resume(p, end);
+  return run(p, end) - data;
+}
+
+
+void
+Reader::finish()
+{
+  if (!carry_.empty()) {
+    if (carry_[0] == '"')
+      // Hit the end of text inside a quoted string.
+      throw ParseError();
+    token(carry_.data(), carry_.data() + carry_.size());
+    carry_.clear();
+  }
+  if (multiple_ ? state_ != VALUE || !stack_.empty() : state_ != DONE)
+    throw ParseError();
+}
+
+
+char const*
+Reader::resume(
+  char const* const p,
+  char const* const end)
+{
+  char const* q;
+  bool complete;
+  if (carry_[0] == '"') {
+    q = string_end(p, end, escaped_);
+    complete = q < end;
+    if (complete)
+      // Include the closing quote.
+      ++q;
+  }
+  else {
+    q = word_end(p, end);
+    // Else the token may continue in the next chunk.
+    complete = q < end;
+  }
+  carry_.append(p, q);
+  if (!complete)
+    return end;
+
+  token(carry_.data(), carry_.data() + carry_.size());
+  carry_.clear();
+  return q;
+}
+
+
+char const*
+Reader::run(
+  char const* p,
+  char const* const end)
+{
+  while (true) {
+    if (state_ == DONE)
+      return p;
+    while (p < end && is_space(*p))
+      ++p;
+    if (p == end)
+      return p;
+
+    char const c = *p;
+    switch (state_) {
+    case COLON:
+      if (c != ':')
+        throw ParseError();
+      ++p;
+      state_ = VALUE;
+      continue;
+
+    case AFTER:
+      if (c == ',') {
+        ++p;
+        state_ = stack_.back() == '{' ? KEY : VALUE;
+      }
+      else if (c == ']' && stack_.back() == '[') {
+        ++p;
+        stack_.pop_back();
+        handler_.end_array();
+        after_value();
+      }
+      else if (c == '}' && stack_.back() == '{') {
+        ++p;
+        stack_.pop_back();
+        handler_.end_object();
+        after_value();
+      }
+      else
+        throw ParseError();
+      continue;
+
+    case FIRST_KEY:
+      if (c == '}') {
+        ++p;
+        stack_.pop_back();
+        handler_.end_object();
+        after_value();
+        continue;
+      }
+      // Fall through.
+    case KEY:
+      if (c != '"')
+        throw ParseError();
+      key_ = true;
+      break;
+
+    case FIRST_VALUE:
+      if (c == ']') {
+        ++p;
+        stack_.pop_back();
+        handler_.end_array();
+        after_value();
+        continue;
+      }
+      // Fall through.
+    case VALUE:
+      if (c == '[') {
+        ++p;
+        stack_.push_back('[');
+        handler_.start_array();
+        state_ = FIRST_VALUE;
+        continue;
+      }
+      else if (c == '{') {
+        ++p;
+        stack_.push_back('{');
+        handler_.start_object();
+        state_ = FIRST_KEY;
+        continue;
+      }
+      key_ = false;
+      break;
+
+    case DONE:
+      assert(false);
+    }
+
+    // A string, number, or literal.
+    char const* q;
+    if (c == '"') {
+      escaped_ = false;
+      q = string_end(p + 1, end, escaped_);
+      if (q < end)
+        ++q;
+      else {
+        carry_.assign(p, end);
+        return end;
+      }
+    }
+    else {
+      q = word_end(p, end);
+      if (q == end) {
+        // The token may continue in the next chunk.
+        carry_.assign(p, end);
+        return end;
+      }
+      else if (q == p)
+        throw ParseError();
+    }
+    token(p, q);
+    p = q;
+  }
+}
+
+
+void
+Reader::token(
+  char const* const p,
+  char const* const end)
+{
+  size_t const len = end - p;
+  if (*p == '"') {
+    char const* data = p + 1;
+    size_t size = len - 2;
+    if (std::memchr(data, '\\', size) != nullptr) {
+      decoded_.clear();
+      decode_string(data, data + size, decoded_);
+      data = decoded_.data();
+      size = decoded_.size();
+    }
+    if (key_) {
+      handler_.key(data, size);
+      state_ = COLON;
+      return;
+    }
+    handler_.string(data, size);
+  }
+  else if (*p == '-' || ('0' <= *p && *p <= '9')) {
+    if (!is_number(p, end))
+      throw ParseError();
+    double val;
+    if (!parse_double(p, end, val))
+      throw ParseError();
+    handler_.number(val);
+  }
+  else if (len == 4 && std::memcmp(p, "true", 4) == 0)
+    handler_.boolean(true);
+  else if (len == 5 && std::memcmp(p, "false", 5) == 0)
+    handler_.boolean(false);
+  else if (len == 4 && std::memcmp(p, "null", 4) == 0)
+    handler_.null();
+  else
+    throw ParseError();
+  after_value();
+}
+
+
+inline void
+Reader::after_value()
+{
+  state_ = !stack_.empty() ? AFTER : multiple_ ? VALUE : DONE;
+}
+
+
+//------------------------------------------------------------------------------
+
+Writer::Writer(
+  std::ostream& os,
+  int const indent,
+  size_t const level)
+: os_(os),
+  indent_(indent),
+  level_(level)
+{
+}
+
+
+Writer::~Writer()
+{
+  flush();
+}
+
+
+void
+Writer::flush()
+{
+  os_.write(buf_.data(), buf_.size());
+  buf_.clear();
+}
+
+
+void
+Writer::before_value()
+{
+  if (after_key_)
+    after_key_ = false;
+  else if (depth_ > 0) {
+    // An array element.
+    if (!first_)
+      buf_ += ',';
+    first_ = false;
+    sep(buf_, indent_, level_);
+  }
+}
+
+
+inline void
+Writer::after_event()
+{
+  if (depth_ == 0 || buf_.size() >= CHUNK_SIZE)
+    flush();
+}
+
+
+void
+Writer::null()
+{
+  before_value();
+  buf_.append("null", 4);
+  after_event();
+}
+
+
+void
+Writer::boolean(
+  bool const val)
+{
+  before_value();
+  if (val)
+    buf_.append("true", 4);
+  else
+    buf_.append("false", 5);
+  after_event();
+}
+
+
+void
+Writer::number(
+  double const val)
+{
+  before_value();
+  // JSON has no NaN or infinities.
+  if (std::isfinite(val))
+    append_double(buf_, val);
+  else
+    buf_.append("null", 4);
+  after_event();
+}
+
+
+void
+Writer::string(
+  char const* const data,
+  size_t const size)
+{
+  before_value();
+  print_str(buf_, data, size);
+  after_event();
+}
+
+
+void
+Writer::start_array()
+{
+  before_value();
+  buf_ += '[';
+  ++depth_;
+  ++level_;
+  first_ = true;
+}
+
+
+void
+Writer::end_array()
+{
+  assert(depth_ > 0);
+  --depth_;
+  --level_;
+  sep(buf_, indent_, level_);
+  buf_ += ']';
+  first_ = false;
+  after_event();
+}
+
+
+void
+Writer::start_object()
+{
+  before_value();
+  buf_ += '{';
+  ++depth_;
+  ++level_;
+  first_ = true;
+}
+
+
+void
+Writer::key(
+  char const* const data,
+  size_t const size)
+{
+  assert(depth_ > 0 && !after_key_);
+  if (!first_)
+    buf_ += ',';
+  first_ = false;
+  sep(buf_, indent_, level_);
+  print_str(buf_, data, size);
+  buf_ += ':';
+  if (indent_ != FORMAT_MIN)
+    buf_ += ' ';
+  after_key_ = true;
+}
+
+
+void
+Writer::end_object()
+{
+  assert(depth_ > 0);
+  --depth_;
+  --level_;
+  sep(buf_, indent_, level_);
+  buf_ += '}';
+  first_ = false;
+  after_event();
+}
+
+
+//------------------------------------------------------------------------------
+
+void
+parse(
+  std::istream& is,
+  Handler& handler,
+  bool const multiple)
+{
+  Reader reader(handler, multiple);
+  std::vector<char> buf(CHUNK_SIZE);
+  while (!reader.done() && is) {
+    is.read(buf.data(), buf.size());
+    auto const size = is.gcount();
+    if (size > 0)
+      reader.feed(buf.data(), size);
+  }
+  reader.finish();
+}
+
+
+Json
+parse(
+  std::istream& is)
+{
+  Builder builder;
+  parse(is, builder);
+  return builder.take();
+}
+
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "json.hh"
+
+namespace aslib {
+namespace json {
+
+//------------------------------------------------------------------------------
+
+/*
+ * Receives the events of a JSON stream.
+ *
+ * A value is one scalar event, or a start event, the contained values, and
+ * the matching end event.  In an object, each value is preceded by `key()`.
+ * Characters passed to `key()` and `string()` are decoded UTF-8, and are
+ * valid only for the duration of the call.
+ */
+class Handler
+{
+public:
+
+  virtual ~Handler() {}
+
+  virtual void null() = 0;
+  virtual void boolean(bool val) = 0;
+  virtual void number(double val) = 0;
+  virtual void string(char const* data, size_t size) = 0;
+
+  virtual void start_array() = 0;
+  virtual void end_array() = 0;
+
+  virtual void start_object() = 0;
+  virtual void key(char const* data, size_t size) = 0;
+  virtual void end_object() = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Incremental JSON parser, which passes events to a handler as it reads text
+ * in chunks of any size.
+ *
+ * Memory use is bounded by the nesting depth and the longest string or number,
+ * independent of the size of the text: nesting is tracked on a heap stack,
+ * rather than by recursion, and only a token split across chunks is copied.
+ */
+class Reader
+{
+public:
+
+  /*
+   * If `multiple`, reads any number of top-level values, e.g. one per line of
+   * NDJSON; else reads exactly one.
+   */
+  Reader(Handler& handler, bool multiple=false);
+
+  /*
+   * Parses `size` bytes of text.  Returns the number consumed, which is
+   * `size` unless a single value is complete before then.
+   */
+  size_t feed(char const* data, size_t size);
+
+  /*
+   * Ends the text, completing a trailing number.  Throws `ParseError` if a
+   * value is incomplete, or if a single value was expected and none was read.
+   */
+  void finish();
+
+  // True if a single value has been read in full.
+  bool done() const                     { return state_ == DONE; }
+
+private:
+
+  enum State : uint8_t
+  {
+    // Expecting a value.
+    VALUE,
+    // After '[', expecting a value or ']'.
+    FIRST_VALUE,
+    // After '{', expecting a key or '}'.
+    FIRST_KEY,
+    // After ',' in an object, expecting a key.
+    KEY,
+    // After a key, expecting ':'.
+    COLON,
+    // After a value in an array or object, expecting ',' or its close.
+    AFTER,
+    // After a single top-level value.
+    DONE,
+  };
+
+  // Parses whole tokens in [p, end); returns where it stopped.
+  char const* run(char const* p, char const* end);
+  // Extends a token split across chunks; returns where it ends in [p, end).
+  char const* resume(char const* p, char const* end);
+  // Handles a complete string, number, or literal in [p, end).
+  void token(char const* p, char const* end);
+  // Sets the state after a complete value.
+  void after_value();
+
+  Handler& handler_;
+  bool const multiple_;
+  State state_ = VALUE;
+  // Whether a key, rather than a string value, is being read.
+  bool key_ = false;
+  // Open containers, '[' or '{'.
+  std::vector<char> stack_;
+  // Text of a token split across chunks.
+  std::string carry_;
+  // Whether `carry_` is a string that ends in an unfinished escape.
+  bool escaped_ = false;
+  // Buffer for decoding strings with escapes.
+  std::string decoded_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes events as JSON text, formatted as `Json::print()` does.
+ *
+ * Text is buffered, and written to the stream when the buffer fills, when a
+ * top-level value is complete, or on `flush()`.  Numbers are written with the
+ * fewest digits that read back exactly; NaN and infinities, which JSON can't
+ * represent, are written as null.
+ */
+class Writer
+  : public Handler
+{
+public:
+
+  Writer(std::ostream& os, int indent=2, size_t level=0);
+  ~Writer() override;
+
+  /*
+   * Writes buffered text to the stream, e.g. to show progress within a
+   * top-level value.  Doesn't flush the stream itself.
+   */
+  void flush();
+
+  void null() override;
+  void boolean(bool val) override;
+  void number(double val) override;
+  void string(char const* data, size_t size) override;
+
+  void start_array() override;
+  void end_array() override;
+
+  void start_object() override;
+  void key(char const* data, size_t size) override;
+  void end_object() override;
+
+  // Convenience.
+  void string(std::string const& val)   { string(val.data(), val.size()); }
+  void key(std::string const& name)     { key(name.data(), name.size()); }
+
+private:
+
+  // Writes the separator before a value.
+  void before_value();
+  // Flushes the buffer if a top-level value is complete, or it is full.
+  void after_event();
+
+  std::ostream& os_;
+  std::string buf_;
+  int const indent_;
+  size_t level_;
+  // Number of open containers.
+  size_t depth_ = 0;
+  // Whether the innermost open container is still empty.
+  bool first_ = true;
+  // Whether a key has been written without its value.
+  bool after_key_ = false;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Builds a `Json` document from events.
+ */
+class Builder
+  : public Handler
+{
+public:
+
+  void null() override;
+  void boolean(bool val) override;
+  void number(double val) override;
+  void string(char const* data, size_t size) override;
+
+  void start_array() override;
+  void end_array() override;
+
+  void start_object() override;
+  void key(char const* data, size_t size) override;
+  void end_object() override;
+
+  // True if a complete value has been built.
+  bool done() const                     { return done_; }
+
+  /*
+   * Returns the value built, and resets to build another.
+   */
+  Json take();
+
+private:
+
+  // Returns the value to set for the next event.
+  Json& next();
+  // Marks the end of a value.
+  void end_value()                      { done_ = stack_.empty(); }
+  // Sorts the members of `obj` by name, keeping the last of any duplicates.
+  static void sort_members(Json& obj);
+
+  Json root_;
+  // Open containers, innermost last.
+  std::vector<Json*> stack_;
+  // For each open object, whether its members so far are sorted by name.
+  std::vector<bool> sorted_;
+  // The member value following a key.
+  Json* member_ = nullptr;
+  bool done_ = false;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns true if [p, end) is a number in JSON syntax.
+ */
+extern bool is_number(char const* p, char const* end);
+
+/*
+ * Decodes the body of a string, [p, end), appending it to `out`.  Throws
+ * `ParseError` on an invalid escape.
+ */
+extern void decode_string(char const* p, char const* end, std::string& out);
+
+//------------------------------------------------------------------------------
+
+/*
+ * Parses a value from `is`, reading it in chunks.  Text after the value is
+ * ignored.
+ */
+extern Json parse(std::istream& is);
+
+/*
+ * Reads `is` in chunks, passing events to `handler`.
+ */
+extern void parse(std::istream& is, Handler& handler, bool multiple=false);
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+#include "json_tape.hh"
+#include "parse.hh"
+#include "text_bits.hh"
+
+//------------------------------------------------------------------------------
+
+namespace aslib {
+namespace json {
+
+namespace {
+
+size_t constexpr BLOCK_SIZE = 64;
+
+// Text indexed at a time; a multiple of the block size.
+size_t constexpr WINDOW_SIZE = 64 << 10;
+
+/*
+ * Bitmasks of character classes in a 64-byte block.
+ */
+struct Block
+{
+  uint64_t quote;
+  uint64_t backslash;
+  // Brackets, braces, colons, and commas.
+  uint64_t op;
+  uint64_t space;
+};
+
+
+#ifdef __AVX2__
+
+inline uint64_t
+mask(
+  __m256i const lo,
+  __m256i const hi)
+{
+  return (uint64_t) (uint32_t) _mm256_movemask_epi8(lo)
+    | (uint64_t) (uint32_t) _mm256_movemask_epi8(hi) << 32;
+}
+
+
+/*
+ * Classifies 32 bytes by looking up each nibble.  A byte is an op if the
+ * result has any of bits 0-2, and whitespace if any of bits 3-4.
+ */
+inline __m256i
+classify(
+  __m256i const v)
+{
+  __m256i const lo_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+    //  0     1  2  3  4  5  6  7  8  9     a     b     c     d  e  f
+    0x08, 0, 0, 0, 0, 0, 0, 0, 0, 0x10, 0x12, 0x04, 0x01, 0x14, 0, 0));
+  __m256i const hi_table = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+    //  0  1     2     3  4     5  6     7  8  9  a  b  c  d  e  f
+    0x10, 0, 0x09, 0x02, 0, 0x04, 0, 0x04, 0, 0, 0, 0, 0, 0, 0, 0));
+  __m256i const nibble = _mm256_set1_epi8(0x0f);
+  __m256i const lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble));
+  __m256i const hi = _mm256_shuffle_epi8(
+    hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+  return _mm256_and_si256(lo, hi);
+}
+
+
+inline Block
+scan_block(
+  char const* const p)
+{
+  __m256i const lo = _mm256_loadu_si256((__m256i const*) p);
+  __m256i const hi = _mm256_loadu_si256((__m256i const*) (p + 32));
+  __m256i const quote = _mm256_set1_epi8('"');
+  __m256i const backslash = _mm256_set1_epi8('\\');
+  __m256i const op_bits = _mm256_set1_epi8(0x07);
+  __m256i const space_bits = _mm256_set1_epi8(0x18);
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i const lo_class = classify(lo);
+  __m256i const hi_class = classify(hi);
+  return {
+    mask(_mm256_cmpeq_epi8(lo, quote), _mm256_cmpeq_epi8(hi, quote)),
+    mask(_mm256_cmpeq_epi8(lo, backslash), _mm256_cmpeq_epi8(hi, backslash)),
+    ~mask(
+      _mm256_cmpeq_epi8(_mm256_and_si256(lo_class, op_bits), zero),
+      _mm256_cmpeq_epi8(_mm256_and_si256(hi_class, op_bits), zero)),
+    ~mask(
+      _mm256_cmpeq_epi8(_mm256_and_si256(lo_class, space_bits), zero),
+      _mm256_cmpeq_epi8(_mm256_and_si256(hi_class, space_bits), zero)),
+  };
+}
+
+#else
+
+inline uint64_t
+mask_eq(
+  __m128i const (&v)[4],
+  char const c)
+{
+  __m128i const cv = _mm_set1_epi8(c);
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i)
+    mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v[i], cv))
+            << (16 * i);
+  return mask;
+}
+
+
+inline Block
+scan_block(
+  char const* const p)
+{
+  __m128i const v[4] = {
+    _mm_loadu_si128((__m128i const*) p),
+    _mm_loadu_si128((__m128i const*) (p + 16)),
+    _mm_loadu_si128((__m128i const*) (p + 32)),
+    _mm_loadu_si128((__m128i const*) (p + 48)),
+  };
+  return {
+    mask_eq(v, '"'),
+    mask_eq(v, '\\'),
+    mask_eq(v, '[') | mask_eq(v, ']') | mask_eq(v, '{') | mask_eq(v, '}')
+      | mask_eq(v, ':') | mask_eq(v, ','),
+    mask_eq(v, ' ') | mask_eq(v, '\n') | mask_eq(v, '\t') | mask_eq(v, '\r'),
+  };
+}
+
+#endif
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+Indexer::Indexer(
+  char const* const text,
+  size_t const size)
+: end_(text + size),
+  window_(text),
+  next_window_(text),
+  index_(new uint32_t[WINDOW_SIZE])
+{
+}
+
+
+bool
+Indexer::refill()
+{
+  while (next_window_ < end_) {
+    window_ = next_window_;
+    next_window_ = window_ + std::min<size_t>(WINDOW_SIZE, end_ - window_);
+    uint32_t* out = index_.get();
+
+    for (char const* p = window_; p < next_window_; p += BLOCK_SIZE) {
+      Block block;
+      uint64_t valid = ~uint64_t(0);
+      if (end_ - p >= (ptrdiff_t) BLOCK_SIZE)
+        block = scan_block(p);
+      else {
+        // Pad the last block, and mask out bits beyond the end.
+        size_t const len = end_ - p;
+        char buf[BLOCK_SIZE] = {};
+        std::memcpy(buf, p, len);
+        block = scan_block(buf);
+        valid = (uint64_t(1) << len) - 1;
+      }
+
+      uint64_t const quote
+        = block.quote & ~escaped_mask(block.backslash, escaped_);
+      // Set from each opening quote up to its closing quote.
+      uint64_t const in_string = prefix_xor(quote) ^ in_string_;
+      in_string_ = uint64_t(int64_t(in_string) >> 63);
+      uint64_t const body = in_string & ~quote;
+
+      uint64_t const op = block.op & ~body;
+      // Characters of numbers and literals, and any others out of place.
+      uint64_t const scalar = ~(op | block.space | quote | body);
+      uint64_t const scalar_start = scalar & ~(scalar << 1 | scalar_);
+      scalar_ = scalar >> 63;
+
+      uint64_t bits = (op | quote | scalar_start) & valid;
+      uint32_t const offset = p - window_;
+      while (bits != 0) {
+        *out++ = offset + __builtin_ctzll(bits);
+        bits &= bits - 1;
+      }
+    }
+
+    num_ = out - index_.get();
+    pos_ = 0;
+    if (num_ > 0)
+      return true;
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Second stage of tape parsing: walks structural characters, checking the
+ * grammar, and appends values to the tape.
+ */
+class Tape::Parser
+{
+public:
+
+  Parser(
+    char const* const text,
+    size_t const size,
+    Tape& tape)
+  : indexer_(text, size),
+    end_(text + size),
+    tape_(tape)
+  {
+  }
+
+  void run();
+
+private:
+
+  enum State
+  {
+    // Expecting a value.
+    VALUE,
+    // After '[', expecting a value or ']'.
+    FIRST_VALUE,
+    // After '{', expecting a key or '}'.
+    FIRST_KEY,
+    // After ',' in an object, expecting a key.
+    KEY,
+    // After a key, expecting ':'.
+    COLON,
+    // After a value in an array or object, expecting ',' or its close.
+    AFTER,
+  };
+
+  void
+  push(
+    Tag const tag,
+    uint64_t const payload=0)
+  {
+    tape_.words_.push_back(uint64_t(tag) << 56 | payload);
+  }
+
+  void
+  open(
+    Tag const tag)
+  {
+    stack_.push_back(tape_.words_.size());
+    push(tag);
+  }
+
+  void
+  close()
+  {
+    size_t const start = stack_.back();
+    stack_.pop_back();
+    auto& words = tape_.words_;
+    words[start] |= words.size() + 1;
+    push(tape_.tag(start) == ARR ? ARR_END : OBJ_END, start);
+  }
+
+  // Whether the innermost open container is an object.
+  bool in_object() const                { return tape_.tag(stack_.back()) == OBJ; }
+
+  void string(char const* p);
+  void scalar(char const* p);
+
+  Indexer indexer_;
+  char const* const end_;
+  Tape& tape_;
+  // Tape indices of open containers.
+  std::vector<size_t> stack_;
+
+};
+
+
+void
+Tape::Parser::run()
+{
+  State state = VALUE;
+  while (true) {
+    char const* const p = indexer_.next();
+    if (p == nullptr)
+      // Hit the end of text inside a value.
+      throw ParseError();
+
+    char const c = *p;
+    switch (state) {
+    case COLON:
+      if (c != ':')
+        throw ParseError();
+      state = VALUE;
+      continue;
+
+    case AFTER:
+      if (c == ',') {
+        state = in_object() ? KEY : VALUE;
+        continue;
+      }
+      else if (c == (in_object() ? '}' : ']'))
+        close();
+      else
+        throw ParseError();
+      break;
+
+    case FIRST_KEY:
+      if (c == '}') {
+        close();
+        break;
+      }
+      // Fall through.
+    case KEY:
+      if (c != '"')
+        throw ParseError();
+      string(p);
+      state = COLON;
+      continue;
+
+    case FIRST_VALUE:
+      if (c == ']') {
+        close();
+        break;
+      }
+      // Fall through.
+    case VALUE:
+      if (c == '[') {
+        open(ARR);
+        state = FIRST_VALUE;
+        continue;
+      }
+      else if (c == '{') {
+        open(OBJ);
+        state = FIRST_KEY;
+        continue;
+      }
+      else if (c == '"')
+        string(p);
+      else
+        scalar(p);
+      break;
+    }
+
+    // After a complete value.
+    if (stack_.empty())
+      return;
+    state = AFTER;
+  }
+}
+
+
+void
+Tape::Parser::string(
+  char const* const p)
+{
+  char const* const q = indexer_.next();
+  if (q == nullptr)
+    // Hit the end of text inside a quoted string.
+    throw ParseError();
+  assert(*q == '"');
+
+  auto& strings = tape_.strings_;
+  size_t const offset = strings.size();
+  uint32_t size = q - (p + 1);
+  if (std::memchr(p + 1, '\\', size) == nullptr) {
+    strings.append((char const*) &size, sizeof(size));
+    strings.append(p + 1, size);
+  }
+  else {
+    strings.append(sizeof(size), '\0');
+    decode_string(p + 1, q, strings);
+    size = strings.size() - offset - sizeof(size);
+    std::memcpy(&strings[offset], &size, sizeof(size));
+  }
+  push(STR, offset);
+}
+
+
+void
+Tape::Parser::scalar(
+  char const* const p)
+{
+  char const* q = p;
+  while (q < end_
+         && (('0' <= *q && *q <= '9')
+             || ('a' <= (*q | 0x20) && (*q | 0x20) <= 'z')
+             || *q == '+' || *q == '-' || *q == '.'))
+    ++q;
+  // In a container, the token must end at whitespace or a structural
+  // character.  At the top level, text after it is ignored.
+  if (!stack_.empty() && q < end_
+      && !(*q == ' ' || *q == '\n' || *q == '\t' || *q == '\r'
+           || *q == ',' || *q == ']' || *q == '}' || *q == '"'
+           || *q == ':' || *q == '[' || *q == '{'))
+    throw ParseError();
+
+  size_t const len = q - p;
+  if (*p == '-' || ('0' <= *p && *p <= '9')) {
+    if (!is_number(p, q))
+      throw ParseError();
+    double val;
+    if (!parse_double(p, q, val))
+      throw ParseError();
+    uint64_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    push(NUM);
+    tape_.words_.push_back(bits);
+  }
+  else if (len == 4 && std::memcmp(p, "true", 4) == 0)
+    push(TRU);
+  else if (len == 5 && std::memcmp(p, "false", 5) == 0)
+    push(FAL);
+  else if (len == 4 && std::memcmp(p, "null", 4) == 0)
+    push(NUL);
+  else
+    throw ParseError();
+}
+
+
+//------------------------------------------------------------------------------
+
+void
+Tape::emit(
+  Handler& handler)
+  const
+{
+  // For each open container, whether it is an object.
+  std::vector<bool> objects;
+  bool key = false;
+
+  for (size_t i = 0; i < words_.size(); ++i) {
+    switch (tag(i)) {
+    case NUL:
+      handler.null();
+      break;
+
+    case TRU:
+    case FAL:
+      handler.boolean(tag(i) == TRU);
+      break;
+
+    case NUM:
+      handler.number(get_num(i++));
+      break;
+
+    case STR: {
+      auto const str = get_chars(i);
+      if (key) {
+        handler.key(str.data(), str.size());
+        key = false;
+        continue;
+      }
+      handler.string(str.data(), str.size());
+      } break;
+
+    case ARR:
+      handler.start_array();
+      objects.push_back(false);
+      continue;
+
+    case OBJ:
+      handler.start_object();
+      objects.push_back(true);
+      key = true;
+      continue;
+
+    case ARR_END:
+    case OBJ_END:
+      objects.pop_back();
+      if (tag(i) == ARR_END)
+        handler.end_array();
+      else
+        handler.end_object();
+      break;
+    }
+
+    // After a value, an object expects a key.
+    key = !objects.empty() && objects.back();
+  }
+}
+
+
+Json
+Tape::to_json()
+  const
+{
+  Builder builder;
+  emit(builder);
+  return builder.take();
+}
+
+
+Tape
+parse_tape(
+  char const* const text,
+  size_t const size)
+{
+  Tape tape;
+  tape.words_.reserve(size / 8);
+  Tape::Parser(text, size, tape).run();
+  return tape;
+}
+
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json.hh"
+#include "json_stream.hh"
+
+namespace aslib {
+namespace json {
+
+//------------------------------------------------------------------------------
+
+/*
+ * First stage of tape parsing: finds the structural characters of JSON text,
+ * 64 bytes at a time with SIMD compares and bit arithmetic.
+ *
+ * Structural characters are brackets, braces, colons, and commas outside
+ * strings; the opening and closing quotes of strings, accounting for escapes;
+ * and the first character of each number or literal.  Text is indexed in
+ * windows, so the index stays small and in cache for documents of any size.
+ */
+class Indexer
+{
+public:
+
+  Indexer(char const* text, size_t size);
+
+  /*
+   * Returns the next structural character, or null at the end of text.
+   */
+  char const*
+  next()
+  {
+    if (pos_ == num_ && !refill())
+      return nullptr;
+    return window_ + index_[pos_++];
+  }
+
+private:
+
+  // Indexes the next window with structural characters.  Returns false if
+  // there is none.
+  bool refill();
+
+  char const* const end_;
+  // Start of the window `index_` is relative to, and of the next.
+  char const* window_;
+  char const* next_window_;
+  // Offsets of structural characters in the window.
+  std::unique_ptr<uint32_t[]> index_;
+  size_t num_ = 0;
+  size_t pos_ = 0;
+
+  // State carried from one 64-byte block to the next: whether the first
+  // character is escaped, whether it is in a string, and whether the last
+  // character was part of a number or literal.
+  uint64_t escaped_ = 0;
+  uint64_t in_string_ = 0;
+  uint64_t scalar_ = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A parsed JSON document, as a flat array of 64-bit words.
+ *
+ * Each value is one word, with a tag in the top byte, except that a number is
+ * followed by a word with its bits.  An array or object is a start word, its
+ * contents, and an end word; the start word holds the index past its end, so
+ * a reader can skip it, and the end word holds the index of its start.  In an
+ * object, each member is a string word for its name, then its value.
+ *
+ * Strings are stored separately, each as a 32-bit length and its characters,
+ * and a string word holds the offset.
+ */
+class Tape
+{
+public:
+
+  enum Tag : uint8_t
+  {
+    NUL         = 'n',
+    TRU         = 't',
+    FAL         = 'f',
+    NUM         = 'd',
+    STR         = '"',
+    ARR         = '[',
+    ARR_END     = ']',
+    OBJ         = '{',
+    OBJ_END     = '}',
+  };
+
+  // Number of words.
+  size_t size() const                   { return words_.size(); }
+  Tag tag(size_t i) const               { return Tag(words_[i] >> 56); }
+  uint64_t payload(size_t i) const      { return words_[i] & PAYLOAD; }
+
+  double
+  get_num(
+    size_t const i)
+    const
+  {
+    double val;
+    std::memcpy(&val, &words_[i + 1], sizeof(val));
+    return val;
+  }
+
+  Json::Str
+  get_chars(
+    size_t const i)
+    const
+  {
+    uint32_t size;
+    char const* const str = &strings_[payload(i)];
+    std::memcpy(&size, str, sizeof(size));
+    return {str + sizeof(size), size};
+  }
+
+  /*
+   * Passes the document to `handler` as events.
+   */
+  void emit(Handler& handler) const;
+
+  /*
+   * Returns the document as a `Json` value.
+   */
+  Json to_json() const;
+
+private:
+
+  class Parser;
+  friend Tape parse_tape(char const* text, size_t size);
+
+  static uint64_t constexpr PAYLOAD = (uint64_t(1) << 56) - 1;
+
+  std::vector<uint64_t> words_;
+  std::string strings_;
+
+};
+
+
+/*
+ * Parses a value from `size` bytes of text, which must be followed by a byte
+ * that is not part of a number, e.g. the null of a `std::string`.  Text after
+ * the value is ignored.  Accepts and rejects the same text as `parse()`.
+ */
+extern Tape parse_tape(char const* text, size_t size);
+
+inline Tape
+parse_tape(
+  std::string const& text)
+{
+  return parse_tape(text.c_str(), text.size());
+}
+
+
+//------------------------------------------------------------------------------
+
+}  // namespace json
+}  // namespace aslib
+
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "json.hh"
+#include "json_stream.hh"
+#include "test.hh"
+
+using aslib::json::Json;
+
+//------------------------------------------------------------------------------
+// Tests of JSON writing.
+//------------------------------------------------------------------------------
+
+namespace {
+
+std::string
+to_text(
+  Json const& json)
+{
+  std::stringstream ss;
+  ss << json;
+  return ss.str();
+}
+
+
+void
+test_nonfinite_numbers()
+{
+  double const inf = std::numeric_limits<double>::infinity();
+  auto doc = Json::new_obj();
+  doc["nan"] = Json(std::nan(""));
+  doc["inf"] = Json(inf);
+  doc["-inf"] = Json(-inf);
+  doc["x"] = Json(0.1);
+
+  // Written as null, so the text is valid JSON.
+  auto const text = to_text(doc);
+  auto const parsed = aslib::json::parse(text);
+  CHECK(parsed["nan"].get_type() == Json::NUL);
+  CHECK(parsed["inf"].get_type() == Json::NUL);
+  CHECK(parsed["-inf"].get_type() == Json::NUL);
+  CHECK(parsed["x"].get_num() == 0.1);
+}
+
+
+void
+test_writer_nonfinite()
+{
+  std::stringstream ss;
+  {
+    aslib::json::Writer writer(ss, 0);
+    writer.start_array();
+    writer.number(-std::numeric_limits<double>::infinity());
+    writer.number(-0.0);
+    writer.number(std::nan(""));
+    writer.end_array();
+  }
+  auto const parsed = aslib::json::parse(ss.str());
+  CHECK(parsed.size() == 3);
+  CHECK(parsed[0].get_type() == Json::NUL);
+  CHECK(parsed[1].get_num() == 0 && std::signbit(parsed[1].get_num()));
+  CHECK(parsed[2].get_type() == Json::NUL);
+}
+
+
+void
+test_empty_names()
+{
+  // Lookups with empty names must not pass null data to memcmp.
+  auto doc = Json::new_obj();
+  doc["b"] = Json(2.0);
+  doc[""] = Json(1.0);
+  doc["a"] = Json(3.0);
+  CHECK(doc.has(""));
+  CHECK(doc[""].get_num() == 1);
+
+  auto const parsed = aslib::json::parse(to_text(doc));
+  CHECK(parsed.has(""));
+  CHECK(parsed[""].get_num() == 1);
+  CHECK(parsed["a"].get_num() == 3);
+  CHECK(!parsed.has("c"));
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+int
+main()
+{
+  test_nonfinite_numbers();
+  test_writer_nonfinite();
+  test_empty_names();
+
+  return test_result("json_test");
+}
+
+
@@ -0,0 +1,71 @@
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "bench.hh"
+#include "kernels.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Fills `arr` with random values in [lo, hi], rounded to `T`.
+ */
+template<typename T>
+void
+fill(
+  size_t const num,
+  T* const arr,
+  double const lo,
+  double const hi)
+{
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> dist(lo, hi);
+  for (size_t i = 0; i < num; ++i)
+    arr[i] = std::is_integral<T>::value ? std::round(dist(rng)) : dist(rng);
+}
+
+
+/*
+ * Registers `dot<T, ACC>`, reporting relative error against a long double
+ * reference.
+ */
+template<typename T, typename ACC>
+size_t
+register_dot(
+  char const* const name)
+{
+  return register_benchmark(
+    name, {{"len", pow2_range(10, 24, 2)}},
+    [](Params const& params) {
+      size_t const len = params.at("len");
+      auto const arr0 = std::make_shared<std::vector<T>>(len);
+      auto const arr1 = std::make_shared<std::vector<T>>(len);
+      fill(len, arr0->data(), 1, 5000);
+      fill(len, arr1->data(), 50, 150);
+
+      long double ref = 0;
+      for (size_t i = 0; i < len; ++i)
+        ref += (long double) (*arr0)[i] * (*arr1)[i];
+      auto const result = dot<T, ACC>(len, arr0->data(), arr1->data());
+      double const err = std::abs((double) ((result - ref) / ref));
+
+      return Case{
+        [=]() { do_not_optimize(dot<T, ACC>(len, arr0->data(), arr1->data())); },
+        (long) len,
+        {{"rel_err", err}},
+        2 * sizeof(T),
+        2,
+        {{arr0->data(), len * sizeof(T)}, {arr1->data(), len * sizeof(T)}}};
+    });
+}
+
+
+static auto const reg_f64_f64 = register_dot<double, double>("dot/f64/f64");
+static auto const reg_f32_f32 = register_dot<float, float>("dot/f32/f32");
+static auto const reg_f32_f64 = register_dot<float, double>("dot/f32/f64");
+static auto const reg_i32_i64 = register_dot<int32_t, int64_t>("dot/i32/i64");
+static auto const reg_i64_i64 = register_dot<int64_t, int64_t>("dot/i64/i64");
+
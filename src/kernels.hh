@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "summation.hh"
+#include "util.hh"
+
+//------------------------------------------------------------------------------
+// Kernels, templated over element type `T`, accumulator type `ACC`, and
+// summation policy `SUM` (see summation.hh).
+//
+// With the default `NaiveSum` policy, sums are accumulated in independent
+// partial sums, which the compiler keeps in vector registers, and combined at
+// the end.  The result therefore depends on the lane count as well as on the
+// data order.  Use `ExactSum` for results independent of order.
+//------------------------------------------------------------------------------
+
+/*
+ * Returns the dot product of `arg0` and `arg1`.
+ */
+template<
+  typename T,
+  typename ACC=accumulator_t<T>,
+  template<typename> class SUM=NaiveSum>
+__attribute((noinline))
+ACC
+dot(
+  size_t const num,
+  T const* const arg0,
+  T const* const arg1)
+{
+  SUM<ACC> sum;
+  sum.add_products(num, arg0, arg1);
+  return sum.result();
+}
+
+
+/*
+ * Returns the sum of `arg`.
+ */
+template<
+  typename T,
+  typename ACC=accumulator_t<T>,
+  template<typename> class SUM=NaiveSum>
+__attribute((noinline))
+ACC
+sum(
+  size_t const num,
+  T const* const arg)
+{
+  SUM<ACC> sum;
+  sum.add(num, arg);
+  return sum.result();
+}
+
+
+// Default rows per block for `linear_combination()`.
+size_t constexpr LINEAR_COMBINATION_BLOCK = 256;
+
+/*
+ * Computes the linear combination of `num` sample columns of length `len`,
+ * weighted by `coefficients`, into `result`.
+ *
+ * Rows are processed in blocks of `block`; for each block, each column's
+ * contribution is added in turn, so that the inner loop is contiguous.  The
+ * best block size depends on the cache sizes; see tuning.hh.  Returns the last
+ * result value.
+ */
+template<
+  typename T,
+  typename ACC=accumulator_t<T>,
+  template<typename> class SUM=NaiveSum>
+__attribute((noinline))
+ACC
+linear_combination(
+  size_t const num,
+  ACC const* const coefficients,
+  size_t const len,
+  T const* const* const samples,
+  ACC* const result,
+  size_t const block=LINEAR_COMBINATION_BLOCK)
+{
+  std::vector<SUM<ACC>> acc(std::min(block, len));
+  for (size_t i0 = 0; i0 < len; i0 += block) {
+    size_t const n = std::min(block, len - i0);
+    std::fill_n(acc.begin(), n, SUM<ACC>());
+    for (size_t c = 0; c < num; ++c) {
+      ACC const coef = coefficients[c];
+      T const* const sample = samples[c] + i0;
+      for (size_t j = 0; j < n; ++j)
+        acc[j].add_product(coef, ACC(sample[j]));
+    }
+    for (size_t j = 0; j < n; ++j)
+      result[i0 + j] = acc[j].result();
+  }
+  return len > 0 ? result[len - 1] : 0;
+}
+
+
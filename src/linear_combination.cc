@@ -1,73 +1,98 @@
 #include <cstddef>
-#include <iomanip>
-#include <unistd.h>
+#include <memory>
+#include <utility>
+#include <vector>
 
-#include "timing.hh"
+#include "bench.hh"
+#include "kernels.hh"
+#include "tuning.hh"
 
 //------------------------------------------------------------------------------
 
-__attribute((noinline)) 
-double
-linear_combination(
+namespace {
+
+/*
+ * Returns `num` columns of length `len`, and pointers to them.
+ */
+std::pair<
+  std::shared_ptr<std::vector<std::vector<double>>>,
+  std::shared_ptr<std::vector<double const*>>>
+make_samples(
   size_t const num,
-  double const* const coefficients,
-  size_t const len,
-  double const* const* const samples,
-  double* const result)
+  size_t const len)
 {
-  double res;
-  for (size_t i = 0; i < len; ++i) {
-    res = 0;
-    for (size_t c = 0; c < num; ++c)
-      res += coefficients[c] * samples[c][i];
-    result[i] = res;
+  auto const data
+    = std::make_shared<std::vector<std::vector<double>>>(num);
+  auto const samples = std::make_shared<std::vector<double const*>>(num);
+  for (size_t c = 0; c < num; ++c) {
+    auto& sample = (*data)[c];
+    sample.resize(len);
+    for (size_t i = 0; i < len; ++i)
+      sample[i] = i + 1;
+    (*samples)[c] = sample.data();
   }
-  return res;
+  return {data, samples};
 }
 
 
-int
-main(
-  int const argc,
-  char const* const* const argv)
-{
-  if (argc != 2) {
-    std::cerr << "usage: " << argv[0] << " NUM-COLUMNS\n";
-    return 1;
-  }
-  long const num_columns = atol(argv[1]);
-  if (num_columns < 1) {
-    std::cerr << "NUM-COLUMNS must be positive\n";
-    return 1;
-  }
-  size_t const num = num_columns;
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
 
-  size_t const max_len = 1 << 24;
+// The block's accumulators should stay in L1 while all columns are added.
+static auto const reg_block = register_tunable(
+  "linear_combination/block", LINEAR_COMBINATION_BLOCK, pow2_range(5, 13),
+  [](Params const& params) {
+    size_t const block = params.at("linear_combination/block");
+    size_t const num = 16;
+    size_t const len = 1 << 18;
+    auto const coefficients = std::make_shared<std::vector<double>>(num, 0.5);
+    auto const samples = make_samples(num, len);
+    auto const result = std::make_shared<std::vector<double>>(len);
+    return Case{
+      [num, len, block, coefficients, samples, result]() {
+        do_not_optimize(linear_combination<double>(
+          num, coefficients->data(), len, samples.second->data(),
+          result->data(), block));
+      },
+      (long) (num * len)};
+  });
 
-  double* coefficients = new double[num];
-  for (size_t c = 0; c < num; ++c) 
-    coefficients[c] = 1.0 / (c + 1);
 
-  double** samples = new double*[num];
-  for (size_t c = 0; c < num; ++c) {
-    double* sample = new double[max_len];
-    for (size_t i = 0; i < max_len; ++i)
-      sample[i] = i + 1;
-    samples[c] = sample;
-  }
+static auto const reg = register_benchmark(
+  "linear_combination",
+  {{"columns", {1, 4, 16}}, {"len", pow2_range(10, 24, 2)}},
+  [](Params const& params) {
+    size_t const num = params.at("columns");
+    size_t const len = params.at("len");
 
-  double* result = new double[max_len];
+    auto const coefficients = std::make_shared<std::vector<double>>(num);
+    for (size_t c = 0; c < num; ++c)
+      (*coefficients)[c] = 1.0 / (c + 1);
 
-  Timer timer{1.0, 0.1, nullptr};
-  for (size_t len = 1024; len <= max_len; len <<= 1) {
-    auto const stats 
-      = timer(linear_combination, num, coefficients, len, samples, result);
-    std::cout << std::setw(10) << len << ": " 
-              << stats << " || " << stats / len
-              << std::endl;
-  }
-    
-  return EXIT_SUCCESS;
-}
+    auto const made = make_samples(num, len);
+    auto const data = made.first;
+    auto const samples = made.second;
+    static size_t const block = tuned("linear_combination/block");
+
+    auto const result = std::make_shared<std::vector<double>>(len);
+    std::vector<MemoryRange> operands{
+      {result->data(), len * sizeof(double)}};
+    for (auto const sample : *samples)
+      operands.push_back({sample, len * sizeof(double)});
 
+    // Capture `data` too, which `samples` points into.
+    return Case{
+      [num, len, coefficients, data, samples, result]() {
+        do_not_optimize(linear_combination<double>(
+          num, coefficients->data(), len, samples->data(), result->data(),
+          block));
+      },
+      (long) (num * len),
+      {},
+      // Each column element is read, and each result written once.
+      (double) (num + 1) * sizeof(double) / num,
+      2,
+      operands};
+  });
 
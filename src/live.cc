@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hh"
+#include "live_table.hh"
+#include "plan.hh"
+#include "timing.hh"
+
+//------------------------------------------------------------------------------
+// Queries of aggregates over a growing table: recomputed from all rows, or
+// maintained incrementally by a live table.
+//
+// The table has `rows` ticks, appended in batches of `BATCH` rows, with
+// increasing times about 1 ms apart, one of `NUM_SYMS` symbols, and a price
+// and size.  The aggregate is one-minute OHLC bars and volume by symbol.  With
+// `window` 0 the query covers all rows; otherwise only the latest `window`
+// rows, which the recomputed plan selects with a filter on time.
+//
+// `live` 0 executes the plan over the whole table; 1 queries the live table.
+// Per-element times are per row queried.  The `append` metric is the time per
+// row to append to the live table, including sealing chunks and updating the
+// aggregate, and `mismatches` counts result cells that differ between the two.
+//------------------------------------------------------------------------------
+
+namespace {
+
+size_t constexpr BATCH = 1000;
+size_t constexpr NUM_SYMS = 100;
+int64_t constexpr MINUTE = 60000000000;
+
+std::vector<std::string> const NAMES = {"time", "sym", "price", "size"};
+std::vector<DType> const DTYPES
+  = {DType::TIME, DType::ID, DType::F64, DType::I64};
+
+std::string const SCAN = R"({"op": "scan", "table": "ticks"})";
+
+/*
+ * The aggregate over `input`, a plan in JSON.
+ */
+Json
+ohlc_plan(
+  std::string const& input)
+{
+  return aslib::json::parse(
+    R"({"op": "aggregate", "input": )" + input + R"(,
+        "by": ["sym", {"bucket": "time", "width": )"
+    + std::to_string(MINUTE) + R"(, "as": "minute"}],
+        "aggs": {"open": ["first", "price"], "high": ["max", "price"],
+                 "low": ["min", "price"], "close": ["last", "price"],
+                 "volume": ["sum", "size"], "trades": ["count"]}})");
+}
+
+
+/*
+ * The ticks, both as one table and as a live table.
+ */
+struct TickData
+{
+  Table table;
+  std::unique_ptr<LiveTable> live;
+  std::vector<int64_t> times;
+  // Seconds per row to append to the live table.
+  double append_time;
+};
+
+
+std::unique_ptr<TickData>
+make_ticks(
+  size_t const rows)
+{
+  std::unique_ptr<TickData> ticks(new TickData);
+  ticks->live.reset(new LiveTable("ticks", NAMES, DTYPES));
+  ticks->live->add_aggregate("ohlc", ohlc_plan(SCAN));
+
+  ColumnBuilder<int64_t> all_times(DType::TIME);
+  ColumnBuilder<uint32_t> all_syms(DType::ID);
+  ColumnBuilder<double> all_prices(DType::F64);
+  ColumnBuilder<int64_t> all_sizes(DType::I64);
+
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int64_t> jitter(0, 499999);
+  std::uniform_int_distribution<size_t> sym(0, NUM_SYMS - 1);
+  std::normal_distribution<double> step(0, 0.01);
+  std::uniform_int_distribution<int64_t> size(1, 1000);
+  std::vector<double> prices(NUM_SYMS, 100);
+
+  double append_time = 0;
+  for (size_t i = 0; i < rows; i += BATCH) {
+    ColumnBuilder<int64_t> times(DType::TIME);
+    ColumnBuilder<uint32_t> syms(DType::ID);
+    ColumnBuilder<double> ps(DType::F64);
+    ColumnBuilder<int64_t> sizes(DType::I64);
+    for (size_t j = i; j < std::min(i + BATCH, rows); ++j) {
+      int64_t const time = (int64_t) j * 1000000 + jitter(rng);
+      size_t const s = sym(rng);
+      prices[s] *= 1 + step(rng);
+      times.append(time);
+      syms.append_str("S" + std::to_string(s));
+      ps.append(prices[s]);
+      sizes.append(size(rng));
+      ticks->times.push_back(time);
+    }
+
+    Table batch;
+    batch.add("time", times.finish());
+    batch.add("sym", syms.finish());
+    batch.add("price", ps.finish());
+    batch.add("size", sizes.finish());
+    auto const start = Clock::now();
+    ticks->live->append(batch);
+    append_time += time_since(start);
+
+    for (size_t j = 0; j < batch.num_rows(); ++j) {
+      all_times.append(column_cast<int64_t>(batch["time"])[j]);
+      auto const& id = column_cast<uint32_t>(batch["sym"]);
+      all_syms.append_str(id.dictionary()[id[j]]);
+      all_prices.append(column_cast<double>(batch["price"])[j]);
+      all_sizes.append(column_cast<int64_t>(batch["size"])[j]);
+    }
+  }
+
+  ticks->table.add("time", all_times.finish());
+  ticks->table.add("sym", all_syms.finish());
+  ticks->table.add("price", all_prices.finish());
+  ticks->table.add("size", all_sizes.finish());
+  ticks->append_time = append_time / rows;
+  return ticks;
+}
+
+
+/*
+ * Counts cells that differ between tables with the same columns.
+ */
+size_t
+count_mismatches(
+  Table const& a,
+  Table const& b)
+{
+  if (a.num_rows() != b.num_rows() || a.num_columns() != b.num_columns())
+    return std::max(a.num_rows(), b.num_rows()) * a.num_columns();
+  size_t mismatches = 0;
+  for (size_t c = 0; c < a.num_columns(); ++c) {
+    auto const& x = a.column(c);
+    auto const& y = b.column(c);
+    for (size_t i = 0; i < a.num_rows(); ++i)
+      switch (x.dtype()) {
+      case DType::F64:
+        mismatches += column_cast<double>(x)[i] != column_cast<double>(y)[i];
+        break;
+      case DType::I64:
+      case DType::TIME:
+        mismatches
+          += column_cast<int64_t>(x)[i] != column_cast<int64_t>(y)[i];
+        break;
+      case DType::ID: {
+        auto const& xx = column_cast<uint32_t>(x);
+        auto const& yy = column_cast<uint32_t>(y);
+        mismatches += xx.dictionary()[xx[i]] != yy.dictionary()[yy[i]];
+        } break;
+      }
+  }
+  return mismatches;
+}
+
+
+}  // anonymous namespace
+
+static auto const reg_query = register_benchmark(
+  "live/query",
+  {{"rows", {1000000, 10000000}}, {"window", {0, 100000}}, {"live", {0, 1}}},
+  [](Params const& params) {
+    size_t const rows = params.at("rows");
+    size_t const window = params.at("window");
+    bool const live = params.at("live");
+    std::shared_ptr<TickData const> const ticks = make_ticks(rows);
+    size_t const start = window == 0 ? 0 : rows - std::min(window, rows);
+
+    // Select the window by time, which increases.
+    auto input = SCAN;
+    if (start > 0)
+      input = R"({"op": "filter", "input": )" + SCAN
+        + R"(, "pred": [">=", "time", )" + std::to_string(ticks->times[start])
+        + "]}";
+    auto const plan = std::make_shared<Plan>(
+      ohlc_plan(input), Catalog{{"ticks", &ticks->table}});
+
+    auto const mismatches = count_mismatches(
+      plan->execute(), ticks->live->query("ohlc", start));
+    std::map<std::string, double> metrics = {
+      {"append", ticks->append_time},
+      {"mismatches", (double) mismatches},
+    };
+
+    std::function<void()> run;
+    if (live)
+      run = [ticks, start]() {
+        do_not_optimize(ticks->live->query("ohlc", start).num_rows());
+      };
+    else
+      run = [ticks, plan]() { do_not_optimize(plan->execute().num_rows()); };
+    return Case{run, (long) (rows - start), metrics};
+  },
+  {CacheState::WARM});
+
+
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cassert>
+
+#include "live_table.hh"
+
+using aslib::json::Json;
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+/*
+ * Copies rows [begin, end) of values and validity bits to a new column, which
+ * shares `dict`.
+ */
+template<typename T>
+std::unique_ptr<ColumnBase>
+copy_column(
+  DType const dtype,
+  std::vector<T> const& vals,
+  std::vector<uint64_t> const& validity,
+  size_t const begin,
+  size_t const end,
+  std::shared_ptr<std::vector<std::string> const> const& dict)
+{
+  std::vector<uint64_t> bits;
+  if (!validity.empty()) {
+    bits.assign((end - begin + 63) / 64, 0);
+    for (size_t i = begin; i < end; ++i)
+      if ((validity[i / 64] >> (i % 64)) & 1)
+        bits[(i - begin) / 64] |= uint64_t(1) << ((i - begin) % 64);
+  }
+  return std::unique_ptr<ColumnBase>(new Column<T>(
+    dtype, std::vector<T>(vals.begin() + begin, vals.begin() + end),
+    std::move(bits), dict));
+}
+
+
+/*
+ * Copies rows [begin, end) of `table`.
+ */
+Table
+slice(
+  Table const& table,
+  size_t const begin,
+  size_t const end)
+{
+  Table result;
+  for (size_t c = 0; c < table.num_columns(); ++c) {
+    auto const& col = table.column(c);
+    std::unique_ptr<ColumnBase> copy;
+    switch (col.dtype()) {
+    case DType::F64: {
+      auto const& src = column_cast<double>(col);
+      copy = copy_column(
+        col.dtype(), src.values(), src.validity(), begin, end,
+        src.shared_dictionary());
+      } break;
+    case DType::I64:
+    case DType::TIME: {
+      auto const& src = column_cast<int64_t>(col);
+      copy = copy_column(
+        col.dtype(), src.values(), src.validity(), begin, end,
+        src.shared_dictionary());
+      } break;
+    case DType::ID: {
+      auto const& src = column_cast<uint32_t>(col);
+      copy = copy_column(
+        col.dtype(), src.values(), src.validity(), begin, end,
+        src.shared_dictionary());
+      } break;
+    }
+    result.add(table.name(c), std::move(copy));
+  }
+  return result;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+LiveTable::LiveTable(
+  std::string name,
+  std::vector<std::string> const& names,
+  std::vector<DType> const& dtypes,
+  size_t const chunk_rows)
+: name_(std::move(name)),
+  names_(names),
+  dtypes_(dtypes),
+  chunk_rows_(std::max<size_t>(1, chunk_rows)),
+  tail_(names.size()),
+  codes_(names.size())
+{
+  if (names_.size() != dtypes_.size())
+    throw LiveTableError("wrong number of types for "s + name_);
+  for (size_t c = 0; c < names_.size(); ++c) {
+    schema_.add(names_[c], AnyColumnBuilder(dtypes_[c]).finish());
+    dicts_.push_back(std::make_shared<std::vector<std::string>>());
+  }
+}
+
+
+LiveTable::~LiveTable()
+{
+}
+
+
+void
+LiveTable::append(
+  Table const& rows)
+{
+  if (rows.num_columns() != names_.size())
+    throw LiveTableError("wrong number of columns for "s + name_);
+  std::vector<std::vector<uint32_t>> remaps(names_.size());
+  for (size_t c = 0; c < names_.size(); ++c) {
+    auto const& col = rows.column(c);
+    if (rows.name(c) != names_[c] || col.dtype() != dtypes_[c])
+      throw LiveTableError(
+        "wrong column "s + rows.name(c) + " for " + name_ + "." + names_[c]);
+    if (dtypes_[c] != DType::ID)
+      continue;
+
+    // Map the rows' dictionary codes to the table's.
+    for (auto const& str : column_cast<uint32_t>(col).dictionary()) {
+      auto const i = codes_[c].find(str);
+      if (i == codes_[c].end()) {
+        uint32_t const code = dicts_[c]->size();
+        codes_[c].emplace(str, code);
+        dicts_[c]->push_back(str);
+        remaps[c].push_back(code);
+      }
+      else
+        remaps[c].push_back(i->second);
+    }
+  }
+
+  // Fill the tail up to chunk boundaries.
+  for (size_t begin = 0; begin < rows.num_rows(); ) {
+    size_t const end
+      = std::min(rows.num_rows(), begin + chunk_rows_ - tail_rows_);
+    append_tail(rows, remaps, begin, end);
+    if (tail_rows_ == chunk_rows_)
+      seal();
+    begin = end;
+  }
+}
+
+
+void
+LiveTable::add_aggregate(
+  std::string const& name,
+  Json const& plan)
+{
+  if (aggregates_.count(name) > 0)
+    throw LiveTableError("duplicate aggregate: "s + name);
+
+  Aggregate agg;
+  agg.plan.reset(new Plan(plan, {{name_, &schema_}}));
+  // Also checks that the plan can be aggregated incrementally.
+  agg.sealed = run(agg, schema_);
+  for (auto const& chunk : chunks_) {
+    auto state = run(agg, *chunk);
+    agg.sealed.merge(state);
+    agg.chunks.push_back(std::move(state));
+  }
+  aggregates_.emplace(name, std::move(agg));
+}
+
+
+Table
+LiveTable::query(
+  std::string const& name)
+  const
+{
+  auto const& agg = find(name);
+  if (tail_rows_ == 0)
+    return agg.plan->finish(agg.sealed);
+
+  AggregateState state;
+  state.merge(agg.sealed);
+  auto const tail = tail_table(0);
+  state.merge(run(agg, tail));
+  return agg.plan->finish(state);
+}
+
+
+Table
+LiveTable::query(
+  std::string const& name,
+  size_t start)
+  const
+{
+  auto const& agg = find(name);
+  start = std::min(start, num_rows());
+  size_t const sealed_rows = chunks_.size() * chunk_rows_;
+
+  // The state refers to these tables' dictionaries until it's finished.
+  Table head;
+  Table tail;
+  AggregateState state;
+  size_t c = start / chunk_rows_;
+  if (c < chunks_.size() && start % chunk_rows_ != 0) {
+    head = slice(*chunks_[c], start % chunk_rows_, chunk_rows_);
+    state.merge(run(agg, head));
+    ++c;
+  }
+  for (; c < chunks_.size(); ++c)
+    state.merge(agg.chunks[c]);
+  if (start < num_rows() && tail_rows_ > 0) {
+    tail = tail_table(std::max(start, sealed_rows) - sealed_rows);
+    state.merge(run(agg, tail));
+  }
+  return agg.plan->finish(state);
+}
+
+
+LiveTable::Aggregate const&
+LiveTable::find(
+  std::string const& name)
+  const
+{
+  auto const i = aggregates_.find(name);
+  if (i == aggregates_.end())
+    throw LiveTableError("no aggregate "s + name + " of " + name_);
+  return i->second;
+}
+
+
+AggregateState
+LiveTable::run(
+  Aggregate const& agg,
+  Table const& table)
+  const
+{
+  return agg.plan->aggregate({{name_, &table}});
+}
+
+
+void
+LiveTable::append_tail(
+  Table const& rows,
+  std::vector<std::vector<uint32_t>> const& remaps,
+  size_t const begin,
+  size_t const end)
+{
+  size_t const base = tail_rows_;
+  size_t const num = end - begin;
+  for (size_t c = 0; c < names_.size(); ++c) {
+    auto const& col = rows.column(c);
+    auto& tail = tail_[c];
+    switch (dtypes_[c]) {
+    case DType::F64: {
+      auto const vals = column_cast<double>(col).data();
+      tail.f64.insert(tail.f64.end(), vals + begin, vals + end);
+      } break;
+    case DType::I64:
+    case DType::TIME: {
+      auto const vals = column_cast<int64_t>(col).data();
+      tail.i64.insert(tail.i64.end(), vals + begin, vals + end);
+      } break;
+    case DType::ID: {
+      auto const vals = column_cast<uint32_t>(col).data();
+      auto const& remap = remaps[c];
+      for (size_t i = begin; i < end; ++i)
+        // Nulls may have any code, or none.
+        tail.id.push_back(col.is_valid(i) ? remap[vals[i]] : 0);
+      } break;
+    }
+
+    if (col.has_validity() || !tail.validity.empty()) {
+      // Rows so far without validity bits are all valid.
+      if (tail.validity.empty())
+        tail.validity.assign((base + 63) / 64, ~uint64_t(0));
+      tail.validity.resize((base + num + 63) / 64, 0);
+      for (size_t i = 0; i < num; ++i) {
+        auto const bit = uint64_t(1) << ((base + i) % 64);
+        auto& word = tail.validity[(base + i) / 64];
+        word = col.is_valid(begin + i) ? word | bit : word & ~bit;
+      }
+    }
+  }
+  tail_rows_ += num;
+}
+
+
+/*
+ * Copies unsealed rows from `begin` on.
+ */
+Table
+LiveTable::tail_table(
+  size_t const begin)
+  const
+{
+  Table table;
+  for (size_t c = 0; c < names_.size(); ++c) {
+    auto const& tail = tail_[c];
+    auto const dtype = dtypes_[c];
+    std::unique_ptr<ColumnBase> col;
+    switch (dtype) {
+    case DType::F64:
+      col = copy_column(
+        dtype, tail.f64, tail.validity, begin, tail_rows_, dicts_[c]);
+      break;
+    case DType::I64:
+    case DType::TIME:
+      col = copy_column(
+        dtype, tail.i64, tail.validity, begin, tail_rows_, dicts_[c]);
+      break;
+    case DType::ID:
+      col = copy_column(
+        dtype, tail.id, tail.validity, begin, tail_rows_, dicts_[c]);
+      break;
+    }
+    table.add(names_[c], std::move(col));
+  }
+  return table;
+}
+
+
+void
+LiveTable::seal()
+{
+  assert(tail_rows_ == chunk_rows_);
+  std::unique_ptr<Table const> chunk(new Table(tail_table(0)));
+  for (auto& i : aggregates_) {
+    auto& agg = i.second;
+    auto state = run(agg, *chunk);
+    agg.sealed.merge(state);
+    agg.chunks.push_back(std::move(state));
+  }
+  chunks_.push_back(std::move(chunk));
+
+  for (auto& tail : tail_) {
+    tail.f64.clear();
+    tail.i64.clear();
+    tail.id.clear();
+    tail.validity.clear();
+  }
+  tail_rows_ = 0;
+}
+
+
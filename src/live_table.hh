@@ -0,0 +1,139 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "column.hh"
+#include "json.hh"
+#include "plan.hh"
+
+//------------------------------------------------------------------------------
+// Append-only tables that maintain aggregates incrementally.
+//
+// Rows are appended in batches and stored in chunks of a fixed number of rows.
+// Once a chunk is full it is sealed, and never changes.  Each aggregate plan
+// registered with the table keeps the state of each sealed chunk, computed
+// once as the chunk is sealed, and the merged state of all of them.  A query
+// merges that with the state of the rows in the unsealed tail, which it
+// aggregates afresh, so its cost depends on the rows appended since the last
+// chunk was sealed and the number of groups, not on the table's size.
+//
+// ID columns of all chunks and the tail share one dictionary, which only
+// grows, so codes are the same in all chunks.
+//------------------------------------------------------------------------------
+
+class LiveTableError
+  : public std::runtime_error
+{
+public:
+
+  using std::runtime_error::runtime_error;
+
+};
+
+
+size_t constexpr LIVE_CHUNK_ROWS = 1 << 16;
+
+class LiveTable
+{
+public:
+
+  /*
+   * An empty table `name`, as plans scan it, with columns `names` of `dtypes`.
+   */
+  LiveTable(
+    std::string name,
+    std::vector<std::string> const& names,
+    std::vector<DType> const& dtypes,
+    size_t chunk_rows=LIVE_CHUNK_ROWS);
+
+  LiveTable(LiveTable const&) = delete;
+  ~LiveTable();
+
+  std::string const& name() const       { return name_; }
+  size_t num_rows() const { return chunks_.size() * chunk_rows_ + tail_rows_; }
+  size_t chunk_rows() const             { return chunk_rows_; }
+  size_t num_chunks() const             { return chunks_.size(); }
+  Table const& chunk(size_t const i) const { return *chunks_[i]; }
+
+  /*
+   * Appends `rows`, whose columns must match the table's, in order.  Seals
+   * chunks as they fill, and updates aggregates with them.
+   */
+  void append(Table const& rows);
+
+  /*
+   * Registers an aggregate plan, `name`, over this table, and aggregates the
+   * sealed chunks.  Throws `PlanError` if the plan is invalid, isn't an
+   * aggregate, scans other tables, or has joins.
+   */
+  void add_aggregate(std::string const& name, aslib::json::Json const& plan);
+
+  /*
+   * Returns the result of aggregate `name` over all rows.
+   */
+  Table query(std::string const& name) const;
+
+  /*
+   * Returns the result of aggregate `name` over rows from `start` on, e.g. for
+   * a window of the latest rows.  Sealed chunks in the window contribute their
+   * states; only rows of the first, if partial, and of the tail are scanned.
+   */
+  Table query(std::string const& name, size_t start) const;
+
+private:
+
+  /*
+   * Unsealed values of a column.
+   */
+  struct TailColumn
+  {
+    std::vector<double> f64;
+    std::vector<int64_t> i64;
+    std::vector<uint32_t> id;
+    // Empty if all are valid.
+    std::vector<uint64_t> validity;
+  };
+
+  struct Aggregate
+  {
+    std::unique_ptr<Plan> plan;
+    // The state of each sealed chunk, and of all of them.
+    std::vector<AggregateState> chunks;
+    AggregateState sealed;
+  };
+
+  Aggregate const& find(std::string const& name) const;
+  AggregateState run(Aggregate const& agg, Table const& table) const;
+
+  void append_tail(
+    Table const& rows, std::vector<std::vector<uint32_t>> const& remaps,
+    size_t begin, size_t end);
+  Table tail_table(size_t begin) const;
+  void seal();
+
+  std::string const name_;
+  std::vector<std::string> const names_;
+  std::vector<DType> const dtypes_;
+  size_t const chunk_rows_;
+
+  // An empty table with the columns, to build plans against.
+  Table schema_;
+
+  std::vector<std::unique_ptr<Table const>> chunks_;
+  std::vector<TailColumn> tail_;
+  size_t tail_rows_ = 0;
+
+  // For ID columns, the shared dictionary and its codes.
+  std::vector<std::shared_ptr<std::vector<std::string>>> dicts_;
+  std::vector<std::unordered_map<std::string, uint32_t>> codes_;
+
+  std::map<std::string, Aggregate> aggregates_;
+
+};
+
+
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "machine.hh"
+
+using namespace std::string_literals;
+using aslib::json::Json;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+Json
+to_json(
+  std::vector<MachineProfile::Point> const& points)
+{
+  auto json = Json::new_arr();
+  for (auto const& point : points) {
+    auto p = Json::new_obj();
+    p["kernel"] = Json(point.kernel);
+    p["size"] = Json((double) point.size);
+    p["threads"] = Json((double) point.threads);
+    p["value"] = point.value;
+    json[json.size()] = std::move(p);
+  }
+  return json;
+}
+
+
+std::vector<MachineProfile::Point>
+points_from_json(
+  Json const& json)
+{
+  std::vector<MachineProfile::Point> points;
+  for (auto const& p : json.get_arr())
+    points.push_back({
+      p["kernel"].get_str(),
+      (long) p["size"].get_num(),
+      (long) p["threads"].get_num(),
+      p["value"].get_num()});
+  return points;
+}
+
+
+/*
+ * Returns the most profiled threads up to `threads`, or the fewest if none.
+ */
+long
+choose_threads(
+  std::vector<MachineProfile::Point> const& points,
+  long const threads)
+{
+  long use_threads = 0;
+  long min_threads = std::numeric_limits<long>::max();
+  for (auto const& point : points) {
+    if (point.threads <= threads)
+      use_threads = std::max(use_threads, point.threads);
+    min_threads = std::min(min_threads, point.threads);
+  }
+  return use_threads > 0 ? use_threads : min_threads;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+double
+MachineProfile::peak_bandwidth(
+  double const size,
+  long const threads)
+  const
+{
+  auto const use_threads = choose_threads(bandwidth, threads);
+
+  // Choose the size.
+  long use_size = -1;
+  long max_size = -1;
+  for (auto const& point : bandwidth)
+    if (point.threads == use_threads) {
+      if (point.size >= size && (use_size < 0 || point.size < use_size))
+        use_size = point.size;
+      max_size = std::max(max_size, point.size);
+    }
+  if (use_size < 0)
+    use_size = max_size;
+
+  double peak = NAN;
+  for (auto const& point : bandwidth)
+    if (point.threads == use_threads && point.size == use_size
+        && !(point.value <= peak))
+      peak = point.value;
+  return peak;
+}
+
+
+double
+MachineProfile::peak_flop_rate(
+  long const threads)
+  const
+{
+  auto const use_threads = choose_threads(flop_rate, threads);
+  double peak = NAN;
+  for (auto const& point : flop_rate)
+    if (point.threads == use_threads && !(point.value <= peak))
+      peak = point.value;
+  return peak;
+}
+
+
+std::string
+cpu_model()
+{
+  std::ifstream file("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(file, line))
+    if (line.compare(0, 10, "model name") == 0) {
+      auto const colon = line.find(':');
+      if (colon != std::string::npos)
+        return line.substr(line.find_first_not_of(" \t", colon + 1));
+    }
+  return "";
+}
+
+
+Json
+to_json(
+  MachineProfile const& profile)
+{
+  auto json = Json::new_obj();
+  json["cpu"] = Json(profile.cpu);
+  json["bandwidth"] = to_json(profile.bandwidth);
+  json["latency"] = to_json(profile.latency);
+  json["flop_rate"] = to_json(profile.flop_rate);
+  return json;
+}
+
+
+MachineProfile
+load_machine_profile(
+  std::string const& path)
+{
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("can't read machine profile: "s + path);
+  std::stringstream text;
+  text << file.rdbuf();
+  auto const json = aslib::json::parse(text.str());
+
+  MachineProfile profile{
+    json["cpu"].get_str(),
+    points_from_json(json["bandwidth"]),
+    points_from_json(json["latency"])};
+  // Older profiles have no FLOP rate.
+  if (json.has("flop_rate"))
+    profile.flop_rate = points_from_json(json["flop_rate"]);
+  return profile;
+}
+
+
+void
+save_machine_profile(
+  MachineProfile const& profile,
+  std::string const& path)
+{
+  std::ofstream file(path);
+  if (!file)
+    throw std::runtime_error("can't write machine profile: "s + path);
+  file << to_json(profile) << std::endl;
+}
+
+
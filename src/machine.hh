@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "json.hh"
+
+//------------------------------------------------------------------------------
+// Machine profile: measured memory bandwidth and latency, and FLOP rate.
+//
+// The `stream/`, `latency/`, and `flops/` benchmarks measure these by working
+// set size and thread count; `bench --save-profile` collects them into a
+// profile, and `bench --profile` loads one to report other benchmarks'
+// bandwidth and FLOP rate as fractions of the measured peaks.
+//------------------------------------------------------------------------------
+
+struct MachineProfile
+{
+  struct Point
+  {
+    // Benchmark kernel, e.g. "triad".
+    std::string kernel;
+    // Working set, in bytes; 0 for FLOP rate.
+    long size;
+    long threads;
+    // Bytes/s for bandwidth, seconds per load for latency, FLOP/s for FLOP
+    // rate.
+    double value;
+  };
+
+  // The CPU model the profile was measured on.
+  std::string cpu;
+  std::vector<Point> bandwidth;
+  std::vector<Point> latency;
+  std::vector<Point> flop_rate;
+
+  /*
+   * Returns the peak bandwidth, in bytes/s, over all kernels, for a working
+   * set of `size` bytes and `threads` threads.
+   *
+   * Uses the smallest profiled size at least `size`, i.e. points in the same
+   * level of the memory hierarchy, or the largest if none; and the most
+   * profiled threads up to `threads`.  Returns NaN if there are no points.
+   */
+  double peak_bandwidth(double size, long threads) const;
+
+  /*
+   * Returns the peak FLOP rate, in FLOP/s, over all kernels, for the most
+   * profiled threads up to `threads`.  Returns NaN if there are no points.
+   */
+  double peak_flop_rate(long threads) const;
+};
+
+
+/*
+ * Returns the CPU model name, or an empty string if unknown.
+ */
+extern std::string cpu_model();
+
+extern aslib::json::Json to_json(MachineProfile const& profile);
+
+extern MachineProfile load_machine_profile(std::string const& path);
+extern void save_machine_profile(
+  MachineProfile const& profile, std::string const& path);
+
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "bench.hh"
+#include "parallel.hh"
+
+//------------------------------------------------------------------------------
+// Memory bandwidth and latency characterization.
+//
+// The `stream/` benchmarks are STREAM-style kernels over arrays of doubles,
+// split among threads.  Bytes per element count only data the kernel reads and
+// writes, as STREAM does; write-allocate traffic for ordinary stores, which
+// non-temporal stores avoid, is not counted.
+//
+// The `latency/` benchmark chases pointers through cache lines in a random
+// cycle, so each load depends on the last and defeats prefetching; its time
+// per element is the load-to-use latency.
+//
+// Both sweep the total working set `size`, in bytes, across cache levels and
+// main memory, and the number of threads, and so run only with warm caches.
+// Use `bench --save-profile` to record the results as a machine profile.
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Keep copy and fill loops from becoming memcpy and memset calls, which
+// choose their own store strategies.
+#if defined(__GNUC__) && !defined(__clang__)
+# define PLAIN_LOOPS __attribute((optimize("no-tree-loop-distribute-patterns")))
+#else
+# define PLAIN_LOOPS
+#endif
+
+size_t constexpr LINE_SIZE = 64;
+// Doubles per cache line.
+size_t constexpr LINE_LEN = LINE_SIZE / sizeof(double);
+
+void*
+alloc_lines(
+  size_t const size)
+{
+  void* ptr;
+  if (posix_memalign(&ptr, LINE_SIZE, std::max<size_t>(size, 1)) != 0)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+
+/*
+ * Line-aligned arrays of doubles, with threads that work on them.
+ *
+ * Each thread works on the same line-aligned portion of each array, and first
+ * touches it, so that its pages are local to that thread.
+ */
+class Arrays
+{
+public:
+
+  Arrays(
+    size_t const num,
+    size_t const len,
+    unsigned const threads)
+  : len_(len),
+    pool_(threads)
+  {
+    for (size_t a = 0; a < num; ++a)
+      arrays_.push_back((double*) alloc_lines(len * sizeof(double)));
+    pool_.run([this](size_t const t) {
+      auto const p = part(t);
+      for (size_t a = 0; a < arrays_.size(); ++a)
+        std::fill(arrays_[a] + p.first, arrays_[a] + p.second, a + 1.0);
+    });
+  }
+
+  Arrays(Arrays const&) = delete;
+
+  ~Arrays()
+  {
+    for (auto const array : arrays_)
+      std::free(array);
+  }
+
+  double* const* data() const           { return arrays_.data(); }
+  WorkerPool& pool()                    { return pool_; }
+
+  /*
+   * Returns the range of elements for thread `t`.
+   */
+  std::pair<size_t, size_t>
+  part(
+    size_t const t)
+    const
+  {
+    size_t const lines = (len_ + LINE_LEN - 1) / LINE_LEN;
+    size_t const chunk = (lines + pool_.size() - 1) / pool_.size() * LINE_LEN;
+    return {std::min(len_, t * chunk), std::min(len_, (t + 1) * chunk)};
+  }
+
+private:
+
+  size_t const len_;
+  std::vector<double*> arrays_;
+  WorkerPool pool_;
+
+};
+
+
+using Kernel = double(size_t, size_t, double* const*);
+
+double constexpr SCALAR = 3.0;
+
+PLAIN_LOOPS double
+read(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  // Independent partial sums, so loads aren't serialized by additions.
+  double const* const a = arrays[0];
+  double sums[LINE_LEN] = {};
+  size_t i = begin;
+  for (; i + LINE_LEN <= end; i += LINE_LEN)
+    for (size_t j = 0; j < LINE_LEN; ++j)
+      sums[j] += a[i + j];
+  for (; i < end; ++i)
+    sums[0] += a[i];
+  return std::accumulate(sums, sums + LINE_LEN, 0.0);
+}
+
+
+PLAIN_LOOPS double
+write(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  double* const a = arrays[0];
+  for (size_t i = begin; i < end; ++i)
+    a[i] = SCALAR;
+  return 0;
+}
+
+
+PLAIN_LOOPS double
+copy(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  double const* const a = arrays[0];
+  double* const b = arrays[1];
+  for (size_t i = begin; i < end; ++i)
+    b[i] = a[i];
+  return 0;
+}
+
+
+PLAIN_LOOPS double
+scale(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  double const* const a = arrays[0];
+  double* const b = arrays[1];
+  for (size_t i = begin; i < end; ++i)
+    b[i] = SCALAR * a[i];
+  return 0;
+}
+
+
+PLAIN_LOOPS double
+add(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  double const* const a = arrays[0];
+  double const* const b = arrays[1];
+  double* const c = arrays[2];
+  for (size_t i = begin; i < end; ++i)
+    c[i] = a[i] + b[i];
+  return 0;
+}
+
+
+PLAIN_LOOPS double
+triad(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  double const* const a = arrays[0];
+  double const* const b = arrays[1];
+  double* const c = arrays[2];
+  for (size_t i = begin; i < end; ++i)
+    c[i] = a[i] + SCALAR * b[i];
+  return 0;
+}
+
+
+/*
+ * Copies `src` to `dst` with non-temporal stores, or fills `dst` with
+ * `SCALAR` if `src` is null.  `begin` must be line-aligned.
+ */
+PLAIN_LOOPS double
+store_nt(
+  size_t const begin,
+  size_t const end,
+  double const* const src,
+  double* const dst)
+{
+  size_t i = begin;
+#if defined(__AVX512F__)
+  size_t constexpr VEC_LEN = 8;
+  auto const fill = _mm512_set1_pd(SCALAR);
+  for (; i + VEC_LEN <= end; i += VEC_LEN)
+    _mm512_stream_pd(dst + i, src == nullptr ? fill : _mm512_load_pd(src + i));
+#elif defined(__AVX__)
+  size_t constexpr VEC_LEN = 4;
+  auto const fill = _mm256_set1_pd(SCALAR);
+  for (; i + VEC_LEN <= end; i += VEC_LEN)
+    _mm256_stream_pd(dst + i, src == nullptr ? fill : _mm256_load_pd(src + i));
+#elif defined(__SSE2__)
+  size_t constexpr VEC_LEN = 2;
+  auto const fill = _mm_set1_pd(SCALAR);
+  for (; i + VEC_LEN <= end; i += VEC_LEN)
+    _mm_stream_pd(dst + i, src == nullptr ? fill : _mm_load_pd(src + i));
+#endif
+  for (; i < end; ++i)
+    dst[i] = src == nullptr ? SCALAR : src[i];
+#ifdef __SSE2__
+  // Non-temporal stores are weakly ordered; complete them.
+  _mm_sfence();
+#endif
+  return 0;
+}
+
+
+double
+write_nt(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  return store_nt(begin, end, nullptr, arrays[0]);
+}
+
+
+double
+copy_nt(
+  size_t const begin,
+  size_t const end,
+  double* const* const arrays)
+{
+  return store_nt(begin, end, arrays[0], arrays[1]);
+}
+
+
+size_t
+register_stream(
+  char const* const name,
+  size_t const num_arrays,
+  double const flops,
+  Kernel* const kernel)
+{
+  return register_benchmark(
+    name, {{"size", pow2_range(12, 29)}, {"threads", thread_counts()}},
+    [num_arrays, flops, kernel](Params const& params) {
+      size_t const size = params.at("size");
+      unsigned const threads = params.at("threads");
+      size_t const len = std::max<size_t>(
+        size / (num_arrays * sizeof(double)), threads * LINE_LEN);
+
+      auto const arrays = std::make_shared<Arrays>(num_arrays, len, threads);
+      return Case{
+        [kernel, arrays]() {
+          arrays->pool().run([kernel, &arrays](size_t const t) {
+            auto const p = arrays->part(t);
+            do_not_optimize(kernel(p.first, p.second, arrays->data()));
+          });
+        },
+        (long) len,
+        {},
+        (double) (num_arrays * sizeof(double)),
+        flops};
+    },
+    {CacheState::WARM});
+}
+
+
+// Loads per thread per run.
+size_t constexpr CHASE_STEPS = 1 << 14;
+
+/*
+ * Cache lines, each holding a pointer to the next in a random cycle, and the
+ * current position in each thread's cycle.
+ */
+struct Chains
+{
+  Chains(
+    size_t const size,
+    unsigned const threads)
+  : lines(std::max<size_t>(size / LINE_SIZE / threads, 2)),
+    buf((char*) alloc_lines(lines * threads * LINE_SIZE)),
+    pos(threads),
+    pool(threads)
+  {
+    pool.run([this](size_t const t) {
+      char* const base = buf + t * lines * LINE_SIZE;
+      // Sattolo's algorithm, for a random permutation with a single cycle.
+      std::vector<size_t> next(lines);
+      std::iota(next.begin(), next.end(), 0);
+      std::mt19937_64 rng(t);
+      for (size_t i = lines - 1; i > 0; --i)
+        std::swap(next[i], next[std::uniform_int_distribution<size_t>(0, i - 1)(rng)]);
+      for (size_t i = 0; i < lines; ++i)
+        *(void**) (base + i * LINE_SIZE) = base + next[i] * LINE_SIZE;
+      pos[t] = base;
+    });
+  }
+
+  Chains(Chains const&) = delete;
+  ~Chains() { std::free(buf); }
+
+  // Lines per thread.
+  size_t const lines;
+  char* const buf;
+  std::vector<void*> pos;
+  WorkerPool pool;
+};
+
+
+__attribute((noinline)) void*
+chase(
+  void* p,
+  size_t const steps)
+{
+  for (size_t i = 0; i < steps; ++i)
+    p = *(void* const*) p;
+  return p;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+static auto const reg_read
+  = register_stream("stream/read", 1, 1, read);
+static auto const reg_write
+  = register_stream("stream/write", 1, 0, write);
+static auto const reg_write_nt
+  = register_stream("stream/write-nt", 1, 0, write_nt);
+static auto const reg_copy
+  = register_stream("stream/copy", 2, 0, copy);
+static auto const reg_copy_nt
+  = register_stream("stream/copy-nt", 2, 0, copy_nt);
+static auto const reg_scale
+  = register_stream("stream/scale", 2, 1, scale);
+static auto const reg_add
+  = register_stream("stream/add", 3, 1, add);
+static auto const reg_triad
+  = register_stream("stream/triad", 3, 2, triad);
+
+
+static auto const reg_chase = register_benchmark(
+  "latency/chase",
+  {{"size", pow2_range(12, 30)}, {"threads", thread_counts()}},
+  [](Params const& params) {
+    size_t const size = params.at("size");
+    unsigned const threads = params.at("threads");
+    auto const chains = std::make_shared<Chains>(size, threads);
+    // Each run continues each thread's chase where the last left off.
+    return Case{
+      [chains]() {
+        chains->pool.run([&chains](size_t const t) {
+          chains->pos[t] = chase(chains->pos[t], CHASE_STEPS);
+        });
+      },
+      (long) CHASE_STEPS};
+  },
+  {CacheState::WARM});
+
@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_stream.hh"
+#include "ndjson.hh"
+#include "parallel.hh"
+#include "parse.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+NdjsonSchema
+parse_ndjson_schema(
+  std::string const& fields)
+{
+  NdjsonSchema schema;
+  std::istringstream ss(fields);
+  std::string field;
+  while (std::getline(ss, field, ',')) {
+    auto const colon = field.rfind(':');
+    if (colon == std::string::npos || colon == 0)
+      throw NdjsonError("invalid field: "s + field);
+    schema.push_back(
+      {field.substr(0, colon), parse_dtype(field.substr(colon + 1))});
+  }
+  return schema;
+}
+
+
+bool
+is_ndjson_path(
+  std::string const& path)
+{
+  auto const ends_with = [&path](std::string const& ext) {
+    return path.size() >= ext.size()
+      && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+  };
+  return ends_with(".ndjson") || ends_with(".jsonl");
+}
+
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Lines are split among threads only if each gets at least this much text.
+size_t constexpr MIN_CHUNK_SIZE = 1 << 20;
+
+size_t constexpr NO_FIELD = -1;
+
+inline bool
+is_space(
+  char const c)
+{
+  // Not newline, which ends a record.
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/*
+ * Returns true if `c` may be part of a number or literal.
+ */
+inline bool
+is_scalar_char(
+  char const c)
+{
+  return ('0' <= c && c <= '9') || ('a' <= c && c <= 'z')
+    || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+
+/*
+ * Parses records from a chunk of lines into column builders.
+ */
+class ChunkParser
+{
+public:
+
+  ChunkParser(
+    NdjsonSchema const& schema,
+    char const* const text)
+  : schema_(schema),
+    text_(text),
+    seen_(schema.size())
+  {
+    for (auto const& field : schema)
+      builders_.emplace_back(field.dtype);
+  }
+
+  std::vector<AnyColumnBuilder>& builders() { return builders_; }
+
+  void
+  parse(
+    char const* const begin,
+    char const* const end)
+  {
+    for (char const* line = begin; line < end; ) {
+      auto const eol = (char const*) memchr(line, '\n', end - line);
+      p_ = line;
+      end_ = eol == nullptr ? end : eol;
+      skip_space();
+      if (p_ < end_) {
+        parse_record();
+        skip_space();
+        if (p_ < end_)
+          error("text after record");
+      }
+      line = end_ + 1;
+    }
+  }
+
+private:
+
+  [[noreturn]] void
+  error(
+    std::string const& msg)
+  {
+    std::ostringstream ss;
+    ss << msg << " at offset " << (p_ - text_);
+    throw NdjsonError(ss.str());
+  }
+
+  // The next character, or newline at the end of the line.
+  char peek() const                     { return p_ < end_ ? *p_ : '\n'; }
+
+  void
+  skip_space()
+  {
+    while (p_ < end_ && is_space(*p_))
+      ++p_;
+  }
+
+  void
+  expect(
+    char const c)
+  {
+    if (peek() != c)
+      error("expected '"s + c + "'");
+    ++p_;
+  }
+
+  /*
+   * Skips a string, at its opening quote.  Returns its body, and whether that
+   * contains escapes.
+   */
+  bool
+  skip_string(
+    char const*& b,
+    char const*& e)
+  {
+    b = ++p_;
+    while (true) {
+      auto const q = (char const*) memchr(p_, '"', end_ - p_);
+      if (q == nullptr) {
+        p_ = end_;
+        error("unterminated string");
+      }
+      p_ = q + 1;
+      // The quote is escaped if preceded by an odd number of backslashes.
+      char const* s = q;
+      while (s > b && s[-1] == '\\')
+        --s;
+      if ((q - s) % 2 == 0) {
+        e = q;
+        return memchr(b, '\\', e - b) != nullptr;
+      }
+    }
+  }
+
+  /*
+   * Parses a string, at its opening quote.  The result is valid until the
+   * next call.
+   */
+  std::pair<char const*, size_t>
+  string()
+  {
+    char const* b;
+    char const* e;
+    if (!skip_string(b, e))
+      return {b, e - b};
+    decoded_.clear();
+    try {
+      aslib::json::decode_string(b, e, decoded_);
+    }
+    catch (aslib::json::ParseError const&) {
+      p_ = b;
+      error("invalid escape");
+    }
+    return {decoded_.data(), decoded_.size()};
+  }
+
+  // Skips a number or literal, and returns its end.
+  char const*
+  skip_scalar()
+  {
+    while (p_ < end_ && is_scalar_char(*p_))
+      ++p_;
+    return p_;
+  }
+
+  size_t
+  find_field(
+    char const* const name,
+    size_t const size)
+    const
+  {
+    for (size_t f = 0; f < schema_.size(); ++f) {
+      auto const& n = schema_[f].name;
+      if (n.size() == size && memcmp(n.data(), name, size) == 0)
+        return f;
+    }
+    return NO_FIELD;
+  }
+
+  void
+  parse_record()
+  {
+    expect('{');
+    std::fill(seen_.begin(), seen_.end(), false);
+    skip_space();
+    if (peek() == '}')
+      ++p_;
+    else
+      while (true) {
+        skip_space();
+        if (peek() != '"')
+          error("expected member name");
+        auto const name = string();
+        size_t const f = find_field(name.first, name.second);
+        skip_space();
+        expect(':');
+        skip_space();
+        if (f == NO_FIELD)
+          skip_value();
+        else {
+          if (seen_[f])
+            error("duplicate member " + schema_[f].name);
+          seen_[f] = true;
+          parse_value(builders_[f]);
+        }
+        skip_space();
+        if (peek() == ',')
+          ++p_;
+        else {
+          expect('}');
+          break;
+        }
+      }
+
+    for (size_t f = 0; f < schema_.size(); ++f)
+      if (!seen_[f])
+        builders_[f].append_null();
+  }
+
+  void
+  parse_value(
+    AnyColumnBuilder& builder)
+  {
+    char const c = peek();
+    char const* const b = p_;
+
+    if (c == '"') {
+      auto const str = string();
+      switch (builder.dtype) {
+      case DType::ID:
+        builder.id.append_str(std::string(str.first, str.second));
+        break;
+
+      case DType::TIME: {
+        TimeNs val;
+        if (!parse_time(str.first, str.first + str.second, val)) {
+          p_ = b;
+          error("invalid time");
+        }
+        builder.i64.append(val);
+        } break;
+
+      default:
+        p_ = b;
+        error("expected "s + dtype_name(builder.dtype));
+      }
+    }
+
+    else if (c == '-' || ('0' <= c && c <= '9')) {
+      char const* const e = skip_scalar();
+      if (!aslib::json::is_number(b, e)) {
+        p_ = b;
+        error("invalid number");
+      }
+      switch (builder.dtype) {
+      case DType::F64: {
+        double val;
+        parse_double(b, e, val);
+        builder.f64.append(val);
+        } break;
+
+      case DType::I64:
+      case DType::TIME: {
+        int64_t val;
+        if (!parse_int64(b, e, val)) {
+          p_ = b;
+          error("invalid "s + dtype_name(builder.dtype));
+        }
+        builder.i64.append(val);
+        } break;
+
+      case DType::ID:
+        p_ = b;
+        error("expected string");
+      }
+    }
+
+    else if (end_ - p_ >= 4 && memcmp(p_, "null", 4) == 0) {
+      p_ += 4;
+      if (skip_scalar() != b + 4) {
+        p_ = b;
+        error("invalid literal");
+      }
+      builder.append_null();
+    }
+
+    else
+      error("expected "s + dtype_name(builder.dtype));
+  }
+
+  void
+  skip_value()
+  {
+    char const* const b = p_;
+    char const c = peek();
+    if (c == '"') {
+      char const* sb;
+      char const* se;
+      skip_string(sb, se);
+    }
+    else if (c == '[' || c == '{') {
+      // Skip to the matching close, without checking what's between.
+      size_t depth = 0;
+      while (true) {
+        char const d = peek();
+        if (d == '"') {
+          char const* sb;
+          char const* se;
+          skip_string(sb, se);
+          continue;
+        }
+        else if (d == '[' || d == '{')
+          ++depth;
+        else if (d == ']' || d == '}') {
+          if (--depth == 0) {
+            ++p_;
+            break;
+          }
+        }
+        else if (d == '\n')
+          error("unterminated value");
+        ++p_;
+      }
+    }
+    else {
+      char const* const e = skip_scalar();
+      size_t const len = e - b;
+      if (!((len == 4 && memcmp(b, "true", 4) == 0)
+            || (len == 5 && memcmp(b, "false", 5) == 0)
+            || (len == 4 && memcmp(b, "null", 4) == 0)
+            || aslib::json::is_number(b, e))) {
+        p_ = b;
+        error("invalid value");
+      }
+    }
+  }
+
+  NdjsonSchema const& schema_;
+  char const* const text_;
+  std::vector<AnyColumnBuilder> builders_;
+  // Position in, and end of, the current line.
+  char const* p_ = nullptr;
+  char const* end_ = nullptr;
+  // Whether each field has been seen in the current record.
+  std::vector<bool> seen_;
+  // Buffer for decoding strings with escapes.
+  std::string decoded_;
+
+};
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+Table
+parse_ndjson(
+  char const* const text,
+  size_t const size,
+  NdjsonSchema const& schema,
+  NdjsonOptions const& options)
+{
+  char const* const end = text + size;
+
+  // Split the text into chunks, and move each boundary past a newline.
+  size_t const num_chunks = std::max<size_t>(
+    1, std::min<size_t>(
+      num_threads(options.num_threads), size / MIN_CHUNK_SIZE));
+  std::vector<char const*> bounds(num_chunks + 1);
+  bounds[0] = text;
+  bounds[num_chunks] = end;
+  for (size_t i = 1; i < num_chunks; ++i) {
+    char const* const nominal
+      = std::max(bounds[i - 1], text + size * i / num_chunks);
+    auto const eol = (char const*) memchr(nominal, '\n', end - nominal);
+    bounds[i] = eol == nullptr ? end : eol + 1;
+  }
+
+  // Parse chunks in parallel.
+  std::vector<std::unique_ptr<ChunkParser>> parsers(num_chunks);
+  run_parallel(num_chunks, [&](size_t const i) {
+    parsers[i].reset(new ChunkParser(schema, text));
+    parsers[i]->parse(bounds[i], bounds[i + 1]);
+  });
+
+  // Concatenate chunks.
+  Table table;
+  auto& builders = parsers[0]->builders();
+  for (size_t f = 0; f < schema.size(); ++f) {
+    for (size_t i = 1; i < num_chunks; ++i)
+      builders[f].append(std::move(parsers[i]->builders()[f]));
+    table.add(schema[f].name, builders[f].finish());
+  }
+  return table;
+}
+
+
+Table
+load_ndjson(
+  std::string const& path,
+  NdjsonSchema const& schema,
+  NdjsonOptions const& options)
+{
+  int const fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw NdjsonError("can't open "s + path + ": " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw NdjsonError("can't stat "s + path + ": " + strerror(errno));
+  }
+  size_t const size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return parse_ndjson(nullptr, 0, schema, options);
+  }
+
+  void* const addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw NdjsonError("can't map "s + path + ": " + strerror(errno));
+  madvise(addr, size, MADV_WILLNEED);
+
+  try {
+    auto table = parse_ndjson((char const*) addr, size, schema, options);
+    munmap(addr, size);
+    return table;
+  }
+  catch (...) {
+    munmap(addr, size);
+    throw;
+  }
+}
+
+
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "column.hh"
+
+//------------------------------------------------------------------------------
+
+class NdjsonError
+  : public std::runtime_error
+{
+public:
+
+  using std::runtime_error::runtime_error;
+
+};
+
+
+/*
+ * A top-level member to load from each record, and its column type.
+ */
+struct NdjsonField
+{
+  std::string name;
+  DType dtype;
+};
+
+using NdjsonSchema = std::vector<NdjsonField>;
+
+/*
+ * Parses a schema of comma-separated member names and types, e.g.
+ * "time:time,symbol:id,price:f64".
+ */
+extern NdjsonSchema parse_ndjson_schema(std::string const& fields);
+
+struct NdjsonOptions
+{
+  // Number of parser threads; 0 for one per hardware thread.
+  unsigned num_threads = 0;
+};
+
+
+/*
+ * Parses newline-delimited JSON text, one object per line, into a table with
+ * a column for each field of `schema`.
+ *
+ * Member values are parsed from their text directly into column builders,
+ * without building a document, so integers keep all 64 bits.  F64 and I64
+ * fields take numbers, ID fields strings, and TIME fields integer nanoseconds
+ * or strings as `parse_time()` accepts.  A member that is missing or null is
+ * stored as null.  Members not in the schema are skipped, checking only that
+ * brackets balance.  Blank lines are ignored.
+ *
+ * Since a record can't span lines, the text is split into chunks at newlines,
+ * which are parsed in parallel.
+ */
+extern Table parse_ndjson(
+  char const* text, size_t size,
+  NdjsonSchema const& schema, NdjsonOptions const& options=NdjsonOptions());
+
+/*
+ * Memory-maps and parses an NDJSON file.
+ */
+extern Table load_ndjson(
+  std::string const& path,
+  NdjsonSchema const& schema, NdjsonOptions const& options=NdjsonOptions());
+
+/*
+ * Returns true if `path` has an NDJSON extension, ".ndjson" or ".jsonl".
+ */
+extern bool is_ndjson_path(std::string const& path);
+
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "topology.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns the number of threads to use, given a requested number; 0 requests
+ * one per hardware thread.
+ */
+inline unsigned
+num_threads(
+  unsigned const requested=0)
+{
+  return requested > 0 ? requested
+    : std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+/*
+ * Returns thread counts to sweep: powers of 2 below the hardware concurrency,
+ * and the hardware concurrency.
+ */
+inline std::vector<long>
+thread_counts()
+{
+  std::vector<long> counts;
+  long const max = num_threads();
+  for (long n = 1; n < max; n *= 2)
+    counts.push_back(n);
+  counts.push_back(max);
+  return counts;
+}
+
+
+/*
+ * Calls `fn(i)` for `i` in [0, num), each in its own thread, and waits for all
+ * to complete.  If any call throws, rethrows the first exception.
+ */
+template<typename FN>
+void
+run_parallel(
+  size_t const num,
+  FN&& fn)
+{
+  if (num == 1) {
+    fn((size_t) 0);
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(num);
+  std::vector<std::thread> threads;
+  threads.reserve(num);
+  for (size_t i = 0; i < num; ++i)
+    threads.emplace_back([&fn, &errors, i]() {
+      try {
+        fn(i);
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  for (auto& thread : threads)
+    thread.join();
+
+  for (auto const& error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+
+
+/*
+ * A reusable barrier for a fixed number of threads, which waits by spinning,
+ * then yielding if the wait is long, e.g. when CPUs are oversubscribed.
+ */
+class SpinBarrier
+{
+public:
+
+  explicit SpinBarrier(
+    unsigned const num)
+  : num_(num)
+  {
+  }
+
+  SpinBarrier(SpinBarrier const&) = delete;
+
+  void
+  wait()
+  {
+    auto const gen = generation_.load(std::memory_order_acquire);
+    if (count_.fetch_add(1, std::memory_order_acq_rel) + 1 == num_) {
+      count_.store(0, std::memory_order_relaxed);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    else
+      for (unsigned spins = 0;
+           generation_.load(std::memory_order_acquire) == gen;
+           ++spins)
+        if (spins >= SPINS)
+          std::this_thread::yield();
+  }
+
+private:
+
+  static unsigned constexpr SPINS = 1 << 12;
+
+  unsigned const num_;
+  std::atomic<unsigned> count_{0};
+  std::atomic<unsigned> generation_{0};
+
+};
+
+
+/*
+ * A fixed set of threads that repeatedly run a function together.
+ *
+ * Unlike `run_parallel()`, threads persist between runs, and wait for work in
+ * a loop that yields the CPU, so a run costs microseconds rather than thread
+ * creation; this suits timing short parallel operations.  The calling thread
+ * does the work of thread 0.  If any call throws, `run()` rethrows the first
+ * exception.
+ *
+ * If `cpus` are given, thread `i` is pinned to `cpus[i]`, including the
+ * calling thread for the pool's lifetime.
+ */
+class WorkerPool
+{
+public:
+
+  explicit WorkerPool(
+    unsigned const num,
+    std::vector<int> const& cpus={})
+  : num_(std::max(1u, num)),
+    errors_(num_)
+  {
+    assert(cpus.empty() || cpus.size() == num_);
+    if (!cpus.empty())
+      pin_.reset(new PinnedScope(cpus[0]));
+
+    remaining_ = num_ - 1;
+    for (size_t i = 1; i < num_; ++i)
+      threads_.emplace_back([this, i, &cpus]() {
+        if (!cpus.empty())
+          try {
+            pin_thread(cpus[i]);
+          }
+          catch (...) {
+            errors_[i] = std::current_exception();
+          }
+        remaining_.fetch_sub(1, std::memory_order_release);
+        work(i);
+      });
+    // Wait for threads to pin themselves.
+    while (remaining_.load(std::memory_order_acquire) > 0)
+      std::this_thread::yield();
+
+    for (auto const& error : errors_)
+      if (error) {
+        shut_down();
+        std::rethrow_exception(error);
+      }
+  }
+
+  WorkerPool(WorkerPool const&) = delete;
+
+  ~WorkerPool()
+  {
+    shut_down();
+  }
+
+  unsigned size() const                 { return num_; }
+
+  /*
+   * Calls `fn(i)` for `i` in [0, size()), each on its own thread, and waits
+   * for all to complete.
+   */
+  template<typename FN>
+  void
+  run(
+    FN&& fn)
+  {
+    std::function<void(size_t)> const call = std::ref(fn);
+    fn_ = &call;
+    remaining_.store(num_ - 1, std::memory_order_relaxed);
+    generation_.fetch_add(1, std::memory_order_release);
+    call_one(0);
+    while (remaining_.load(std::memory_order_acquire) > 0)
+      std::this_thread::yield();
+
+    for (auto& error : errors_)
+      if (error)
+        std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+private:
+
+  void
+  shut_down()
+  {
+    stop_ = true;
+    generation_.fetch_add(1, std::memory_order_release);
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+  void
+  call_one(
+    size_t const i)
+  {
+    try {
+      (*fn_)(i);
+    }
+    catch (...) {
+      errors_[i] = std::current_exception();
+    }
+  }
+
+  void
+  work(
+    size_t const i)
+  {
+    uint64_t seen = 0;
+    for (;;) {
+      uint64_t gen;
+      while ((gen = generation_.load(std::memory_order_acquire)) == seen)
+        std::this_thread::yield();
+      seen = gen;
+      if (stop_)
+        return;
+      call_one(i);
+      remaining_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  unsigned const num_;
+  std::vector<std::exception_ptr> errors_;
+  std::function<void(size_t)> const* fn_ = nullptr;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<size_t> remaining_{0};
+  std::atomic<bool> stop_{false};
+  std::vector<std::thread> threads_;
+  std::unique_ptr<PinnedScope> pin_;
+
+};
+
+
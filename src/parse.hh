@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "column.hh"
+
+//------------------------------------------------------------------------------
+// Fast parsing of numbers and timestamps from unterminated character ranges.
+//
+// Each function parses the entire range [p, end) and returns false if it is
+// not a valid representation.
+//------------------------------------------------------------------------------
+
+/*
+ * Returns true if the eight characters at `p` are all decimal digits.
+ */
+inline bool
+is_eight_digits(
+  char const* const p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return ((v & 0xf0f0f0f0f0f0f0f0)
+          | (((v + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4))
+    == 0x3333333333333333;
+}
+
+
+/*
+ * Returns the value of the eight decimal digits at `p`, computed in parallel
+ * in a 64-bit register.
+ */
+inline uint32_t
+parse_eight_digits(
+  char const* const p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  v = (v & 0x0f0f0f0f0f0f0f0f) * 2561 >> 8;
+  v = (v & 0x00ff00ff00ff00ff) * 6553601 >> 16;
+  return (uint32_t) ((v & 0x0000ffff0000ffff) * 42949672960001 >> 32);
+}
+
+
+/*
+ * Parses a decimal floating point number, correctly rounded.
+ *
+ * Numbers with up to 19 significant digits are converted without calling the
+ * C library: exactly with one multiply or divide if the mantissa and power of
+ * ten are both exact doubles, else by `eisel_lemire()`.  Others, and the rare
+ * cases it can't decide, fall back to `strtod()`.
+ */
+extern bool parse_double_slow(char const* p, char const* end, double& val);
+
+/*
+ * Computes `mant` * 10^`exp10`, correctly rounded, with a 128-bit
+ * approximation of the power of five, as described by Lemire, "Number Parsing
+ * at a Gigabyte per Second".  Returns false if the approximation is too close
+ * to a halfway point to decide the rounding.
+ */
+extern bool eisel_lemire(uint64_t mant, long exp10, double& val);
+
+inline bool
+parse_double(
+  char const* p,
+  char const* const end,
+  double& val)
+{
+  // Powers of ten exactly representable as doubles.
+  static double constexpr POW10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  char const* const start = p;
+  bool const neg = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    ++p;
+
+  // Skip leading zeros, which aren't significant.
+  char const* const int_start = p;
+  while (p < end && *p == '0')
+    ++p;
+
+  // Integer part.  The mantissa may overflow; we check digit counts below.
+  uint64_t mant = 0;
+  char const* const digits_start = p;
+  for (; p < end && '0' <= *p && *p <= '9'; ++p)
+    mant = mant * 10 + (*p - '0');
+  long num_digits = p - digits_start;
+  long exp10 = 0;
+  bool any = p > int_start;
+
+  // Fractional part.
+  if (p < end && *p == '.') {
+    char const* const frac_start = ++p;
+    if (num_digits == 0)
+      while (p < end && *p == '0')
+        ++p;
+    char const* const frac_digits = p;
+    for (; end - p >= 8 && is_eight_digits(p); p += 8)
+      mant = mant * 100000000 + parse_eight_digits(p);
+    for (; p < end && '0' <= *p && *p <= '9'; ++p)
+      mant = mant * 10 + (*p - '0');
+    num_digits += p - frac_digits;
+    exp10 = -(p - frac_start);
+    any |= p > frac_start;
+  }
+  if (!any)
+    // Not a plain decimal; maybe inf or nan.
+    return parse_double_slow(start, end, val);
+
+  // Exponent.
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool const eneg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+      ++p;
+    if (!(p < end && '0' <= *p && *p <= '9'))
+      return false;
+    long e = 0;
+    for (; p < end && '0' <= *p && *p <= '9'; ++p)
+      if (e < 100000)
+        e = e * 10 + (*p - '0');
+    exp10 += eneg ? -e : e;
+  }
+  if (p != end)
+    return false;
+
+  if (num_digits > 19)
+    return parse_double_slow(start, end, val);
+
+  double v;
+  if (mant <= (uint64_t(1) << 53) && -22 <= exp10 && exp10 <= 22) {
+    // Both the mantissa and power of ten are exact, so a single multiply or
+    // divide is correctly rounded.
+    double const m = (double) mant;
+    v = exp10 < 0 ? m / POW10[-exp10] : m * POW10[exp10];
+  }
+  else if (!eisel_lemire(mant, exp10, v))
+    return parse_double_slow(start, end, val);
+  val = neg ? -v : v;
+  return true;
+}
+
+
+/*
+ * Parses a decimal integer with optional sign.
+ */
+inline bool
+parse_int64(
+  char const* p,
+  char const* const end,
+  int64_t& val)
+{
+  bool const neg = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    ++p;
+  if (p == end)
+    return false;
+  uint64_t v = 0;
+  for (; p < end; ++p) {
+    unsigned const d = *p - '0';
+    if (d > 9 || v > (UINT64_MAX - d) / 10)
+      return false;
+    v = v * 10 + d;
+  }
+  if (v > (uint64_t) INT64_MAX + neg)
+    return false;
+  val = neg ? -v : v;
+  return true;
+}
+
+
+/*
+ * Parses a timestamp.
+ *
+ * Accepts "YYYY-MM-DD", "YYYY-MM-DD HH:MM:SS" or "YYYY-MM-DDTHH:MM:SS", with
+ * up to nine fractional second digits and an optional trailing "Z", all in
+ * UTC; or an integer number of nanoseconds since the epoch.
+ */
+extern bool parse_time(char const* p, char const* end, TimeNs& val);
+
+/*
+ * Returns the number of days since 1970-01-01 of a proleptic Gregorian date.
+ */
+inline int64_t
+days_from_civil(
+  int64_t y,
+  unsigned const m,
+  unsigned const d)
+{
+  // See http://howardhinnant.github.io/date_algorithms.html.
+  y -= m <= 2;
+  int64_t const era = (y >= 0 ? y : y - 399) / 400;
+  unsigned const yoe = (unsigned) (y - era * 400);
+  unsigned const doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+
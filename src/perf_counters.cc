@@ -0,0 +1,198 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+struct EventInfo
+{
+  PerfEvent event;
+  char const* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+
+uint64_t constexpr
+cache_config(
+  uint64_t const cache)
+{
+  return
+    cache
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+
+EventInfo constexpr EVENTS[] = {
+  {PerfEvent::CYCLES, "cycles",
+   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PerfEvent::INSTRUCTIONS, "instructions",
+   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PerfEvent::BRANCH_MISSES, "branch-misses",
+   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {PerfEvent::L1D_MISSES, "l1d-misses",
+   PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_L1D)},
+  {PerfEvent::LLC_REFERENCES, "llc-references",
+   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+  {PerfEvent::LLC_MISSES, "llc-misses",
+   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {PerfEvent::DTLB_MISSES, "dtlb-misses",
+   PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_DTLB)},
+  {PerfEvent::TASK_CLOCK, "task-clock",
+   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+  {PerfEvent::PAGE_FAULTS, "page-faults",
+   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  {PerfEvent::CONTEXT_SWITCHES, "context-switches",
+   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+
+EventInfo const&
+get_info(
+  PerfEvent const event)
+{
+  for (auto const& info : EVENTS)
+    if (info.event == event)
+      return info;
+  throw std::logic_error("unknown perf event");
+}
+
+
+int
+perf_event_open(
+  perf_event_attr& attr,
+  int const group_fd)
+{
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+char const*
+perf_event_name(
+  PerfEvent const event)
+{
+  return get_info(event).name;
+}
+
+
+PerfEvent
+parse_perf_event(
+  std::string const& name)
+{
+  for (auto const& info : EVENTS)
+    if (name == info.name)
+      return info.event;
+  throw std::invalid_argument("unknown perf event: "s + name);
+}
+
+
+PerfCounters::~PerfCounters()
+{
+  for (auto const fd : fds_)
+    if (fd >= 0)
+      close(fd);
+}
+
+
+bool
+PerfCounters::open()
+{
+  if (!opened_) {
+    opened_ = true;
+    fds_.assign(events_.size(), -1);
+    for (size_t i = 0; i < events_.size(); ++i) {
+      auto const& info = get_info(events_[i]);
+      auto& group = groups_[info.type == PERF_TYPE_SOFTWARE ? 1 : 0];
+
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = info.type;
+      attr.config = info.config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format
+        = PERF_FORMAT_GROUP
+        | PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      // The leader starts disabled, and enables the whole group.
+      attr.disabled = group.leader < 0;
+
+      int const fd = perf_event_open(attr, group.leader);
+      if (fd < 0)
+        continue;
+      fds_[i] = fd;
+      if (group.leader < 0)
+        group.leader = fd;
+      group.members.push_back(i);
+    }
+
+    for (auto const& group : groups_)
+      if (group.leader >= 0)
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  for (auto const fd : fds_)
+    if (fd >= 0)
+      return true;
+  return false;
+}
+
+
+PerfCounters::Snapshot
+PerfCounters::read()
+  const
+{
+  // For each group: nr, time enabled, time running, and member values.
+  Snapshot snapshot;
+  for (auto const& group : groups_)
+    if (group.leader >= 0) {
+      auto const base = snapshot.size();
+      snapshot.resize(base + 3 + group.members.size(), 0);
+      auto const size = (snapshot.size() - base) * sizeof(uint64_t);
+      if (::read(group.leader, &snapshot[base], size) != (ssize_t) size)
+        // Mark the group as not running.
+        snapshot[base + 2] = 0;
+    }
+  return snapshot;
+}
+
+
+std::vector<double>
+PerfCounters::counts(
+  Snapshot const& start,
+  Snapshot const& stop)
+  const
+{
+  std::vector<double> counts(events_.size(), NAN);
+  size_t base = 0;
+  for (auto const& group : groups_)
+    if (group.leader >= 0) {
+      double const enabled = stop[base + 1] - start[base + 1];
+      double const running = stop[base + 2] - start[base + 2];
+      if (running > 0)
+        for (size_t j = 0; j < group.members.size(); ++j)
+          counts[group.members[j]]
+            = double(stop[base + 3 + j] - start[base + 3 + j])
+              * enabled / running;
+      base += 3 + group.members.size();
+    }
+  return counts;
+}
+
+
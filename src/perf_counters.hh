@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Hardware and software event counters, via Linux perf_event_open.
+//
+// Hardware events are opened as one group, so that they count over the same
+// intervals and ratios between them, e.g. instructions per cycle, are
+// consistent; software events form another group.  Counts exclude the kernel.
+//
+// If the kernel multiplexes a group because there are more events than
+// hardware counters, counts are scaled by the fraction of time the group ran.
+// Events that can't be opened, e.g. hardware events in a VM or with
+// restrictive perf_event_paranoid, are unavailable and count NaN; the others
+// still work.
+//------------------------------------------------------------------------------
+
+enum class PerfEvent
+{
+  CYCLES,
+  INSTRUCTIONS,
+  BRANCH_MISSES,
+  L1D_MISSES,
+  LLC_REFERENCES,
+  LLC_MISSES,
+  DTLB_MISSES,
+  TASK_CLOCK,       // ns
+  PAGE_FAULTS,
+  CONTEXT_SWITCHES,
+};
+
+
+extern char const* perf_event_name(PerfEvent);
+extern PerfEvent parse_perf_event(std::string const&);
+
+class PerfCounters
+{
+public:
+
+  /*
+   * Raw group readings; see `read()`.
+   */
+  using Snapshot = std::vector<uint64_t>;
+
+  PerfCounters() {}
+  PerfCounters(PerfCounters const&) = delete;
+  ~PerfCounters();
+
+  /*
+   * Adds an event.  Events must be added before the first `read()`.
+   */
+  PerfCounters&
+  add(
+    PerfEvent const event)
+  {
+    events_.push_back(event);
+    return *this;
+  }
+
+  size_t size() const                   { return events_.size(); }
+  PerfEvent event(size_t i) const       { return events_[i]; }
+
+  /*
+   * Opens and enables counters, if not already done.  Returns true if any
+   * event is available.
+   */
+  bool open();
+
+  bool available(size_t i) const        { return fds_.size() > i && fds_[i] >= 0; }
+
+  /*
+   * Reads all counters.
+   */
+  Snapshot read() const;
+
+  /*
+   * Returns the scaled counts of each event between two snapshots; NaN for
+   * unavailable events, or if a group didn't run at all.
+   */
+  std::vector<double> counts(Snapshot const& start, Snapshot const& stop) const;
+
+  /*
+   * Invokes `fn(args...)`, and returns the event counts and return value.
+   */
+  template<typename FN, typename ...ARGS>
+  __attribute((noinline))
+  std::pair<std::vector<double>, std::result_of_t<FN&&(ARGS&&...)>>
+  operator()(
+    FN&& fn,
+    ARGS&&... args)
+  {
+    open();
+    auto const start = read();
+    auto const result = fn(std::forward<ARGS>(args)...);
+    auto const stop = read();
+    return {counts(start, stop), result};
+  }
+
+private:
+
+  struct Group
+  {
+    int leader = -1;
+    // Indices of member events, in group read order.
+    std::vector<size_t> members;
+  };
+
+  std::vector<PerfEvent> events_;
+  bool opened_ = false;
+  std::vector<int> fds_;
+  // Hardware and software groups.
+  Group groups_[2];
+
+};
+
+
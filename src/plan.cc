@@ -0,0 +1,2129 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+#include "parallel.hh"
+#include "plan.hh"
+#include "quantile.hh"
+
+using aslib::json::Json;
+using namespace std::string_literals;
+
+using Schema = std::vector<std::pair<std::string, DType>>;
+
+//------------------------------------------------------------------------------
+// Expressions
+//------------------------------------------------------------------------------
+
+namespace {
+
+enum class Op
+{
+  ADD, SUB, MUL, DIV, MIN, MAX, LT, LE, GT, GE, EQ, NE, AND, OR,
+  NEG, ABS, SQRT, LOG, EXP, NOT,
+};
+
+struct OpInfo
+{
+  char const* name;
+  Op op;
+  int arity;
+};
+
+OpInfo constexpr OPS[] = {
+  {"+",    Op::ADD,  2},
+  {"-",    Op::SUB,  2},
+  {"*",    Op::MUL,  2},
+  {"/",    Op::DIV,  2},
+  {"min",  Op::MIN,  2},
+  {"max",  Op::MAX,  2},
+  {"<",    Op::LT,   2},
+  {"<=",   Op::LE,   2},
+  {">",    Op::GT,   2},
+  {">=",   Op::GE,   2},
+  {"==",   Op::EQ,   2},
+  {"!=",   Op::NE,   2},
+  {"and",  Op::AND,  2},
+  {"or",   Op::OR,   2},
+  {"neg",  Op::NEG,  1},
+  {"abs",  Op::ABS,  1},
+  {"sqrt", Op::SQRT, 1},
+  {"log",  Op::LOG,  1},
+  {"exp",  Op::EXP,  1},
+  {"not",  Op::NOT,  1},
+};
+
+
+struct Expr;
+using ExprPtr = std::shared_ptr<Expr const>;
+
+struct Expr
+{
+  enum Kind { COL, LIT, OP };
+
+  Kind kind;
+  std::string name;  // column name
+  double value;      // literal value
+  OpInfo const* op;
+  std::vector<ExprPtr> args;
+};
+
+
+ExprPtr
+make_col(
+  std::string const& name)
+{
+  return std::make_shared<Expr>(Expr{Expr::COL, name, 0, nullptr, {}});
+}
+
+
+ExprPtr
+make_lit(
+  double const value)
+{
+  return std::make_shared<Expr>(Expr{Expr::LIT, "", value, nullptr, {}});
+}
+
+
+ExprPtr
+make_op(
+  OpInfo const* const op,
+  std::vector<ExprPtr> args)
+{
+  return std::make_shared<Expr>(Expr{Expr::OP, "", 0, op, std::move(args)});
+}
+
+
+OpInfo const*
+find_op(
+  Op const op)
+{
+  for (auto const& info : OPS)
+    if (info.op == op)
+      return &info;
+  return nullptr;
+}
+
+
+ExprPtr
+parse_expr(
+  Json const& json)
+{
+  switch (json.get_type()) {
+  case Json::NUM: return make_lit(json.get_num());
+  case Json::TRU: return make_lit(1);
+  case Json::FAL: return make_lit(0);
+  case Json::STR: return make_col(json.get_str());
+
+  case Json::ARR: {
+    if (json.size() == 0 || json[0].get_type() != Json::STR)
+      throw PlanError("expression must start with an operator");
+    auto const& name = json[0].get_str();
+    OpInfo const* op = nullptr;
+    for (auto const& info : OPS)
+      if (name == info.name)
+        op = &info;
+    if (op == nullptr)
+      throw PlanError("unknown operator: "s + name);
+
+    std::vector<ExprPtr> args;
+    for (size_t i = 1; i < json.size(); ++i)
+      args.push_back(parse_expr(json[i]));
+
+    if ((op->op == Op::AND || op->op == Op::OR) && args.size() > 2) {
+      // Fold n-ary and, or.
+      auto expr = make_op(op, {args[0], args[1]});
+      for (size_t i = 2; i < args.size(); ++i)
+        expr = make_op(op, {expr, args[i]});
+      return expr;
+    }
+    if ((int) args.size() != op->arity)
+      throw PlanError(
+        "operator "s + name + " takes " + std::to_string(op->arity)
+        + " arguments");
+    return make_op(op, std::move(args));
+  }
+
+  default:
+    throw PlanError("invalid expression");
+  }
+}
+
+
+Json
+expr_to_json(
+  Expr const& expr)
+{
+  switch (expr.kind) {
+  case Expr::COL:
+    return Json(expr.name);
+
+  case Expr::LIT:
+    return Json(expr.value);
+
+  case Expr::OP:
+  default: {
+    auto json = Json::new_arr();
+    json[0] = Json(expr.op->name);
+    for (auto const& arg : expr.args)
+      json[json.size()] = expr_to_json(*arg);
+    return json;
+    }
+  }
+}
+
+
+void
+get_columns(
+  Expr const& expr,
+  std::set<std::string>& columns)
+{
+  if (expr.kind == Expr::COL)
+    columns.insert(expr.name);
+  for (auto const& arg : expr.args)
+    get_columns(*arg, columns);
+}
+
+
+std::set<std::string>
+get_columns(
+  Expr const& expr)
+{
+  std::set<std::string> columns;
+  get_columns(expr, columns);
+  return columns;
+}
+
+
+/*
+ * Splits an expression into its top-level conjuncts.
+ */
+void
+get_conjuncts(
+  ExprPtr const& expr,
+  std::vector<ExprPtr>& conjuncts)
+{
+  if (expr->kind == Expr::OP && expr->op->op == Op::AND) {
+    get_conjuncts(expr->args[0], conjuncts);
+    get_conjuncts(expr->args[1], conjuncts);
+  }
+  else
+    conjuncts.push_back(expr);
+}
+
+
+ExprPtr
+make_conjunction(
+  std::vector<ExprPtr> const& conjuncts)
+{
+  ExprPtr expr;
+  for (auto const& c : conjuncts)
+    expr = expr ? make_op(find_op(Op::AND), {expr, c}) : c;
+  return expr;
+}
+
+
+/*
+ * Applies an operator elementwise to `num` values.
+ */
+void
+apply(
+  Op const op,
+  size_t const num,
+  double const* const a,
+  double const* const b,
+  double* const r)
+{
+  switch (op) {
+  case Op::ADD:  for (size_t i = 0; i < num; ++i) r[i] = a[i] + b[i]; break;
+  case Op::SUB:  for (size_t i = 0; i < num; ++i) r[i] = a[i] - b[i]; break;
+  case Op::MUL:  for (size_t i = 0; i < num; ++i) r[i] = a[i] * b[i]; break;
+  case Op::DIV:  for (size_t i = 0; i < num; ++i) r[i] = a[i] / b[i]; break;
+  case Op::MIN:  for (size_t i = 0; i < num; ++i) r[i] = std::min(a[i], b[i]); break;
+  case Op::MAX:  for (size_t i = 0; i < num; ++i) r[i] = std::max(a[i], b[i]); break;
+  case Op::LT:   for (size_t i = 0; i < num; ++i) r[i] = a[i] < b[i]; break;
+  case Op::LE:   for (size_t i = 0; i < num; ++i) r[i] = a[i] <= b[i]; break;
+  case Op::GT:   for (size_t i = 0; i < num; ++i) r[i] = a[i] > b[i]; break;
+  case Op::GE:   for (size_t i = 0; i < num; ++i) r[i] = a[i] >= b[i]; break;
+  case Op::EQ:   for (size_t i = 0; i < num; ++i) r[i] = a[i] == b[i]; break;
+  case Op::NE:   for (size_t i = 0; i < num; ++i) r[i] = a[i] != b[i]; break;
+  case Op::AND:  for (size_t i = 0; i < num; ++i) r[i] = a[i] != 0 && b[i] != 0; break;
+  case Op::OR:   for (size_t i = 0; i < num; ++i) r[i] = a[i] != 0 || b[i] != 0; break;
+  case Op::NEG:  for (size_t i = 0; i < num; ++i) r[i] = -a[i]; break;
+  case Op::ABS:  for (size_t i = 0; i < num; ++i) r[i] = std::abs(a[i]); break;
+  case Op::SQRT: for (size_t i = 0; i < num; ++i) r[i] = std::sqrt(a[i]); break;
+  case Op::LOG:  for (size_t i = 0; i < num; ++i) r[i] = std::log(a[i]); break;
+  case Op::EXP:  for (size_t i = 0; i < num; ++i) r[i] = std::exp(a[i]); break;
+  case Op::NOT:  for (size_t i = 0; i < num; ++i) r[i] = a[i] == 0; break;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Aggregate functions
+//------------------------------------------------------------------------------
+
+enum class Fn { COUNT, SUM, MEAN, MIN, MAX, FIRST, LAST, STD, QUANTILE };
+
+struct FnInfo
+{
+  char const* name;
+  Fn fn;
+};
+
+FnInfo constexpr FNS[] = {
+  {"count", Fn::COUNT},
+  {"sum",   Fn::SUM},
+  {"mean",  Fn::MEAN},
+  {"min",   Fn::MIN},
+  {"max",   Fn::MAX},
+  {"first", Fn::FIRST},
+  {"last",  Fn::LAST},
+  {"std",   Fn::STD},
+  {"quantile", Fn::QUANTILE},
+};
+
+
+/*
+ * Mergeable state for any aggregate function.  NaN values are ignored.
+ */
+struct AggState
+{
+  int64_t count = 0;
+  double sum = 0;
+  double sum2 = 0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  double first = NAN;
+  double last = NAN;
+  // For quantiles only, since a sketch is much larger than the rest.
+  std::unique_ptr<KllSketch<double>> sketch;
+
+  void
+  add_to_sketch(
+    double const val)
+  {
+    if (std::isnan(val))
+      return;
+    ++count;
+    if (!sketch)
+      sketch.reset(new KllSketch<double>());
+    sketch->add(val);
+  }
+
+  void
+  add(
+    double const val)
+  {
+    if (std::isnan(val))
+      return;
+    if (count++ == 0)
+      first = val;
+    last = val;
+    sum += val;
+    sum2 += val * val;
+    min = std::min(min, val);
+    max = std::max(max, val);
+  }
+
+  void
+  merge(
+    AggState const& other)
+  {
+    if (other.count == 0)
+      return;
+    if (count == 0)
+      first = other.first;
+    last = other.last;
+    count += other.count;
+    sum += other.sum;
+    sum2 += other.sum2;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    if (other.sketch) {
+      if (sketch)
+        sketch->merge(*other.sketch);
+      else
+        sketch.reset(new KllSketch<double>(*other.sketch));
+    }
+  }
+
+  double
+  result(
+    Fn const fn,
+    double const q)
+    const
+  {
+    switch (fn) {
+    case Fn::COUNT: return count;
+    case Fn::SUM:   return sum;
+    case Fn::MEAN:  return count > 0 ? sum / count : NAN;
+    case Fn::MIN:   return count > 0 ? min : NAN;
+    case Fn::MAX:   return count > 0 ? max : NAN;
+    case Fn::FIRST: return first;
+    case Fn::LAST:  return last;
+    case Fn::STD:
+      return count > 1
+        ? std::sqrt(std::max(0.0, (sum2 - sum * sum / count) / (count - 1)))
+        : NAN;
+    case Fn::QUANTILE: return sketch ? sketch->quantile(q) : NAN;
+    }
+    return NAN;
+  }
+
+};
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+// Plan nodes
+//------------------------------------------------------------------------------
+
+/*
+ * A filter (if `name` is empty) or a computed column.
+ */
+struct Stage
+{
+  std::string name;
+  ExprPtr expr;
+};
+
+
+struct Key
+{
+  std::string column;
+  // If nonzero, group by buckets of this width.
+  int64_t width;
+  std::string name;
+};
+
+
+struct Agg
+{
+  std::string name;
+  FnInfo const* fn;
+  ExprPtr expr;  // null for count
+  double q;  // for quantile
+};
+
+
+struct PlanNode
+{
+  enum Kind { SCAN, FILTER, PROJECT, SELECT, PIPELINE, AGGREGATE, JOIN };
+
+  Kind kind;
+  // SCAN: table name.
+  std::string table;
+  // SCAN, SELECT: columns; PIPELINE: output columns, or all if empty.
+  std::vector<std::string> columns;
+  // FILTER, PROJECT, PIPELINE.
+  std::vector<Stage> stages;
+  // AGGREGATE.
+  std::vector<Key> keys;
+  std::vector<Agg> aggs;
+  // JOIN.
+  std::string left_key;
+  std::string right_key;
+
+  std::vector<std::shared_ptr<PlanNode>> inputs;
+
+  // Output columns, filled in by resolve().
+  Schema schema;
+};
+
+using NodePtr = std::shared_ptr<PlanNode>;
+
+namespace {
+
+NodePtr
+make_node(
+  PlanNode::Kind const kind)
+{
+  auto node = std::make_shared<PlanNode>();
+  node->kind = kind;
+  return node;
+}
+
+
+Json const&
+get(
+  Json const& json,
+  char const* const name)
+{
+  if (!json.has(name))
+    throw PlanError("missing field: "s + name);
+  return json[name];
+}
+
+
+std::string
+get_str(
+  Json const& json,
+  char const* const name)
+{
+  auto const& val = get(json, name);
+  if (val.get_type() != Json::STR)
+    throw PlanError("field must be a string: "s + name);
+  return val.get_str();
+}
+
+
+NodePtr
+parse_node(
+  Json const& json)
+{
+  if (json.get_type() != Json::OBJ)
+    throw PlanError("plan node must be an object");
+  auto const& op = get_str(json, "op");
+
+  if (op == "scan") {
+    auto node = make_node(PlanNode::SCAN);
+    node->table = get_str(json, "table");
+    if (json.has("columns"))
+      for (auto const& col : json["columns"].get_arr())
+        node->columns.push_back(col.get_str());
+    return node;
+  }
+
+  else if (op == "filter") {
+    auto node = make_node(PlanNode::FILTER);
+    node->stages.push_back({"", parse_expr(get(json, "pred"))});
+    node->inputs.push_back(parse_node(get(json, "input")));
+    return node;
+  }
+
+  else if (op == "project") {
+    auto node = make_node(PlanNode::PROJECT);
+    auto const& columns = get(json, "columns");
+    if (columns.get_type() != Json::OBJ)
+      throw PlanError("project columns must be an object");
+    for (auto const& col : columns.get_obj())
+      node->stages.push_back({col.first, parse_expr(col.second)});
+    node->inputs.push_back(parse_node(get(json, "input")));
+    return node;
+  }
+
+  else if (op == "select") {
+    auto node = make_node(PlanNode::SELECT);
+    for (auto const& col : get(json, "columns").get_arr())
+      node->columns.push_back(col.get_str());
+    node->inputs.push_back(parse_node(get(json, "input")));
+    return node;
+  }
+
+  else if (op == "pipeline") {
+    // As written by to_json() for fused filters and projections.
+    auto node = make_node(PlanNode::PIPELINE);
+    for (auto const& stage : get(json, "stages").get_arr()) {
+      if (stage.get_type() != Json::OBJ)
+        throw PlanError("pipeline stage must be an object");
+      if (stage.has("filter"))
+        node->stages.push_back({"", parse_expr(stage["filter"])});
+      else
+        node->stages.push_back(
+          {get_str(stage, "name"), parse_expr(get(stage, "project"))});
+    }
+    if (json.has("columns"))
+      for (auto const& col : json["columns"].get_arr())
+        node->columns.push_back(col.get_str());
+    node->inputs.push_back(parse_node(get(json, "input")));
+    return node;
+  }
+
+  else if (op == "aggregate") {
+    auto node = make_node(PlanNode::AGGREGATE);
+    if (json.has("by"))
+      for (auto const& key : json["by"].get_arr()) {
+        if (key.get_type() == Json::STR)
+          node->keys.push_back({key.get_str(), 0, key.get_str()});
+        else if (key.get_type() == Json::OBJ) {
+          auto const& column = get_str(key, "bucket");
+          auto const width = get(key, "width").get_num();
+          if (!(width >= 1))
+            throw PlanError("bucket width must be positive");
+          node->keys.push_back({
+            column, (int64_t) width,
+            key.has("as") ? get_str(key, "as") : column});
+        }
+        else
+          throw PlanError("invalid aggregate key");
+      }
+
+    for (auto const& agg : get(json, "aggs").get_obj()) {
+      auto const& spec = agg.second;
+      if (spec.get_type() != Json::ARR || spec.size() < 1
+          || spec[0].get_type() != Json::STR)
+        throw PlanError("aggregate must be [FN, EXPR]: "s + agg.first.str());
+      FnInfo const* fn = nullptr;
+      for (auto const& info : FNS)
+        if (spec[0].get_str() == info.name)
+          fn = &info;
+      if (fn == nullptr)
+        throw PlanError("unknown aggregate function: "s + spec[0].get_str());
+      size_t const num_args
+        = fn->fn == Fn::COUNT ? 1 : fn->fn == Fn::QUANTILE ? 3 : 2;
+      if (spec.size() != num_args)
+        throw PlanError("wrong number of arguments for "s + fn->name);
+      double q = 0;
+      if (fn->fn == Fn::QUANTILE) {
+        if (spec[2].get_type() != Json::NUM
+            || !(0 <= spec[2].get_num() && spec[2].get_num() <= 1))
+          throw PlanError("quantile must be between 0 and 1");
+        q = spec[2].get_num();
+      }
+      node->aggs.push_back({
+        agg.first, fn,
+        fn->fn == Fn::COUNT ? nullptr : parse_expr(spec[1]), q});
+    }
+    node->inputs.push_back(parse_node(get(json, "input")));
+    return node;
+  }
+
+  else if (op == "join") {
+    auto node = make_node(PlanNode::JOIN);
+    auto const& on = get(json, "on");
+    if (on.get_type() == Json::STR)
+      node->left_key = node->right_key = on.get_str();
+    else if (on.get_type() == Json::ARR && on.size() == 2) {
+      node->left_key = on[0].get_str();
+      node->right_key = on[1].get_str();
+    }
+    else
+      throw PlanError("join on must be a name or two names");
+    node->inputs.push_back(parse_node(get(json, "left")));
+    node->inputs.push_back(parse_node(get(json, "right")));
+    return node;
+  }
+
+  else
+    throw PlanError("unknown op: "s + op);
+}
+
+
+Json
+node_to_json(
+  PlanNode const& node)
+{
+  auto json = Json::new_obj();
+
+  auto columns = [&]() {
+    auto arr = Json::new_arr();
+    for (auto const& col : node.columns)
+      arr[arr.size()] = Json(col);
+    return arr;
+  };
+
+  switch (node.kind) {
+  case PlanNode::SCAN:
+    json["op"] = "scan";
+    json["table"] = Json(node.table);
+    json["columns"] = columns();
+    break;
+
+  case PlanNode::FILTER:
+    json["op"] = "filter";
+    json["pred"] = expr_to_json(*node.stages[0].expr);
+    break;
+
+  case PlanNode::PROJECT: {
+    json["op"] = "project";
+    auto cols = Json::new_obj();
+    for (auto const& stage : node.stages)
+      cols[stage.name] = expr_to_json(*stage.expr);
+    json["columns"] = std::move(cols);
+    } break;
+
+  case PlanNode::SELECT:
+    json["op"] = "select";
+    json["columns"] = columns();
+    break;
+
+  case PlanNode::PIPELINE: {
+    json["op"] = "pipeline";
+    auto stages = Json::new_arr();
+    for (auto const& stage : node.stages) {
+      auto s = Json::new_obj();
+      if (stage.name.empty())
+        s["filter"] = expr_to_json(*stage.expr);
+      else {
+        s["name"] = Json(stage.name);
+        s["project"] = expr_to_json(*stage.expr);
+      }
+      stages[stages.size()] = std::move(s);
+    }
+    json["stages"] = std::move(stages);
+    if (!node.columns.empty())
+      json["columns"] = columns();
+    } break;
+
+  case PlanNode::AGGREGATE: {
+    json["op"] = "aggregate";
+    auto by = Json::new_arr();
+    for (auto const& key : node.keys)
+      if (key.width == 0)
+        by[by.size()] = Json(key.column);
+      else {
+        auto k = Json::new_obj();
+        k["bucket"] = Json(key.column);
+        k["width"] = Json((double) key.width);
+        k["as"] = Json(key.name);
+        by[by.size()] = std::move(k);
+      }
+    json["by"] = std::move(by);
+    auto aggs = Json::new_obj();
+    for (auto const& agg : node.aggs) {
+      auto spec = Json::new_arr();
+      spec[0] = Json(agg.fn->name);
+      if (agg.expr)
+        spec[1] = expr_to_json(*agg.expr);
+      if (agg.fn->fn == Fn::QUANTILE)
+        spec[2] = Json(agg.q);
+      aggs[agg.name] = std::move(spec);
+    }
+    json["aggs"] = std::move(aggs);
+    } break;
+
+  case PlanNode::JOIN: {
+    json["op"] = "join";
+    auto on = Json::new_arr();
+    on[0] = Json(node.left_key);
+    on[1] = Json(node.right_key);
+    json["on"] = std::move(on);
+    json["left"] = node_to_json(*node.inputs[0]);
+    json["right"] = node_to_json(*node.inputs[1]);
+    } break;
+  }
+
+  if (node.inputs.size() == 1)
+    json["input"] = node_to_json(*node.inputs[0]);
+  return json;
+}
+
+
+//------------------------------------------------------------------------------
+// Validation
+//------------------------------------------------------------------------------
+
+DType const*
+find(
+  Schema const& schema,
+  std::string const& name)
+{
+  for (auto const& col : schema)
+    if (col.first == name)
+      return &col.second;
+  return nullptr;
+}
+
+
+void
+check_columns(
+  Expr const& expr,
+  Schema const& schema,
+  char const* const where)
+{
+  for (auto const& name : get_columns(expr))
+    if (find(schema, name) == nullptr)
+      throw PlanError(where + ": unknown column: "s + name);
+}
+
+
+void
+add_column(
+  Schema& schema,
+  std::string const& name,
+  DType const dtype,
+  char const* const where)
+{
+  if (find(schema, name) != nullptr)
+    throw PlanError(where + ": duplicate column: "s + name);
+  schema.emplace_back(name, dtype);
+}
+
+
+inline bool
+is_int_key(
+  DType const dtype)
+{
+  return dtype == DType::I64 || dtype == DType::TIME;
+}
+
+
+/*
+ * Validates a plan tree against the catalog, and computes output schemas.
+ */
+void
+resolve(
+  PlanNode& node,
+  Catalog const& catalog)
+{
+  for (auto& input : node.inputs)
+    resolve(*input, catalog);
+
+  Schema schema;
+  switch (node.kind) {
+  case PlanNode::SCAN: {
+    auto const t = catalog.find(node.table);
+    if (t == catalog.end())
+      throw PlanError("scan: unknown table: "s + node.table);
+    auto const& table = *t->second;
+    if (node.columns.empty())
+      for (size_t i = 0; i < table.num_columns(); ++i)
+        node.columns.push_back(table.name(i));
+    for (auto const& name : node.columns) {
+      if (!table.has(name))
+        throw PlanError("scan: unknown column: "s + name);
+      add_column(schema, name, table[name].dtype(), "scan");
+    }
+    } break;
+
+  case PlanNode::FILTER:
+  case PlanNode::PROJECT:
+  case PlanNode::PIPELINE:
+    schema = node.inputs[0]->schema;
+    for (auto const& stage : node.stages) {
+      check_columns(*stage.expr, schema, "pipeline");
+      if (!stage.name.empty())
+        add_column(schema, stage.name, DType::F64, "project");
+    }
+    if (!node.columns.empty()) {
+      Schema out;
+      for (auto const& name : node.columns) {
+        auto const dtype = find(schema, name);
+        if (dtype == nullptr)
+          throw PlanError("pipeline: unknown column: "s + name);
+        out.emplace_back(name, *dtype);
+      }
+      schema = std::move(out);
+    }
+    break;
+
+  case PlanNode::SELECT: {
+    auto const& in = node.inputs[0]->schema;
+    for (auto const& name : node.columns) {
+      auto const dtype = find(in, name);
+      if (dtype == nullptr)
+        throw PlanError("select: unknown column: "s + name);
+      add_column(schema, name, *dtype, "select");
+    }
+    } break;
+
+  case PlanNode::AGGREGATE: {
+    auto const& in = node.inputs[0]->schema;
+    // Null keys are tracked in one word.
+    if (node.keys.size() > 64)
+      throw PlanError("aggregate: too many keys");
+    for (auto const& key : node.keys) {
+      auto const dtype = find(in, key.column);
+      if (dtype == nullptr)
+        throw PlanError("aggregate: unknown column: "s + key.column);
+      if (!(is_int_key(*dtype) || (*dtype == DType::ID && key.width == 0)))
+        throw PlanError("aggregate: can't group by column: "s + key.column);
+      add_column(schema, key.name, *dtype, "aggregate");
+    }
+    for (auto const& agg : node.aggs) {
+      if (agg.expr)
+        check_columns(*agg.expr, in, "aggregate");
+      add_column(
+        schema, agg.name, agg.fn->fn == Fn::COUNT ? DType::I64 : DType::F64,
+        "aggregate");
+    }
+    } break;
+
+  case PlanNode::JOIN: {
+    auto const& left = node.inputs[0]->schema;
+    auto const& right = node.inputs[1]->schema;
+    auto const lt = find(left, node.left_key);
+    auto const rt = find(right, node.right_key);
+    if (lt == nullptr)
+      throw PlanError("join: unknown left column: "s + node.left_key);
+    if (rt == nullptr)
+      throw PlanError("join: unknown right column: "s + node.right_key);
+    if (!((is_int_key(*lt) && is_int_key(*rt))
+          || (*lt == DType::ID && *rt == DType::ID)))
+      throw PlanError("join: incompatible key types");
+    schema = left;
+    for (auto const& col : right)
+      if (col.first != node.right_key)
+        add_column(schema, col.first, col.second, "join");
+    } break;
+  }
+
+  node.schema = std::move(schema);
+}
+
+
+//------------------------------------------------------------------------------
+// Optimization
+//------------------------------------------------------------------------------
+
+bool
+has_any(
+  std::set<std::string> const& names,
+  Schema const& schema)
+{
+  for (auto const& name : names)
+    if (find(schema, name) != nullptr)
+      return true;
+  return false;
+}
+
+
+bool
+has_all(
+  std::set<std::string> const& names,
+  Schema const& schema)
+{
+  for (auto const& name : names)
+    if (find(schema, name) == nullptr)
+      return false;
+  return true;
+}
+
+
+NodePtr
+make_filter(
+  ExprPtr const& pred,
+  NodePtr const& input)
+{
+  auto node = make_node(PlanNode::FILTER);
+  node->stages.push_back({"", pred});
+  node->inputs.push_back(input);
+  return node;
+}
+
+
+/*
+ * Pushes filters as far toward the scans as possible.  Schemas must be
+ * resolved.
+ */
+NodePtr
+push_down(
+  NodePtr node)
+{
+  for (auto& input : node->inputs)
+    input = push_down(input);
+  if (node->kind != PlanNode::FILTER)
+    return node;
+
+  auto const& pred = node->stages[0].expr;
+  auto const input = node->inputs[0];
+  std::vector<ExprPtr> conjuncts;
+  get_conjuncts(pred, conjuncts);
+
+  switch (input->kind) {
+  case PlanNode::FILTER:
+    // Merge adjacent filters.
+    return push_down(make_filter(
+      make_conjunction({input->stages[0].expr, pred}), input->inputs[0]));
+
+  case PlanNode::SELECT:
+    // Swap, since the select only removes columns.
+    input->inputs[0] = push_down(make_filter(pred, input->inputs[0]));
+    return input;
+
+  case PlanNode::PROJECT: {
+    // Push conjuncts that don't use computed columns.
+    Schema computed;
+    for (auto const& stage : input->stages)
+      computed.emplace_back(stage.name, DType::F64);
+    std::vector<ExprPtr> below, above;
+    for (auto const& c : conjuncts)
+      (has_any(get_columns(*c), computed) ? above : below).push_back(c);
+    if (below.empty())
+      return node;
+    input->inputs[0]
+      = push_down(make_filter(make_conjunction(below), input->inputs[0]));
+    return above.empty() ? input : make_filter(make_conjunction(above), input);
+    }
+
+  case PlanNode::JOIN: {
+    // Push conjuncts that use only one side's columns to that side.
+    auto const& left = input->inputs[0]->schema;
+    auto const& right = input->inputs[1]->schema;
+    std::vector<ExprPtr> l, r, above;
+    for (auto const& c : conjuncts) {
+      auto const cols = get_columns(*c);
+      if (has_all(cols, left))
+        l.push_back(c);
+      else if (has_all(cols, right) && cols.count(input->right_key) == 0)
+        r.push_back(c);
+      else
+        above.push_back(c);
+    }
+    if (!l.empty())
+      input->inputs[0]
+        = push_down(make_filter(make_conjunction(l), input->inputs[0]));
+    if (!r.empty())
+      input->inputs[1]
+        = push_down(make_filter(make_conjunction(r), input->inputs[1]));
+    return above.empty() ? input : make_filter(make_conjunction(above), input);
+    }
+
+  case PlanNode::AGGREGATE: {
+    // Push conjuncts that use only ungrouped key columns.
+    Schema keys;
+    for (auto const& key : input->keys)
+      if (key.width == 0)
+        keys.emplace_back(key.name, DType::I64);
+    std::vector<ExprPtr> below, above;
+    for (auto const& c : conjuncts)
+      (has_all(get_columns(*c), keys) ? below : above).push_back(c);
+    if (below.empty())
+      return node;
+    input->inputs[0]
+      = push_down(make_filter(make_conjunction(below), input->inputs[0]));
+    return above.empty() ? input : make_filter(make_conjunction(above), input);
+    }
+
+  default:
+    return node;
+  }
+}
+
+
+/*
+ * Fuses chains of filters and projections into pipelines.
+ */
+NodePtr
+fuse(
+  NodePtr node)
+{
+  for (auto& input : node->inputs)
+    input = fuse(input);
+  if (node->kind == PlanNode::FILTER || node->kind == PlanNode::PROJECT) {
+    node->kind = PlanNode::PIPELINE;
+    auto const input = node->inputs[0];
+    if (input->kind == PlanNode::PIPELINE && input->columns.empty()) {
+      auto stages = input->stages;
+      stages.insert(stages.end(), node->stages.begin(), node->stages.end());
+      node->stages = std::move(stages);
+      node->inputs = input->inputs;
+    }
+  }
+  return node;
+}
+
+
+/*
+ * Removes columns and computations not needed for `required` outputs.
+ */
+void
+prune(
+  PlanNode& node,
+  std::set<std::string> required)
+{
+  switch (node.kind) {
+  case PlanNode::SCAN: {
+    std::vector<std::string> columns;
+    for (auto const& name : node.columns)
+      if (required.count(name) > 0)
+        columns.push_back(name);
+    // Keep at least one column, to carry the row count.
+    if (columns.empty() && !node.columns.empty())
+      columns.push_back(node.columns[0]);
+    node.columns = std::move(columns);
+    } break;
+
+  case PlanNode::FILTER:
+  case PlanNode::PROJECT:
+  case PlanNode::PIPELINE: {
+    node.columns.clear();
+    for (auto const& col : node.schema)
+      if (required.count(col.first) > 0)
+        node.columns.push_back(col.first);
+    // Walk stages backward, dropping unused projections.
+    std::vector<Stage> stages;
+    for (auto s = node.stages.rbegin(); s != node.stages.rend(); ++s)
+      if (s->name.empty() || required.count(s->name) > 0) {
+        required.erase(s->name);
+        get_columns(*s->expr, required);
+        stages.push_back(*s);
+      }
+    node.stages.assign(stages.rbegin(), stages.rend());
+    prune(*node.inputs[0], required);
+    } break;
+
+  case PlanNode::SELECT: {
+    std::vector<std::string> columns;
+    for (auto const& name : node.columns)
+      if (required.count(name) > 0)
+        columns.push_back(name);
+    node.columns = columns;
+    prune(*node.inputs[0], {columns.begin(), columns.end()});
+    } break;
+
+  case PlanNode::AGGREGATE: {
+    std::vector<Agg> aggs;
+    std::set<std::string> need;
+    for (auto const& key : node.keys)
+      need.insert(key.column);
+    for (auto const& agg : node.aggs)
+      if (required.count(agg.name) > 0) {
+        aggs.push_back(agg);
+        if (agg.expr)
+          get_columns(*agg.expr, need);
+      }
+    node.aggs = std::move(aggs);
+    prune(*node.inputs[0], need);
+    } break;
+
+  case PlanNode::JOIN: {
+    std::set<std::string> left{node.left_key}, right{node.right_key};
+    for (auto const& name : required) {
+      if (find(node.inputs[0]->schema, name) != nullptr)
+        left.insert(name);
+      else
+        right.insert(name);
+    }
+    prune(*node.inputs[0], left);
+    prune(*node.inputs[1], right);
+    } break;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Execution
+//------------------------------------------------------------------------------
+
+size_t constexpr CHUNK_SIZE = 1024;
+
+// Rows are split among threads only if each gets at least this many.
+size_t constexpr MIN_THREAD_ROWS = 1 << 16;
+
+template<typename T> struct Tag { using type = T; };
+
+/*
+ * Calls `fn(Tag<T>())` with the storage type `T` for `dtype`.
+ */
+template<typename FN>
+inline auto
+with_type(
+  DType const dtype,
+  FN&& fn)
+{
+  switch (dtype) {
+  case DType::I64:
+  case DType::TIME: return fn(Tag<int64_t>());
+  case DType::ID:   return fn(Tag<uint32_t>());
+  case DType::F64:
+  default:          return fn(Tag<double>());
+  }
+}
+
+
+/*
+ * A column of values during execution, either borrowed from a table or owned.
+ */
+struct Series
+{
+  DType dtype;
+  size_t size;
+  void const* data;
+  std::shared_ptr<void const> owner;
+  std::vector<std::string> const* dict;
+  // Validity bits, borrowed or owned like the values, or null if all are
+  // valid.
+  uint64_t const* validity = nullptr;
+  std::shared_ptr<void const> validity_owner = nullptr;
+
+  template<typename T> T const* values() const { return (T const*) data; }
+
+  bool
+  is_valid(
+    size_t const i)
+    const
+  {
+    return validity == nullptr || (validity[i / 64] >> (i % 64)) & 1;
+  }
+
+  /*
+   * Takes validity bits, one per value.
+   */
+  void
+  set_validity(
+    std::vector<uint64_t>&& bits)
+  {
+    auto owner = std::make_shared<std::vector<uint64_t>>(std::move(bits));
+    validity = owner->data();
+    validity_owner = std::move(owner);
+  }
+
+  double
+  as_double(
+    size_t const i)
+    const
+  {
+    return with_type(dtype, [&](auto tag) {
+      return (double) values<typename decltype(tag)::type>()[i];
+    });
+  }
+
+  int64_t
+  as_key(
+    size_t const i)
+    const
+  {
+    return dtype == DType::ID ? values<uint32_t>()[i] : values<int64_t>()[i];
+  }
+};
+
+
+template<typename T>
+Series
+make_series(
+  DType const dtype,
+  std::vector<T>&& vals,
+  std::vector<std::string> const* const dict)
+{
+  auto owner = std::make_shared<std::vector<T>>(std::move(vals));
+  return Series{dtype, owner->size(), owner->data(), owner, dict};
+}
+
+
+struct Frame
+{
+  size_t num_rows = 0;
+  std::vector<std::string> names;
+  std::vector<Series> series;
+
+  Series const&
+  operator[](
+    std::string const& name)
+    const
+  {
+    for (size_t i = 0; i < names.size(); ++i)
+      if (names[i] == name)
+        return series[i];
+    assert(false);
+    return series[0];
+  }
+
+  void
+  add(
+    std::string const& name,
+    Series s)
+  {
+    num_rows = s.size;
+    names.push_back(name);
+    series.push_back(std::move(s));
+  }
+};
+
+
+/*
+ * Builds an output column from pieces produced in parallel.
+ */
+class SeriesBuilder
+{
+public:
+
+  SeriesBuilder(
+    Series const& proto,
+    size_t const num_parts)
+  : dtype_(proto.dtype),
+    dict_(proto.dict),
+    has_validity_(proto.validity != nullptr),
+    f64_(num_parts),
+    i64_(num_parts),
+    id_(num_parts),
+    valid_(num_parts)
+  {
+  }
+
+  template<typename T>
+  std::vector<T>&
+  part(
+    size_t const i)
+  {
+    return parts(Tag<T>())[i];
+  }
+
+  void
+  gather(
+    size_t const part,
+    Series const& src,
+    size_t const* const rows,
+    size_t const num)
+  {
+    with_type(dtype_, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      auto& dst = this->part<T>(part);
+      T const* const vals = src.values<T>();
+      for (size_t i = 0; i < num; ++i)
+        dst.push_back(vals[rows[i]]);
+    });
+    if (has_validity_)
+      for (size_t i = 0; i < num; ++i)
+        valid_[part].push_back(src.is_valid(rows[i]));
+  }
+
+  Series
+  finish()
+  {
+    return with_type(dtype_, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      std::vector<T> all;
+      size_t size = 0;
+      for (size_t i = 0; i < f64_.size(); ++i)
+        size += part<T>(i).size();
+      all.reserve(size);
+      for (size_t i = 0; i < f64_.size(); ++i)
+        all.insert(all.end(), part<T>(i).begin(), part<T>(i).end());
+      auto series = make_series(dtype_, std::move(all), dict_);
+      if (has_validity_) {
+        std::vector<uint64_t> bits((size + 63) / 64, 0);
+        size_t j = 0;
+        for (auto const& valid : valid_)
+          for (auto const v : valid) {
+            bits[j / 64] |= uint64_t(v) << (j % 64);
+            ++j;
+          }
+        series.set_validity(std::move(bits));
+      }
+      return series;
+    });
+  }
+
+private:
+
+  std::vector<std::vector<double>>& parts(Tag<double>)    { return f64_; }
+  std::vector<std::vector<int64_t>>& parts(Tag<int64_t>)  { return i64_; }
+  std::vector<std::vector<uint32_t>>& parts(Tag<uint32_t>) { return id_; }
+
+  DType const dtype_;
+  std::vector<std::string> const* const dict_;
+  bool const has_validity_;
+  std::vector<std::vector<double>> f64_;
+  std::vector<std::vector<int64_t>> i64_;
+  std::vector<std::vector<uint32_t>> id_;
+  std::vector<std::vector<bool>> valid_;
+
+};
+
+
+/*
+ * Evaluates expressions over a chunk of selected rows of a frame.
+ */
+class ChunkEval
+{
+public:
+
+  ChunkEval(Frame const& frame) : frame_(frame) {}
+
+  /*
+   * Sets the selected rows, and forgets computed columns.
+   */
+  void
+  reset(
+    size_t const* const rows,
+    size_t const num)
+  {
+    rows_ = rows;
+    num_ = num;
+    gathered_.clear();
+    computed_.clear();
+  }
+
+  size_t size() const { return num_; }
+
+  /*
+   * Narrows the selection to rows where `mask` is nonzero.  `rows` is updated
+   * in place.
+   */
+  void
+  select(
+    size_t* const rows,
+    double const* const mask)
+  {
+    // Copy the mask, as it may be one of the buffers we compact.
+    mask_.assign(mask, mask + num_);
+    size_t n = 0;
+    for (size_t i = 0; i < num_; ++i)
+      if (mask_[i] != 0) {
+        rows[n] = rows[i];
+        for (auto& c : computed_)
+          c.second[n] = c.second[i];
+        ++n;
+      }
+    num_ = n;
+    for (auto& c : computed_)
+      c.second.resize(n);
+    gathered_.clear();
+  }
+
+  /*
+   * Stores a computed column for the current selection.
+   */
+  void
+  set(
+    std::string const& name,
+    double const* const vals)
+  {
+    auto& buf = computed_[name];
+    buf.assign(vals, vals + num_);
+  }
+
+  std::vector<double> const* computed(std::string const& name) const
+  {
+    auto const i = computed_.find(name);
+    return i == computed_.end() ? nullptr : &i->second;
+  }
+
+  double const*
+  column(
+    std::string const& name)
+  {
+    auto const c = computed_.find(name);
+    if (c != computed_.end())
+      return c->second.data();
+
+    auto& buf = gathered_[name];
+    if (buf.size() != num_) {
+      auto const& series = frame_[name];
+      buf.resize(num_);
+      with_type(series.dtype, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        T const* const vals = series.values<T>();
+        if (series.validity == nullptr)
+          for (size_t i = 0; i < num_; ++i)
+            buf[i] = vals[rows_[i]];
+        else
+          // Read nulls as NaN.
+          for (size_t i = 0; i < num_; ++i)
+            buf[i] = series.is_valid(rows_[i]) ? vals[rows_[i]] : NAN;
+      });
+    }
+    return buf.data();
+  }
+
+  double const*
+  eval(
+    Expr const& expr)
+  {
+    if (expr.kind == Expr::COL)
+      return column(expr.name);
+
+    auto& buf = buffers_[&expr];
+    buf.resize(num_);
+    if (expr.kind == Expr::LIT)
+      std::fill(buf.begin(), buf.end(), expr.value);
+    else {
+      double const* const a = eval(*expr.args[0]);
+      double const* const b = expr.args.size() > 1 ? eval(*expr.args[1]) : a;
+      apply(expr.op->op, num_, a, b, buf.data());
+    }
+    return buf.data();
+  }
+
+private:
+
+  Frame const& frame_;
+  size_t const* rows_ = nullptr;
+  size_t num_ = 0;
+  std::unordered_map<std::string, std::vector<double>> gathered_;
+  std::unordered_map<std::string, std::vector<double>> computed_;
+  std::unordered_map<Expr const*, std::vector<double>> buffers_;
+  std::vector<double> mask_;
+
+};
+
+
+/*
+ * Splits `num_rows` into ranges for threads.
+ */
+size_t
+num_parts(
+  size_t const num_rows,
+  unsigned const threads)
+{
+  return std::max<size_t>(
+    1, std::min<size_t>(threads, num_rows / MIN_THREAD_ROWS));
+}
+
+
+Frame
+scan(
+  PlanNode const& node,
+  Table const& table)
+{
+  Frame frame;
+  for (auto const& name : node.columns) {
+    auto const& col = table[name];
+    auto const dtype = col.dtype();
+    Series series;
+    if (dtype == DType::F64 && col.has_validity()) {
+      // Read nulls as NaN, for expressions.
+      auto const& c = column_cast<double>(col);
+      std::vector<double> vals(c.data(), c.data() + c.size());
+      for (size_t i = 0; i < vals.size(); ++i)
+        if (!c.is_valid(i))
+          vals[i] = NAN;
+      series = make_series(dtype, std::move(vals), nullptr);
+    }
+    else
+      series = with_type(dtype, [&](auto tag) {
+        auto const& c = column_cast<typename decltype(tag)::type>(col);
+        return Series{
+          dtype, c.size(), c.data(), nullptr,
+          dtype == DType::ID ? &c.dictionary() : nullptr};
+      });
+    if (col.has_validity())
+      series.validity = col.validity().data();
+    frame.add(name, std::move(series));
+  }
+  frame.num_rows = table.num_rows();
+  return frame;
+}
+
+
+Frame
+run_pipeline(
+  PlanNode const& node,
+  Frame const& input,
+  unsigned const threads)
+{
+  size_t const n = input.num_rows;
+  size_t const parts = num_parts(n, threads);
+
+  // Output columns, in schema order.
+  std::vector<SeriesBuilder> builders;
+  std::vector<int> sources;  // input column index, or -1 if computed
+  for (auto const& col : node.schema) {
+    auto const i = std::find(input.names.begin(), input.names.end(), col.first);
+    if (i == input.names.end()) {
+      sources.push_back(-1);
+      builders.emplace_back(
+        Series{DType::F64, 0, nullptr, nullptr, nullptr}, parts);
+    }
+    else {
+      sources.push_back(i - input.names.begin());
+      builders.emplace_back(*(input.series.begin() + sources.back()), parts);
+    }
+  }
+
+  run_parallel(parts, [&](size_t const part) {
+    size_t const end = n * (part + 1) / parts;
+    ChunkEval eval(input);
+    size_t rows[CHUNK_SIZE];
+
+    for (size_t start = n * part / parts; start < end; start += CHUNK_SIZE) {
+      size_t const num = std::min(CHUNK_SIZE, end - start);
+      for (size_t i = 0; i < num; ++i)
+        rows[i] = start + i;
+      eval.reset(rows, num);
+
+      for (auto const& stage : node.stages) {
+        auto const vals = eval.eval(*stage.expr);
+        if (stage.name.empty())
+          eval.select(rows, vals);
+        else
+          eval.set(stage.name, vals);
+        if (eval.size() == 0)
+          break;
+      }
+      if (eval.size() == 0)
+        continue;
+
+      for (size_t c = 0; c < builders.size(); ++c)
+        if (sources[c] < 0) {
+          auto const& vals = *eval.computed(node.schema[c].first);
+          auto& dst = builders[c].part<double>(part);
+          dst.insert(dst.end(), vals.begin(), vals.end());
+        }
+        else
+          builders[c].gather(
+            part, input.series[sources[c]], rows, eval.size());
+    }
+  });
+
+  Frame frame;
+  for (size_t c = 0; c < builders.size(); ++c)
+    frame.add(node.schema[c].first, builders[c].finish());
+  return frame;
+}
+
+
+// Not a group or row index.
+size_t constexpr EMPTY = (size_t) -1;
+
+/*
+ * Open-addressing hash table mapping fixed-length integer key tuples to
+ * dense group indices.
+ */
+class GroupTable
+{
+public:
+
+  GroupTable(size_t const width) : width_(width), slots_(64, EMPTY) {}
+
+  size_t size() const { return num_; }
+  int64_t const* key(size_t const g) const { return &keys_[g * width_]; }
+
+  size_t
+  find_or_insert(
+    int64_t const* const key)
+  {
+    size_t const mask = slots_.size() - 1;
+    for (size_t s = hash(key) & mask; ; s = (s + 1) & mask) {
+      auto const g = slots_[s];
+      if (g == EMPTY) {
+        slots_[s] = num_;
+        keys_.insert(keys_.end(), key, key + width_);
+        if (++num_ * 2 > slots_.size())
+          grow();
+        return num_ - 1;
+      }
+      else if (memcmp(this->key(g), key, width_ * sizeof(int64_t)) == 0)
+        return g;
+    }
+  }
+
+  size_t
+  find(
+    int64_t const* const key)
+    const
+  {
+    size_t const mask = slots_.size() - 1;
+    for (size_t s = hash(key) & mask; ; s = (s + 1) & mask) {
+      auto const g = slots_[s];
+      if (g == EMPTY
+          || memcmp(this->key(g), key, width_ * sizeof(int64_t)) == 0)
+        return g;
+    }
+  }
+
+private:
+
+  size_t
+  hash(
+    int64_t const* const key)
+    const
+  {
+    uint64_t h = 0;
+    for (size_t i = 0; i < width_; ++i) {
+      h = (h ^ (uint64_t) key[i]) * 0x9e3779b97f4a7c15;
+      h ^= h >> 29;
+    }
+    return h;
+  }
+
+  void
+  grow()
+  {
+    slots_.assign(slots_.size() * 2, EMPTY);
+    size_t const mask = slots_.size() - 1;
+    for (size_t g = 0; g < num_; ++g) {
+      size_t s = hash(key(g)) & mask;
+      while (slots_[s] != EMPTY)
+        s = (s + 1) & mask;
+      slots_[s] = g;
+    }
+  }
+
+  size_t const width_;
+  std::vector<size_t> slots_;
+  std::vector<int64_t> keys_;
+  size_t num_ = 0;
+
+};
+
+
+/*
+ * Floor division, for bucketing negative times correctly.
+ */
+inline int64_t
+floor_div(
+  int64_t const a,
+  int64_t const b)
+{
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+
+}  // anonymous namespace
+
+struct AggregateGroups
+{
+  AggregateGroups(
+    size_t const width,
+    size_t const num_aggs)
+  : groups(width + 1),
+    num_aggs(num_aggs),
+    dicts(width, nullptr)
+  {
+  }
+
+  // Keys are followed by a mask of those that are null.
+  GroupTable groups;
+  size_t const num_aggs;
+  // `num_aggs` states per group.
+  std::vector<AggState> states;
+  // For ID keys, the dictionary; else null.
+  std::vector<std::vector<std::string> const*> dicts;
+
+  /*
+   * Merges in groups of following rows.
+   */
+  void
+  merge(
+    AggregateGroups const& other)
+  {
+    for (size_t g = 0; g < other.groups.size(); ++g) {
+      auto const gg = groups.find_or_insert(other.groups.key(g));
+      states.resize(groups.size() * num_aggs);
+      for (size_t a = 0; a < num_aggs; ++a)
+        states[gg * num_aggs + a].merge(other.states[g * num_aggs + a]);
+    }
+    // Dictionaries agree on shared codes, so the longer covers both.
+    for (size_t k = 0; k < dicts.size(); ++k)
+      if (dicts[k] == nullptr
+          || (other.dicts[k] != nullptr
+              && other.dicts[k]->size() > dicts[k]->size()))
+        dicts[k] = other.dicts[k];
+  }
+};
+
+namespace {
+
+std::unique_ptr<AggregateGroups>
+aggregate_groups(
+  PlanNode const& node,
+  Frame const& input,
+  unsigned const threads)
+{
+  size_t const n = input.num_rows;
+  size_t const parts = num_parts(n, threads);
+  size_t const width = node.keys.size();
+  size_t const num_aggs = node.aggs.size();
+
+  // Each part aggregates its rows into its own groups.
+  std::vector<std::unique_ptr<AggregateGroups>> part_groups(parts);
+
+  run_parallel(parts, [&](size_t const part) {
+    part_groups[part].reset(new AggregateGroups(width, num_aggs));
+    auto& groups = part_groups[part]->groups;
+    auto& state = part_groups[part]->states;
+    size_t const end = n * (part + 1) / parts;
+    ChunkEval eval(input);
+    size_t rows[CHUNK_SIZE];
+    size_t gids[CHUNK_SIZE];
+    std::vector<int64_t> key(width + 1);
+
+    for (size_t start = n * part / parts; start < end; start += CHUNK_SIZE) {
+      size_t const num = std::min(CHUNK_SIZE, end - start);
+      for (size_t i = 0; i < num; ++i)
+        rows[i] = start + i;
+      eval.reset(rows, num);
+
+      // Assign group indices.  Null keys form their own groups.
+      for (size_t i = 0; i < num; ++i) {
+        uint64_t nulls = 0;
+        for (size_t k = 0; k < width; ++k) {
+          auto const& kk = node.keys[k];
+          auto const& series = input[kk.column];
+          if (!series.is_valid(rows[i])) {
+            key[k] = 0;
+            nulls |= uint64_t(1) << k;
+            continue;
+          }
+          int64_t const v = series.as_key(rows[i]);
+          key[k] = kk.width == 0 ? v : floor_div(v, kk.width) * kk.width;
+        }
+        key[width] = nulls;
+        gids[i] = groups.find_or_insert(key.data());
+      }
+      state.resize(groups.size() * num_aggs);
+
+      for (size_t a = 0; a < num_aggs; ++a) {
+        auto const& agg = node.aggs[a];
+        if (agg.fn->fn == Fn::QUANTILE) {
+          double const* const vals = eval.eval(*agg.expr);
+          for (size_t i = 0; i < num; ++i)
+            state[gids[i] * num_aggs + a].add_to_sketch(vals[i]);
+        }
+        else if (agg.expr) {
+          double const* const vals = eval.eval(*agg.expr);
+          for (size_t i = 0; i < num; ++i)
+            state[gids[i] * num_aggs + a].add(vals[i]);
+        }
+        else
+          for (size_t i = 0; i < num; ++i)
+            state[gids[i] * num_aggs + a].count++;
+      }
+    }
+  });
+
+  // Merge parts, in order.
+  std::unique_ptr<AggregateGroups> groups(
+    new AggregateGroups(width, num_aggs));
+  for (size_t k = 0; k < width; ++k)
+    groups->dicts[k] = input[node.keys[k].column].dict;
+  for (auto const& part : part_groups)
+    groups->merge(*part);
+  return groups;
+}
+
+
+/*
+ * Finishes aggregates of groups, in the aggregate node's output schema.
+ */
+Frame
+finish_groups(
+  PlanNode const& node,
+  AggregateGroups const& agg_groups)
+{
+  auto const& groups = agg_groups.groups;
+  size_t const width = node.keys.size();
+  size_t const num_aggs = node.aggs.size();
+  // Without keys, there's one group even if there are no rows.
+  size_t const num_groups = width == 0 ? 1 : groups.size();
+  AggState const empty;
+  auto const state = [&](size_t const g, size_t const a) -> AggState const& {
+    return g < groups.size() ? agg_groups.states[g * num_aggs + a] : empty;
+  };
+
+  Frame frame;
+  for (size_t k = 0; k < width; ++k) {
+    auto const dtype = node.schema[k].second;
+    std::vector<uint64_t> validity((num_groups + 63) / 64, 0);
+    bool any_null = false;
+    for (size_t g = 0; g < num_groups; ++g)
+      if ((groups.key(g)[width] >> k) & 1)
+        any_null = true;
+      else
+        validity[g / 64] |= uint64_t(1) << (g % 64);
+
+    Series series;
+    if (dtype == DType::ID) {
+      std::vector<uint32_t> vals(num_groups);
+      for (size_t g = 0; g < num_groups; ++g)
+        vals[g] = groups.key(g)[k];
+      series = make_series(dtype, std::move(vals), agg_groups.dicts[k]);
+    }
+    else {
+      std::vector<int64_t> vals(num_groups);
+      for (size_t g = 0; g < num_groups; ++g)
+        vals[g] = groups.key(g)[k];
+      series = make_series(dtype, std::move(vals), nullptr);
+    }
+    if (any_null)
+      series.set_validity(std::move(validity));
+    frame.add(node.keys[k].name, std::move(series));
+  }
+  for (size_t a = 0; a < num_aggs; ++a) {
+    auto const fn = node.aggs[a].fn->fn;
+    auto const q = node.aggs[a].q;
+    if (fn == Fn::COUNT) {
+      std::vector<int64_t> vals(num_groups);
+      for (size_t g = 0; g < num_groups; ++g)
+        vals[g] = state(g, a).count;
+      frame.add(node.aggs[a].name, make_series(DType::I64, std::move(vals), nullptr));
+    }
+    else {
+      std::vector<double> vals(num_groups);
+      for (size_t g = 0; g < num_groups; ++g)
+        vals[g] = state(g, a).result(fn, q);
+      frame.add(node.aggs[a].name, make_series(DType::F64, std::move(vals), nullptr));
+    }
+  }
+  frame.num_rows = num_groups;
+  return frame;
+}
+
+
+Frame
+run_aggregate(
+  PlanNode const& node,
+  Frame const& input,
+  unsigned const threads)
+{
+  return finish_groups(node, *aggregate_groups(node, input, threads));
+}
+
+
+Frame
+run_join(
+  PlanNode const& node,
+  Frame const& left,
+  Frame const& right,
+  unsigned const threads)
+{
+  auto const& lkey = left[node.left_key];
+  auto const& rkey = right[node.right_key];
+
+  // For id keys, map right codes to left codes via the strings.
+  bool const remap_ids = rkey.dtype == DType::ID;
+  std::vector<int64_t> remap;
+  if (remap_ids) {
+    std::unordered_map<std::string, int64_t> codes;
+    for (size_t i = 0; i < lkey.dict->size(); ++i)
+      codes.emplace((*lkey.dict)[i], i);
+    for (auto const& str : *rkey.dict) {
+      auto const c = codes.find(str);
+      remap.push_back(c == codes.end() ? -1 : c->second);
+    }
+  }
+
+  // Build a hash table on the right side, chaining rows with equal keys.
+  GroupTable groups(1);
+  std::vector<size_t> head;
+  std::vector<size_t> next(right.num_rows);
+  for (size_t r = right.num_rows; r-- > 0; ) {
+    // Null keys match nothing.
+    if (!rkey.is_valid(r))
+      continue;
+    int64_t key = rkey.as_key(r);
+    if (remap_ids
+        && ((size_t) key >= remap.size() || (key = remap[key]) < 0))
+      continue;
+    auto const g = groups.find_or_insert(&key);
+    if (g == head.size())
+      head.push_back(EMPTY);
+    next[r] = head[g];
+    head[g] = r;
+  }
+
+  // Probe with the left side in parallel.
+  size_t const parts = num_parts(left.num_rows, threads);
+  std::vector<std::vector<size_t>> lrows(parts), rrows(parts);
+  run_parallel(parts, [&](size_t const part) {
+    size_t const end = left.num_rows * (part + 1) / parts;
+    for (size_t l = left.num_rows * part / parts; l < end; ++l) {
+      if (!lkey.is_valid(l))
+        continue;
+      int64_t const key = lkey.as_key(l);
+      auto const g = groups.find(&key);
+      if (g != EMPTY)
+        for (size_t r = head[g]; r != EMPTY; r = next[r]) {
+          lrows[part].push_back(l);
+          rrows[part].push_back(r);
+        }
+    }
+  });
+
+  Frame frame;
+  auto gather = [&](Frame const& src, std::vector<std::vector<size_t>> const& rows, size_t c) {
+    SeriesBuilder builder(src.series[c], parts);
+    run_parallel(parts, [&](size_t const part) {
+      builder.gather(part, src.series[c], rows[part].data(), rows[part].size());
+    });
+    frame.add(src.names[c], builder.finish());
+  };
+  for (size_t c = 0; c < left.names.size(); ++c)
+    gather(left, lrows, c);
+  for (size_t c = 0; c < right.names.size(); ++c)
+    if (right.names[c] != node.right_key)
+      gather(right, rrows, c);
+  frame.num_rows = 0;
+  for (auto const& rows : lrows)
+    frame.num_rows += rows.size();
+  return frame;
+}
+
+
+Frame
+run(
+  PlanNode const& node,
+  Catalog const& catalog,
+  unsigned const threads)
+{
+  switch (node.kind) {
+  case PlanNode::SCAN:
+    return scan(node, *catalog.at(node.table));
+
+  case PlanNode::FILTER:
+  case PlanNode::PROJECT:
+  case PlanNode::PIPELINE:
+    return run_pipeline(node, run(*node.inputs[0], catalog, threads), threads);
+
+  case PlanNode::SELECT: {
+    auto const input = run(*node.inputs[0], catalog, threads);
+    Frame frame;
+    for (auto const& name : node.columns)
+      frame.add(name, input[name]);
+    frame.num_rows = input.num_rows;
+    return frame;
+    }
+
+  case PlanNode::AGGREGATE:
+    return run_aggregate(node, run(*node.inputs[0], catalog, threads), threads);
+
+  case PlanNode::JOIN:
+    return run_join(
+      node,
+      run(*node.inputs[0], catalog, threads),
+      run(*node.inputs[1], catalog, threads),
+      threads);
+  }
+  return Frame();
+}
+
+
+Table
+to_table(
+  Frame const& frame)
+{
+  Table table;
+  for (size_t c = 0; c < frame.names.size(); ++c) {
+    auto const& series = frame.series[c];
+    with_type(series.dtype, [&](auto tag) {
+      using T = typename decltype(tag)::type;
+      ColumnBuilder<T> builder(series.dtype);
+      builder.reserve(series.size);
+      T const* const vals = series.values<T>();
+      for (size_t i = 0; i < series.size; ++i)
+        if (!series.is_valid(i))
+          builder.append_null();
+        else if (series.dtype != DType::ID)
+          builder.append(vals[i]);
+        else if (series.dict != nullptr
+                 && (size_t) vals[i] < series.dict->size())
+          builder.append_str((*series.dict)[vals[i]]);
+        else
+          builder.append_null();
+      table.add(frame.names[c], builder.finish());
+    });
+  }
+  return table;
+}
+
+
+bool
+has_join(
+  PlanNode const& node)
+{
+  if (node.kind == PlanNode::JOIN)
+    return true;
+  for (auto const& input : node.inputs)
+    if (has_join(*input))
+      return true;
+  return false;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+AggregateState::AggregateState()
+{
+}
+
+
+AggregateState::AggregateState(AggregateState&&) = default;
+AggregateState& AggregateState::operator=(AggregateState&&) = default;
+
+AggregateState::~AggregateState()
+{
+}
+
+
+size_t
+AggregateState::num_groups()
+  const
+{
+  return groups_ ? groups_->groups.size() : 0;
+}
+
+
+void
+AggregateState::merge(
+  AggregateState const& other)
+{
+  if (!other.groups_)
+    return;
+  if (!groups_)
+    groups_.reset(new AggregateGroups(
+      other.groups_->dicts.size(), other.groups_->num_aggs));
+  groups_->merge(*other.groups_);
+}
+
+//------------------------------------------------------------------------------
+
+Plan::Plan(
+  Json const& json,
+  Catalog const& catalog)
+: Plan(json, catalog, Options())
+{
+}
+
+
+Plan::Plan(
+  Json const& json,
+  Catalog const& catalog,
+  Options const& options)
+: catalog_(catalog),
+  options_(options),
+  root_(parse_node(json))
+{
+  resolve(*root_, catalog_);
+  if (options_.optimize) {
+    root_ = push_down(root_);
+    resolve(*root_, catalog_);
+    root_ = fuse(root_);
+    resolve(*root_, catalog_);
+    std::set<std::string> required;
+    for (auto const& col : root_->schema)
+      required.insert(col.first);
+    prune(*root_, required);
+    resolve(*root_, catalog_);
+  }
+}
+
+
+Plan::~Plan()
+{
+}
+
+
+Json
+Plan::to_json()
+  const
+{
+  return node_to_json(*root_);
+}
+
+
+Table
+Plan::execute()
+  const
+{
+  return to_table(run(*root_, catalog_, num_threads(options_.num_threads)));
+}
+
+
+AggregateState
+Plan::aggregate(
+  Catalog const& catalog)
+  const
+{
+  if (root_->kind != PlanNode::AGGREGATE)
+    throw PlanError("not an aggregate plan");
+  if (has_join(*root_))
+    throw PlanError("can't aggregate a join incrementally");
+  unsigned const threads = num_threads(options_.num_threads);
+  AggregateState state;
+  state.groups_ = aggregate_groups(
+    *root_, run(*root_->inputs[0], catalog, threads), threads);
+  return state;
+}
+
+
+Table
+Plan::finish(
+  AggregateState const& state)
+  const
+{
+  assert(root_->kind == PlanNode::AGGREGATE);
+  if (state.groups_)
+    return to_table(finish_groups(*root_, *state.groups_));
+  AggregateGroups const empty(root_->keys.size(), root_->aggs.size());
+  return to_table(finish_groups(*root_, empty));
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "column.hh"
+#include "json.hh"
+
+//------------------------------------------------------------------------------
+// Query plans described in JSON.
+//
+// A plan is a tree of operators, each a JSON object with an "op" field:
+//
+//   {"op": "scan", "table": NAME}
+//   {"op": "filter", "input": PLAN, "pred": EXPR}
+//   {"op": "project", "input": PLAN, "columns": {NAME: EXPR, ...}}
+//   {"op": "select", "input": PLAN, "columns": [NAME, ...]}
+//   {"op": "aggregate", "input": PLAN, "by": [KEY, ...],
+//    "aggs": {NAME: [FN, EXPR], ...}}
+//   {"op": "join", "left": PLAN, "right": PLAN, "on": NAME | [NAME, NAME]}
+//
+// "project" adds computed f64 columns to its input's columns.  Each KEY is an
+// i64, time, or id column name, or {"bucket": NAME, "width": N, "as": NAME} to
+// group an i64 or time column into buckets of width N.  FN is one of count,
+// sum, mean, min, max, first, last, std, quantile; count takes no EXPR, and
+// quantile takes a fraction Q after it, as [quantile, EXPR, Q].  Quantiles are
+// approximate, from a mergeable sketch (see quantile.hh).  "join" is an inner
+// equijoin on one key column from each side.
+//
+// Null values of any type are read as NaN in expressions, which aggregates
+// ignore.  Rows with null keys form their own groups, whose keys are output as
+// null, and match nothing in joins.  An aggregate without keys returns one row,
+// even with no input rows.
+//
+// An EXPR is a number, a column name, true, false, or [OP, EXPR...] where OP
+// is one of + - * / min max < <= > >= == != and or (binary), or neg abs sqrt
+// log exp not (unary).  Expressions are evaluated in f64.
+//
+// Before execution, a plan is validated against the catalog and optimized:
+// filters are pushed below projections, joins, and other filters; chains of
+// filters and projections are fused into pipelines that evaluate a chunk of
+// rows at a time without materializing intermediate columns; and unused
+// columns are pruned, down to the scans.
+//
+// An aggregate plan without joins can also be run incrementally: its groups
+// and their aggregates' states over some rows are an `AggregateState`, and the
+// states of consecutive runs of rows merge into the state of all of them, from
+// which the plan's result is finished.  See live_table.hh.
+//------------------------------------------------------------------------------
+
+class PlanError
+  : public std::runtime_error
+{
+public:
+
+  using std::runtime_error::runtime_error;
+
+};
+
+
+/*
+ * Tables available to plans, by name.
+ */
+using Catalog = std::map<std::string, Table const*>;
+
+struct PlanNode;
+struct AggregateGroups;
+
+/*
+ * The groups of an aggregate plan, and their aggregates' mergeable states, over
+ * some of the plan's input rows.
+ *
+ * ID keys refer to the dictionaries of the tables aggregated, which must
+ * outlive the state.
+ */
+class AggregateState
+{
+public:
+
+  AggregateState();
+  AggregateState(AggregateState&&);
+  AggregateState& operator=(AggregateState&&);
+  ~AggregateState();
+
+  size_t num_groups() const;
+
+  /*
+   * Merges in `other`, which must be of the same plan, over rows that follow
+   * this state's.  Dictionaries of ID keys must agree on the codes they share,
+   * as when one extends the other.
+   */
+  void merge(AggregateState const& other);
+
+private:
+
+  std::unique_ptr<AggregateGroups> groups_;
+
+  friend class Plan;
+
+};
+
+
+class Plan
+  : public aslib::json::Serializable
+{
+public:
+
+  struct Options
+  {
+    bool optimize = true;
+    // Number of execution threads; 0 for one per hardware thread.
+    unsigned num_threads = 0;
+  };
+
+  /*
+   * Parses, validates, and optimizes a plan.  Throws `PlanError` if the plan
+   * is invalid.
+   */
+  Plan(aslib::json::Json const& json, Catalog const& catalog);
+  Plan(aslib::json::Json const& json, Catalog const& catalog, Options const&);
+  ~Plan() override;
+
+  /*
+   * Returns the plan, as optimized, in the same JSON form, which parses back
+   * to the same plan.  Fused filters and projections appear as
+   *
+   *   {"op": "pipeline", "input": PLAN,
+   *    "stages": [{"filter": EXPR} | {"name": NAME, "project": EXPR}, ...],
+   *    "columns": [NAME, ...]}
+   *
+   * whose stages are evaluated in order, and whose output is `columns`, if
+   * given, or else the input's and the projected columns.
+   */
+  aslib::json::Json to_json() const override;
+
+  Table execute() const;
+
+  /*
+   * Aggregates the rows of the tables in `catalog`, which must have the
+   * schemas of those the plan was built with, without finishing the
+   * aggregates.  Throws `PlanError` unless the plan is an aggregate without
+   * joins.
+   */
+  AggregateState aggregate(Catalog const& catalog) const;
+
+  /*
+   * Returns the plan's result for the rows aggregated into `state`.
+   */
+  Table finish(AggregateState const& state) const;
+
+private:
+
+  Catalog const catalog_;
+  Options const options_;
+  std::shared_ptr<PlanNode> root_;
+
+};
+
+
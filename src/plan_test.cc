@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "plan.hh"
+#include "test.hh"
+
+using aslib::json::Json;
+
+//------------------------------------------------------------------------------
+// Tests of plan execution: with null values, and optimized against not.
+//------------------------------------------------------------------------------
+
+namespace {
+
+Table
+execute(
+  std::string const& plan,
+  Catalog const& catalog,
+  bool const optimize=true)
+{
+  Plan::Options options;
+  options.optimize = optimize;
+  return Plan(aslib::json::parse(plan), catalog, options).execute();
+}
+
+
+/*
+ * k: i64 [1, null, 1, null, 2]
+ * s: id  [a, b, null, null, a]
+ * v: f64 [1, 2, 3, 4, null]
+ */
+Table
+make_table()
+{
+  AnyColumnBuilder k(DType::I64);
+  AnyColumnBuilder s(DType::ID);
+  AnyColumnBuilder v(DType::F64);
+  k.i64.append(1); k.append_null(); k.i64.append(1); k.append_null();
+  k.i64.append(2);
+  s.id.append_str("a"); s.id.append_str("b"); s.append_null();
+  s.append_null(); s.id.append_str("a");
+  v.f64.append(1); v.f64.append(2); v.f64.append(3); v.f64.append(4);
+  v.append_null();
+  Table table;
+  table.add("k", k.finish());
+  table.add("s", s.finish());
+  table.add("v", v.finish());
+  return table;
+}
+
+
+std::string
+id_at(
+  Table const& table,
+  std::string const& name,
+  size_t const i)
+{
+  auto const& col = column_cast<uint32_t>(table[name]);
+  return col.is_valid(i) ? col.dictionary()[col[i]] : "<null>";
+}
+
+
+void
+test_null_int_keys()
+{
+  auto const table = make_table();
+  auto const result = execute(
+    R"({"op": "aggregate", "input": {"op": "scan", "table": "t"},
+        "by": ["k"], "aggs": {"n": ["count"], "sum": ["sum", "v"]}})",
+    {{"t", &table}});
+  auto const& k = column_cast<int64_t>(result["k"]);
+  auto const& n = column_cast<int64_t>(result["n"]);
+  auto const& sum = column_cast<double>(result["sum"]);
+  CHECK(result.num_rows() == 3);
+  // Groups in order of first appearance: 1, null, 2.
+  CHECK(k.is_valid(0) && k[0] == 1 && n[0] == 2 && sum[0] == 4);
+  CHECK(!k.is_valid(1) && n[1] == 2 && sum[1] == 6);
+  CHECK(k.is_valid(2) && k[2] == 2 && n[2] == 1);
+}
+
+
+void
+test_null_id_keys()
+{
+  auto const table = make_table();
+  auto const result = execute(
+    R"({"op": "aggregate", "input": {"op": "scan", "table": "t"},
+        "by": ["s"], "aggs": {"n": ["count"]}})",
+    {{"t", &table}});
+  auto const& n = column_cast<int64_t>(result["n"]);
+  CHECK(result.num_rows() == 3);
+  CHECK(id_at(result, "s", 0) == "a" && n[0] == 2);
+  CHECK(id_at(result, "s", 1) == "b" && n[1] == 1);
+  CHECK(id_at(result, "s", 2) == "<null>" && n[2] == 2);
+}
+
+
+void
+test_all_null_id()
+{
+  AnyColumnBuilder s(DType::ID);
+  s.append_null();
+  s.append_null();
+  Table table;
+  table.add("s", s.finish());
+
+  auto const scanned
+    = execute(R"({"op": "scan", "table": "t"})", {{"t", &table}});
+  CHECK(scanned.num_rows() == 2);
+  CHECK(!scanned["s"].is_valid(0) && !scanned["s"].is_valid(1));
+
+  auto const grouped = execute(
+    R"({"op": "aggregate", "input": {"op": "scan", "table": "t"},
+        "by": ["s"], "aggs": {"n": ["count"]}})",
+    {{"t", &table}});
+  CHECK(grouped.num_rows() == 1);
+  CHECK(!grouped["s"].is_valid(0));
+  CHECK(column_cast<int64_t>(grouped["n"])[0] == 2);
+}
+
+
+void
+test_null_expressions()
+{
+  auto const table = make_table();
+  auto const result = execute(
+    R"({"op": "project", "input": {"op": "scan", "table": "t"},
+        "columns": {"w": ["+", "k", 1]}})",
+    {{"t", &table}});
+  auto const& w = column_cast<double>(result["w"]);
+  CHECK(w[0] == 2 && std::isnan(w[1]) && w[4] == 3);
+  // Passed-through columns keep their nulls.
+  CHECK(!result["k"].is_valid(1) && !result["v"].is_valid(4));
+}
+
+
+void
+test_empty_global_aggregate()
+{
+  auto const table = make_table();
+  auto const result = execute(
+    R"({"op": "aggregate",
+        "input": {"op": "filter", "input": {"op": "scan", "table": "t"},
+                  "pred": [">", "v", 100]},
+        "by": [], "aggs": {"n": ["count"], "sum": ["sum", "v"],
+                           "mean": ["mean", "v"]}})",
+    {{"t", &table}});
+  CHECK(result.num_rows() == 1);
+  CHECK(column_cast<int64_t>(result["n"])[0] == 0);
+  CHECK(column_cast<double>(result["sum"])[0] == 0);
+  CHECK(std::isnan(column_cast<double>(result["mean"])[0]));
+}
+
+
+void
+test_null_join_keys()
+{
+  auto const table = make_table();
+  auto const result = execute(
+    R"({"op": "join", "left": {"op": "scan", "table": "t"},
+        "right": {"op": "select", "input": {"op": "scan", "table": "t"},
+                  "columns": ["s"]},
+        "on": "s"})",
+    {{"t", &table}});
+  // a matches twice on each side, b once; nulls match nothing.
+  CHECK(result.num_rows() == 5);
+  for (size_t i = 0; i < result.num_rows(); ++i)
+    CHECK(id_at(result, "s", i) != "<null>");
+}
+
+
+/*
+ * Returns the rows of `table` as text, sorted, as optimization may reorder
+ * them.
+ */
+std::vector<std::string>
+sorted_rows(
+  Table const& table)
+{
+  std::vector<std::string> rows;
+  for (size_t i = 0; i < table.num_rows(); ++i) {
+    std::stringstream row;
+    for (size_t c = 0; c < table.num_columns(); ++c) {
+      auto const& col = table.column(c);
+      row << table.name(c) << "=";
+      if (!col.is_valid(i))
+        row << "null";
+      else
+        switch (col.dtype()) {
+        case DType::F64: row << column_cast<double>(col)[i]; break;
+        case DType::I64:
+        case DType::TIME: row << column_cast<int64_t>(col)[i]; break;
+        case DType::ID: row << id_at(table, table.name(c), i); break;
+        }
+      row << " ";
+    }
+    rows.push_back(row.str());
+  }
+  std::sort(rows.begin(), rows.end());
+  return rows;
+}
+
+
+/*
+ * Checks that `plan` has the same result optimized and not, with `rows` rows.
+ */
+void
+check_optimized(
+  std::string const& plan,
+  Catalog const& catalog,
+  size_t const rows,
+  int const line)
+{
+  auto const optimized = execute(plan, catalog);
+  auto const plain = execute(plan, catalog, false);
+  check(optimized.num_rows() == rows, "optimized rows", line);
+  check(plain.num_rows() == rows, "unoptimized rows", line);
+  check(
+    optimized.num_columns() == plain.num_columns(), "same columns", line);
+  check(sorted_rows(optimized) == sorted_rows(plain), "same rows", line);
+}
+
+
+/*
+ * a: k i64 [0, 10), s id [x, y, z, ...], v f64 [0, 10)
+ * b: s id [x, y, w], u f64 [1, 2, 3]
+ */
+struct Tables
+{
+  Table a;
+  Table b;
+  Catalog catalog() const { return {{"a", &a}, {"b", &b}}; }
+};
+
+
+Tables
+make_tables()
+{
+  Tables tables;
+  AnyColumnBuilder k(DType::I64);
+  AnyColumnBuilder s(DType::ID);
+  AnyColumnBuilder v(DType::F64);
+  for (int i = 0; i < 10; ++i) {
+    k.i64.append(i);
+    s.id.append_str(std::string(1, "xyz"[i % 3]));
+    v.f64.append(i);
+  }
+  tables.a.add("k", k.finish());
+  tables.a.add("s", s.finish());
+  tables.a.add("v", v.finish());
+
+  AnyColumnBuilder bs(DType::ID);
+  AnyColumnBuilder u(DType::F64);
+  for (int i = 0; i < 3; ++i) {
+    bs.id.append_str(std::string(1, "xyw"[i]));
+    u.f64.append(i + 1);
+  }
+  tables.b.add("s", bs.finish());
+  tables.b.add("u", u.finish());
+  return tables;
+}
+
+
+void
+test_fused_project_filter()
+{
+  auto const tables = make_tables();
+  // The filter uses the computed column, so stays above the projection, and
+  // both fuse into one pipeline.
+  check_optimized(
+    R"({"op": "filter", "pred": ["<", "w", 5],
+        "input": {"op": "project", "columns": {"w": ["+", "v", 1]},
+                  "input": {"op": "scan", "table": "a"}}})",
+    tables.catalog(), 4, __LINE__);
+  // Filters on both sides of a projection, some of which are pushed below.
+  check_optimized(
+    R"({"op": "filter", "pred": ["and", [">", "w", 2], ["<", "k", 8]],
+        "input": {"op": "project", "columns": {"w": ["*", "v", 2]},
+                  "input": {"op": "filter", "pred": ["!=", "k", 5],
+                            "input": {"op": "scan", "table": "a"}}}})",
+    tables.catalog(), 5, __LINE__);
+}
+
+
+void
+test_push_down_join()
+{
+  auto const tables = make_tables();
+  // One conjunct for each side, and one that needs both.
+  check_optimized(
+    R"({"op": "filter",
+        "pred": ["and", ["and", [">", "v", 2], ["<", "u", 3]],
+                 ["<", "v", ["*", "u", 4]]],
+        "input": {"op": "join", "on": "s",
+                  "left": {"op": "project", "columns": {"w": ["-", "v", 1]},
+                           "input": {"op": "scan", "table": "a"}},
+                  "right": {"op": "scan", "table": "b"}}})",
+    tables.catalog(), 3, __LINE__);
+}
+
+
+void
+test_push_down_aggregate()
+{
+  auto const tables = make_tables();
+  // The filter on the key is pushed below the aggregate; that on the
+  // aggregate isn't.
+  check_optimized(
+    R"({"op": "filter", "pred": ["and", ["<", "k", 6], [">", "total", 1]],
+        "input": {"op": "aggregate", "by": ["k"],
+                  "aggs": {"total": ["sum", "w"]},
+                  "input": {"op": "project", "columns": {"w": ["+", "v", 1]},
+                            "input": {"op": "scan", "table": "a"}}}})",
+    tables.catalog(), 5, __LINE__);
+  // A bucketed key isn't pushed down.
+  check_optimized(
+    R"({"op": "filter", "pred": [">=", "b", 4],
+        "input": {"op": "aggregate",
+                  "by": [{"bucket": "k", "width": 4, "as": "b"}],
+                  "aggs": {"n": ["count"]},
+                  "input": {"op": "scan", "table": "a"}}})",
+    tables.catalog(), 2, __LINE__);
+}
+
+
+void
+test_to_json_round_trip()
+{
+  auto const tables = make_tables();
+  auto const catalog = tables.catalog();
+  for (auto const& text : {
+      R"({"op": "filter", "pred": ["<", "w", 5],
+          "input": {"op": "project", "columns": {"w": ["+", "v", 1]},
+                    "input": {"op": "scan", "table": "a"}}})",
+      R"({"op": "aggregate", "by": ["s"], "aggs": {"n": ["count"]},
+          "input": {"op": "filter", "pred": [">", "u", 1],
+                    "input": {"op": "join", "on": "s",
+                              "left": {"op": "scan", "table": "a"},
+                              "right": {"op": "scan", "table": "b"}}}})"}) {
+    Plan const plan(aslib::json::parse(text), catalog);
+    std::stringstream json;
+    json << plan.to_json();
+    CHECK(json.str().find("pipeline") != std::string::npos);
+
+    // The optimized plan parses back to itself.
+    Plan const parsed(aslib::json::parse(json.str()), catalog);
+    std::stringstream reparsed;
+    reparsed << parsed.to_json();
+    CHECK(reparsed.str() == json.str());
+    CHECK(sorted_rows(parsed.execute()) == sorted_rows(plan.execute()));
+  }
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+int
+main()
+{
+  test_null_int_keys();
+  test_null_id_keys();
+  test_all_null_id();
+  test_null_expressions();
+  test_empty_global_aggregate();
+  test_null_join_keys();
+  test_fused_project_filter();
+  test_push_down_join();
+  test_push_down_aggregate();
+  test_to_json_round_trip();
+
+  return test_result("plan_test");
+}
+
+
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.hh"
+#include "parallel.hh"
+#include "quantile.hh"
+
+//------------------------------------------------------------------------------
+// Exact and approximate quantiles, and top-k selection, against full sorts.
+//
+// Inputs are `size` doubles, uniform in [0, 1) for `dist` 0, or for `dist` 1
+// returns with heavy tails: normal with a log-normal scale.  Quantiles are the
+// percentiles in `QS`.
+//
+// The `sort` benchmarks copy the input and sort it; `nth_element` copies it
+// and partitions it once per quantile.  Both include the copy, which in-place
+// algorithms need to keep the input.  `radix` selects without modifying the
+// input, and `kll` sketches each thread's part and merges the sketches; its
+// `rank_error` is the largest difference between the quantiles and the ranks
+// of the values returned, as a fraction of `size`.
+//
+// `topk/heap` finds the indices of the `k` largest values; `topk/sort` sorts a
+// copy of the values in descending order, for comparison.
+//------------------------------------------------------------------------------
+
+namespace {
+
+std::vector<long> const SIZES = {1000000, 10000000, 100000000};
+std::vector<double> const QS = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99};
+
+using Values = std::vector<double>;
+
+std::shared_ptr<Values>
+make_values(
+  size_t const size,
+  long const dist)
+{
+  auto const vals = std::make_shared<Values>(size);
+  std::mt19937_64 rng(42);
+  if (dist == 0) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (auto& val : *vals)
+      val = uniform(rng);
+  }
+  else {
+    std::normal_distribution<double> normal(0, 0.01);
+    std::lognormal_distribution<double> scale(0, 1);
+    for (auto& val : *vals)
+      val = normal(rng) * scale(rng);
+  }
+  return vals;
+}
+
+
+std::vector<size_t>
+ranks(
+  size_t const size)
+{
+  std::vector<size_t> ranks;
+  for (auto const q : QS)
+    ranks.push_back(quantile_rank(q, size));
+  return ranks;
+}
+
+
+/*
+ * Copies `vals` to `scratch` and partitions it at each of `ranks`, which are
+ * sorted.
+ */
+Values
+nth_elements(
+  Values const& vals,
+  Values& scratch,
+  std::vector<size_t> const& ranks)
+{
+  std::copy(vals.begin(), vals.end(), scratch.begin());
+  Values result;
+  size_t lo = 0;
+  for (auto const rank : ranks) {
+    if (rank >= lo) {
+      std::nth_element(
+        scratch.begin() + lo, scratch.begin() + rank, scratch.end());
+      lo = rank + 1;
+    }
+    result.push_back(scratch[rank]);
+  }
+  return result;
+}
+
+
+Values
+kll_quantiles(
+  Values const& vals,
+  unsigned const threads)
+{
+  size_t const size = vals.size();
+  std::vector<KllSketch<double>> sketches(threads);
+  run_parallel(threads, [&](size_t const t) {
+    size_t const begin = size * t / threads;
+    sketches[t].add(size * (t + 1) / threads - begin, vals.data() + begin);
+  });
+  for (unsigned t = 1; t < threads; ++t)
+    sketches[0].merge(sketches[t]);
+  return sketches[0].quantiles(QS);
+}
+
+
+std::vector<Axis>
+axes(
+  std::vector<long> const& threads)
+{
+  return {{"size", SIZES}, {"dist", {0, 1}}, {"threads", threads}};
+}
+
+
+}  // anonymous namespace
+
+static auto const reg_sort = register_benchmark(
+  "quantile/sort", axes({1}),
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    auto const scratch = std::make_shared<Values>(vals->size());
+    auto const rs = ranks(vals->size());
+    return Case{
+      [vals, scratch, rs]() {
+        std::copy(vals->begin(), vals->end(), scratch->begin());
+        std::sort(scratch->begin(), scratch->end());
+        for (auto const rank : rs)
+          do_not_optimize((*scratch)[rank]);
+      },
+      (long) vals->size(), {}, sizeof(double)};
+  },
+  {CacheState::WARM});
+
+static auto const reg_nth_element = register_benchmark(
+  "quantile/nth_element", axes({1}),
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    auto const scratch = std::make_shared<Values>(vals->size());
+    auto const rs = ranks(vals->size());
+    return Case{
+      [vals, scratch, rs]() {
+        do_not_optimize(nth_elements(*vals, *scratch, rs)[0]);
+      },
+      (long) vals->size(), {}, sizeof(double)};
+  },
+  {CacheState::WARM});
+
+static auto const reg_radix = register_benchmark(
+  "quantile/radix", axes(thread_counts()),
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    unsigned const threads = params.at("threads");
+    Values scratch(vals->size());
+    auto const ref = nth_elements(*vals, scratch, ranks(vals->size()));
+    auto const result = quantiles(vals->size(), vals->data(), QS, threads);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < QS.size(); ++i)
+      mismatches += result[i] != ref[i];
+
+    return Case{
+      [vals, threads]() {
+        do_not_optimize(
+          quantiles(vals->size(), vals->data(), QS, threads)[0]);
+      },
+      (long) vals->size(), {{"mismatches", (double) mismatches}},
+      sizeof(double)};
+  },
+  {CacheState::WARM});
+
+static auto const reg_kll = register_benchmark(
+  "quantile/kll", axes(thread_counts()),
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    unsigned const threads = params.at("threads");
+    size_t const size = vals->size();
+    auto const result = kll_quantiles(*vals, threads);
+    double error = 0;
+    for (size_t i = 0; i < QS.size(); ++i) {
+      size_t const rank = std::count_if(
+        vals->begin(), vals->end(),
+        [&](double const val) { return val < result[i]; });
+      error = std::max(error, std::abs(double(rank) / size - QS[i]));
+    }
+
+    return Case{
+      [vals, threads]() { do_not_optimize(kll_quantiles(*vals, threads)[0]); },
+      (long) size, {{"rank_error", error}}, sizeof(double)};
+  },
+  {CacheState::WARM});
+
+static auto const reg_topk_sort = register_benchmark(
+  "topk/sort", axes({1}),
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    auto const scratch = std::make_shared<Values>(vals->size());
+    return Case{
+      [vals, scratch]() {
+        std::copy(vals->begin(), vals->end(), scratch->begin());
+        std::sort(scratch->begin(), scratch->end(), std::greater<double>());
+        do_not_optimize((*scratch)[0]);
+      },
+      (long) vals->size(), {}, sizeof(double)};
+  },
+  {CacheState::WARM});
+
+static auto const reg_topk_heap = register_benchmark(
+  "topk/heap",
+  {{"size", SIZES}, {"dist", {0, 1}}, {"k", {10, 1000}},
+   {"threads", thread_counts()}},
+  [](Params const& params) {
+    auto const vals = make_values(params.at("size"), params.at("dist"));
+    size_t const k = params.at("k");
+    unsigned const threads = params.at("threads");
+
+    Values ref(*vals);
+    std::partial_sort(
+      ref.begin(), ref.begin() + k, ref.end(), std::greater<double>());
+    auto const result = top_k(vals->size(), vals->data(), k, threads);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < k; ++i)
+      mismatches += (*vals)[result[i]] != ref[i];
+
+    return Case{
+      [vals, k, threads]() {
+        do_not_optimize(top_k(vals->size(), vals->data(), k, threads)[0]);
+      },
+      (long) vals->size(), {{"mismatches", (double) mismatches}},
+      sizeof(double)};
+  },
+  {CacheState::WARM});
+
@@ -0,0 +1,640 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel.hh"
+
+//------------------------------------------------------------------------------
+// Quantiles and top-k selection.
+//
+// Values are ordered as sort.hh orders them: floating point values in IEEE
+// total order, so -0 precedes 0 and NaNs are at the ends.  `OrderKey` maps each
+// value to an unsigned integer key in the same order, on which the kernels
+// operate.
+//
+// `select_ranks()` finds exact order statistics without sorting, by radix
+// selection.  It histograms keys by their top bits within the keys' range,
+// keeps only the buckets that contain the ranks sought, and repeats on those
+// until few candidates remain.  The first pass reads the input three times:
+// for the range, the histogram, and to gather candidates, which are typically
+// a small fraction of it.
+//
+// `top_k()` keeps the best k values so far in a bounded heap.  Once the heap is
+// full, few values beat its minimum, so each block of values is compared with
+// it in vector registers, and only blocks with some value that beats it are
+// pushed into the heap value by value.
+//
+// `KllSketch` approximates quantiles of a stream in bounded memory, and the
+// sketches of parts or groups merge into a sketch of their union.
+//------------------------------------------------------------------------------
+
+/*
+ * Maps values of `T` to unsigned integer keys in the same order, and back.
+ */
+template<typename T, typename=void>
+struct OrderKey;
+
+template<typename T>
+struct OrderKey<T, std::enable_if_t<std::is_unsigned<T>::value>>
+{
+  static uint64_t key(T const val)      { return val; }
+  static T value(uint64_t const key)    { return (T) key; }
+};
+
+
+template<typename T>
+struct OrderKey<T, std::enable_if_t<std::is_signed<T>::value
+                                    && std::is_integral<T>::value>>
+{
+  static uint64_t constexpr SIGN = uint64_t(1) << 63;
+
+  static uint64_t key(T const val)      { return uint64_t(val) ^ SIGN; }
+  static T value(uint64_t const key)    { return (T) int64_t(key ^ SIGN); }
+};
+
+
+/*
+ * Floating point keys flip the sign bit of positive values and all bits of
+ * negative values.
+ */
+template<typename T>
+struct OrderKey<T, std::enable_if_t<std::is_floating_point<T>::value>>
+{
+  using Bits = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+  using SBits = std::make_signed_t<Bits>;
+  static_assert(sizeof(T) == sizeof(Bits), "unsupported float type");
+  static Bits constexpr SIGN = Bits(1) << (8 * sizeof(Bits) - 1);
+
+  static uint64_t
+  key(
+    T const val)
+  {
+    Bits bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits ^ (Bits(SBits(bits) >> (8 * sizeof(Bits) - 1)) | SIGN);
+  }
+
+  static T
+  value(
+    uint64_t const key)
+  {
+    Bits const bits = (Bits) key & SIGN ? (Bits) key ^ SIGN : ~(Bits) key;
+    T val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+
+// Bits of the key range that a selection pass resolves: enough for about 64
+// keys per bucket, within these bounds.  More buckets spread keys that cluster
+// in a few floating point exponents, but cost more to clear and scan.
+int constexpr SELECT_MIN_BITS = 8;
+int constexpr SELECT_MAX_BITS = 16;
+// Candidates below which selection finishes with `std::nth_element()`.
+size_t constexpr SELECT_SMALL = 1 << 12;
+// Values per thread below which selection doesn't add threads.
+size_t constexpr SELECT_PART = 1 << 16;
+
+struct SelectKey
+{
+  uint64_t operator()(uint64_t const key) const { return key; }
+};
+
+
+/*
+ * Finds the keys at ranks among the keys of `num` values `vals`, as computed
+ * by `key_of`.  `ranks` are pairs of rank and index in `out`, sorted by rank.
+ */
+template<typename T, typename KEY>
+void
+select_keys(
+  size_t const num,
+  T const* const vals,
+  KEY const& key_of,
+  std::vector<std::pair<size_t, size_t>> const& ranks,
+  uint64_t* const out,
+  unsigned const threads)
+{
+  if (num <= SELECT_SMALL) {
+    std::vector<uint64_t> keys(num);
+    for (size_t i = 0; i < num; ++i)
+      keys[i] = key_of(vals[i]);
+    // Each call partitions the keys after the last rank found.
+    size_t lo = 0;
+    for (auto const& rank : ranks) {
+      if (rank.first >= lo) {
+        std::nth_element(
+          keys.begin() + lo, keys.begin() + rank.first, keys.end());
+        lo = rank.first + 1;
+      }
+      out[rank.second] = keys[rank.first];
+    }
+    return;
+  }
+
+  size_t const parts
+    = std::max<size_t>(1, std::min<size_t>(threads, num / SELECT_PART));
+  auto const begin = [num, parts](size_t const part) {
+    return num * part / parts;
+  };
+
+  // Find the range of keys.
+  std::vector<std::pair<uint64_t, uint64_t>> ranges(parts);
+  run_parallel(parts, [&](size_t const part) {
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    size_t const end = begin(part + 1);
+    for (size_t i = begin(part); i < end; ++i) {
+      uint64_t const key = key_of(vals[i]);
+      min = std::min(min, key);
+      max = std::max(max, key);
+    }
+    ranges[part] = {min, max};
+  });
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  for (auto const& range : ranges) {
+    min = std::min(min, range.first);
+    max = std::max(max, range.second);
+  }
+  if (min == max) {
+    for (auto const& rank : ranks)
+      out[rank.second] = min;
+    return;
+  }
+  int const width = 64 - __builtin_clzll(max - min);
+  int const bits = std::min(
+    SELECT_MAX_BITS, std::max(SELECT_MIN_BITS, 58 - __builtin_clzll(num)));
+  int const shift = std::max(0, width - bits);
+  size_t const num_buckets = size_t(1) << std::min(width, bits);
+
+  // Count keys by bucket, in each part.  Loops copy what they use, since
+  // stores to counts might otherwise alias it.
+  std::vector<size_t> counts(parts * num_buckets, 0);
+  run_parallel(parts, [&, min, shift](size_t const part) {
+    size_t* const count = &counts[part * num_buckets];
+    size_t const end = begin(part + 1);
+    for (size_t i = begin(part); i < end; ++i)
+      ++count[(key_of(vals[i]) - min) >> shift];
+  });
+
+  // Find the bucket of each rank.  Keys in a bucket are all equal if the shift
+  // is 0; otherwise, the bucket's keys become candidates.
+  std::vector<int> slots(num_buckets, -1);
+  std::vector<std::vector<std::pair<size_t, size_t>>> slot_ranks;
+  size_t b = 0;
+  size_t start = 0;
+  size_t bucket_count = 0;
+  for (size_t p = 0; p < parts; ++p)
+    bucket_count += counts[p * num_buckets];
+  for (auto const& rank : ranks) {
+    while (rank.first >= start + bucket_count) {
+      start += bucket_count;
+      ++b;
+      bucket_count = 0;
+      for (size_t p = 0; p < parts; ++p)
+        bucket_count += counts[p * num_buckets + b];
+    }
+    if (shift == 0)
+      out[rank.second] = min + b;
+    else {
+      if (slots[b] < 0) {
+        slots[b] = slot_ranks.size();
+        slot_ranks.emplace_back();
+      }
+      slot_ranks[slots[b]].push_back({rank.first - start, rank.second});
+    }
+  }
+  if (slot_ranks.empty())
+    return;
+
+  // Gather candidates.  Each part writes its keys after those of earlier parts.
+  size_t const num_slots = slot_ranks.size();
+  std::vector<std::vector<uint64_t>> candidates(num_slots);
+  std::vector<size_t> offsets(parts * num_slots);
+  for (size_t bucket = 0; bucket < num_buckets; ++bucket)
+    if (slots[bucket] >= 0) {
+      size_t const s = slots[bucket];
+      size_t offset = 0;
+      for (size_t p = 0; p < parts; ++p) {
+        offsets[p * num_slots + s] = offset;
+        offset += counts[p * num_buckets + bucket];
+      }
+      candidates[s].resize(offset);
+    }
+  std::vector<uint64_t*> dests(num_slots);
+  for (size_t s = 0; s < num_slots; ++s)
+    dests[s] = candidates[s].data();
+  run_parallel(parts, [&, min, shift](size_t const part) {
+    size_t* const offset = &offsets[part * num_slots];
+    int const* const slot = slots.data();
+    uint64_t* const* const dest = dests.data();
+    size_t const end = begin(part + 1);
+    for (size_t i = begin(part); i < end; ++i) {
+      uint64_t const key = key_of(vals[i]);
+      int const s = slot[(key - min) >> shift];
+      if (s >= 0)
+        dest[s][offset[s]++] = key;
+    }
+  });
+
+  for (size_t s = 0; s < num_slots; ++s)
+    select_keys(
+      candidates[s].size(), candidates[s].data(), SelectKey(), slot_ranks[s],
+      out, threads);
+}
+
+
+/*
+ * Returns the values at `ranks`, each less than `num`, in the order of `num`
+ * values `vals`.  `vals` is not modified.
+ */
+template<typename T>
+std::vector<T>
+select_ranks(
+  size_t const num,
+  T const* const vals,
+  std::vector<size_t> const& ranks,
+  unsigned const threads=1)
+{
+  std::vector<std::pair<size_t, size_t>> sorted;
+  for (size_t i = 0; i < ranks.size(); ++i) {
+    assert(ranks[i] < num);
+    sorted.push_back({ranks[i], i});
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  std::vector<uint64_t> keys(ranks.size());
+  select_keys(
+    num, vals, [](T const val) { return OrderKey<T>::key(val); },
+    sorted, keys.data(), threads);
+
+  std::vector<T> result;
+  for (auto const key : keys)
+    result.push_back(OrderKey<T>::value(key));
+  return result;
+}
+
+
+/*
+ * Returns the rank of quantile `q`, in [0, 1], of `num` values: the nearest
+ * rank to q (num - 1).
+ */
+inline size_t
+quantile_rank(
+  double const q,
+  size_t const num)
+{
+  assert(num > 0);
+  return std::llround(std::min(1.0, std::max(0.0, q)) * (num - 1));
+}
+
+
+/*
+ * Returns quantiles `qs` of `num` > 0 values `vals`, by `quantile_rank()`.
+ */
+template<typename T>
+std::vector<T>
+quantiles(
+  size_t const num,
+  T const* const vals,
+  std::vector<double> const& qs,
+  unsigned const threads=1)
+{
+  std::vector<size_t> ranks;
+  for (auto const q : qs)
+    ranks.push_back(quantile_rank(q, num));
+  return select_ranks(num, vals, ranks, threads);
+}
+
+
+//------------------------------------------------------------------------------
+
+// Values per block compared with the heap's minimum at once.
+size_t constexpr TOP_K_BLOCK = 64;
+
+/*
+ * Returns the indices of the `k` largest of `num` values `vals`, largest first.
+ * Equal values are in index order, so the result is that of a stable sort.
+ *
+ * Each thread keeps a heap of its part's best values; the heaps are merged.
+ */
+template<typename T>
+std::vector<size_t>
+top_k(
+  size_t const num,
+  T const* const vals,
+  size_t k,
+  unsigned const threads=1)
+{
+  k = std::min(k, num);
+  if (k == 0)
+    return {};
+
+  // Key and index.
+  using Entry = std::pair<uint64_t, size_t>;
+  // Orders entries best first, so the heap's front is the worst.
+  auto const better = [](Entry const& a, Entry const& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  };
+
+  size_t const parts = std::max<size_t>(
+    1, std::min<size_t>(threads, num / std::max(k, SELECT_PART)));
+  std::vector<std::vector<Entry>> heaps(parts);
+  run_parallel(parts, [&](size_t const part) {
+    auto& heap = heaps[part];
+    heap.reserve(k);
+    size_t i = num * part / parts;
+    size_t const end = num * (part + 1) / parts;
+    for (; i < end && heap.size() < k; ++i) {
+      heap.push_back({OrderKey<T>::key(vals[i]), i});
+      std::push_heap(heap.begin(), heap.end(), better);
+    }
+
+    // Later values beat the worst entry only with a larger key.
+    auto const offer = [&](size_t const j) {
+      uint64_t const key = OrderKey<T>::key(vals[j]);
+      if (key > heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = {key, j};
+        std::push_heap(heap.begin(), heap.end(), better);
+      }
+    };
+
+    for (; i + TOP_K_BLOCK <= end; i += TOP_K_BLOCK) {
+      uint64_t const worst = heap.front().first;
+      T const* const block = vals + i;
+      // Not bool, which GCC doesn't vectorize.
+      uint64_t any = 0;
+      for (size_t j = 0; j < TOP_K_BLOCK; ++j)
+        any |= OrderKey<T>::key(block[j]) > worst;
+      if (any)
+        for (size_t j = i; j < i + TOP_K_BLOCK; ++j)
+          offer(j);
+    }
+    for (; i < end; ++i)
+      offer(i);
+  });
+
+  std::vector<Entry> entries;
+  for (auto const& heap : heaps)
+    entries.insert(entries.end(), heap.begin(), heap.end());
+  std::partial_sort(
+    entries.begin(), entries.begin() + k, entries.end(), better);
+  std::vector<size_t> result;
+  for (size_t i = 0; i < k; ++i)
+    result.push_back(entries[i].second);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+
+// Default accuracy parameter of `KllSketch`.
+unsigned constexpr KLL_K = 200;
+// Smallest capacity of any level of a `KllSketch`.
+size_t constexpr KLL_MIN_CAPACITY = 8;
+// Most values in the first level of a `KllSketch` sorted by counting.
+size_t constexpr KLL_SMALL_SORT = 64;
+
+/*
+ * A KLL sketch (Karnin, Lang, and Liberty, 2016) of a stream of values, for
+ * approximate quantiles.
+ *
+ * Values are kept in levels; a value in level h stands for 2^h values of the
+ * stream.  Capacities shrink by 2/3 per level down from the top, which holds
+ * `k`.  When the sketch is full, the lowest full level is sorted, and every
+ * other value, from a random offset, moves up a level.  Levels above the first
+ * are kept sorted, so values moving up are merged into them.  The sketch
+ * retains about 3k values, and a quantile's rank is within about 1.7 / k of
+ * the count with high probability.
+ *
+ * The random offsets come from a generator with a fixed seed, so results are
+ * reproducible for the same values and merges.
+ */
+template<typename T>
+class KllSketch
+{
+public:
+
+  explicit KllSketch(
+    unsigned const k=KLL_K)
+  : k_(std::max<size_t>(k, KLL_MIN_CAPACITY)),
+    levels_(1)
+  {
+    update_capacity();
+  }
+
+  // Number of values added.
+  uint64_t count() const                { return count_; }
+  // Number of values retained.
+  size_t size() const                   { return size_; }
+
+  void
+  add(
+    T const val)
+  {
+    levels_[0].push_back(val);
+    ++count_;
+    if (++size_ > capacity_)
+      compress();
+  }
+
+  void
+  add(
+    size_t const num,
+    T const* const vals)
+  {
+    for (size_t i = 0; i < num; ++i)
+      add(vals[i]);
+  }
+
+  /*
+   * Adds the values of another sketch.
+   */
+  void
+  merge(
+    KllSketch const& other)
+  {
+    if (levels_.size() < other.levels_.size())
+      levels_.resize(other.levels_.size());
+    for (size_t h = 0; h < other.levels_.size(); ++h) {
+      auto& level = levels_[h];
+      size_t const mid = level.size();
+      level.insert(
+        level.end(), other.levels_[h].begin(), other.levels_[h].end());
+      if (h > 0)
+        std::inplace_merge(
+          level.begin(), level.begin() + mid, level.end(), Less());
+    }
+    count_ += other.count_;
+    size_ += other.size_;
+    update_capacity();
+    while (size_ > capacity_)
+      compress();
+  }
+
+  /*
+   * Returns approximate quantiles `qs`, by `quantile_rank()`.  The sketch must
+   * not be empty.
+   */
+  std::vector<T>
+  quantiles(
+    std::vector<double> const& qs)
+    const
+  {
+    assert(count_ > 0);
+    // Retained values, with their weights, in order.
+    std::vector<std::pair<T, uint64_t>> items;
+    items.reserve(size_);
+    for (size_t h = 0; h < levels_.size(); ++h)
+      for (auto const val : levels_[h])
+        items.push_back({val, uint64_t(1) << h});
+    std::sort(
+      items.begin(), items.end(),
+      [](std::pair<T, uint64_t> const& a, std::pair<T, uint64_t> const& b) {
+        return Less()(a.first, b.first);
+      });
+
+    std::vector<T> result;
+    for (auto const q : qs) {
+      size_t const rank = quantile_rank(q, count_);
+      uint64_t weight = 0;
+      auto i = items.begin();
+      while ((weight += i->second) <= rank && i + 1 != items.end())
+        ++i;
+      result.push_back(i->first);
+    }
+    return result;
+  }
+
+  T quantile(double const q) const      { return quantiles({q})[0]; }
+
+private:
+
+  struct Less
+  {
+    bool
+    operator()(
+      T const a,
+      T const b)
+      const
+    {
+      return OrderKey<T>::key(a) < OrderKey<T>::key(b);
+    }
+  };
+
+  /*
+   * Sorts the first level.  It's usually small, so a value's position is the
+   * number of values that precede it, which vectorizes without the branch
+   * mispredictions of an insertion sort.
+   */
+  void
+  sort_level(
+    std::vector<T>& level)
+  {
+    size_t const num = level.size();
+    if (num > KLL_SMALL_SORT) {
+      std::sort(level.begin(), level.end(), Less());
+      return;
+    }
+    uint64_t keys[KLL_SMALL_SORT];
+    for (size_t i = 0; i < num; ++i)
+      keys[i] = OrderKey<T>::key(level[i]);
+    scratch_.resize(num);
+    for (size_t i = 0; i < num; ++i) {
+      // Equal values precede if they're earlier.
+      size_t pos = 0;
+      for (size_t j = 0; j < i; ++j)
+        pos += keys[j] <= keys[i];
+      for (size_t j = i + 1; j < num; ++j)
+        pos += keys[j] < keys[i];
+      scratch_[pos] = level[i];
+    }
+    level.swap(scratch_);
+  }
+
+  /*
+   * Computes level capacities, which depend on the number of levels.
+   */
+  void
+  update_capacity()
+  {
+    size_t const num = levels_.size();
+    capacities_.resize(num);
+    capacity_ = 0;
+    for (size_t h = 0; h < num; ++h) {
+      double const depth = num - 1 - h;
+      capacities_[h] = std::max<size_t>(
+        KLL_MIN_CAPACITY, std::ceil(k_ * std::pow(2.0 / 3, depth)));
+      capacity_ += capacities_[h];
+    }
+  }
+
+  bool
+  random_bit()
+  {
+    // xorshift64.
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 7;
+    seed_ ^= seed_ << 17;
+    return seed_ >> 63;
+  }
+
+  /*
+   * Compacts the lowest full level into the next.
+   */
+  void
+  compress()
+  {
+    size_t h = 0;
+    while (levels_[h].size() < capacities_[h])
+      ++h;
+    if (h + 1 == levels_.size()) {
+      levels_.emplace_back();
+      update_capacity();
+    }
+
+    auto& level = levels_[h];
+    if (h == 0)
+      sort_level(level);
+    // If the level is odd, its last value stays.
+    size_t const num = level.size() & ~size_t(1);
+    size_t half = 0;
+    for (size_t i = random_bit(); i < num; i += 2)
+      level[half++] = level[i];
+    auto& next = levels_[h + 1];
+    scratch_.resize(next.size() + half);
+    std::merge(
+      next.begin(), next.end(), level.begin(), level.begin() + half,
+      scratch_.begin(), Less());
+    next.swap(scratch_);
+    level.erase(level.begin(), level.begin() + num);
+    size_ -= num / 2;
+  }
+
+  size_t k_;
+  std::vector<std::vector<T>> levels_;
+  uint64_t count_ = 0;
+  size_t size_ = 0;
+  // Capacity of each level, and in total.
+  std::vector<size_t> capacities_;
+  size_t capacity_;
+  // Reused for merging values into a level.
+  std::vector<T> scratch_;
+  uint64_t seed_ = 0x9e3779b97f4a7c15;
+
+};
+
+
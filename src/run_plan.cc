@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "colfile.hh"
+#include "csv.hh"
+#include "format.hh"
+#include "json_stream.hh"
+#include "ndjson.hh"
+#include "plan.hh"
+#include "timing.hh"
+
+using aslib::json::Json;
+
+//------------------------------------------------------------------------------
+
+/*
+ * Formats a timestamp as ISO 8601 UTC, with nanoseconds.
+ */
+std::string
+format_time(
+  TimeNs const time)
+{
+  int64_t const ns_per_day = 86400000000000;
+  int64_t days = time / ns_per_day;
+  int64_t ns = time % ns_per_day;
+  if (ns < 0) {
+    --days;
+    ns += ns_per_day;
+  }
+
+  // Inverse of days_from_civil().
+  days += 719468;
+  int64_t const era = (days >= 0 ? days : days - 146096) / 146097;
+  unsigned const doe = days - era * 146097;
+  unsigned const yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned const doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned const mp = (5 * doy + 2) / 153;
+  unsigned const d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned const m = mp < 10 ? mp + 3 : mp - 9;
+  int64_t const y = yoe + era * 400 + (m <= 2);
+
+  char buf[48];
+  snprintf(
+    buf, sizeof(buf), "%04ld-%02u-%02uT%02ld:%02ld:%02ld.%09ldZ",
+    (long) y, m, d,
+    (long) (ns / 3600000000000), (long) (ns / 60000000000 % 60),
+    (long) (ns / 1000000000 % 60), (long) (ns % 1000000000));
+  return buf;
+}
+
+
+void
+print_csv(
+  std::ostream& os,
+  Table const& table)
+{
+  for (size_t c = 0; c < table.num_columns(); ++c)
+    os << (c > 0 ? "," : "") << table.name(c);
+  os << "\n";
+
+  char buf[FORMAT_NUMBER_SIZE];
+  for (size_t i = 0; i < table.num_rows(); ++i) {
+    for (size_t c = 0; c < table.num_columns(); ++c) {
+      if (c > 0)
+        os << ",";
+      auto const& col = table.column(c);
+      if (!col.is_valid(i))
+        continue;
+      switch (col.dtype()) {
+      case DType::F64:
+        os.write(buf, format_double(column_cast<double>(col)[i], buf) - buf);
+        break;
+      case DType::I64:
+        os.write(buf, format_int64(column_cast<int64_t>(col)[i], buf) - buf);
+        break;
+      case DType::TIME: os << format_time(column_cast<int64_t>(col)[i]); break;
+      case DType::ID: {
+        auto const& id = column_cast<uint32_t>(col);
+        os << id.dictionary()[id[i]];
+        } break;
+      }
+    }
+    os << "\n";
+  }
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  auto const usage = [&]() {
+    std::cerr << "usage: " << argv[0]
+              << " [--explain] [--no-optimize] [--threads N]"
+              << " PLAN NAME=PATH:TYPES ...\n"
+              << "For .ndjson or .jsonl, TYPES are FIELD:TYPE,...\n"
+              << "For .col column files, omit :TYPES.\n";
+    return EXIT_FAILURE;
+  };
+
+  bool explain = false;
+  Plan::Options options;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    std::string const arg = argv[i];
+    if (arg == "--explain")
+      explain = true;
+    else if (arg == "--no-optimize")
+      options.optimize = false;
+    else if (arg == "--threads" && i + 1 < argc)
+      options.num_threads = parse_size(argv[++i]);
+    else
+      return usage();
+  }
+  if (argc - i < 2)
+    return usage();
+
+  try {
+    std::ifstream file(argv[i]);
+    if (!file) {
+      std::cerr << "can't read " << argv[i] << "\n";
+      return EXIT_FAILURE;
+    }
+    auto const json = aslib::json::parse(file);
+
+    // Load the tables.
+    std::vector<std::unique_ptr<Table>> tables;
+    Catalog catalog;
+    for (++i; i < argc; ++i) {
+      std::string const arg = argv[i];
+      auto const eq = arg.find('=');
+      if (eq == std::string::npos)
+        return usage();
+      auto const start = Clock::now();
+      if (is_colfile_path(arg.substr(eq + 1)))
+        // A column file has its own schema.
+        tables.emplace_back(new Table(load_colfile(arg.substr(eq + 1))));
+      else {
+        // An NDJSON schema has colons, so the path ends at the first.
+        auto colon = arg.find(':', eq);
+        if (colon == std::string::npos)
+          return usage();
+        bool const ndjson
+          = is_ndjson_path(arg.substr(eq + 1, colon - eq - 1));
+        if (!ndjson)
+          colon = arg.rfind(':');
+        auto const path = arg.substr(eq + 1, colon - eq - 1);
+        auto const types = arg.substr(colon + 1);
+        tables.emplace_back(new Table(
+          ndjson ? load_ndjson(path, parse_ndjson_schema(types))
+          : load_csv(path, parse_csv_schema(types))));
+      }
+      catalog[arg.substr(0, eq)] = tables.back().get();
+      std::cerr << "loaded " << arg.substr(0, eq) << ": "
+                << tables.back()->num_rows() << " rows in "
+                << format_ns(time_since(start)) << "\n";
+    }
+
+    Plan const plan(json, catalog, options);
+    if (explain) {
+      std::cout << plan.to_json() << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    auto const start = Clock::now();
+    auto const result = plan.execute();
+    std::cerr << "executed: " << result.num_rows() << " rows in "
+              << format_ns(time_since(start)) << "\n";
+    print_csv(std::cout, result);
+  }
+  catch (std::exception const& exc) {
+    std::cerr << "error: " << exc.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
@@ -0,0 +1,832 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "colfile.hh"
+#include "sort.hh"
+#include "timing.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+/*
+ * A key column, and how to map its values to ordered integers.
+ */
+struct KeySpec
+{
+  // Index of the column.
+  size_t col;
+  DType dtype;
+  // For ID columns, the rank of each code's string.
+  std::vector<uint64_t> ranks;
+};
+
+
+size_t
+find_column(
+  std::vector<std::string> const& names,
+  std::string const& name)
+{
+  for (size_t c = 0; c < names.size(); ++c)
+    if (names[c] == name)
+      return c;
+  throw std::out_of_range("no column: "s + name);
+}
+
+
+/*
+ * Returns the ordering of `keys`, with ID ranks from `dictionary(c)`.
+ */
+template<typename DICTIONARY>
+std::vector<KeySpec>
+make_keys(
+  std::vector<std::string> const& names,
+  std::vector<DType> const& dtypes,
+  DICTIONARY&& dictionary,
+  std::vector<std::string> const& keys)
+{
+  std::vector<KeySpec> specs;
+  for (auto const& key : keys) {
+    size_t const c = find_column(names, key);
+    specs.push_back({c, dtypes[c], {}});
+    if (dtypes[c] == DType::ID) {
+      std::vector<std::string> const& dict = dictionary(c);
+      std::vector<size_t> order(dict.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(
+        order.begin(), order.end(),
+        [&dict](size_t const a, size_t const b) { return dict[a] < dict[b]; });
+      auto& ranks = specs.back().ranks;
+      ranks.resize(dict.size());
+      for (size_t r = 0; r < order.size(); ++r)
+        ranks[order[r]] = r;
+    }
+  }
+  return specs;
+}
+
+
+/*
+ * Maps the values of a key column to unsigned integers in the same order.
+ */
+void
+normalize(
+  ColumnBase const& col,
+  KeySpec const& key,
+  std::vector<uint64_t>& out)
+{
+  size_t const num = col.size();
+  out.resize(num);
+  uint64_t constexpr SIGN = uint64_t(1) << 63;
+  switch (key.dtype) {
+  case DType::F64: {
+    auto const vals = column_cast<double>(col).data();
+    for (size_t i = 0; i < num; ++i) {
+      uint64_t bits;
+      memcpy(&bits, &vals[i], sizeof(bits));
+      // Flip all bits of negatives, and the sign bit of positives.
+      out[i] = bits ^ ((uint64_t) ((int64_t) bits >> 63) | SIGN);
+    }
+    } break;
+
+  case DType::I64:
+  case DType::TIME: {
+    auto const vals = column_cast<int64_t>(col).data();
+    for (size_t i = 0; i < num; ++i)
+      out[i] = (uint64_t) vals[i] ^ SIGN;
+    } break;
+
+  case DType::ID: {
+    auto const vals = column_cast<uint32_t>(col).data();
+    for (size_t i = 0; i < num; ++i)
+      // Nulls may have any code.
+      out[i] = vals[i] < key.ranks.size() ? key.ranks[vals[i]] : 0;
+    } break;
+  }
+}
+
+
+struct Pair
+{
+  uint64_t key;
+  size_t index;
+};
+
+
+/*
+ * Returns the number of bits needed for values up to `max`.
+ */
+inline int
+bit_width(
+  uint64_t const max)
+{
+  return max == 0 ? 0 : 64 - __builtin_clzll(max);
+}
+
+
+// Bits of the key range by which keys are first distributed to buckets.
+int constexpr BUCKET_BITS = 11;
+
+/*
+ * Sorts `pairs` by key, stably.
+ *
+ * Keys are first distributed to buckets by their top bits above the least
+ * key.  Each bucket, which is usually small enough to stay in cache, is then
+ * sorted by its remaining bits with an LSD radix sort on bytes, skipping
+ * bytes where all of its keys agree.  Sorting the whole array by bytes instead
+ * would scatter it across memory in each pass.
+ */
+void
+radix_sort(
+  std::vector<Pair>& pairs,
+  std::vector<Pair>& tmp)
+{
+  size_t const num = pairs.size();
+  if (num < 2)
+    return;
+  tmp.resize(num);
+
+  uint64_t min = pairs[0].key;
+  uint64_t max = pairs[0].key;
+  for (auto const& pair : pairs) {
+    min = std::min(min, pair.key);
+    max = std::max(max, pair.key);
+  }
+  int const shift = std::max(0, bit_width(max - min) - BUCKET_BITS);
+
+  // Distribute to buckets, into `tmp`.
+  size_t constexpr NUM_BUCKETS = size_t(1) << BUCKET_BITS;
+  std::vector<size_t> starts(NUM_BUCKETS + 1, 0);
+  for (auto const& pair : pairs)
+    ++starts[((pair.key - min) >> shift) + 1];
+  for (size_t b = 0; b < NUM_BUCKETS; ++b)
+    starts[b + 1] += starts[b];
+  std::vector<size_t> offsets(starts.begin(), starts.end() - 1);
+  for (auto const& pair : pairs)
+    tmp[offsets[(pair.key - min) >> shift]++] = pair;
+
+  // Sort each bucket by its low bits, back into `pairs`.
+  int const num_digits = (shift + 7) / 8;
+  size_t counts[8][256];
+  for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+    size_t const size = starts[b + 1] - starts[b];
+    Pair* src = &tmp[starts[b]];
+    Pair* dst = &pairs[starts[b]];
+    if (size > 1 && num_digits > 0) {
+      memset(counts, 0, sizeof(counts));
+      for (size_t i = 0; i < size; ++i)
+        for (int d = 0; d < num_digits; ++d)
+          ++counts[d][((src[i].key - min) >> (8 * d)) & 0xff];
+
+      for (int d = 0; d < num_digits; ++d) {
+        auto const count = counts[d];
+        if (count[((src[0].key - min) >> (8 * d)) & 0xff] == size)
+          continue;
+        size_t offset = 0;
+        for (int i = 0; i < 256; ++i)
+          offset += std::exchange(count[i], offset);
+        for (size_t i = 0; i < size; ++i)
+          dst[count[((src[i].key - min) >> (8 * d)) & 0xff]++] = src[i];
+        std::swap(src, dst);
+      }
+    }
+    if (src != &pairs[starts[b]])
+      std::copy(src, src + size, &pairs[starts[b]]);
+  }
+}
+
+
+/*
+ * Range of a key column's normalized values.
+ */
+struct KeyRange
+{
+  uint64_t min;
+  // Values above `min` span [0, max], with null, if any, as `max`.
+  uint64_t max;
+  // Bits to pack the values in; 65 if they don't fit.
+  int width;
+};
+
+
+std::vector<size_t>
+argsort(
+  Table const& table,
+  std::vector<KeySpec> const& keys)
+{
+  size_t const num = table.num_rows();
+  std::vector<Pair> pairs(num);
+  std::vector<Pair> tmp;
+
+  // Normalize each key, and find its range.
+  std::vector<std::vector<uint64_t>> vals(keys.size());
+  std::vector<KeyRange> ranges;
+  int total_width = 0;
+  for (size_t k = 0; k < keys.size(); ++k) {
+    auto const& col = table.column(keys[k].col);
+    normalize(col, keys[k], vals[k]);
+    uint64_t min = -1;
+    uint64_t max = 0;
+    bool has_null = false;
+    for (size_t i = 0; i < num; ++i)
+      if (col.is_valid(i)) {
+        min = std::min(min, vals[k][i]);
+        max = std::max(max, vals[k][i]);
+      }
+      else
+        has_null = true;
+    if (min > max)
+      ranges.push_back({0, 0, 0});
+    else if (has_null && max - min == (uint64_t) -1)
+      // No room for null.
+      ranges.push_back({min, 0, 65});
+    else
+      ranges.push_back(
+        {min, max - min + has_null, bit_width(max - min + has_null)});
+    total_width += ranges.back().width;
+  }
+
+  std::vector<size_t> perm(num);
+  if (total_width <= 64) {
+    // Pack all keys into one, with nulls above values, and sort once.
+    for (size_t i = 0; i < num; ++i) {
+      uint64_t key = 0;
+      for (size_t k = 0; k < keys.size(); ++k) {
+        auto const width = ranges[k].width;
+        if (width == 0)
+          continue;
+        auto const& col = table.column(keys[k].col);
+        key = (width == 64 ? 0 : key << width)
+          | (col.is_valid(i) ? vals[k][i] - ranges[k].min : ranges[k].max);
+      }
+      pairs[i] = {key, i};
+    }
+    radix_sort(pairs, tmp);
+    for (size_t i = 0; i < num; ++i)
+      perm[i] = pairs[i].index;
+    return perm;
+  }
+
+  // Sort stably by each key, from the last to the first.
+  std::iota(perm.begin(), perm.end(), 0);
+  for (size_t k = keys.size(); k-- > 0; ) {
+    auto const& col = table.column(keys[k].col);
+    // Nulls' values are arbitrary, so give them all the same key, to keep
+    // their order from the later keys.
+    for (size_t i = 0; i < num; ++i)
+      pairs[i] = {col.is_valid(perm[i]) ? vals[k][perm[i]] : 0, perm[i]};
+    radix_sort(pairs, tmp);
+    for (size_t i = 0; i < num; ++i)
+      perm[i] = pairs[i].index;
+    if (col.has_validity())
+      std::stable_partition(
+        perm.begin(), perm.end(),
+        [&col](size_t const i) { return col.is_valid(i); });
+  }
+  return perm;
+}
+
+
+template<typename T>
+std::unique_ptr<ColumnBase>
+take_column(
+  ColumnBase const& col,
+  std::vector<size_t> const& indices)
+{
+  auto const& src = column_cast<T>(col);
+  size_t const num = indices.size();
+  std::vector<T> values(num);
+  for (size_t i = 0; i < num; ++i)
+    values[i] = src[indices[i]];
+
+  std::vector<uint64_t> validity;
+  if (src.has_validity()) {
+    validity.assign((num + 63) / 64, 0);
+    for (size_t i = 0; i < num; ++i)
+      validity[i / 64] |= uint64_t(src.is_valid(indices[i])) << (i % 64);
+  }
+
+  return std::unique_ptr<ColumnBase>(new Column<T>(
+    src.dtype(), std::move(values), std::move(validity), src.dictionary()));
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+std::vector<size_t>
+argsort(
+  Table const& table,
+  std::vector<std::string> const& keys)
+{
+  std::vector<std::string> names;
+  std::vector<DType> dtypes;
+  for (size_t c = 0; c < table.num_columns(); ++c) {
+    names.push_back(table.name(c));
+    dtypes.push_back(table.column(c).dtype());
+  }
+  auto const dictionary = [&table](size_t const c)
+    -> std::vector<std::string> const& {
+    return column_cast<uint32_t>(table.column(c)).dictionary();
+  };
+  return argsort(table, make_keys(names, dtypes, dictionary, keys));
+}
+
+
+Table
+take(
+  Table const& table,
+  std::vector<size_t> const& indices)
+{
+  Table result;
+  for (size_t c = 0; c < table.num_columns(); ++c) {
+    auto const& col = table.column(c);
+    switch (col.dtype()) {
+    case DType::F64:
+      result.add(table.name(c), take_column<double>(col, indices));
+      break;
+    case DType::I64:
+    case DType::TIME:
+      result.add(table.name(c), take_column<int64_t>(col, indices));
+      break;
+    case DType::ID:
+      result.add(table.name(c), take_column<uint32_t>(col, indices));
+      break;
+    }
+  }
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+/*
+ * A temporary file in `dir`, removed when destroyed.
+ */
+class TempFile
+{
+public:
+
+  explicit TempFile(
+    std::string const& dir)
+  : path_(dir + "/datula-sort-XXXXXX.col")
+  {
+    int const fd = mkstemps(&path_[0], 4);
+    if (fd < 0)
+      throw ColFileError(
+        "can't create temporary file in "s + dir + ": " + strerror(errno));
+    close(fd);
+  }
+
+  TempFile(TempFile const&) = delete;
+  ~TempFile()                           { unlink(path_.c_str()); }
+
+  std::string const& path() const       { return path_; }
+
+private:
+
+  std::string path_;
+
+};
+
+
+/*
+ * A group of a run being merged.
+ */
+struct RunBlock
+{
+  Table table;
+  size_t num_rows;
+  // Values of each column.
+  std::vector<void const*> data;
+  // Key columns, and their normalized values.
+  std::vector<ColumnBase const*> key_cols;
+  std::vector<std::vector<uint64_t>> keys;
+};
+
+
+/*
+ * Reads a sorted run a group at a time.
+ */
+class RunReader
+{
+public:
+
+  RunReader(
+    std::string const& path,
+    std::vector<KeySpec> const& keys,
+    bool const read_ahead)
+  : file_(path),
+    keys_(keys),
+    read_ahead_(read_ahead)
+  {
+    next_group();
+  }
+
+  size_t file_size() const              { return file_.file_size(); }
+
+  // The current group, or null if the run is done.
+  RunBlock const* block() const         { return block_.get(); }
+  size_t row() const                    { return row_; }
+
+  /*
+   * Advances to the next row.  If that moves to the next group, returns the
+   * previous one, which callers may still be using.
+   */
+  std::shared_ptr<RunBlock>
+  advance()
+  {
+    if (++row_ < block_->num_rows)
+      return nullptr;
+    auto prev = std::move(block_);
+    next_group();
+    return prev;
+  }
+
+private:
+
+  std::shared_ptr<RunBlock>
+  load(
+    size_t const g)
+    const
+  {
+    std::shared_ptr<RunBlock> block(new RunBlock{file_.read(g, g + 1)});
+    auto const& table = block->table;
+    block->num_rows = table.num_rows();
+    for (size_t c = 0; c < table.num_columns(); ++c) {
+      auto const& col = table.column(c);
+      block->data.push_back(
+        col.dtype() == DType::F64
+          ? (void const*) column_cast<double>(col).data()
+        : col.dtype() == DType::ID
+          ? (void const*) column_cast<uint32_t>(col).data()
+        : (void const*) column_cast<int64_t>(col).data());
+    }
+    block->keys.resize(keys_.size());
+    for (size_t k = 0; k < keys_.size(); ++k) {
+      block->key_cols.push_back(&table.column(keys_[k].col));
+      normalize(*block->key_cols[k], keys_[k], block->keys[k]);
+    }
+    return block;
+  }
+
+  void
+  next_group()
+  {
+    size_t const g = group_++;
+    row_ = 0;
+    if (g >= file_.num_groups())
+      block_ = nullptr;
+    else {
+      block_ = next_.valid() ? next_.get() : load(g);
+      if (read_ahead_ && g + 1 < file_.num_groups())
+        next_ = std::async(
+          std::launch::async, [this, g]() { return load(g + 1); });
+    }
+  }
+
+  ColFileReader file_;
+  std::vector<KeySpec> const& keys_;
+  bool const read_ahead_;
+  // Index of the next group to load.
+  size_t group_ = 0;
+  std::shared_ptr<RunBlock> block_;
+  size_t row_ = 0;
+  std::future<std::shared_ptr<RunBlock>> next_;
+
+};
+
+
+/*
+ * A tournament tree that tracks the least of `num` sequences.
+ *
+ * Each internal node holds the loser of the match between its subtrees; node
+ * 0 holds the overall winner.  When the winner's sequence advances, only the
+ * matches on the path from its leaf to the root are replayed, with about
+ * log2(num) comparisons.
+ */
+template<typename LESS>
+class LoserTree
+{
+public:
+
+  LoserTree(
+    size_t const num,
+    LESS less)
+  : num_(num),
+    less_(less),
+    nodes_(num)
+  {
+    // Play all matches, from the leaves at `num + i` up.
+    std::vector<size_t> winners(2 * num);
+    for (size_t i = 0; i < num; ++i)
+      winners[num + i] = i;
+    for (size_t n = num - 1; n > 0; --n) {
+      auto const a = winners[2 * n];
+      auto const b = winners[2 * n + 1];
+      bool const b_wins = less_(b, a);
+      winners[n] = b_wins ? b : a;
+      nodes_[n] = b_wins ? a : b;
+    }
+    nodes_[0] = num > 1 ? winners[1] : 0;
+  }
+
+  size_t winner() const                 { return nodes_[0]; }
+
+  /*
+   * Updates the tree after the winner's sequence has advanced.
+   */
+  void
+  replay()
+  {
+    auto w = nodes_[0];
+    for (size_t n = (num_ + w) / 2; n > 0; n /= 2)
+      if (less_(nodes_[n], w))
+        std::swap(nodes_[n], w);
+    nodes_[0] = w;
+  }
+
+private:
+
+  size_t const num_;
+  LESS less_;
+  std::vector<size_t> nodes_;
+
+};
+
+
+/*
+ * Gathers column `c` from `(block, row)` sources.
+ */
+template<typename T>
+std::unique_ptr<ColumnBase>
+gather(
+  std::vector<std::pair<RunBlock const*, size_t>> const& sources,
+  size_t const c,
+  DType const dtype)
+{
+  size_t const num = sources.size();
+  std::vector<T> values(num);
+  bool has_null = false;
+  for (size_t i = 0; i < num; ++i) {
+    auto const& src = sources[i];
+    values[i] = ((T const*) src.first->data[c])[src.second];
+    has_null |= !src.first->table.column(c).is_valid(src.second);
+  }
+
+  std::vector<uint64_t> validity;
+  if (has_null) {
+    validity.assign((num + 63) / 64, 0);
+    for (size_t i = 0; i < num; ++i) {
+      auto const& src = sources[i];
+      validity[i / 64] |= uint64_t(src.first->table.column(c).is_valid(
+        src.second)) << (i % 64);
+    }
+  }
+  return std::unique_ptr<ColumnBase>(
+    new Column<T>(dtype, std::move(values), std::move(validity)));
+}
+
+
+/*
+ * Merges sorted runs into `out`.
+ */
+void
+merge(
+  std::vector<std::string> const& paths,
+  ColFileWriter& out,
+  ColFileReader const& schema,
+  std::vector<KeySpec> const& keys,
+  ExternalSortOptions const& options,
+  ExternalSortStats& stats)
+{
+  std::vector<std::unique_ptr<RunReader>> runs;
+  for (auto const& path : paths) {
+    runs.emplace_back(new RunReader(path, keys, options.read_ahead));
+    stats.bytes_read += runs.back()->file_size();
+  }
+
+  // Orders runs by their current rows.  Done runs are last, and ties go to the
+  // earlier run, for stability.
+  auto const less = [&runs, &keys](size_t const a, size_t const b) {
+    auto const ba = runs[a]->block();
+    auto const bb = runs[b]->block();
+    if (ba == nullptr || bb == nullptr)
+      return bb == nullptr && (ba != nullptr || a < b);
+    auto const ra = runs[a]->row();
+    auto const rb = runs[b]->row();
+    for (size_t k = 0; k < keys.size(); ++k) {
+      bool const va = ba->key_cols[k]->is_valid(ra);
+      bool const vb = bb->key_cols[k]->is_valid(rb);
+      if (va != vb)
+        return va;
+      if (va) {
+        auto const ka = ba->keys[k][ra];
+        auto const kb = bb->keys[k][rb];
+        if (ka != kb)
+          return ka < kb;
+      }
+    }
+    return a < b;
+  };
+  LoserTree<decltype(less)> tree(runs.size(), less);
+
+  // Rows of the next output group, and groups they refer to that the runs
+  // have moved past.
+  std::vector<std::pair<RunBlock const*, size_t>> sources;
+  std::vector<std::shared_ptr<RunBlock>> retired;
+  auto const flush = [&]() {
+    Table table;
+    for (size_t c = 0; c < schema.num_columns(); ++c) {
+      auto const dtype = schema.dtype(c);
+      table.add(
+        schema.name(c),
+        dtype == DType::F64 ? gather<double>(sources, c, dtype)
+        : dtype == DType::ID ? gather<uint32_t>(sources, c, dtype)
+        : gather<int64_t>(sources, c, dtype));
+    }
+    out.write(table);
+    sources.clear();
+    retired.clear();
+  };
+
+  sources.reserve(options.group_rows);
+  while (true) {
+    auto& run = *runs[tree.winner()];
+    if (run.block() == nullptr)
+      break;
+    sources.emplace_back(run.block(), run.row());
+    auto prev = run.advance();
+    if (prev)
+      retired.push_back(std::move(prev));
+    tree.replay();
+    if (sources.size() == options.group_rows)
+      flush();
+  }
+  if (!sources.empty())
+    flush();
+}
+
+
+}  // anonymous namespace
+
+ExternalSortStats
+external_sort(
+  std::string const& in_path,
+  std::string const& out_path,
+  std::vector<std::string> const& keys,
+  ExternalSortOptions const& options)
+{
+  ExternalSortStats stats;
+  ColFileReader const input(in_path);
+  auto const specs = make_keys(
+    input.names(), input.dtypes(),
+    [&input](size_t const c) -> std::vector<std::string> const& {
+      return input.dictionary(c);
+    },
+    keys);
+  stats.num_rows = input.num_rows();
+
+  // Output has the input's schema and dictionaries; runs have the same codes
+  // but omit the dictionaries.
+  auto const make_writer = [&input](
+    std::string const& path,
+    bool const dictionaries) {
+    std::unique_ptr<ColFileWriter> writer(
+      new ColFileWriter(path, input.names(), input.dtypes()));
+    if (dictionaries)
+      for (size_t c = 0; c < input.num_columns(); ++c)
+        if (input.dtype(c) == DType::ID)
+          writer->set_dictionary(c, input.dictionary(c));
+    return writer;
+  };
+
+  // Estimate memory per row: the input table, the one being read ahead, the
+  // sorted table, and argsort's keys, permutation, and pairs.
+  size_t row_size = 0;
+  for (auto const dtype : input.dtypes())
+    row_size += dtype == DType::ID ? sizeof(uint32_t) : sizeof(uint64_t);
+  size_t const sort_row_size
+    = row_size * (options.read_ahead ? 3 : 2)
+      + keys.size() * sizeof(uint64_t) + sizeof(size_t) + 2 * sizeof(Pair);
+  size_t const max_run_rows = std::max<size_t>(
+    1, options.memory / sort_row_size);
+
+  // Divide the input's groups into ranges read together.  Each is one run,
+  // except that a group larger than a run is split into several.
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t g = 0, rows = 0; g < input.num_groups(); ++g) {
+    if (ranges.empty() || rows + input.group_rows(g) > max_run_rows) {
+      ranges.emplace_back(g, g);
+      rows = 0;
+    }
+    ++ranges.back().second;
+    rows += input.group_rows(g);
+  }
+  // Rows of each range.
+  std::vector<size_t> range_rows;
+  for (auto const& range : ranges) {
+    size_t rows = 0;
+    for (size_t g = range.first; g < range.second; ++g)
+      rows += input.group_rows(g);
+    range_rows.push_back(rows);
+    stats.num_runs += (rows + max_run_rows - 1) / max_run_rows;
+  }
+  stats.bytes_read += input.group_bytes(0, input.num_groups());
+
+  // Sort each run.  If there's just one, write it as the output.
+  auto const start = Clock::now();
+  std::vector<std::unique_ptr<TempFile>> runs;
+  std::future<Table> next;
+  for (size_t r = 0; r < ranges.size(); ++r) {
+    auto const table
+      = next.valid() ? next.get()
+      : input.read(ranges[r].first, ranges[r].second);
+    if (options.read_ahead && r + 1 < ranges.size())
+      next = std::async(std::launch::async, [&input, &ranges, r]() {
+        return input.read(ranges[r + 1].first, ranges[r + 1].second);
+      });
+
+    for (size_t begin = 0; begin < range_rows[r]; begin += max_run_rows) {
+      // Sort a copy of each part of a split group, so that argsort's memory
+      // is bounded by the run.
+      size_t const end = std::min(range_rows[r], begin + max_run_rows);
+      Table part;
+      if (end - begin < table.num_rows()) {
+        std::vector<size_t> rows(end - begin);
+        std::iota(rows.begin(), rows.end(), begin);
+        part = take(table, rows);
+      }
+      auto const& unsorted = part.num_columns() > 0 ? part : table;
+      auto const sorted = take(unsorted, argsort(unsorted, specs));
+
+      bool const spill = stats.num_runs > 1;
+      if (spill)
+        runs.emplace_back(new TempFile(options.tmp_dir));
+      auto const writer = make_writer(
+        spill ? runs.back()->path() : out_path, !spill);
+      for (size_t i = 0; i < sorted.num_rows(); i += options.group_rows)
+        writer->write(sorted, i, i + options.group_rows);
+      stats.bytes_written += writer->close();
+      if (spill && options.drop_cache)
+        evict_file(runs.back()->path());
+    }
+  }
+  if (ranges.empty())
+    stats.bytes_written += make_writer(out_path, true)->close();
+  stats.run_time = time_since(start);
+  if (stats.num_runs <= 1)
+    return stats;
+
+  // Merge as many runs at a time as there's memory for their groups: the
+  // current one, the one being read ahead, and one retired until the output
+  // group that refers to it is written.
+  auto const merge_start = Clock::now();
+  size_t const group_size
+    = options.group_rows * (row_size + keys.size() * sizeof(uint64_t));
+  size_t const fan_in = std::max<size_t>(
+    2, options.memory / (group_size * (options.read_ahead ? 3 : 2)));
+  while (true) {
+    ++stats.num_passes;
+    if (runs.size() <= fan_in) {
+      std::vector<std::string> paths;
+      for (auto const& run : runs)
+        paths.push_back(run->path());
+      auto const writer = make_writer(out_path, true);
+      merge(paths, *writer, input, specs, options, stats);
+      stats.bytes_written += writer->close();
+      break;
+    }
+
+    // Merge consecutive runs, to keep the merge stable.
+    std::vector<std::unique_ptr<TempFile>> merged;
+    for (size_t r = 0; r < runs.size(); r += fan_in) {
+      std::vector<std::string> paths;
+      for (size_t i = r; i < std::min(r + fan_in, runs.size()); ++i)
+        paths.push_back(runs[i]->path());
+      merged.emplace_back(new TempFile(options.tmp_dir));
+      auto const writer = make_writer(merged.back()->path(), false);
+      merge(paths, *writer, input, specs, options, stats);
+      stats.bytes_written += writer->close();
+      if (options.drop_cache)
+        evict_file(merged.back()->path());
+    }
+    runs = std::move(merged);
+  }
+  stats.merge_time = time_since(merge_start);
+
+  return stats;
+}
+
+
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "column.hh"
+
+//------------------------------------------------------------------------------
+// Sorting tables by key columns.
+//
+// Rows are ordered by the first key column, then the second, and so on, all
+// ascending.  F64 values are in IEEE total order, so -0 precedes 0 and NaNs
+// are at the ends; ID values are in the order of their strings; and nulls
+// follow all values.  Sorts are stable.
+//------------------------------------------------------------------------------
+
+/*
+ * Returns the permutation that sorts the rows of `table` by the `keys`
+ * columns, i.e. the index of the row that belongs at each position.
+ *
+ * Each key's values are mapped to unsigned integers in the same order.  If
+ * the keys' ranges fit in 64 bits together, they're packed into one integer
+ * and sorted once; otherwise, each key is sorted in turn, from the last.  The
+ * radix sort distributes rows to buckets by the top bits of the key range,
+ * then sorts each bucket by bytes while it's in cache.
+ */
+extern std::vector<size_t> argsort(
+  Table const& table, std::vector<std::string> const& keys);
+
+/*
+ * Returns a table of the rows of `table` at `indices`, in that order.
+ */
+extern Table take(Table const& table, std::vector<size_t> const& indices);
+
+/*
+ * Returns `table` sorted by the `keys` columns.
+ */
+inline Table
+sort_table(
+  Table const& table,
+  std::vector<std::string> const& keys)
+{
+  return take(table, argsort(table, keys));
+}
+
+
+//------------------------------------------------------------------------------
+
+struct ExternalSortOptions
+{
+  // Memory to use for sorting runs and merge buffers, in bytes.
+  size_t memory = size_t(1) << 30;
+  // Directory for spilled runs.
+  std::string tmp_dir = "/tmp";
+  // Rows per group in spilled runs and in the output.
+  size_t group_rows = 1 << 16;
+  // If true, the next input groups or run groups are read while the current
+  // ones are sorted or merged.
+  bool read_ahead = true;
+  // If true, spilled runs are flushed and evicted from the page cache, so
+  // that merging reads them from disk even if they would fit in memory.
+  bool drop_cache = false;
+};
+
+
+struct ExternalSortStats
+{
+  size_t num_rows = 0;
+  // Number of sorted runs spilled from the input.
+  size_t num_runs = 0;
+  // Number of merge passes, including the final one that writes the output.
+  size_t num_passes = 0;
+  // Bytes read from and written to files, including the input and output.
+  size_t bytes_read = 0;
+  size_t bytes_written = 0;
+  // Seconds spent forming runs, and merging.
+  double run_time = 0;
+  double merge_time = 0;
+};
+
+
+/*
+ * Sorts the column file at `in_path` by the `keys` columns into a new column
+ * file at `out_path`, using about `options.memory` bytes whatever the size of
+ * the input.
+ *
+ * The input is read in runs of whole groups that fit in memory, each of which
+ * is sorted with `argsort()` and spilled to a temporary column file.  A group
+ * too large for one run is split into several, but is still read whole, so
+ * the memory used is at least that of one input group's columns.  Runs are
+ * then merged with a loser tree, reading each a group at a time, in as many
+ * passes as the memory allows buffers for.  With `read_ahead`, each run's next
+ * group is read in the background while its current group is merged.
+ */
+extern ExternalSortStats external_sort(
+  std::string const& in_path, std::string const& out_path,
+  std::vector<std::string> const& keys,
+  ExternalSortOptions const& options=ExternalSortOptions());
+
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sort.hh"
+#include "test.hh"
+
+//------------------------------------------------------------------------------
+// Tests of sorting tables.
+//------------------------------------------------------------------------------
+
+namespace {
+
+/*
+ * Returns the permutation that sorts `table` by `keys`, by comparing rows.
+ * Keys are i64 or id columns.
+ */
+std::vector<size_t>
+reference_argsort(
+  Table const& table,
+  std::vector<std::string> const& keys)
+{
+  std::vector<size_t> perm(table.num_rows());
+  std::iota(perm.begin(), perm.end(), 0);
+  std::stable_sort(
+    perm.begin(), perm.end(),
+    [&](size_t const a, size_t const b) {
+      for (auto const& name : keys) {
+        auto const& col = table[name];
+        if (col.is_valid(a) != col.is_valid(b))
+          // Nulls follow values.
+          return col.is_valid(a);
+        if (!col.is_valid(a))
+          continue;
+        if (col.dtype() == DType::ID) {
+          auto const& id = column_cast<uint32_t>(col);
+          auto const& x = id.dictionary()[id[a]];
+          auto const& y = id.dictionary()[id[b]];
+          if (x != y)
+            return x < y;
+        }
+        else {
+          auto const& i64 = column_cast<int64_t>(col);
+          if (i64[a] != i64[b])
+            return i64[a] < i64[b];
+        }
+      }
+      return false;
+    });
+  return perm;
+}
+
+
+/*
+ * Sorts with keys that don't pack into 64 bits, so each is sorted in turn.
+ */
+void
+test_wide_keys_with_nulls()
+{
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> sym(0, 4);
+  std::uniform_int_distribution<int> small(0, 9);
+  size_t const num = 10000;
+
+  // x spans nearly all of int64, so can't share a word with another key.
+  // Nulls have arbitrary values, as they may in loaded columns.
+  std::vector<uint32_t> s(num);
+  std::vector<int64_t> x(num);
+  std::vector<int64_t> n(num);
+  std::vector<uint64_t> s_valid((num + 63) / 64, 0);
+  std::vector<uint64_t> x_valid((num + 63) / 64, 0);
+  for (size_t i = 0; i < num; ++i) {
+    auto const bit = uint64_t(1) << (i % 64);
+    s[i] = sym(rng);
+    if (small(rng) > 2)
+      s_valid[i / 64] |= bit;
+    x[i] = i == 0 ? INT64_MIN / 2 : i == 1 ? INT64_MAX / 2 : small(rng);
+    if (small(rng) > 0)
+      x_valid[i / 64] |= bit;
+    n[i] = small(rng);
+  }
+  Table table;
+  table.add("s", std::unique_ptr<ColumnBase>(new Column<uint32_t>(
+    DType::ID, s, s_valid, {"e", "d", "c", "b", "a"})));
+  table.add("x", std::unique_ptr<ColumnBase>(new Column<int64_t>(
+    DType::I64, x, x_valid)));
+  table.add("n", std::unique_ptr<ColumnBase>(new Column<int64_t>(
+    DType::I64, n)));
+
+  for (auto const& keys : std::vector<std::vector<std::string>>{
+         {"s", "x"}, {"x", "s"}, {"n", "s", "x"}, {"s", "n", "x"}})
+    CHECK(argsort(table, keys) == reference_argsort(table, keys));
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+int
+main()
+{
+  test_wide_keys_with_nulls();
+
+  return test_result("sort_test");
+}
+
+
@@ -0,0 +1,80 @@
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.hh"
+#include "kernels.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * The plain sequential loop, for reference.
+ */
+__attribute((noinline))
+double
+dot_sequential(
+  size_t const num,
+  double const* const arg0,
+  double const* const arg1)
+{
+  double result = 0;
+  for (size_t i = 0; i < num; ++i)
+    result += arg0[i] * arg1[i];
+  return result;
+}
+
+
+/*
+ * Registers a dot product on ill-conditioned data, reporting relative error
+ * against the exact result.
+ */
+size_t
+register_sum(
+  char const* const name,
+  double (*const fn)(size_t, double const*, double const*))
+{
+  return register_benchmark(
+    name, {{"len", pow2_range(10, 22, 4)}},
+    [fn](Params const& params) {
+      size_t const len = params.at("len");
+
+      // Terms of widely varying magnitude and sign, whose sum is much smaller
+      // than the sum of their magnitudes.
+      std::mt19937_64 rng(42);
+      std::normal_distribution<double> normal(0, 1);
+      std::uniform_real_distribution<double> scale(-12, 12);
+      auto const arr0 = std::make_shared<std::vector<double>>(len);
+      auto const arr1 = std::make_shared<std::vector<double>>(len);
+      for (size_t i = 0; i < len; ++i) {
+        (*arr0)[i] = normal(rng) * std::exp(scale(rng));
+        (*arr1)[i] = 1 + normal(rng) * 1e-3;
+      }
+
+      auto const exact
+        = dot<double, double, ExactSum>(len, arr0->data(), arr1->data());
+      auto const result = fn(len, arr0->data(), arr1->data());
+      return Case{
+        [=]() { do_not_optimize(fn(len, arr0->data(), arr1->data())); },
+        (long) len,
+        {{"rel_err", std::abs((result - exact) / exact)}},
+        2 * sizeof(double),
+        2,
+        {{arr0->data(), len * sizeof(double)},
+         {arr1->data(), len * sizeof(double)}}};
+    });
+}
+
+
+static auto const reg_sequential
+  = register_sum("sum/sequential", dot_sequential);
+static auto const reg_naive
+  = register_sum("sum/naive", dot<double, double, NaiveSum>);
+static auto const reg_pairwise
+  = register_sum("sum/pairwise", dot<double, double, PairwiseSum>);
+static auto const reg_kahan
+  = register_sum("sum/kahan", dot<double, double, KahanSum>);
+static auto const reg_exact
+  = register_sum("sum/exact", dot<double, double, ExactSum>);
+
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//------------------------------------------------------------------------------
+// Summation policies.
+//
+// Each policy is an accumulator class template over the accumulator type, with
+// this interface:
+//
+//   void add(ACC x);                                // adds x
+//   void add_product(ACC x, ACC y);                 // adds x * y
+//   template<typename T> void add(size_t n, T const* x);
+//   template<typename T> void add_products(size_t n, T const* x, T const* y);
+//   void merge(POLICY const& other);                // adds other's sum
+//   ACC result() const;
+//
+// The bulk methods are equivalent to repeated calls to the scalar methods, but
+// may be faster and may associate terms differently.
+//------------------------------------------------------------------------------
+
+/*
+ * Number of independent partial sums in bulk methods.  These are kept in
+ * vector registers.
+ */
+size_t constexpr SUM_LANES = 8;
+
+/*
+ * Computes `p = x * y` and `e` such that `x * y == p + e` exactly.
+ */
+inline void
+two_product(
+  double const x,
+  double const y,
+  double& p,
+  double& e)
+{
+  p = x * y;
+#ifdef __FMA__
+  e = __builtin_fma(x, y, -p);
+#else
+  // Dekker's algorithm, splitting each factor into 26-bit halves.
+  double constexpr SPLIT = 134217729.0;  // 2^27 + 1
+  double const cx = SPLIT * x;
+  double const xh = cx - (cx - x);
+  double const xl = x - xh;
+  double const cy = SPLIT * y;
+  double const yh = cy - (cy - y);
+  double const yl = y - yh;
+  e = ((xh * yh - p) + xh * yl + xl * yh) + xl * yl;
+#endif
+}
+
+
+inline void
+two_product(
+  float const x,
+  float const y,
+  float& p,
+  float& e)
+{
+  double const d = (double) x * y;
+  p = d;
+  e = d - p;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Plain uncompensated summation.  Error grows linearly with the number of
+ * terms.
+ */
+template<typename ACC>
+class NaiveSum
+{
+public:
+
+  void add(ACC const x)                 { sum_ += x; }
+  void add_product(ACC const x, ACC const y) { sum_ += x * y; }
+  void merge(NaiveSum const& other)     { sum_ += other.sum_; }
+  ACC result() const                    { return sum_; }
+
+  template<typename T>
+  void
+  add(
+    size_t const num,
+    T const* const x)
+  {
+    ACC acc[SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + SUM_LANES <= num; i += SUM_LANES)
+      for (size_t l = 0; l < SUM_LANES; ++l)
+        acc[l] += ACC(x[i + l]);
+    for (size_t l = 0; l < SUM_LANES; ++l)
+      sum_ += acc[l];
+    for (; i < num; ++i)
+      sum_ += ACC(x[i]);
+  }
+
+  template<typename T>
+  void
+  add_products(
+    size_t const num,
+    T const* const x,
+    T const* const y)
+  {
+    ACC acc[SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + SUM_LANES <= num; i += SUM_LANES)
+      for (size_t l = 0; l < SUM_LANES; ++l)
+        acc[l] += ACC(x[i + l]) * ACC(y[i + l]);
+    for (size_t l = 0; l < SUM_LANES; ++l)
+      sum_ += acc[l];
+    for (; i < num; ++i)
+      sum_ += ACC(x[i]) * ACC(y[i]);
+  }
+
+private:
+
+  ACC sum_ = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Blocked pairwise summation.  Terms are summed naively in blocks of `BLOCK`,
+ * and block sums are combined pairwise in a binary tree, so error grows with
+ * the logarithm of the number of blocks.
+ */
+template<typename ACC>
+class PairwiseSum
+{
+public:
+
+  static size_t constexpr BLOCK = 256;
+
+  void
+  add(
+    ACC const x)
+  {
+    block_.add(x);
+    if (++num_ == BLOCK)
+      flush();
+  }
+
+  void
+  add_product(
+    ACC const x,
+    ACC const y)
+  {
+    block_.add_product(x, y);
+    if (++num_ == BLOCK)
+      flush();
+  }
+
+  template<typename T>
+  void
+  add(
+    size_t const num,
+    T const* const x)
+  {
+    for (size_t i = 0; i < num; ) {
+      size_t const n = std::min(BLOCK - num_, num - i);
+      block_.add(n, x + i);
+      i += n;
+      if ((num_ += n) == BLOCK)
+        flush();
+    }
+  }
+
+  template<typename T>
+  void
+  add_products(
+    size_t const num,
+    T const* const x,
+    T const* const y)
+  {
+    for (size_t i = 0; i < num; ) {
+      size_t const n = std::min(BLOCK - num_, num - i);
+      block_.add_products(n, x + i, y + i);
+      i += n;
+      if ((num_ += n) == BLOCK)
+        flush();
+    }
+  }
+
+  void
+  merge(
+    PairwiseSum const& other)
+  {
+    for (size_t d = 0; d < other.depth_; ++d)
+      push(other.stack_[d]);
+    add(other.block_.result());
+  }
+
+  ACC
+  result()
+    const
+  {
+    ACC sum = block_.result();
+    for (size_t d = depth_; d > 0; --d)
+      sum += stack_[d - 1];
+    return sum;
+  }
+
+private:
+
+  void
+  flush()
+  {
+    push(block_.result());
+    block_ = NaiveSum<ACC>();
+    num_ = 0;
+  }
+
+  /*
+   * Pushes a block sum, combining equal-sized partial sums like carries in a
+   * binary counter.
+   */
+  void
+  push(
+    ACC sum)
+  {
+    for (uint64_t c = count_; c & 1; c >>= 1)
+      sum += stack_[--depth_];
+    stack_[depth_++] = sum;
+    ++count_;
+  }
+
+  NaiveSum<ACC> block_;
+  size_t num_ = 0;
+  uint64_t count_ = 0;
+  size_t depth_ = 0;
+  ACC stack_[64];
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Compensated summation with Neumaier's variant of the Kahan algorithm.
+ * Products are split exactly, so dot products are as accurate as if computed
+ * in twice the working precision.
+ *
+ * The bulk methods keep independent sums and compensations in lanes, which
+ * the compiler vectorizes.
+ */
+template<typename ACC>
+class KahanSum
+{
+public:
+
+  void
+  add(
+    ACC const x)
+  {
+    accumulate(sum_, comp_, x);
+  }
+
+  void
+  add_product(
+    ACC const x,
+    ACC const y)
+  {
+    ACC p, e;
+    two_product(x, y, p, e);
+    accumulate(sum_, comp_, p);
+    comp_ += e;
+  }
+
+  template<typename T>
+  void
+  add(
+    size_t const num,
+    T const* const x)
+  {
+    ACC sum[SUM_LANES] = {};
+    ACC comp[SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + SUM_LANES <= num; i += SUM_LANES)
+      for (size_t l = 0; l < SUM_LANES; ++l)
+        accumulate(sum[l], comp[l], ACC(x[i + l]));
+    for (size_t l = 0; l < SUM_LANES; ++l) {
+      add(sum[l]);
+      comp_ += comp[l];
+    }
+    for (; i < num; ++i)
+      add(ACC(x[i]));
+  }
+
+  template<typename T>
+  void
+  add_products(
+    size_t const num,
+    T const* const x,
+    T const* const y)
+  {
+    ACC sum[SUM_LANES] = {};
+    ACC comp[SUM_LANES] = {};
+    size_t i = 0;
+    for (; i + SUM_LANES <= num; i += SUM_LANES)
+      for (size_t l = 0; l < SUM_LANES; ++l) {
+        ACC p, e;
+        two_product(ACC(x[i + l]), ACC(y[i + l]), p, e);
+        accumulate(sum[l], comp[l], p);
+        comp[l] += e;
+      }
+    for (size_t l = 0; l < SUM_LANES; ++l) {
+      add(sum[l]);
+      comp_ += comp[l];
+    }
+    for (; i < num; ++i)
+      add_product(ACC(x[i]), ACC(y[i]));
+  }
+
+  void
+  merge(
+    KahanSum const& other)
+  {
+    add(other.sum_);
+    comp_ += other.comp_;
+  }
+
+  ACC result() const                    { return sum_ + comp_; }
+
+private:
+
+  static inline void
+  accumulate(
+    ACC& sum,
+    ACC& comp,
+    ACC const x)
+  {
+    // Knuth's two-sum computes the rounding error exactly, like Neumaier's
+    // comparison of magnitudes, but without a branch.
+    ACC const t = sum + x;
+    ACC const z = t - sum;
+    comp += (sum - (t - z)) + (x - z);
+    sum = t;
+  }
+
+  ACC sum_ = 0;
+  ACC comp_ = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Exact summation of doubles with a superaccumulator.
+ *
+ * The accumulator is a fixed-point number covering the full double exponent
+ * range, stored as signed 32-bit digits in 64-bit words so that carries need
+ * to be propagated only occasionally.  The result is the exact sum, correctly
+ * rounded to double, independent of the order of terms.
+ */
+template<typename ACC>
+class ExactSum
+{
+public:
+
+  static_assert(std::is_same<ACC, double>::value, "ExactSum supports double only");
+
+  void
+  add(
+    double const x)
+  {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int const exp = (bits >> 52) & 0x7ff;
+    uint64_t mant = bits & ((uint64_t(1) << 52) - 1);
+
+    if (exp == 0x7ff) {
+      // Inf or NaN.
+      special_ += x;
+      return;
+    }
+    if (exp > 0)
+      mant |= uint64_t(1) << 52;
+    else if (mant == 0)
+      return;
+
+    // The value is mant * 2^(pos - 1074).
+    int const pos = std::max(exp, 1) - 1;
+    int const d = pos / DIGIT_BITS;
+    unsigned __int128 const v = (unsigned __int128) mant << (pos % DIGIT_BITS);
+    // Negate digits without a branch, as signs are unpredictable.
+    int64_t const s = (int64_t) bits >> 63;
+    digits_[d]     += ((int64_t) (uint32_t) v ^ s) - s;
+    digits_[d + 1] += ((int64_t) (uint32_t) (v >> 32) ^ s) - s;
+    digits_[d + 2] += ((int64_t) (uint32_t) (v >> 64) ^ s) - s;
+
+    // Each addition changes a digit by less than 2^32, so carries must be
+    // propagated before 2^31 additions.
+    if (++count_ == MAX_COUNT)
+      normalize();
+  }
+
+  void
+  add_product(
+    double const x,
+    double const y)
+  {
+    double p, e;
+    two_product(x, y, p, e);
+    add(p);
+    add(e);
+  }
+
+  template<typename T>
+  void
+  add(
+    size_t const num,
+    T const* const x)
+  {
+    for (size_t i = 0; i < num; ++i)
+      add(double(x[i]));
+  }
+
+  template<typename T>
+  void
+  add_products(
+    size_t const num,
+    T const* const x,
+    T const* const y)
+  {
+    for (size_t i = 0; i < num; ++i)
+      add_product(double(x[i]), double(y[i]));
+  }
+
+  void
+  merge(
+    ExactSum const& other)
+  {
+    ExactSum o = other;
+    o.normalize();
+    normalize();
+    for (int i = 0; i < NUM_DIGITS; ++i)
+      digits_[i] += o.digits_[i];
+    count_ = 1;
+    special_ += o.special_;
+  }
+
+  double
+  result()
+    const
+  {
+    if (special_ != 0 || std::isnan(special_))
+      return special_;
+
+    ExactSum s = *this;
+    s.normalize();
+    bool const neg = s.digits_[NUM_DIGITS - 1] < 0;
+    if (neg) {
+      for (auto& digit : s.digits_)
+        digit = -digit;
+      s.normalize();
+    }
+
+    int top = NUM_DIGITS - 1;
+    while (top > 0 && s.digits_[top] == 0)
+      --top;
+    top = std::max(top, 2);
+
+    // Take the top three digits, with a sticky bit for any lower nonzero
+    // digits.
+    unsigned __int128 v
+      = (unsigned __int128) s.digits_[top] << 64
+      | (unsigned __int128) s.digits_[top - 1] << 32
+      | (unsigned __int128) s.digits_[top - 2];
+    for (int i = 0; i < top - 2; ++i)
+      if (s.digits_[i] != 0) {
+        v |= 1;
+        break;
+      }
+
+    // Round to 53 bits, to nearest, ties to even, so that the conversion and
+    // scaling below are exact and the result is rounded only once.  A
+    // subnormal result needs no rounding: it's below 2^-1022, so top is 2,
+    // and the lowest digit is worth 2^-1074, its least significant bit.
+    int const width = v >> 64 != 0
+      ? 128 - __builtin_clzll((uint64_t) (v >> 64))
+      : 64 - __builtin_clzll((uint64_t) v | 1);
+    if (width > 53) {
+      int const shift = width - 53;
+      auto const rest = v & (((unsigned __int128) 1 << shift) - 1);
+      auto const half = (unsigned __int128) 1 << (shift - 1);
+      v >>= shift;
+      if (rest > half || (rest == half && (v & 1)))
+        ++v;
+      v <<= shift;
+    }
+    double const r = std::ldexp((double) v, (top - 2) * DIGIT_BITS - 1074);
+    return neg ? -r : r;
+  }
+
+private:
+
+  static int constexpr DIGIT_BITS = 32;
+  // Enough digits for 2^64 terms of the largest magnitude.
+  static int constexpr NUM_DIGITS = (1074 + 1024 + 64) / DIGIT_BITS + 2;
+  static uint32_t constexpr MAX_COUNT = uint32_t(1) << 30;
+
+  /*
+   * Propagates carries, leaving all but the top digit in [0, 2^32).
+   */
+  void
+  normalize()
+  {
+    for (int i = 0; i < NUM_DIGITS - 1; ++i) {
+      int64_t const carry = digits_[i] >> DIGIT_BITS;
+      digits_[i] -= carry * (int64_t(1) << DIGIT_BITS);
+      digits_[i + 1] += carry;
+    }
+    count_ = 0;
+  }
+
+  int64_t digits_[NUM_DIGITS] = {};
+  uint32_t count_ = 0;
+  double special_ = 0;
+
+};
+
+
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+#include "summation.hh"
+#include "test.hh"
+
+//------------------------------------------------------------------------------
+// Tests of exact summation.
+//------------------------------------------------------------------------------
+
+namespace {
+
+double
+exact_sum(
+  std::initializer_list<double> const vals)
+{
+  ExactSum<double> sum;
+  for (auto const val : vals)
+    sum.add(val);
+  return sum.result();
+}
+
+
+void
+test_subnormal_results()
+{
+  double const min_sub = std::ldexp(1, -1074);
+  double const min_normal = std::ldexp(1, -1022);
+  CHECK(exact_sum({1, 3 * min_sub, -1}) == 3 * min_sub);
+  CHECK(exact_sum({min_normal, -min_sub}) == min_normal - min_sub);
+  CHECK(exact_sum({-min_normal, min_sub}) == -(min_normal - min_sub));
+  CHECK(exact_sum({1e300, min_sub, -1e300}) == min_sub);
+}
+
+
+void
+test_rounding()
+{
+  double const big = std::ldexp(1, 53);
+  // Ties go to even.
+  CHECK(exact_sum({big, 1}) == big);
+  CHECK(exact_sum({big, 3}) == big + 4);
+  // Anything below breaks the tie.
+  CHECK(exact_sum({big, 1, std::ldexp(1, -1000)}) == big + 2);
+  CHECK(exact_sum({big, 1, -std::ldexp(1, -1074)}) == big);
+  CHECK(exact_sum({-big, -1, -std::ldexp(1, -1000)}) == -big - 2);
+}
+
+
+void
+test_order_independent()
+{
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> mant(-1, 1);
+  std::uniform_int_distribution<int> exp(-1074, 1000);
+  std::vector<double> vals(10000);
+  for (auto& val : vals)
+    val = std::ldexp(mant(rng), exp(rng));
+
+  ExactSum<double> a;
+  a.add(vals.size(), vals.data());
+  std::shuffle(vals.begin(), vals.end(), rng);
+  ExactSum<double> b;
+  b.add(vals.size(), vals.data());
+  CHECK(a.result() == b.result());
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+int
+main()
+{
+  test_subnormal_results();
+  test_rounding();
+  test_order_independent();
+
+  return test_result("summation_test");
+}
+
+
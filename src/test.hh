@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+//------------------------------------------------------------------------------
+// Checks for test programs.
+//
+// A test program's `main()` calls its tests, which `CHECK` conditions, and
+// returns `test_result()`.  A failed check is reported with its line, and the
+// remaining checks still run.
+//------------------------------------------------------------------------------
+
+inline int&
+num_failures()
+{
+  static int num = 0;
+  return num;
+}
+
+
+inline void
+check(
+  bool const ok,
+  char const* const what,
+  int const line)
+{
+  if (!ok) {
+    std::cerr << "FAILED line " << line << ": " << what << "\n";
+    ++num_failures();
+  }
+}
+
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+/*
+ * Reports the outcome of program `name`'s tests, and returns its exit status.
+ */
+inline int
+test_result(
+  char const* const name)
+{
+  if (num_failures() > 0) {
+    std::cerr << num_failures() << " failed\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << name << ": ok\n";
+  return EXIT_SUCCESS;
+}
+
+
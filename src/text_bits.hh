@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+// Bit arithmetic for scanning text 64 bytes at a time, on masks with bit i set
+// for a character class at byte i of a block.
+//------------------------------------------------------------------------------
+
+/*
+ * Returns a mask with bit i set if an odd number of bits [0, i] are set in x.
+ */
+inline uint64_t
+prefix_xor(
+  uint64_t x)
+{
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+
+/*
+ * Returns a mask of characters escaped by a backslash, given a mask of
+ * backslashes.  `carry` is 1 if the first character is escaped, and is set to
+ * whether the character after the block is.
+ */
+inline uint64_t
+escaped_mask(
+  uint64_t backslash,
+  uint64_t& carry)
+{
+  uint64_t constexpr EVEN = 0x5555555555555555;
+  // An escaped backslash doesn't escape.
+  backslash &= ~carry;
+  uint64_t const follows = backslash << 1 | carry;
+  // Runs of backslashes starting at odd bits.  Adding them to the backslashes
+  // carries each run to the bit after it.
+  uint64_t const odd_starts = backslash & ~EVEN & ~follows;
+  uint64_t even_runs;
+  carry = __builtin_add_overflow(odd_starts, backslash, &even_runs);
+  // A character is escaped if it follows a run of odd length: one starting at
+  // an even bit and ending at an even bit, or vice versa.
+  return (EVEN ^ even_runs << 1) & follows;
+}
+
+
@@ -5,12 +5,19 @@
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <sstream>
 #include <utility>
 
+#include "histogram.hh"
 #include "json.hh"
+#include "parallel.hh"
+#include "perf_counters.hh"
+#include "tsc.hh"
 #include "util.hh"
 
 using aslib::json::Json;
@@ -70,31 +77,41 @@ struct SummaryStats
 
 /*
  * Computes summary statistics over a number of sample values.
+ *
+ * Moments are accumulated in `ACC`; by default, `moment_t` of the value type.
  */
-template<typename ITER>
+template<typename ACC=void, typename ITER>
 auto
 summarize(
   ITER begin,
   ITER end)
 {
   using Value = typename std::iterator_traits<ITER>::value_type;
+  using Moment = std::conditional_t<
+    std::is_void<ACC>::value, moment_t<Value>, ACC>;
 
-  // Compute moments.
+  // Compute moments and extrema.
   size_t m0 = 0;
-  Value m1 = 0;
-  Value m2 = 0;
+  Moment m1 = 0;
+  Moment m2 = 0;
+  Moment min = std::numeric_limits<Moment>::max();
+  Moment max = std::numeric_limits<Moment>::lowest();
   for (auto i = begin; i < end; ++i) {
+    Moment const val = *i;
     m0 += 1;
-    m1 += *i;
-    m2 += *i * *i;
+    m1 += val;
+    m2 += val * val;
+    min = std::min(min, val);
+    max = std::max(max, val);
   }
 
-  return SummaryStats<Value>{
+  Moment const mean = m1 / m0;
+  return SummaryStats<Moment>{
     m0,
-    *begin,      // FIXME: Wrong!
-    *(end - 1),  // FIXME: Wrong!
-    m1 / m0,
-    sqrt(m2 / m0 - square(m1 / m0)) * m0 / (m0 - 1)
+    min,
+    max,
+    mean,
+    m0 > 1 ? std::sqrt(std::max(Moment(0), (m2 - m1 * mean) / (m0 - 1))) : 0
   };
 }
 
@@ -159,56 +176,413 @@ operator<<(
 
 //------------------------------------------------------------------------------
 
+/*
+ * Source of ticks for `Timer`.
+ */
+enum class TimerBackend
+{
+  CLOCK,  // steady clock, ticks are ns
+  TSC,    // time stamp counter
+};
+
+
+/*
+ * An empty call, for measuring timing overhead.
+ */
+__attribute((noinline))
+inline int
+empty_call()
+{
+  asm volatile("");
+  return 0;
+}
+
+
+/*
+ * Times repeated calls to a function.
+ *
+ * Each sample times a batch of calls between two tick reads, and subtracts
+ * the overhead of timing a batch of empty calls.  Functions faster than
+ * `BATCH_THRESHOLD` are batched so that each sample spans about `BATCH_TIME`;
+ * this amortizes tick read cost and resolution.  If there is a setup
+ * function, which must run before each call, batches are single calls.
+ *
+ * The TSC backend is used if the TSC is invariant, else the steady clock.
+ *
+ * Samples are taken until the time budget is spent, and are recorded into a
+ * histogram, in constant memory.  Raw sample times are kept only on request.
+ *
+ * Optionally, perf event counters are read around each sample, outside the
+ * timed interval, and averaged per call.
+ */
 class Timer
 {
 public:
 
-  static size_t constexpr MAX_SAMPLES = 1024;
+  static constexpr Elapsed BATCH_THRESHOLD = 100e-9;
+  static constexpr Elapsed BATCH_TIME = 2e-6;
 
-  using SetupFn = void (*)();
+  // Called before each sample, untimed.
+  using SetupFn = std::function<void()>;
 
   Timer(
     Elapsed const time_budget,
     double const discard_fraction=0,
-    SetupFn const setup=nullptr
-    )
+    SetupFn const setup=nullptr,
+    TimerBackend const backend=TimerBackend::TSC)
   : time_budget_(time_budget),
     discard_fraction_(discard_fraction),
-    setup_(setup)
+    setup_(setup),
+    backend_(
+      backend == TimerBackend::TSC && !tsc_invariant()
+      ? TimerBackend::CLOCK : backend),
+    frequency_(backend_ == TimerBackend::TSC ? tsc_frequency() : 1e9)
   {
     assert(time_budget > 0);
     assert(discard_fraction >= 0);
   }
 
+  TimerBackend backend() const          { return backend_; }
+
+  /*
+   * If true, subsequent calls keep raw sample times.
+   */
+  void keep_samples(bool const keep)    { keep_samples_ = keep; }
+
+  /*
+   * Counts events from `counters` in subsequent calls, or none if null.
+   */
+  void counters(PerfCounters* const counters) { counters_ = counters; }
+
+  /*
+   * Returns the number of calls per sample in the last call.
+   */
+  size_t batch() const                  { return batch_; }
+
+  /*
+   * Times `fn(args...)` and returns summary statistics, excluding
+   * `discard_fraction` of samples, half the fastest and half the slowest.
+   */
   template<typename FN, typename ...ARGS>
   SummaryStats<Elapsed>
   operator()(
     FN&& fn,
     ARGS&&... args)
   {
-    std::vector<Elapsed> elapsed;
+    histogram_ = Histogram();
+    samples_.clear();
+    counter_samples_.clear();
+    if (counters_ != nullptr) {
+      counters_->open();
+      counter_means_.assign(counters_->size(), 0);
+    }
+    else
+      counter_means_.clear();
+
+    // Warm up, and estimate the time per call.
+    batch_ = 1;
+    Elapsed est = std::numeric_limits<Elapsed>::max();
+    for (int i = 0; i < 8; ++i) {
+      if (setup_ != nullptr)
+        setup_();
+      est = std::min(est, sample(1, fn, args...));
+    }
+    if (setup_ == nullptr && est < BATCH_THRESHOLD)
+      batch_ = std::ceil(BATCH_TIME / std::max(est, 1e-9));
 
     auto const start = Clock::now();
     do {
       if (setup_ != nullptr)
         setup_();
-      elapsed.push_back(time1(fn, std::forward<ARGS>(args)...).first);
-    } while (elapsed.size() < MAX_SAMPLES && time_since(start) < time_budget_);
-      
-    // Sort and ignore the highest and lowest.
-    std::sort(elapsed.begin(), elapsed.end());
-    size_t const num_discard = elapsed.size() * discard_fraction_ / 2;
-    auto const begin = elapsed.begin() + num_discard;
-    auto const end   = elapsed.end()   - num_discard;
-
-    return summarize(begin, end);
+      PerfCounters::Snapshot before;
+      if (counters_ != nullptr)
+        before = counters_->read();
+      auto const elapsed = sample(batch_, fn, args...);
+      if (counters_ != nullptr) {
+        auto counts = counters_->counts(before, counters_->read());
+        for (size_t i = 0; i < counts.size(); ++i) {
+          counts[i] /= batch_;
+          counter_means_[i] += counts[i];
+        }
+        if (keep_samples_)
+          counter_samples_.push_back(std::move(counts));
+      }
+      histogram_.record(elapsed);
+      if (keep_samples_)
+        samples_.push_back(elapsed);
+    } while (time_since(start) < time_budget_);
+
+    for (auto& mean : counter_means_)
+      mean /= histogram_.count();
+
+    auto const moments = histogram_.trimmed_moments(discard_fraction_);
+    return {
+      histogram_.count(),
+      histogram_.min(),
+      histogram_.max(),
+      moments.first,
+      moments.second,
+    };
   }
 
+  /*
+   * Returns the histogram of sample times from the last call.
+   */
+  Histogram const& histogram() const    { return histogram_; }
+
+  /*
+   * Returns the sample times from the last call, in order, if kept.
+   */
+  std::vector<Elapsed> const& samples() const { return samples_; }
+
+  /*
+   * Returns the mean count per call of each counter event in the last call;
+   * NaN if unavailable.
+   */
+  std::vector<double> const& counter_means() const { return counter_means_; }
+
+  /*
+   * Returns the per-call counts for each sample in the last call, if kept.
+   */
+  std::vector<std::vector<double>> const& counter_samples() const
+    { return counter_samples_; }
+
 private:
 
+  Ticks
+  start()
+    const
+  {
+    return backend_ == TimerBackend::TSC ? tsc_start() : clock_ticks();
+  }
+
+  Ticks
+  stop()
+    const
+  {
+    return backend_ == TimerBackend::TSC ? tsc_stop() : clock_ticks();
+  }
+
+  template<typename FN, typename ...ARGS>
+  Ticks
+  time_batch(
+    size_t const batch,
+    FN&& fn,
+    ARGS&&... args)
+    const
+  {
+    auto const t0 = start();
+    for (size_t i = 0; i < batch; ++i)
+      do_not_optimize(fn(args...));
+    return stop() - t0;
+  }
+
+  /*
+   * Returns the time per call of a batch, less overhead.
+   */
+  template<typename FN, typename ...ARGS>
+  Elapsed
+  sample(
+    size_t const batch,
+    FN&& fn,
+    ARGS&&... args)
+  {
+    Ticks const ticks = time_batch(batch, fn, args...);
+    double const net = std::max(0.0, double(ticks) - overhead(batch));
+    return net / frequency_ / batch;
+  }
+
+  /*
+   * Returns the median ticks to time a batch of empty calls.
+   */
+  double
+  overhead(
+    size_t const batch)
+  {
+    auto const i = overhead_.find(batch);
+    if (i != overhead_.end())
+      return i->second;
+
+    std::vector<Ticks> ticks(101);
+    for (auto& t : ticks)
+      t = time_batch(batch, empty_call);
+    std::nth_element(ticks.begin(), ticks.begin() + 50, ticks.end());
+    return overhead_[batch] = ticks[50];
+  }
+
   Elapsed const time_budget_;
   double const discard_fraction_;
   SetupFn const setup_;
+  TimerBackend const backend_;
+  // Ticks per second.
+  double const frequency_;
+
+  bool keep_samples_ = false;
+  size_t batch_ = 1;
+  std::map<size_t, double> overhead_;
+  PerfCounters* counters_ = nullptr;
+  Histogram histogram_;
+  std::vector<Elapsed> samples_;
+  std::vector<double> counter_means_;
+  std::vector<std::vector<double>> counter_samples_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Times a function run concurrently on threads pinned to given CPUs.
+ *
+ * For each sample, threads meet at a barrier, then each times a batch of calls
+ * to `fn(i)`, where `i` is its index.  The sample is the parallel region, from
+ * the first thread's start to the last thread's stop; thread start-up and
+ * dispatch are excluded.  Each thread's own time is tracked too, so that load
+ * imbalance and per-thread throughput are visible.  Ticks are comparable
+ * across CPUs only with an invariant TSC or the steady clock.
+ *
+ * Batching and the time budget are as for `Timer`; timing overhead isn't
+ * subtracted, as batches are long enough for it to be negligible.
+ */
+class ParallelTimer
+{
+public:
+
+  ParallelTimer(
+    Elapsed const time_budget,
+    double const discard_fraction,
+    std::vector<int> const& cpus,
+    TimerBackend const backend=TimerBackend::TSC)
+  : time_budget_(time_budget),
+    discard_fraction_(discard_fraction),
+    backend_(
+      backend == TimerBackend::TSC && !tsc_invariant()
+      ? TimerBackend::CLOCK : backend),
+    frequency_(backend_ == TimerBackend::TSC ? tsc_frequency() : 1e9),
+    pool_(cpus.size(), cpus),
+    barrier_(cpus.size()),
+    starts_(cpus.size()),
+    stops_(cpus.size())
+  {
+    assert(time_budget > 0);
+    assert(discard_fraction >= 0);
+  }
+
+  unsigned threads() const              { return pool_.size(); }
+
+  /*
+   * The pinned threads, e.g. to set up per-thread data on them.
+   */
+  WorkerPool& pool()                    { return pool_; }
+
+  /*
+   * Returns the number of calls per sample in the last call.
+   */
+  size_t batch() const                  { return batch_; }
+
+  /*
+   * Times `fn(i)` on each thread `i`, and returns summary statistics of the
+   * parallel region per call, excluding `discard_fraction` of samples.
+   */
+  template<typename FN>
+  SummaryStats<Elapsed>
+  operator()(
+    FN&& fn)
+  {
+    histogram_ = Histogram();
+    thread_means_.assign(threads(), 0);
+
+    // Warm up, and estimate the time per call.
+    batch_ = 1;
+    Elapsed est = std::numeric_limits<Elapsed>::max();
+    for (int i = 0; i < 8; ++i)
+      est = std::min(est, sample(1, fn));
+    if (est < Timer::BATCH_THRESHOLD)
+      batch_ = std::ceil(Timer::BATCH_TIME / std::max(est, 1e-9));
+
+    auto const start = Clock::now();
+    do {
+      histogram_.record(sample(batch_, fn));
+      for (size_t i = 0; i < threads(); ++i)
+        thread_means_[i]
+          += double(stops_[i] - starts_[i]) / frequency_ / batch_;
+    } while (time_since(start) < time_budget_);
+
+    for (auto& mean : thread_means_)
+      mean /= histogram_.count();
+
+    auto const moments = histogram_.trimmed_moments(discard_fraction_);
+    return {
+      histogram_.count(),
+      histogram_.min(),
+      histogram_.max(),
+      moments.first,
+      moments.second,
+    };
+  }
+
+  /*
+   * Returns the histogram of parallel region times from the last call.
+   */
+  Histogram const& histogram() const    { return histogram_; }
+
+  /*
+   * Returns each thread's mean time per call in the last call.
+   */
+  std::vector<Elapsed> const& thread_means() const { return thread_means_; }
+
+private:
+
+  Ticks
+  start()
+    const
+  {
+    return backend_ == TimerBackend::TSC ? tsc_start() : clock_ticks();
+  }
+
+  Ticks
+  stop()
+    const
+  {
+    return backend_ == TimerBackend::TSC ? tsc_stop() : clock_ticks();
+  }
+
+  /*
+   * Returns the parallel region time per call of a batch.
+   */
+  template<typename FN>
+  Elapsed
+  sample(
+    size_t const batch,
+    FN& fn)
+  {
+    pool_.run([this, batch, &fn](size_t const i) {
+      barrier_.wait();
+      auto const t0 = start();
+      for (size_t b = 0; b < batch; ++b)
+        do_not_optimize(fn(i));
+      auto const t1 = stop();
+      starts_[i] = t0;
+      stops_[i] = t1;
+    });
+    auto const first = *std::min_element(starts_.begin(), starts_.end());
+    auto const last = *std::max_element(stops_.begin(), stops_.end());
+    return double(last - first) / frequency_ / batch;
+  }
+
+  Elapsed const time_budget_;
+  double const discard_fraction_;
+  TimerBackend const backend_;
+  // Ticks per second.
+  double const frequency_;
+
+  WorkerPool pool_;
+  SpinBarrier barrier_;
+  size_t batch_ = 1;
+  std::vector<Ticks> starts_;
+  std::vector<Ticks> stops_;
+  Histogram histogram_;
+  std::vector<Elapsed> thread_means_;
 
 };
 
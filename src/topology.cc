@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+
+#include "topology.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+int
+read_int(
+  std::string const& path,
+  int const default_val)
+{
+  std::ifstream file(path);
+  int val;
+  return file >> val ? val : default_val;
+}
+
+
+/*
+ * Returns the NUMA node of `cpu`, from its `nodeN` link, or 0.
+ */
+int
+cpu_node(
+  int const cpu)
+{
+  auto const dir = "/sys/devices/system/cpu/cpu"s + std::to_string(cpu) + "/";
+  for (int node = 0; node < 1024; ++node)
+    if (std::ifstream(dir + "node" + std::to_string(node) + "/cpulist"))
+      return node;
+  return 0;
+}
+
+
+/*
+ * Orders CPUs so that consecutive ones are spread by `key`, i.e. round-robin
+ * over groups with distinct `key` values, keeping order within each group.
+ */
+template<typename KEY>
+std::vector<Cpu>
+round_robin(
+  std::vector<Cpu> const& cpus,
+  KEY&& key)
+{
+  std::map<int, std::vector<Cpu>> groups;
+  for (auto const& cpu : cpus)
+    groups[key(cpu)].push_back(cpu);
+  std::vector<Cpu> order;
+  for (size_t i = 0; order.size() < cpus.size(); ++i)
+    for (auto const& group : groups)
+      if (i < group.second.size())
+        order.push_back(group.second[i]);
+  return order;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+std::vector<Cpu> const&
+cpu_topology()
+{
+  static std::vector<Cpu> const cpus = []() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+      throw std::system_error(
+        errno, std::system_category(), "sched_getaffinity");
+
+    std::vector<Cpu> cpus;
+    for (int id = 0; id < CPU_SETSIZE; ++id)
+      if (CPU_ISSET(id, &set)) {
+        auto const dir
+          = "/sys/devices/system/cpu/cpu"s + std::to_string(id) + "/topology/";
+        cpus.push_back({
+          id,
+          read_int(dir + "physical_package_id", 0),
+          read_int(dir + "core_id", id),
+          cpu_node(id)});
+      }
+    return cpus;
+  }();
+  return cpus;
+}
+
+
+char const*
+placement_name(
+  Placement const placement)
+{
+  switch (placement) {
+  case Placement::COMPACT: return "compact";
+  case Placement::SCATTER: return "scatter";
+  case Placement::NUMA: return "numa";
+  }
+  return nullptr;
+}
+
+
+Placement
+parse_placement(
+  std::string const& name)
+{
+  if (name == "compact")
+    return Placement::COMPACT;
+  else if (name == "scatter")
+    return Placement::SCATTER;
+  else if (name == "numa")
+    return Placement::NUMA;
+  else
+    throw std::invalid_argument("unknown placement: "s + name);
+}
+
+
+std::vector<int>
+place_threads(
+  Placement const placement,
+  unsigned const num)
+{
+  // Compact order: by package, core, then hyperthread.
+  auto cpus = cpu_topology();
+  std::stable_sort(
+    cpus.begin(), cpus.end(),
+    [](Cpu const& a, Cpu const& b) {
+      return std::tie(a.package, a.core) < std::tie(b.package, b.core);
+    });
+
+  switch (placement) {
+  case Placement::COMPACT:
+    break;
+
+  case Placement::SCATTER: {
+    // One hyperthread of each core first, then the rest; cores alternate
+    // among packages.
+    std::map<std::pair<int, int>, int> seen;
+    std::vector<std::vector<Cpu>> ranks;
+    for (auto const& cpu : cpus) {
+      auto const rank = seen[{cpu.package, cpu.core}]++;
+      ranks.resize(std::max<size_t>(ranks.size(), rank + 1));
+      ranks[rank].push_back(cpu);
+    }
+    cpus.clear();
+    for (auto const& rank : ranks)
+      for (auto const& cpu
+           : round_robin(rank, [](Cpu const& c) { return c.package; }))
+        cpus.push_back(cpu);
+    break;
+  }
+
+  case Placement::NUMA:
+    cpus = round_robin(cpus, [](Cpu const& c) { return c.node; });
+    break;
+  }
+
+  std::vector<int> ids;
+  for (unsigned i = 0; i < num; ++i)
+    ids.push_back(cpus[i % cpus.size()].id);
+  return ids;
+}
+
+
+void
+pin_thread(
+  int const cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int const err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0)
+    throw std::system_error(
+      err, std::system_category(), "can't pin thread to CPU "s
+      + std::to_string(cpu));
+}
+
+
+PinnedScope::PinnedScope(
+  int const cpu)
+{
+  int const err
+    = pthread_getaffinity_np(pthread_self(), sizeof(saved_), &saved_);
+  if (err != 0)
+    throw std::system_error(err, std::system_category(), "can't get affinity");
+  pin_thread(cpu);
+}
+
+
+PinnedScope::~PinnedScope()
+{
+  pthread_setaffinity_np(pthread_self(), sizeof(saved_), &saved_);
+}
+
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sched.h>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// CPU topology, thread placement, and pinning.
+//------------------------------------------------------------------------------
+
+struct Cpu
+{
+  int id;
+  // Socket.
+  int package;
+  // Physical core, within the package.
+  int core;
+  int node;
+};
+
+
+/*
+ * Returns the CPUs this process may run on, from sysfs, in id order.
+ */
+extern std::vector<Cpu> const& cpu_topology();
+
+/*
+ * How threads are assigned to CPUs.
+ */
+enum class Placement
+{
+  COMPACT,  // fill each core, then each package, before the next
+  SCATTER,  // round-robin over packages, then cores, then hyperthreads
+  NUMA,     // round-robin over NUMA nodes, compact within each node
+};
+
+
+extern char const* placement_name(Placement);
+extern Placement parse_placement(std::string const&);
+
+/*
+ * Returns CPU ids for `num` threads.  If there are more threads than CPUs,
+ * the placement wraps around and CPUs are oversubscribed.
+ */
+extern std::vector<int> place_threads(Placement placement, unsigned num);
+
+/*
+ * Pins the calling thread to `cpu`.
+ */
+extern void pin_thread(int cpu);
+
+/*
+ * Pins the calling thread to a CPU while in scope, then restores its previous
+ * affinity.
+ */
+class PinnedScope
+{
+public:
+
+  explicit PinnedScope(int cpu);
+  PinnedScope(PinnedScope const&) = delete;
+  ~PinnedScope();
+
+private:
+
+  cpu_set_t saved_;
+
+};
+
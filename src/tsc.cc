@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <iterator>
+
+#include "tsc.hh"
+
+#if HAVE_TSC
+# include <cpuid.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+/*
+ * Measures the TSC frequency, in Hz, over an interval of about `ns`.
+ */
+double
+measure_frequency(
+  Ticks const ns)
+{
+  // Align to a clock tick edge.
+  auto const t = clock_ticks();
+  Ticks c0;
+  while ((c0 = clock_ticks()) == t)
+    ;
+  Ticks const tsc0 = tsc_start();
+
+  Ticks c1;
+  while ((c1 = clock_ticks()) < c0 + ns)
+    ;
+  Ticks const tsc1 = tsc_stop();
+
+  return double(tsc1 - tsc0) / double(c1 - c0) * 1e9;
+}
+
+
+}  // anonymous namespace
+
+bool
+tsc_invariant()
+{
+#if HAVE_TSC
+  unsigned eax, ebx, ecx, edx;
+  // Advanced power management leaf; EDX bit 8 is invariant TSC.
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx >> 8) & 1;
+#else
+  return false;
+#endif
+}
+
+
+double
+tsc_frequency()
+{
+  static double const frequency = []() {
+#if HAVE_TSC
+    // Median of several short measurements, to reject preemptions.
+    double f[5];
+    for (auto& ff : f)
+      ff = measure_frequency(10000000);
+    std::sort(std::begin(f), std::end(f));
+    return f[2];
+#else
+    return 1e9;
+#endif
+  }();
+  return frequency;
+}
+
+
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+# define HAVE_TSC 1
+#else
+# define HAVE_TSC 0
+#endif
+
+//------------------------------------------------------------------------------
+// Time stamp counter.
+//
+// On x86, reads the TSC, fenced so that the measured code can't be reordered
+// across the reads.  `tsc_start()` waits for prior instructions to complete
+// before reading; `tsc_stop()` uses rdtscp, which waits for the measured code,
+// and fences after, so that later instructions don't start early.
+//
+// Elsewhere, falls back to the steady clock in ns.
+//------------------------------------------------------------------------------
+
+using Ticks = uint64_t;
+
+inline Ticks
+clock_ticks()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+inline Ticks
+tsc_start()
+{
+#if HAVE_TSC
+  _mm_lfence();
+  Ticks const ticks = __rdtsc();
+  _mm_lfence();
+  return ticks;
+#else
+  return clock_ticks();
+#endif
+}
+
+
+inline Ticks
+tsc_stop()
+{
+#if HAVE_TSC
+  unsigned aux;
+  Ticks const ticks = __rdtscp(&aux);
+  _mm_lfence();
+  return ticks;
+#else
+  return clock_ticks();
+#endif
+}
+
+
+/*
+ * Returns true if the TSC runs at a constant rate, independent of frequency
+ * scaling and sleep states, so that it measures wall time.
+ */
+extern bool tsc_invariant();
+
+/*
+ * Returns the TSC frequency, in Hz, calibrated against the steady clock on
+ * first call.
+ */
+extern double tsc_frequency();
+
@@ -0,0 +1,219 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include "machine.hh"
+#include "tuning.hh"
+
+using namespace std::string_literals;
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+// Time to run each candidate when tuning on first use.
+Elapsed constexpr FIRST_USE_BUDGET = 0.05;
+
+std::string path_override;
+bool auto_tune = true;
+
+// Guards tuned values and the tuning file, as benchmark setup may call
+// `tuned()` on several threads at once.
+std::mutex tuning_mutex;
+
+/*
+ * Returns tuned values for all machines in the tuning file, or none if it
+ * doesn't exist.
+ */
+Json
+load_file()
+{
+  std::ifstream file(tuning_path());
+  if (!file)
+    return Json::new_obj();
+  std::stringstream text;
+  text << file.rdbuf();
+  return aslib::json::parse(text.str());
+}
+
+
+/*
+ * Returns tuned values for this machine, loaded from the tuning file on first
+ * use.
+ */
+std::map<std::string, long>&
+machine_values()
+{
+  static std::map<std::string, long> values = []() {
+    std::map<std::string, long> values;
+    auto const json = load_file();
+    auto const cpu = cpu_model();
+    if (json.has(cpu))
+      for (auto const& v : json[cpu].get_obj())
+        values[v.first] = (long) v.second.get_num();
+    return values;
+  }();
+  return values;
+}
+
+
+Tunable const&
+find_tunable(
+  std::string const& name)
+{
+  for (auto const& tunable : tunables())
+    if (tunable.name == name)
+      return tunable;
+  throw std::invalid_argument("unknown tunable: "s + name);
+}
+
+
+/*
+ * As `save_tuned()`, with `tuning_mutex` held.
+ */
+void
+save_locked(
+  std::vector<TuneResult> const& results)
+{
+  auto& values = machine_values();
+  for (auto const& result : results)
+    values[result.name] = result.value;
+
+  // Reread the file, to keep other machines' values.
+  auto json = load_file();
+  auto const cpu = cpu_model();
+  if (!json.has(cpu))
+    json[cpu] = Json::new_obj();
+  for (auto const& v : values)
+    json[cpu][v.first] = Json((double) v.second);
+
+  auto const path = tuning_path();
+  std::ofstream file(path);
+  if (!file)
+    throw std::runtime_error("can't write tuning file: "s + path);
+  file << json << std::endl;
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+std::vector<Tunable>&
+tunables()
+{
+  // Constructed on first use, as registration happens during static init.
+  static std::vector<Tunable> tunables;
+  return tunables;
+}
+
+
+size_t
+register_tunable(
+  std::string const& name,
+  long const default_value,
+  std::vector<long> candidates,
+  SetupFn trial)
+{
+  auto& all = tunables();
+  all.push_back({name, default_value, std::move(candidates), std::move(trial)});
+  return all.size() - 1;
+}
+
+
+std::string
+tuning_path()
+{
+  if (!path_override.empty())
+    return path_override;
+  if (auto const path = std::getenv("ASLIB_TUNING"))
+    return path;
+  if (auto const home = std::getenv("HOME"))
+    return home + "/.aslib_tuning.json"s;
+  return ".aslib_tuning.json";
+}
+
+
+void
+set_tuning_path(
+  std::string const& path)
+{
+  path_override = path;
+}
+
+
+void
+set_auto_tune(
+  bool const enable)
+{
+  auto_tune = enable;
+}
+
+
+long
+tuned(
+  std::string const& name)
+{
+  // Other callers wait while one tunes, so they neither tune the same
+  // parameter again nor disturb its trials.
+  std::lock_guard<std::mutex> lock(tuning_mutex);
+  auto& values = machine_values();
+  auto const v = values.find(name);
+  if (v != values.end())
+    return v->second;
+
+  auto const& tunable = find_tunable(name);
+  if (!auto_tune)
+    return tunable.default_value;
+
+  std::cerr << "tuning " << name << " for this machine\n";
+  auto const result = tune(tunable, FIRST_USE_BUDGET);
+  try {
+    save_locked({result});
+  }
+  catch (std::runtime_error const& exc) {
+    // Use the value this time anyway.
+    std::cerr << "warning: " << exc.what() << "\n";
+    values[name] = result.value;
+  }
+  return result.value;
+}
+
+
+TuneResult
+tune(
+  Tunable const& tunable,
+  Elapsed const budget)
+{
+  TuneResult result{tunable.name, tunable.default_value, {}};
+  Elapsed best = std::numeric_limits<Elapsed>::infinity();
+  for (auto const value : tunable.candidates) {
+    auto const c = tunable.trial({{tunable.name, value}});
+    Timer timer{budget, 0.1};
+    auto const& run = c.run;
+    auto const elapsed = timer([&run]() { run(); return 0; }).mean
+      / c.num_elements;
+    result.trials.emplace_back(value, elapsed);
+    if (elapsed < best) {
+      best = elapsed;
+      result.value = value;
+    }
+  }
+  return result;
+}
+
+
+void
+save_tuned(
+  std::vector<TuneResult> const& results)
+{
+  std::lock_guard<std::mutex> lock(tuning_mutex);
+  save_locked(results);
+}
+
+
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.hh"
+
+//------------------------------------------------------------------------------
+// Autotuning of kernel parameters.
+//
+// A tunable parameter, e.g. a block size, has a default, a set of candidate
+// values, and a trial: a setup function, like a benchmark's, that returns a
+// representative case run with the value given in its params under the
+// parameter's name.  Tuning times a short trial of each candidate and keeps
+// the fastest.
+//
+// Tuned values are persisted in a JSON tuning file, by CPU model and then
+// parameter name, so that a file shared by different machines, e.g. in a home
+// directory on a heterogeneous cluster, holds each one's best values:
+//
+//   {"Intel(R) Xeon(R) ...": {"linear_combination/block": 512, ...}, ...}
+//
+// `tuned()` returns a parameter's value for this machine, tuning it on first
+// use if the file has no value, unless automatic tuning is disabled.  It may be
+// called from several threads, e.g. in benchmark setup with --scaling; the
+// first tunes while the others wait.  Kernels look up a value once, in a
+// function-local static.  Register at namespace scope, as for benchmarks:
+//
+//   static auto const reg_block = register_tunable(
+//     "kernel/block", 256, pow2_range(6, 12),
+//     [](Params const& params) {
+//       auto const block = params.at("kernel/block");
+//       ...
+//       return Case{[=]() { kernel(..., block); }, len};
+//     });
+//------------------------------------------------------------------------------
+
+struct Tunable
+{
+  std::string name;
+  long default_value;
+  std::vector<long> candidates;
+  SetupFn trial;
+};
+
+
+/*
+ * Returns all registered tunable parameters, in registration order.
+ */
+extern std::vector<Tunable>& tunables();
+
+/*
+ * Registers a tunable parameter.  Returns its index, so that registration can
+ * initialize a static.
+ */
+extern size_t register_tunable(
+  std::string const& name, long default_value, std::vector<long> candidates,
+  SetupFn trial);
+
+/*
+ * Returns the tuning file path: $ASLIB_TUNING if set, else .aslib_tuning.json
+ * in the home directory.
+ */
+extern std::string tuning_path();
+
+extern void set_tuning_path(std::string const& path);
+
+/*
+ * Enables or disables tuning on first use.  If disabled, parameters without a
+ * tuned value take their defaults.
+ */
+extern void set_auto_tune(bool enable);
+
+/*
+ * Returns the value of tunable parameter `name` for this machine.
+ */
+extern long tuned(std::string const& name);
+
+struct TuneResult
+{
+  std::string name;
+  long value;
+  // Mean time per element of each candidate.
+  std::vector<std::pair<long, Elapsed>> trials;
+};
+
+
+/*
+ * Times each candidate of `tunable` for `budget` seconds, and returns the
+ * fastest.
+ */
+extern TuneResult tune(Tunable const& tunable, Elapsed budget);
+
+/*
+ * Records tuned values for this machine, in memory and in the tuning file.
+ */
+extern void save_tuned(std::vector<TuneResult> const& results);
+
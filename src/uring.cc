@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "uring.hh"
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+inline int
+io_uring_setup(
+  unsigned const entries,
+  io_uring_params* const params)
+{
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+inline int
+io_uring_enter(
+  int const fd,
+  unsigned const to_submit,
+  unsigned const min_complete,
+  unsigned const flags)
+{
+  return syscall(
+    __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+
+void*
+map_ring(
+  int const fd,
+  size_t const size,
+  off_t const offset)
+{
+  void* const addr = mmap(
+    nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+    fd, offset);
+  if (addr == MAP_FAILED)
+    throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+  return addr;
+}
+
+
+template<typename T>
+inline T*
+field(
+  void* const ring,
+  unsigned const offset)
+{
+  return (T*) ((char*) ring + offset);
+}
+
+
+}  // anonymous namespace
+
+//------------------------------------------------------------------------------
+
+IoUring::IoUring(
+  unsigned const entries)
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd_ = io_uring_setup(entries, &params);
+  if (fd_ < 0)
+    throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+  sq_entries_ = params.sq_entries;
+
+  // The rings may share one mapping.
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_
+    = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool const single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+  sq_ring_ = cq_ring_ = nullptr;
+  try {
+    sq_ring_ = map_ring(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_
+      = single ? sq_ring_ : map_ring(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_ = (io_uring_sqe*) map_ring(fd_, sqes_size_, IORING_OFF_SQES);
+  }
+  catch (...) {
+    // Unmap the rings mapped before the failure.
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != nullptr)
+      munmap(sq_ring_, sq_ring_size_);
+    close(fd_);
+    throw;
+  }
+
+  sq_head_ = field<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_ = field<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = *field<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = field<unsigned>(sq_ring_, params.sq_off.array);
+  cq_head_ = field<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = field<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = *field<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = field<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+}
+
+
+IoUring::~IoUring()
+{
+  munmap(sqes_, sqes_size_);
+  if (cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  munmap(sq_ring_, sq_ring_size_);
+  close(fd_);
+}
+
+
+bool
+IoUring::prepare_read(
+  int const fd,
+  void* const buf,
+  unsigned const size,
+  uint64_t const offset,
+  uint64_t const tag)
+{
+  unsigned const tail = *sq_tail_;
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+    return false;
+
+  unsigned const index = tail & sq_mask_;
+  auto& sqe = sqes_[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.addr = (uint64_t) buf;
+  sqe.len = size;
+  sqe.off = offset;
+  sqe.user_data = tag;
+  sq_array_[index] = index;
+  // Publish the entry to the kernel.
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit_;
+  return true;
+}
+
+
+void
+IoUring::submit(
+  bool const wait)
+{
+  while (to_submit_ > 0 || wait) {
+    int const n = io_uring_enter(
+      fd_, to_submit_, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::system_error(
+        errno, std::generic_category(), "io_uring_enter");
+    }
+    to_submit_ -= n;
+    // A wait with submissions returns after both.
+    if (wait || n == 0)
+      break;
+  }
+}
+
+
+bool
+IoUring::pop(
+  uint64_t& tag,
+  int& result)
+{
+  unsigned const head = *cq_head_;
+  if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+    return false;
+  auto const& cqe = cqes_[head & cq_mask_];
+  tag = cqe.user_data;
+  result = cqe.res;
+  __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//------------------------------------------------------------------------------
+
+/*
+ * A minimal io_uring instance for asynchronous reads.
+ *
+ * The ring is set up and driven with raw system calls and the shared-memory
+ * queues, so liburing isn't needed.  Reads are queued with `prepare_read()`,
+ * submitted in one system call by `submit()`, and their completions, which may
+ * arrive in any order, collected with `pop()`.
+ */
+class IoUring
+{
+public:
+
+  /*
+   * Sets up a ring with room for `entries` reads in flight.  Throws
+   * `std::system_error` if io_uring is unavailable, e.g. on older kernels or
+   * where a seccomp policy forbids it.
+   */
+  explicit IoUring(unsigned entries);
+
+  IoUring(IoUring const&) = delete;
+  ~IoUring();
+
+  // Number of reads that may be queued or in flight.
+  unsigned capacity() const             { return sq_entries_; }
+
+  /*
+   * Queues a read of `size` bytes at `offset` in `fd` into `buf`, identified
+   * by `tag` on completion.  Returns false if the submission queue is full.
+   */
+  bool prepare_read(
+    int fd, void* buf, unsigned size, uint64_t offset, uint64_t tag);
+
+  /*
+   * Submits queued reads.  If `wait`, also waits for at least one completion.
+   */
+  void submit(bool wait=false);
+
+  /*
+   * If a read has completed, sets its tag and result, the number of bytes read
+   * or a negative errno, and returns true.
+   */
+  bool pop(uint64_t& tag, int& result);
+
+private:
+
+  int fd_;
+  unsigned sq_entries_;
+  // Reads queued but not yet submitted.
+  unsigned to_submit_ = 0;
+
+  // Mapped rings.
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Fields of the submission queue ring.
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+
+  // Fields of the completion queue ring.
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+};
+
+
@@ -1,13 +1,36 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <type_traits>
 #include <utility>
 
 //------------------------------------------------------------------------------
 
 template<typename T> T square(T val) { return val * val; }
 
+/*
+ * Accumulator type policy: the type in which sums of `T` values are
+ * accumulated by default.  Narrow integers are widened to avoid overflow.
+ * Specify a wider accumulator explicitly for mixed precision, e.g. float data
+ * with double accumulation.
+ */
+template<typename T> struct Accumulator { using type = T; };
+template<> struct Accumulator<int8_t> { using type = int64_t; };
+template<> struct Accumulator<int16_t> { using type = int64_t; };
+template<> struct Accumulator<int32_t> { using type = int64_t; };
+template<> struct Accumulator<uint32_t> { using type = uint64_t; };
+
+template<typename T> using accumulator_t = typename Accumulator<T>::type;
+
+/*
+ * The type in which moments of `T` values are computed: `T` itself for
+ * floating point types, otherwise double.
+ */
+template<typename T>
+using moment_t = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
 /*
  * Calls fn on args and returns the result, suppressing inlining.
  */
@@ -21,6 +44,18 @@ no_inline(
 }
 
 
+/*
+ * Forces `val` to be computed, even if unused.
+ */
+template<typename T>
+inline void
+do_not_optimize(
+  T const& val)
+{
+  asm volatile("" : : "r,m"(val) : "memory");
+}
+
+
 //------------------------------------------------------------------------------
 
 /*
@@ -31,5 +66,4 @@ no_inline(
  */
 extern long parse_size(std::string const&);
 
-extern void thrash_cache(size_t);
 